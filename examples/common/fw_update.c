@@ -11,6 +11,7 @@
 #include <string.h>
 #include <golioth/golioth_sys.h>
 #include <golioth/ota.h>
+#include <golioth/ota_delta.h>
 
 #include "fw_update.h"
 
@@ -21,6 +22,12 @@ _Static_assert(sizeof(CONFIG_GOLIOTH_FW_UPDATE_PACKAGE_NAME)
 
 #if defined(CONFIG_GOLIOTH_FW_UPDATE)
 
+_Static_assert(CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE
+                       % CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE
+                   == 0,
+               "GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE must be a multiple of "
+               "GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE");
+
 LOG_TAG_DEFINE(golioth_fw_update);
 
 struct fw_update_component_context
@@ -35,18 +42,58 @@ struct download_progress_context
 {
     size_t bytes_downloaded;
     uint32_t block_idx;
+    uint32_t saved_block_idx;
+    /* Hash of the image passed to the backend, which differs for compressed components */
+    uint8_t image_hash[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
+    bool decompressed;
+    /* The backend failed to write part of the image, so the download is not retried */
+    bool write_failed;
     uint8_t retries;
     enum golioth_status result;
     golioth_sys_sha256_t sha;
     golioth_sys_timer_t block_retry_timer;
 };
 
+/* Part of the image staged for the writer thread */
+struct fw_writer_buffer
+{
+    const struct golioth_ota_component *component;
+    uint8_t *data;
+    size_t len;
+    size_t offset;
+    size_t block_size;
+};
+
+/* Ring of buffers between the CoAP thread (producer) and the writer thread (consumer) */
+struct fw_writer
+{
+    struct fw_writer_buffer bufs[CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS];
+    golioth_sys_sem_t free_sem;
+    golioth_sys_sem_t full_sem;
+    uint8_t fill_idx;
+    uint8_t write_idx;
+    bool filling;
+    enum golioth_status status;
+    struct download_progress_context *download_ctx;
+};
+
 struct block_retry_context
 {
     struct fw_update_component_context *component_ctx;
     struct download_progress_context *download_ctx;
 };
 
+/* Download progress persisted through the session storage */
+struct fw_update_session
+{
+    uint32_t magic;
+    char package[CONFIG_GOLIOTH_OTA_MAX_PACKAGE_NAME_LEN + 1];
+    char version[CONFIG_GOLIOTH_OTA_MAX_VERSION_LEN + 1];
+    uint8_t hash[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
+    uint32_t next_block_idx;
+    uint32_t block_size;
+};
+
 static struct golioth_client *_client;
 static golioth_sys_mutex_t _manifest_update_mut;
 static golioth_sys_sem_t _manifest_rcvd;
@@ -55,6 +102,11 @@ static struct golioth_ota_manifest _ota_manifest;
 static golioth_fw_update_state_change_callback _state_callback;
 static void *_state_callback_arg;
 static struct fw_update_component_context _component_ctx;
+static const struct golioth_fw_update_session_storage *_session_storage;
+static struct fw_update_session _session;
+static struct fw_writer _writer;
+/* Patcher of the delta being applied, only allocated while an update is a delta */
+static struct golioth_ota_delta *_delta;
 
 #define FW_MAX_BLOCK_RESUME_BEFORE_FAIL 15
 #define FW_UPDATE_RESUME_DELAY_S 15
@@ -64,10 +116,370 @@ static struct fw_update_component_context _component_ctx;
 #define BACKOFF_DURATION_INITIAL_MS 60 * 1000
 #define BACKOFF_DURATION_MAX_MS 24 * 60 * 60 * 1000
 
+#define FW_UPDATE_SESSION_MAGIC 0x4F544131 /* "OTA1" */
+
 #define FW_REPORT_COMPONENT_NAME 1 << 0
 #define FW_REPORT_TARGET_VERSION 1 << 1
 #define FW_REPORT_CURRENT_VERSION 1 << 2
 
+static void fw_session_save(const struct golioth_ota_component *component,
+                            uint32_t next_block_idx,
+                            size_t block_size)
+{
+    _session.magic = FW_UPDATE_SESSION_MAGIC;
+    strncpy(_session.package, component->package, sizeof(_session.package) - 1);
+    strncpy(_session.version, component->version, sizeof(_session.version) - 1);
+    memcpy(_session.hash, component->hash, sizeof(_session.hash));
+    _session.next_block_idx = next_block_idx;
+    _session.block_size = block_size;
+
+    enum golioth_status status =
+        _session_storage->save(&_session, sizeof(_session), _session_storage->arg);
+    if (GOLIOTH_OK != status)
+    {
+        GLTH_LOGW(TAG, "Failed to save download session: %d", status);
+    }
+}
+
+static void fw_session_erase(void)
+{
+    if (_session_storage)
+    {
+        _session_storage->erase(_session_storage->arg);
+    }
+}
+
+// Hash the first len bytes of the image already written by the backend, as hash states can't be
+// persisted portably (e.g. with hardware accelerated SHA-256)
+static enum golioth_status fw_session_rehash(size_t len,
+                                             size_t block_size,
+                                             struct download_progress_context *ctx)
+{
+    uint8_t *buf = golioth_sys_malloc(block_size);
+    if (NULL == buf)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    enum golioth_status status = GOLIOTH_OK;
+
+    for (size_t offset = 0; offset < len; offset += block_size)
+    {
+        size_t chunk_len = (len - offset < block_size) ? len - offset : block_size;
+
+        status = fw_update_read_candidate_image(offset, buf, chunk_len);
+        if (GOLIOTH_OK != status)
+        {
+            break;
+        }
+
+        golioth_sys_sha256_update(ctx->sha, buf, chunk_len);
+    }
+
+    golioth_sys_free(buf);
+
+    return status;
+}
+
+// Restore the progress of a previously interrupted download of component.
+//
+// Returns the block index to resume from, in units of the resume block size, or 0 if there is
+// nothing to resume.
+static uint32_t fw_session_restore(const struct golioth_ota_component *component,
+                                   struct download_progress_context *ctx)
+{
+    if (!_session_storage)
+    {
+        return 0;
+    }
+
+    size_t len = sizeof(_session);
+    memset(&_session, 0, sizeof(_session));
+
+    if (GOLIOTH_OK != _session_storage->load(&_session, &len, _session_storage->arg)
+        || len != sizeof(_session) || _session.magic != FW_UPDATE_SESSION_MAGIC)
+    {
+        return 0;
+    }
+
+    if (0 != strcmp(_session.package, component->package)
+        || 0 != strcmp(_session.version, component->version)
+        || 0 != memcmp(_session.hash, component->hash, sizeof(_session.hash)))
+    {
+        GLTH_LOGI(TAG, "Discarding download session of %s-%s", _session.package, _session.version);
+        fw_session_erase();
+        return 0;
+    }
+
+    /* Downloads are resumed in units of the resume block size, whatever the block size is now */
+    size_t resume_block_size = golioth_client_get_download_resume_block_size(_client);
+    size_t block_size = golioth_client_get_download_block_size(_client);
+    size_t offset = (size_t) _session.next_block_idx * _session.block_size;
+
+    if (0 == resume_block_size || offset % resume_block_size != 0 || offset >= component->size)
+    {
+        return 0;
+    }
+
+    enum golioth_status status = fw_session_rehash(offset, block_size, ctx);
+    if (GOLIOTH_OK != status)
+    {
+        GLTH_LOGW(TAG, "Failed to read back downloaded image: %d", status);
+
+        /* Start over with a fresh hash */
+        golioth_sys_sha256_destroy(ctx->sha);
+        ctx->sha = golioth_sys_sha256_create();
+        return 0;
+    }
+
+    ctx->bytes_downloaded = offset;
+    ctx->saved_block_idx = offset / block_size;
+
+    GLTH_LOGI(TAG, "Resuming download at offset %zu", offset);
+
+    return offset / resume_block_size;
+}
+
+static enum golioth_status fw_delta_read(size_t offset, uint8_t *buf, size_t len, void *arg)
+{
+    return fw_update_read_current_image(offset, buf, len);
+}
+
+static enum golioth_status fw_delta_write(size_t offset,
+                                          const uint8_t *buf,
+                                          size_t len,
+                                          size_t target_size,
+                                          void *arg)
+{
+    return fw_update_handle_block(buf, len, offset, target_size);
+}
+
+static void fw_delta_reset(void)
+{
+    if (_delta)
+    {
+        golioth_ota_delta_abort(_delta);
+        golioth_sys_free(_delta);
+        _delta = NULL;
+    }
+}
+
+// Pass part of the downloaded component to the backend. Delta components are recognized by
+// their first bytes, and applied to the running image rather than written as is.
+static enum golioth_status fw_write_component(const struct golioth_ota_component *component,
+                                              const uint8_t *data,
+                                              size_t len,
+                                              size_t offset)
+{
+    if (0 == offset)
+    {
+        fw_delta_reset();
+
+        if (golioth_ota_delta_is_patch(data, len))
+        {
+            GLTH_LOGI(TAG, "Component is a delta of the running image");
+
+            _delta = golioth_sys_malloc(sizeof(*_delta));
+            if (!_delta)
+            {
+                return GOLIOTH_ERR_MEM_ALLOC;
+            }
+
+            enum golioth_status status =
+                golioth_ota_delta_init(_delta, fw_delta_read, fw_delta_write, NULL);
+            if (GOLIOTH_OK != status)
+            {
+                fw_delta_reset();
+                return status;
+            }
+        }
+    }
+
+    if (_delta)
+    {
+        return golioth_ota_delta_apply(_delta, data, len);
+    }
+
+    return fw_update_handle_block(data, len, offset, component->size);
+}
+
+// Write part of the image, starting at offset, and account for it in the download progress
+static enum golioth_status fw_process_chunk(const struct golioth_ota_component *component,
+                                            const uint8_t *data,
+                                            size_t len,
+                                            size_t offset,
+                                            size_t block_size,
+                                            struct download_progress_context *ctx)
+{
+    enum golioth_status status = fw_write_component(component, data, len, offset);
+    if (status != GOLIOTH_OK)
+    {
+        return status;
+    }
+
+    ctx->bytes_downloaded += len;
+    golioth_sys_sha256_update(ctx->sha, data, len);
+
+    uint32_t next_block_idx = (offset + len) / block_size;
+
+    /* Patcher and decompressor states are not saved, so those downloads can't be resumed */
+    if (_session_storage && !_delta && !ctx->decompressed && (offset + len) < component->size
+        && (offset + len) % block_size == 0
+        && next_block_idx >= ctx->saved_block_idx + CONFIG_GOLIOTH_FW_UPDATE_SESSION_SAVE_INTERVAL)
+    {
+        fw_session_save(component, next_block_idx, block_size);
+        ctx->saved_block_idx = next_block_idx;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static void fw_writer_submit(void)
+{
+    _writer.filling = false;
+    _writer.fill_idx = (_writer.fill_idx + 1) % CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS;
+    golioth_sys_sem_give(_writer.full_sem);
+}
+
+// Copy a block into the writer ring. Called from the CoAP thread; only blocks when all buffers
+// are waiting to be written, which throttles the download to the speed of the flash.
+static enum golioth_status fw_writer_push(const struct golioth_ota_component *component,
+                                          const uint8_t *data,
+                                          size_t len,
+                                          size_t offset,
+                                          size_t block_size,
+                                          bool is_last)
+{
+    while (len > 0)
+    {
+        if (GOLIOTH_OK != _writer.status)
+        {
+            return _writer.status;
+        }
+
+        struct fw_writer_buffer *buf = &_writer.bufs[_writer.fill_idx];
+
+        if (!_writer.filling)
+        {
+            golioth_sys_sem_take(_writer.free_sem, GOLIOTH_SYS_WAIT_FOREVER);
+            buf->component = component;
+            buf->len = 0;
+            buf->offset = offset;
+            _writer.filling = true;
+        }
+        else if (buf->component != component || buf->offset + buf->len != offset)
+        {
+            /* Not contiguous with the staged data, so start a new buffer */
+            fw_writer_submit();
+            continue;
+        }
+
+        size_t copy_len = CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE - buf->len;
+        if (copy_len > len)
+        {
+            copy_len = len;
+        }
+
+        memcpy(&buf->data[buf->len], data, copy_len);
+        buf->len += copy_len;
+        buf->block_size = block_size;
+        data += copy_len;
+        len -= copy_len;
+        offset += copy_len;
+
+        if (buf->len == CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE)
+        {
+            fw_writer_submit();
+        }
+    }
+
+    if (is_last && _writer.filling)
+    {
+        fw_writer_submit();
+    }
+
+    return _writer.status;
+}
+
+// Wait until the writer thread has written all staged data
+static enum golioth_status fw_writer_drain(void)
+{
+    if (_writer.filling)
+    {
+        fw_writer_submit();
+    }
+
+    for (int i = 0; i < CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS; i++)
+    {
+        golioth_sys_sem_take(_writer.free_sem, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+    for (int i = 0; i < CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS; i++)
+    {
+        golioth_sys_sem_give(_writer.free_sem);
+    }
+
+    return _writer.status;
+}
+
+static void fw_writer_reset(struct download_progress_context *download_ctx)
+{
+    _writer.download_ctx = download_ctx;
+    _writer.status = GOLIOTH_OK;
+}
+
+static void fw_writer_thread(void *arg)
+{
+    while (1)
+    {
+        golioth_sys_sem_take(_writer.full_sem, GOLIOTH_SYS_WAIT_FOREVER);
+
+        struct fw_writer_buffer *buf = &_writer.bufs[_writer.write_idx];
+
+        if (GOLIOTH_OK == _writer.status)
+        {
+            _writer.status = fw_process_chunk(buf->component,
+                                              buf->data,
+                                              buf->len,
+                                              buf->offset,
+                                              buf->block_size,
+                                              _writer.download_ctx);
+        }
+
+        _writer.write_idx = (_writer.write_idx + 1) % CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS;
+        golioth_sys_sem_give(_writer.free_sem);
+    }
+}
+
+static bool fw_writer_init(void)
+{
+    for (int i = 0; i < CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS; i++)
+    {
+        _writer.bufs[i].data = golioth_sys_malloc(CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE);
+        if (!_writer.bufs[i].data)
+        {
+            return false;
+        }
+    }
+
+    _writer.free_sem = golioth_sys_sem_create(CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS,
+                                              CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS);
+    _writer.full_sem = golioth_sys_sem_create(CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS, 0);
+    if (!_writer.free_sem || !_writer.full_sem)
+    {
+        return false;
+    }
+
+    struct golioth_thread_config thread_cfg = {
+        .name = "fw_writer",
+        .fn = fw_writer_thread,
+        .user_arg = NULL,
+        .stack_size = CONFIG_GOLIOTH_FW_UPDATE_WRITER_THREAD_STACK_SIZE,
+        .prio = 3,
+    };
+
+    return (NULL != golioth_sys_thread_create(&thread_cfg));
+}
+
 static enum golioth_status fw_write_block_cb(const struct golioth_ota_component *component,
                                              uint32_t block_idx,
                                              const uint8_t *block_buffer,
@@ -78,22 +490,46 @@ static enum golioth_status fw_write_block_cb(const struct golioth_ota_component
 {
     assert(arg);
     struct download_progress_context *ctx = arg;
+    enum golioth_status status;
 
     GLTH_LOGI(TAG,
               "Received block %" PRIu32 "/%zu",
               block_idx,
               (size_t) (component->size / negotiated_block_size));
 
-    enum golioth_status status = fw_update_handle_block(block_buffer,
-                                                        block_buffer_len,
-                                                        negotiated_block_size * block_idx,
-                                                        component->size);
+    if (0 == block_idx)
+    {
+        /* Compressed components are passed decompressed, and described by their own component */
+        ctx->decompressed = component->decompressed;
+        memcpy(ctx->image_hash, component->hash, sizeof(ctx->image_hash));
+    }
+
+    if (CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER)
+    {
+        status = fw_writer_push(component,
+                                block_buffer,
+                                block_buffer_len,
+                                negotiated_block_size * block_idx,
+                                negotiated_block_size,
+                                is_last);
+    }
+    else
+    {
+        status = fw_process_chunk(component,
+                                  block_buffer,
+                                  block_buffer_len,
+                                  negotiated_block_size * block_idx,
+                                  negotiated_block_size,
+                                  ctx);
+    }
 
     if (status == GOLIOTH_OK)
     {
         ctx->retries = 0;
-        ctx->bytes_downloaded += block_buffer_len;
-        golioth_sys_sha256_update(ctx->sha, block_buffer, block_buffer_len);
+    }
+    else
+    {
+        ctx->write_failed = true;
     }
 
     return status;
@@ -107,7 +543,7 @@ static void fw_download_end_cb(enum golioth_status status,
 {
     struct download_progress_context *ctx = arg;
 
-    if (GOLIOTH_OK == status || GOLIOTH_ERR_IO == status
+    if (GOLIOTH_OK == status || GOLIOTH_ERR_IO == status || ctx->write_failed
         || ctx->retries >= FW_MAX_BLOCK_RESUME_BEFORE_FAIL)
     {
         ctx->result = status;
@@ -529,8 +965,23 @@ static void fw_update_thread(void *arg)
 
         uint64_t start_time_ms = golioth_sys_now_ms();
         download_ctx.bytes_downloaded = 0;
+        download_ctx.saved_block_idx = 0;
         download_ctx.retries = 0;
+        download_ctx.decompressed = false;
+        download_ctx.write_failed = false;
+        memcpy(download_ctx.image_hash,
+               _component_ctx.target_component.hash,
+               sizeof(download_ctx.image_hash));
         download_ctx.sha = golioth_sys_sha256_create();
+        fw_delta_reset();
+
+        uint32_t start_block_idx =
+            fw_session_restore(&_component_ctx.target_component, &download_ctx);
+
+        if (CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER)
+        {
+            fw_writer_reset(&download_ctx);
+        }
 
         int err;
 
@@ -549,7 +1000,7 @@ static void fw_update_thread(void *arg)
 
         err = golioth_ota_download_component(_client,
                                              &_component_ctx.target_component,
-                                             0,
+                                             start_block_idx,
                                              fw_write_block_cb,
                                              fw_download_end_cb,
                                              &download_ctx);
@@ -569,6 +1020,16 @@ static void fw_update_thread(void *arg)
 
         golioth_sys_timer_destroy(download_ctx.block_retry_timer);
 
+        if (CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER)
+        {
+            /* Blocks may still be staged for writing, even if the download failed */
+            enum golioth_status writer_status = fw_writer_drain();
+            if (GOLIOTH_OK == err)
+            {
+                err = writer_status;
+            }
+        }
+
         /* Download finished, prepare backoff in case needed */
         backoff_increment(&_component_ctx);
 
@@ -585,12 +1046,31 @@ static void fw_update_thread(void *arg)
             }
 
             golioth_sys_sha256_destroy(download_ctx.sha);
+            fw_delta_reset();
             continue;
         }
 
         golioth_sys_sha256_finish(download_ctx.sha, calc_sha256);
         golioth_sys_sha256_destroy(download_ctx.sha);
 
+        /* Download complete, nothing left to resume */
+        fw_session_erase();
+
+        if (_delta)
+        {
+            /* Writes the end of the target image, and verifies it against the patch */
+            enum golioth_status status = golioth_ota_delta_finish(_delta);
+
+            golioth_sys_free(_delta);
+            _delta = NULL;
+
+            if (GOLIOTH_OK != status)
+            {
+                fw_download_failed(GOLIOTH_OTA_REASON_INTEGRITY_CHECK_FAILURE);
+                continue;
+            }
+        }
+
         if (GOLIOTH_OK != fw_update_post_download())
         {
             GLTH_LOGE(TAG, "Failed to perform post download operations");
@@ -598,8 +1078,7 @@ static void fw_update_thread(void *arg)
             continue;
         };
 
-        if (GOLIOTH_OK
-            != fw_verify_component_hash(calc_sha256, _component_ctx.target_component.hash))
+        if (GOLIOTH_OK != fw_verify_component_hash(calc_sha256, download_ctx.image_hash))
         {
             fw_download_failed(GOLIOTH_OTA_REASON_INTEGRITY_CHECK_FAILURE);
             continue;
@@ -663,6 +1142,12 @@ void golioth_fw_update_init_with_config(struct golioth_client *client,
 
     if (!initialized)
     {
+        if (CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER && !fw_writer_init())
+        {
+            GLTH_LOGE(TAG, "Failed to create firmware writer");
+            return;
+        }
+
         struct golioth_thread_config thread_cfg = {
             .name = "fw_update",
             .fn = fw_update_thread,
@@ -683,6 +1168,12 @@ void golioth_fw_update_init_with_config(struct golioth_client *client,
     }
 }
 
+void golioth_fw_update_register_session_storage(
+    const struct golioth_fw_update_session_storage *storage)
+{
+    _session_storage = storage;
+}
+
 void golioth_fw_update_register_state_change_callback(
     golioth_fw_update_state_change_callback callback,
     void *user_arg)
@@ -75,6 +75,38 @@ void golioth_fw_update_register_state_change_callback(
     golioth_fw_update_state_change_callback callback,
     void *user_arg);
 
+/// Storage for the progress of an in-flight firmware download.
+///
+/// When registered, the firmware update thread periodically saves the download progress
+/// (component, version and next block) so that a download interrupted by a reboot or power loss
+/// resumes where it stopped, rather than from the first block. The SHA-256 of the part already
+/// downloaded is computed again from @ref fw_update_read_candidate_image when resuming.
+///
+/// The session is saved after @ref fw_update_handle_block returns, so the backend must have
+/// persisted the block by then. It must also accept a first block at a non-zero offset after
+/// a reboot. Downloads of delta and compressed components are not saved, and always restart
+/// from the first block.
+struct golioth_fw_update_session_storage
+{
+    /// Store len bytes of session data, replacing previously stored data
+    enum golioth_status (*save)(const void *data, size_t len, void *arg);
+    /// Load session data. On input *len is the size of data, on output the length loaded.
+    enum golioth_status (*load)(void *data, size_t *len, void *arg);
+    /// Erase stored session data
+    void (*erase)(void *arg);
+    /// Arbitrary user argument passed to the functions above, can be NULL
+    void *arg;
+};
+
+/// Register storage used to resume interrupted firmware downloads.
+///
+/// Must be called before @ref golioth_fw_update_init. The storage struct is shallow-copied
+/// and must remain valid.
+///
+/// @param storage Session storage, or NULL to disable resuming downloads across reboots
+void golioth_fw_update_register_session_storage(
+    const struct golioth_fw_update_session_storage *storage);
+
 //---------------------------------------------------------------------------
 // Backend API for firmware updates. Required to be implemented by port.
 // Not intended to be called by user code.
@@ -115,6 +147,34 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
                                            size_t offset,
                                            size_t total_size);
 
+/// Read part of the currently running firmware image.
+///
+/// Used as the source image when applying a delta (binary patch) component.
+/// See @ref golioth_ota_delta.
+///
+/// @param offset The offset in the running firmware image
+/// @param buf Buffer to read into
+/// @param len Number of bytes to read
+///
+/// @return GOLIOTH_OK - len bytes read
+/// @return GOLIOTH_ERR_IO - error reading the image, abort firmware update
+/// @return GOLIOTH_ERR_NOT_IMPLEMENTED - delta components are not supported by this port
+enum golioth_status fw_update_read_current_image(size_t offset, uint8_t *buf, size_t len);
+
+/// Read part of the image written by @ref fw_update_handle_block.
+///
+/// Used to hash the part of the image already downloaded when resuming an interrupted
+/// download. See @ref golioth_fw_update_register_session_storage.
+///
+/// @param offset The offset in the new firmware image
+/// @param buf Buffer to read into
+/// @param len Number of bytes to read
+///
+/// @return GOLIOTH_OK - len bytes read
+/// @return GOLIOTH_ERR_IO - error reading the image, download restarts from the first block
+/// @return GOLIOTH_ERR_NOT_IMPLEMENTED - downloads can't be resumed with this port
+enum golioth_status fw_update_read_candidate_image(size_t offset, uint8_t *buf, size_t len);
+
 /// Post-download hook.
 ///
 /// Called by golioth_fw_update.c after downloading the full image.
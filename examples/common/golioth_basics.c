@@ -32,6 +32,9 @@ int32_t _loop_delay_s = 10;
 // Given if/when the we have a connection to Golioth
 static golioth_sys_sem_t _connected_sem;
 
+// Settings of the last run, applied at boot. Optional, registered by the port.
+static const struct golioth_settings_storage *_settings_storage;
+
 static void on_client_event(struct golioth_client *client,
                             enum golioth_client_event event,
                             void *arg)
@@ -130,6 +133,10 @@ static void on_my_config(struct golioth_client *client,
     golioth_lightdb_delete(client, path, NULL, NULL);
 }
 
+void golioth_basics_register_settings_storage(const struct golioth_settings_storage *storage)
+{
+    _settings_storage = storage;
+}
 
 void golioth_basics(struct golioth_client *client)
 {
@@ -225,6 +232,14 @@ void golioth_basics(struct golioth_client *client)
     // allows remote users to manage and push settings to devices.
     golioth_settings_register_int(settings, "LOOP_DELAY_S", on_loop_delay_setting, NULL);
 
+    // The settings received in the last run are applied right away, so that the device starts
+    // with them even before it connects. Registered after all settings, as only the settings
+    // registered so far are applied.
+    if (_settings_storage)
+    {
+        golioth_settings_register_storage(settings, _settings_storage);
+    }
+
     // Now we'll just sit in a loop and update a LightDB state variable every
     // once in a while.
     GLTH_LOGI(TAG, "Entering endless loop");
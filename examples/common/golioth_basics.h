@@ -12,6 +12,14 @@ extern "C"
 #pragma once
 
 #include <golioth/client.h>
+#include <golioth/settings.h>
+
+/// Register storage used to apply the settings of the last run at boot, before the device
+/// connects. Must be called before @ref golioth_basics. The storage struct is not copied and
+/// must remain valid.
+///
+/// @param storage Settings storage, or NULL to only get settings from the cloud
+void golioth_basics_register_settings_storage(const struct golioth_settings_storage *storage);
 
 void golioth_basics(struct golioth_client *client);
 
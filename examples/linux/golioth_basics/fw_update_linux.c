@@ -8,14 +8,19 @@
 #include <string.h>  // memcpy
 
 #include "fw_update.h"
+#include "fw_update_linux.h"
 
 #define TAG "fw_update_linux"
 
-// If set to 1, any received FW blocks will be written to file DOWNLOADED_FILE_NAME
-// This is mostly used for testing right now.
-#define ENABLE_DOWNLOAD_TO_FILE 0
 #define DOWNLOADED_FILE_NAME "downloaded.bin"
 
+// Download progress is saved to this file, so interrupted downloads can be resumed
+#define SESSION_FILE_NAME "fw_update_session.bin"
+#define SESSION_TMP_FILE_NAME SESSION_FILE_NAME ".tmp"
+
+// The running executable is the source image of delta components
+#define CURRENT_FILE_NAME "/proc/self/exe"
+
 #define FW_UPDATE_RETURN_IF_NEGATIVE(expr) \
     do                                     \
     {                                      \
@@ -50,14 +55,23 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
 {
     if (!_download_fp)
     {
-        _download_fp = fopen(DOWNLOADED_FILE_NAME, "w");
+        // Keep previously downloaded data when resuming an interrupted download
+        _download_fp = fopen(DOWNLOADED_FILE_NAME, (offset == 0) ? "w" : "r+");
+        if (!_download_fp)
+        {
+            return GOLIOTH_ERR_IO;
+        }
     }
     GLTH_LOGD(TAG,
               "block_size 0x%08lX, offset 0x%08lX, total_size 0x%08lX",
               block_size,
               offset,
               total_size);
+    fseek(_download_fp, offset, SEEK_SET);
     fwrite(block, block_size, 1, _download_fp);
+
+    // The download session is saved after this returns, so make sure the block is on disk
+    fflush(_download_fp);
     return GOLIOTH_OK;
 }
 #else
@@ -70,6 +84,49 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
 }
 #endif
 
+#if ENABLE_DOWNLOAD_TO_FILE
+enum golioth_status fw_update_read_candidate_image(size_t offset, uint8_t *buf, size_t len)
+{
+    FILE *fp = fopen(DOWNLOADED_FILE_NAME, "r");
+    if (!fp)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    bool ok = (fseek(fp, offset, SEEK_SET) == 0 && fread(buf, 1, len, fp) == len);
+    fclose(fp);
+
+    return ok ? GOLIOTH_OK : GOLIOTH_ERR_IO;
+}
+#else
+enum golioth_status fw_update_read_candidate_image(size_t offset, uint8_t *buf, size_t len)
+{
+    // Blocks are not stored, so there is nothing to resume from. The session storage is not
+    // registered in this case.
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+#endif
+
+enum golioth_status fw_update_read_current_image(size_t offset, uint8_t *buf, size_t len)
+{
+    if (!_current_fp)
+    {
+        _current_fp = fopen(CURRENT_FILE_NAME, "r");
+        if (!_current_fp)
+        {
+            return GOLIOTH_ERR_IO;
+        }
+    }
+
+    if (fseek(_current_fp, offset, SEEK_SET) != 0 || fread(buf, 1, len, _current_fp) != len)
+    {
+        GLTH_LOGE(TAG, "Failed to read %zu bytes of current image at offset %zu", len, offset);
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
 enum golioth_status fw_update_post_download(void)
 {
     if (_download_fp)
@@ -99,6 +156,11 @@ enum golioth_status fw_update_change_boot_image(void)
 
 void fw_update_end(void)
 {
+    if (_current_fp)
+    {
+        fclose(_current_fp);
+        _current_fp = NULL;
+    }
     if (_filebuf)
     {
         free(_filebuf);
@@ -107,6 +169,55 @@ void fw_update_end(void)
     _initialized = false;
 }
 
+#if ENABLE_DOWNLOAD_TO_FILE
+// Write to a temporary file, then rename it, so that a power loss never leaves a partial session
+static enum golioth_status session_file_save(const void *data, size_t len, void *arg)
+{
+    FILE *fp = fopen(SESSION_TMP_FILE_NAME, "w");
+    if (!fp)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    size_t written = fwrite(data, 1, len, fp);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    if (written != len || rename(SESSION_TMP_FILE_NAME, SESSION_FILE_NAME) != 0)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status session_file_load(void *data, size_t *len, void *arg)
+{
+    FILE *fp = fopen(SESSION_FILE_NAME, "r");
+    if (!fp)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    *len = fread(data, 1, *len, fp);
+    fclose(fp);
+
+    return GOLIOTH_OK;
+}
+
+static void session_file_erase(void *arg)
+{
+    remove(SESSION_FILE_NAME);
+}
+
+const struct golioth_fw_update_session_storage fw_update_linux_session_storage = {
+    .save = session_file_save,
+    .load = session_file_load,
+    .erase = session_file_erase,
+};
+#endif
+
 // Opens filepath, allocates filebuf, and reads the entire contents into filebuf.
 // The caller is responsible for freeing filebuf.
 //
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include "fw_update.h"
+
+// If set to 1, any received FW blocks will be written to file DOWNLOADED_FILE_NAME
+// This is mostly used for testing right now.
+#define ENABLE_DOWNLOAD_TO_FILE 0
+
+#if ENABLE_DOWNLOAD_TO_FILE
+/// Session storage backed by a file in the working directory
+///
+/// Only provided when blocks are written to a file, as resuming a download hashes the blocks
+/// already written.
+extern const struct golioth_fw_update_session_storage fw_update_linux_session_storage;
+#endif
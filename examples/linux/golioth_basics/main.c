@@ -10,6 +10,8 @@
 
 #include <golioth/client.h>
 #include "golioth_basics.h"
+#include "fw_update_linux.h"
+#include "settings_linux.h"
 
 #define TAG "main"
 
@@ -44,6 +46,11 @@ int main(void)
 
     struct golioth_client *client = golioth_client_create(&config);
     assert(client);
+#if ENABLE_DOWNLOAD_TO_FILE
+    golioth_fw_update_register_session_storage(&fw_update_linux_session_storage);
+#endif
+    golioth_basics_register_settings_storage(&settings_linux_storage);
+
     golioth_basics(client);
 
     return 0;
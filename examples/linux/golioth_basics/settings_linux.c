@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+#include <unistd.h>  // fsync
+
+#include "settings_linux.h"
+
+// The last settings received from the cloud are saved to this file, and applied at boot
+#define SETTINGS_FILE_NAME "settings.bin"
+#define SETTINGS_TMP_FILE_NAME SETTINGS_FILE_NAME ".tmp"
+
+// Write to a temporary file, then rename it, so that a power loss never leaves partial settings
+static enum golioth_status settings_file_save(const void *data, size_t len, void *arg)
+{
+    FILE *fp = fopen(SETTINGS_TMP_FILE_NAME, "w");
+    if (!fp)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    size_t written = fwrite(data, 1, len, fp);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    if (written != len || rename(SETTINGS_TMP_FILE_NAME, SETTINGS_FILE_NAME) != 0)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status settings_file_load(void *data, size_t *len, void *arg)
+{
+    FILE *fp = fopen(SETTINGS_FILE_NAME, "r");
+    if (!fp)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    *len = fread(data, 1, *len, fp);
+    fclose(fp);
+
+    return GOLIOTH_OK;
+}
+
+const struct golioth_settings_storage settings_linux_storage = {
+    .save = settings_file_save,
+    .load = settings_file_load,
+};
@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <golioth/settings.h>
+
+/// Settings storage backed by a file in the working directory
+extern const struct golioth_settings_storage settings_linux_storage;
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "fw_update.h"
+#include "fw_update_mcuboot.h"
 #include "bootutil/bootutil.h"
 #include "bootutil/image.h"
 #include "sysflash/sysflash.h"
@@ -13,6 +14,27 @@
 static const struct flash_area *_primary_flash_area;
 static const struct flash_area *_secondary_flash_area;
 
+// Download session, stored in the external flash erase sector that follows the secondary slot
+static struct flash_area _session_flash_area;
+
+static enum golioth_status secondary_flash_area_open(void)
+{
+    if (_secondary_flash_area)
+    {
+        return GOLIOTH_OK;
+    }
+
+    int secondary_id = flash_area_id_from_image_slot(1);
+    int status = flash_area_open(secondary_id, &_secondary_flash_area);
+    if (status != 0)
+    {
+        GLTH_LOGE(TAG, "flash_area_open error: %d", status);
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
 bool fw_update_is_pending_verify(void)
 {
     struct boot_swap_state primary_swap_state;
@@ -62,11 +84,8 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
         }
 
         // Open secondary flash area
-        int secondary_id = flash_area_id_from_image_slot(1);
-        status = flash_area_open(secondary_id, &_secondary_flash_area);
-        if (status != 0)
+        if (GOLIOTH_OK != secondary_flash_area_open())
         {
-            GLTH_LOGE(TAG, "flash_area_open error: %d", status);
             return GOLIOTH_ERR_IO;
         }
 
@@ -88,6 +107,12 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
         }
     }
 
+    // Opened by the first block, unless resuming an interrupted download after a reboot
+    if (GOLIOTH_OK != secondary_flash_area_open())
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
     // Write secondary flash area at offset
     status = flash_area_write(_secondary_flash_area, offset, block, block_size);
     if (status != 0)
@@ -99,6 +124,48 @@ enum golioth_status fw_update_handle_block(const uint8_t *block,
     return GOLIOTH_OK;
 }
 
+enum golioth_status fw_update_read_current_image(size_t offset, uint8_t *buf, size_t len)
+{
+    int status = 0;
+
+    if (!_primary_flash_area)
+    {
+        int primary_id = flash_area_id_from_image_slot(0);
+        status = flash_area_open(primary_id, &_primary_flash_area);
+        if (status != 0)
+        {
+            GLTH_LOGE(TAG, "flash_area_open error: %d", status);
+            return GOLIOTH_ERR_IO;
+        }
+    }
+
+    status = flash_area_read(_primary_flash_area, offset, buf, len);
+    if (status != 0)
+    {
+        GLTH_LOGE(TAG, "flash_area_read error: %d", status);
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status fw_update_read_candidate_image(size_t offset, uint8_t *buf, size_t len)
+{
+    if (GOLIOTH_OK != secondary_flash_area_open())
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    int status = flash_area_read(_secondary_flash_area, offset, buf, len);
+    if (status != 0)
+    {
+        GLTH_LOGE(TAG, "flash_area_read error: %d", status);
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
 enum golioth_status fw_update_post_download(void)
 {
     if (_primary_flash_area)
@@ -148,3 +215,90 @@ void fw_update_end(void)
 {
     // Nothing to do
 }
+
+static const struct flash_area *session_flash_area(void)
+{
+#if !defined(CY_BOOT_USE_EXTERNAL_FLASH)
+    // Only the external flash has room after the secondary slot
+    return NULL;
+#endif
+
+    if (0 == _session_flash_area.fa_size)
+    {
+        const struct flash_area *secondary;
+        int status = flash_area_open(flash_area_id_from_image_slot(1), &secondary);
+        if (status != 0)
+        {
+            return NULL;
+        }
+
+        _session_flash_area.fa_device_id = secondary->fa_device_id;
+        _session_flash_area.fa_off = secondary->fa_off + secondary->fa_size;
+#if defined(CY_BOOT_USE_EXTERNAL_FLASH)
+        _session_flash_area.fa_size = CY_MAX_EXT_FLASH_ERASE_SIZE;
+#endif
+
+        flash_area_close(secondary);
+    }
+
+    return &_session_flash_area;
+}
+
+// The session is stored as its length followed by its data. An erased sector reads as a length
+// of 0xFFFFFFFF, which is rejected when loading.
+static enum golioth_status session_flash_save(const void *data, size_t len, void *arg)
+{
+    const struct flash_area *fa = session_flash_area();
+    uint32_t stored_len = len;
+
+    if (!fa || sizeof(stored_len) + len > fa->fa_size)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    if (flash_area_erase(fa, 0, fa->fa_size) != 0
+        || flash_area_write(fa, sizeof(stored_len), data, len) != 0
+        || flash_area_write(fa, 0, &stored_len, sizeof(stored_len)) != 0)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status session_flash_load(void *data, size_t *len, void *arg)
+{
+    const struct flash_area *fa = session_flash_area();
+    uint32_t stored_len;
+
+    if (!fa || flash_area_read(fa, 0, &stored_len, sizeof(stored_len)) != 0
+        || stored_len > *len)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    if (flash_area_read(fa, sizeof(stored_len), data, stored_len) != 0)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    *len = stored_len;
+
+    return GOLIOTH_OK;
+}
+
+static void session_flash_erase(void *arg)
+{
+    const struct flash_area *fa = session_flash_area();
+
+    if (fa)
+    {
+        flash_area_erase(fa, 0, fa->fa_size);
+    }
+}
+
+const struct golioth_fw_update_session_storage fw_update_mcuboot_session_storage = {
+    .save = session_flash_save,
+    .load = session_flash_load,
+    .erase = session_flash_erase,
+};
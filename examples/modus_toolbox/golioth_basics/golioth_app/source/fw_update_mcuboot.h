@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include "fw_update.h"
+
+/// Session storage in the external flash sector that follows the secondary slot
+extern const struct golioth_fw_update_session_storage fw_update_mcuboot_session_storage;
@@ -58,6 +58,7 @@
 #include "golioth_main.h"
 #include <golioth/client.h>
 #include "golioth_basics.h"
+#include "fw_update_mcuboot.h"
 
 #define TAG "golioth_main"
 
@@ -179,6 +180,9 @@ void golioth_main_task(void *arg)
     struct golioth_client *client = golioth_client_create(&config);
     assert(client);
 
+    // Resume firmware downloads interrupted by a reset
+    golioth_fw_update_register_session_storage(&fw_update_mcuboot_session_storage);
+
     // golioth_basics will interact with each Golioth service and enter an endless loop.
     golioth_basics(client);
 }
@@ -381,6 +381,41 @@ void golioth_client_register_event_callback(struct golioth_client *client,
 /// @return The number of items currently in the client thread request queue.
 uint32_t golioth_client_num_items_in_request_queue(struct golioth_client *client);
 
+/// The block size currently selected for blockwise downloads.
+///
+/// When GOLIOTH_BLOCKWISE_PMTU_DISCOVERY is enabled, this reflects the path MTU probing of the
+/// current session, including any downgrade caused by lost blocks and any upgrade after blocks
+/// went through. Otherwise it is GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE. Intended for telemetry.
+///
+/// @param client The client handle
+///
+/// @return The download block size in bytes, or 0 if client is NULL
+size_t golioth_client_get_download_block_size(struct golioth_client *client);
+
+/// The unit of the block index of resumed blockwise downloads.
+///
+/// The block index reported at the end of a download, and accepted to resume it (for example by
+/// @ref golioth_ota_download_component), counts blocks of this size. Unlike @ref
+/// golioth_client_get_download_block_size, it does not change while the client runs, so a
+/// download resumes at the exact offset where it stopped, even if the block size changed
+/// meanwhile. It is GOLIOTH_BLOCKWISE_PMTU_MIN_BLOCK_SIZE when GOLIOTH_BLOCKWISE_PMTU_DISCOVERY is
+/// enabled (bounded by GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE), and
+/// GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE otherwise.
+///
+/// @param client The client handle
+///
+/// @return The resume block size in bytes, or 0 if client is NULL
+size_t golioth_client_get_download_resume_block_size(struct golioth_client *client);
+
+/// The block size currently selected for blockwise uploads.
+///
+/// Same as @ref golioth_client_get_download_block_size, for uploads.
+///
+/// @param client The client handle
+///
+/// @return The upload block size in bytes, or 0 if client is NULL
+size_t golioth_client_get_upload_block_size(struct golioth_client *client);
+
 /// Simulate packet loss at a particular percentage (0 to 100).
 ///
 /// Intended for testing and troubleshooting in packet loss scenarios.
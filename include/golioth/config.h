@@ -65,6 +65,27 @@ extern "C"
 #define CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE 1024
 #endif
 
+#ifndef CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY
+#define CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_BLOCKWISE_PATH_MTU
+#define CONFIG_GOLIOTH_BLOCKWISE_PATH_MTU 1280
+#endif
+
+#ifndef CONFIG_GOLIOTH_BLOCKWISE_PACKET_OVERHEAD
+#define CONFIG_GOLIOTH_BLOCKWISE_PACKET_OVERHEAD 213
+#endif
+
+#ifndef CONFIG_GOLIOTH_BLOCKWISE_PMTU_MIN_BLOCK_SIZE
+/* Valid values: 16, 32, 64, 128, 256, 512, 1024 */
+#define CONFIG_GOLIOTH_BLOCKWISE_PMTU_MIN_BLOCK_SIZE 256
+#endif
+
+#ifndef CONFIG_GOLIOTH_BLOCKWISE_PMTU_UPGRADE_BLOCKS
+#define CONFIG_GOLIOTH_BLOCKWISE_PMTU_UPGRADE_BLOCKS 64
+#endif
+
 #ifndef CONFIG_GOLIOTH_FW_UPDATE_THREAD_STACK_SIZE
 #define CONFIG_GOLIOTH_FW_UPDATE_THREAD_STACK_SIZE 4096
 #endif
@@ -81,6 +102,26 @@ extern "C"
 #define CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS 1
 #endif
 
+#ifndef CONFIG_GOLIOTH_OTA_MANIFEST_CACHE
+#define CONFIG_GOLIOTH_OTA_MANIFEST_CACHE 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_OTA_DELTA_BUFFER_SIZE
+#define CONFIG_GOLIOTH_OTA_DELTA_BUFFER_SIZE 256
+#endif
+
+#ifndef CONFIG_GOLIOTH_OTA_DECOMPRESS
+#define CONFIG_GOLIOTH_OTA_DECOMPRESS 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2
+#define CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2 10
+#endif
+
+#ifndef CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS
+#define CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS 2
+#endif
+
 #ifndef CONFIG_GOLIOTH_OTA_MANIFEST_SUBSCRIPTION_POLL_INTERVAL_S
 #define CONFIG_GOLIOTH_OTA_MANIFEST_SUBSCRIPTION_POLL_INTERVAL_S 86400
 #endif
@@ -97,6 +138,58 @@ extern "C"
 #define CONFIG_GOLIOTH_COAP_MAX_PATH_LEN 39
 #endif
 
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES 16
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE 512
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_ENTRIES
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_ENTRIES 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE 1024
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_DEPTH
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_DEPTH 8
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN 64
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_STRING_BUF_SIZE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_STRING_BUF_SIZE 64
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES 64
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_DEPTH
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_DEPTH 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE 512
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_LEAVES
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_LEAVES 32
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_HANDLERS
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_HANDLERS 8
+#endif
+
+#ifndef CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH 4
+#endif
+
 #ifndef CONFIG_GOLIOTH_MAX_NUM_SETTINGS
 #define CONFIG_GOLIOTH_MAX_NUM_SETTINGS 16
 #endif
@@ -105,6 +198,10 @@ extern "C"
 #define CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN 256
 #endif
 
+#ifndef CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN
+#define CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN 512
+#endif
+
 #ifndef CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS
 #define CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS 8
 #endif
@@ -113,6 +210,26 @@ extern "C"
 #define CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN 256
 #endif
 
+#ifndef CONFIG_GOLIOTH_RPC_NUM_WORKERS
+#define CONFIG_GOLIOTH_RPC_NUM_WORKERS 1
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE
+#define CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_WORKER_PRIORITY
+#define CONFIG_GOLIOTH_RPC_WORKER_PRIORITY 5
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS
+#define CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_RPC_QUEUE_DEPTH
+#define CONFIG_GOLIOTH_RPC_QUEUE_DEPTH 2
+#endif
+
 #ifndef CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD
 #define CONFIG_GOLIOTH_AUTO_LOG_TO_CLOUD 0
 #endif
@@ -125,6 +242,62 @@ extern "C"
 #define CONFIG_GOLIOTH_LOG_PIPELINES_PATH "logs"
 #endif
 
+#ifndef CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE
+#define CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE 1024
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS
+#define CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS 5000
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL
+#define CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL 1
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS
+#define CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS 4
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE
+#define CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE 8
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_ARGS_SIZE
+#define CONFIG_GOLIOTH_LOG_DEFERRED_ARGS_SIZE 48
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN
+#define CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN 256
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_STACK_SIZE
+#define CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_PRIORITY
+#define CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_PRIORITY 1
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_GOVERNOR_ENTRIES
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_ENTRIES 8
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_GOVERNOR_DEDUP_INTERVAL_MS
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_DEDUP_INTERVAL_MS 1000
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_GOVERNOR_RATE
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_RATE 5
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_GOVERNOR_BURST
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_BURST 10
+#endif
+
+#ifndef CONFIG_GOLIOTH_LOG_GOVERNOR_SUMMARY_INTERVAL_MS
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_SUMMARY_INTERVAL_MS 10000
+#endif
+
 #ifndef GOLIOTH_OVERRIDE_LIBCOAP_LOG_HANDLER
 #define GOLIOTH_OVERRIDE_LIBCOAP_LOG_HANDLER 1
 #endif
@@ -137,6 +310,29 @@ extern "C"
 #define CONFIG_GOLIOTH_FW_UPDATE_ROLLBACK_TIMER_S 300
 #endif
 
+#ifndef CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER
+/* Write firmware blocks from a dedicated thread, rather than from the CoAP client thread */
+#define CONFIG_GOLIOTH_FW_UPDATE_ASYNC_WRITER 0
+#endif
+
+#ifndef CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE
+/* Should be a multiple of the flash page size */
+#define CONFIG_GOLIOTH_FW_UPDATE_WRITER_BUFFER_SIZE 4096
+#endif
+
+#ifndef CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS
+#define CONFIG_GOLIOTH_FW_UPDATE_WRITER_NUM_BUFFERS 2
+#endif
+
+#ifndef CONFIG_GOLIOTH_FW_UPDATE_WRITER_THREAD_STACK_SIZE
+#define CONFIG_GOLIOTH_FW_UPDATE_WRITER_THREAD_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_GOLIOTH_FW_UPDATE_SESSION_SAVE_INTERVAL
+/* Number of blocks between saves of the download session, if session storage is registered */
+#define CONFIG_GOLIOTH_FW_UPDATE_SESSION_SAVE_INTERVAL 16
+#endif
+
 #ifdef __cplusplus
 }
 #endif
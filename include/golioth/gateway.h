@@ -42,8 +42,9 @@ struct gateway_uplink *golioth_gateway_uplink_start(struct golioth_client *clien
 /// Send a single uplink block
 ///
 /// Call this function for each block. For each call you must increment the \p block_idx, On the
-/// final block, set \p is_last to true. Block size is determined by the value of
-/// CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE.
+/// final block, set \p is_last to true. Block size is the value returned by
+/// \ref golioth_client_get_upload_block_size when \p uplink was created by
+/// \ref golioth_gateway_uplink_start.
 ///
 /// An optional callback and callback argument may be supplied. The callback will be called after
 /// the block is uploaded to provide access to status and CoAP response codes.
@@ -53,8 +54,7 @@ struct gateway_uplink *golioth_gateway_uplink_start(struct golioth_client *clien
 /// @param block_idx The index of the block being sent
 /// @param buf The buffer where the data for this block is located
 /// @param buf_len The actual length of data (in bytes) for this block. This should be equal to
-///        CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE for all blocks except for the final
-///        block, which may be shorter
+///        the block size for all blocks except for the final block, which may be shorter
 /// @param is_last Set this to true if this is the last block in the upload
 /// @param set_cb A callback that will be called after each block is sent (can be NULL)
 /// @param callback_arg An optional user provided argument that will be passed to \p set_cb (can
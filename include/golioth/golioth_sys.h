@@ -95,6 +95,11 @@ struct golioth_thread_config
 golioth_sys_thread_t golioth_sys_thread_create(const struct golioth_thread_config *config);
 void golioth_sys_thread_destroy(golioth_sys_thread_t thread);
 
+// Opaque identifier of a running thread, only meant to be compared for equality
+typedef void *golioth_sys_thread_id_t;
+
+golioth_sys_thread_id_t golioth_sys_thread_id(void);
+
 /*--------------------------------------------------
  * Malloc/Free
  *------------------------------------------------*/
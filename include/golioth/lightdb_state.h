@@ -32,6 +32,8 @@ extern "C"
 /// the request was acknowledged by the server) or a timeout occurs (response
 /// never received).
 ///
+/// The value is sent CBOR-encoded.
+///
 /// @param client The client handle from @ref golioth_client_create
 /// @param path The path in LightDB state to set (e.g. "my_integer")
 /// @param value The value to set at path
@@ -69,7 +71,8 @@ enum golioth_status golioth_lightdb_set_float(struct golioth_client *client,
 
 /// Set a string in LightDB state at a particular path
 ///
-/// Same as @ref golioth_lightdb_set_int, but for type string
+/// Same as @ref golioth_lightdb_set_int, but for type string. The string is sent as is, so it
+/// does not need to be NUL-terminated, quoted or escaped.
 enum golioth_status golioth_lightdb_set_string(struct golioth_client *client,
                                                const char *path,
                                                const char *str,
@@ -181,6 +184,455 @@ enum golioth_status golioth_lightdb_observe(struct golioth_client *client,
                                             golioth_get_cb_fn callback,
                                             void *callback_arg);
 
+//-------------------------------------------------------------------------------
+// LightDB State GET cache
+//-------------------------------------------------------------------------------
+
+struct golioth_lightdb_cache;
+
+/// Counters of a LightDB State GET cache
+struct golioth_lightdb_cache_stats
+{
+    /// GETs answered from the cache, after the server validated the cached ETag
+    uint32_t validations;
+    /// GETs answered with the full value from the server
+    uint32_t full_fetches;
+    /// Values evicted from the cache to make room for others
+    uint32_t evictions;
+};
+
+/// Create a LightDB State GET cache
+///
+/// A cache keeps the last value received for each path, with the ETag the server returned
+/// for it. GETs through the cache send the cached ETag, so the server can reply 2.03 (Valid)
+/// without a payload when the value did not change, and the cached value is passed to the
+/// callback instead.
+///
+/// Up to CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_ENTRIES values, with a total of
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE bytes, are cached. The least recently used
+/// values are evicted first.
+///
+/// @param client The client handle from @ref golioth_client_create
+///
+/// @return pointer to the cache
+/// @return NULL - Error creating the cache
+struct golioth_lightdb_cache *golioth_lightdb_cache_create(struct golioth_client *client);
+
+/// Destroy a LightDB State GET cache
+///
+/// Responses to earlier GETs refer to the cache, so the client must be stopped before
+/// destroying it.
+///
+/// @param cache Cache handle from @ref golioth_lightdb_cache_create
+void golioth_lightdb_cache_destroy(struct golioth_lightdb_cache *cache);
+
+/// Get data in LightDB state at a particular path, through a cache
+///
+/// Same as @ref golioth_lightdb_get, but the request is conditional on the ETag of the
+/// cached value, if any. When the server validates it, the callback gets the cached value,
+/// with \p coap_rsp_code 2.03 (Valid).
+///
+/// @param cache Cache handle from @ref golioth_lightdb_cache_create
+/// @param path The path in LightDB state to get (e.g. "config")
+/// @param content_type The serialization format to request for the path
+/// @param callback Callback to call on response received or timeout. Can be NULL.
+/// @param callback_arg Callback argument, passed directly when callback invoked. Can be NULL.
+///
+/// @retval GOLIOTH_OK request enqueued
+/// @retval GOLIOTH_ERR_NULL invalid cache handle or path
+/// @retval GOLIOTH_ERR_INVALID_STATE client is not running, currently stopped
+/// @retval GOLIOTH_ERR_MEM_ALLOC memory allocation error
+/// @retval GOLIOTH_ERR_QUEUE_FULL request queue is full, this request is dropped
+enum golioth_status golioth_lightdb_cache_get(struct golioth_lightdb_cache *cache,
+                                              const char *path,
+                                              enum golioth_content_type content_type,
+                                              golioth_get_cb_fn callback,
+                                              void *callback_arg);
+
+/// Get the counters of a LightDB State GET cache
+///
+/// @param cache Cache handle from @ref golioth_lightdb_cache_create
+/// @param stats Filled with the counters since the cache was created
+void golioth_lightdb_cache_get_stats(struct golioth_lightdb_cache *cache,
+                                     struct golioth_lightdb_cache_stats *stats);
+
+//-------------------------------------------------------------------------------
+// LightDB State streaming GET
+//-------------------------------------------------------------------------------
+
+/// Type of a value reported by a LightDB State streaming GET
+enum golioth_lightdb_stream_type
+{
+    GOLIOTH_LIGHTDB_STREAM_TYPE_INT,
+    GOLIOTH_LIGHTDB_STREAM_TYPE_BOOL,
+    GOLIOTH_LIGHTDB_STREAM_TYPE_FLOAT,
+    GOLIOTH_LIGHTDB_STREAM_TYPE_STRING,
+    GOLIOTH_LIGHTDB_STREAM_TYPE_BYTES,
+    GOLIOTH_LIGHTDB_STREAM_TYPE_NULL,
+};
+
+/// Value reported by a LightDB State streaming GET
+struct golioth_lightdb_stream_value
+{
+    /// Path of the value, relative to the requested path (e.g. "sensors/0/name"), with array
+    /// indexes as path segments. "" when the requested path itself holds the value.
+    const char *path;
+    enum golioth_lightdb_stream_type type;
+    union
+    {
+        int64_t i;
+        bool b;
+        double f;
+        /// Strings and byte strings up to CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_STRING_BUF_SIZE
+        /// bytes are reported at once. Longer ones are reported in parts, as they arrive, with
+        /// the offset of each part.
+        struct
+        {
+            const uint8_t *data;
+            size_t len;
+            size_t offset;
+            size_t total_len;
+        } str;
+    };
+};
+
+/// Callback function type for values of a LightDB State streaming GET
+///
+/// @param value The value. Only valid during the callback.
+/// @param arg User argument, copied from the original request. Can be NULL.
+///
+/// @retval GOLIOTH_OK continue
+/// @return otherwise - abort the GET, the error is passed to the end callback
+typedef enum golioth_status (*golioth_lightdb_stream_cb_fn)(
+    const struct golioth_lightdb_stream_value *value,
+    void *arg);
+
+/// Get data in LightDB state at a particular path, parsing it as it streams in
+///
+/// The CBOR value at path is downloaded blockwise, and parsed incrementally as blocks arrive,
+/// in constant memory. Instead of passing the whole document to the application,
+/// value_cb is invoked for each value in it, in document order, with its path. Maps and
+/// arrays up to CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_DEPTH levels deep, and paths up to
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN characters are supported.
+///
+/// This function will enqueue a request and return immediately.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param path The path in LightDB state to get (e.g. "config")
+/// @param value_cb Callback to call for each value
+/// @param end_cb Callback to call once, when the GET completed or failed. A document that is
+///     malformed or too deep is reported as failed, after the values that preceded the error.
+///     Can be NULL.
+/// @param callback_arg Callback argument, passed to both callbacks. Can be NULL.
+///
+/// @retval GOLIOTH_OK request enqueued
+/// @retval GOLIOTH_ERR_NULL invalid client handle, path or value_cb
+/// @retval GOLIOTH_ERR_MEM_ALLOC memory allocation error
+/// @return otherwise - error enqueueing the request
+enum golioth_status golioth_lightdb_stream_get(struct golioth_client *client,
+                                               const char *path,
+                                               golioth_lightdb_stream_cb_fn value_cb,
+                                               golioth_end_block_cb_fn end_cb,
+                                               void *callback_arg);
+
+//-------------------------------------------------------------------------------
+// LightDB State batch
+//-------------------------------------------------------------------------------
+
+struct golioth_lightdb_batch;
+
+/// Begin a batch of LightDB State values, set together in a single request
+///
+/// Values are added with golioth_lightdb_batch_add_*(), and sent with
+/// @ref golioth_lightdb_batch_commit. They are encoded into one CBOR document, posted to the
+/// deepest path containing all of them, so the server stores them as one consistent update.
+/// For example, a batch with "a/b", "a/c" and "x/y" is posted to the root as
+/// {"a": {"b": ..., "c": ...}, "x": {"y": ...}}.
+///
+/// Up to CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES values can be added.
+///
+/// @param client The client handle from @ref golioth_client_create
+///
+/// @return pointer to the batch, to be committed or aborted
+/// @return NULL - memory allocation error
+struct golioth_lightdb_batch *golioth_lightdb_batch_begin(struct golioth_client *client);
+
+/// Add an integer to a LightDB State batch
+///
+/// An error from adding a value is returned again by @ref golioth_lightdb_batch_commit, so
+/// that a batch is either sent with all of its values or not at all.
+///
+/// @param batch Batch handle from @ref golioth_lightdb_batch_begin
+/// @param path The path in LightDB state to set (e.g. "sensor/count"). Not copied, it must
+///     remain valid until the batch is committed or aborted.
+/// @param value The value to set at path
+///
+/// @retval GOLIOTH_OK value added
+/// @retval GOLIOTH_ERR_NULL invalid batch handle or path
+/// @retval GOLIOTH_ERR_INVALID_FORMAT path is invalid
+/// @retval GOLIOTH_ERR_MEM_ALLOC the batch is full
+enum golioth_status golioth_lightdb_batch_add_int(struct golioth_lightdb_batch *batch,
+                                                  const char *path,
+                                                  int32_t value);
+
+/// Add a bool to a LightDB State batch
+///
+/// Same as @ref golioth_lightdb_batch_add_int, but for type bool
+enum golioth_status golioth_lightdb_batch_add_bool(struct golioth_lightdb_batch *batch,
+                                                   const char *path,
+                                                   bool value);
+
+/// Add a float to a LightDB State batch
+///
+/// Same as @ref golioth_lightdb_batch_add_int, but for type float
+enum golioth_status golioth_lightdb_batch_add_float(struct golioth_lightdb_batch *batch,
+                                                    const char *path,
+                                                    float value);
+
+/// Add a string to a LightDB State batch
+///
+/// Same as @ref golioth_lightdb_batch_add_int, but for type string. Like path, the string is
+/// not copied. Returns GOLIOTH_ERR_NULL if str is NULL.
+enum golioth_status golioth_lightdb_batch_add_string(struct golioth_lightdb_batch *batch,
+                                                     const char *path,
+                                                     const char *str,
+                                                     size_t str_len);
+
+/// Add a CBOR-encoded value to a LightDB State batch
+///
+/// Same as @ref golioth_lightdb_batch_add_int, but for a single CBOR data item (e.g. a map or
+/// an array), copied into the batch document as is. Like path, the data is not copied. Returns
+/// GOLIOTH_ERR_NULL if cbor is NULL.
+enum golioth_status golioth_lightdb_batch_add_raw(struct golioth_lightdb_batch *batch,
+                                                  const char *path,
+                                                  const uint8_t *cbor,
+                                                  size_t cbor_len);
+
+/// Commit a LightDB State batch
+///
+/// Enqueue a request with all values of the batch, and return immediately. The batch handle
+/// is freed, whether the request was enqueued or not.
+///
+/// @param batch Batch handle from @ref golioth_lightdb_batch_begin
+/// @param callback Callback to call on response received or timeout, once for the whole batch.
+///     Can be NULL.
+/// @param callback_arg Callback argument, passed directly when callback invoked. Can be NULL.
+///
+/// @retval GOLIOTH_OK request enqueued
+/// @retval GOLIOTH_ERR_NULL invalid batch handle
+/// @retval GOLIOTH_ERR_INVALID_STATE the batch is empty
+/// @retval GOLIOTH_ERR_INVALID_FORMAT a path was repeated, or holds both a value and other paths
+/// @retval GOLIOTH_ERR_MEM_ALLOC the batch does not fit into
+///     CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE bytes, or memory allocation error
+/// @return otherwise - error adding a value, or enqueueing the request
+enum golioth_status golioth_lightdb_batch_commit(struct golioth_lightdb_batch *batch,
+                                                 golioth_set_cb_fn callback,
+                                                 void *callback_arg);
+
+/// Abort a LightDB State batch, freeing it without sending anything
+///
+/// @param batch Batch handle from @ref golioth_lightdb_batch_begin
+void golioth_lightdb_batch_abort(struct golioth_lightdb_batch *batch);
+
+//-------------------------------------------------------------------------------
+// LightDB State shadow
+//-------------------------------------------------------------------------------
+
+struct golioth_lightdb_shadow;
+
+/// Flush policy of a LightDB State shadow
+struct golioth_lightdb_shadow_config
+{
+    /// Flush changed values periodically, at this interval. 0 disables periodic flushes.
+    uint32_t flush_interval_ms;
+    /// Flush as soon as this many values changed since the last flush. 0 disables it.
+    size_t flush_dirty_count;
+};
+
+/// Create a LightDB State shadow
+///
+/// A shadow is a local copy of LightDB State values, keyed by path. Setting a value with
+/// golioth_lightdb_shadow_set_*() only updates the shadow, and marks the value dirty if it
+/// changed. Flushing the shadow uploads the dirty values as a single CBOR document, merged
+/// into LightDB State at the root, with nested maps for paths with several segments (e.g.
+/// "sensor/temp"). Values that did not change are not sent again.
+///
+/// A path can either hold a value, or other paths below it, but not both. Paths have at
+/// most CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_DEPTH segments.
+///
+/// Flushes happen according to config, and whenever @ref golioth_lightdb_shadow_flush is
+/// called. If the server rejects a flush, the next one sends all values.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param config Flush policy. Can be NULL to only flush explicitly.
+///
+/// @return pointer to the shadow
+/// @return NULL - Error creating the shadow
+struct golioth_lightdb_shadow *golioth_lightdb_shadow_create(
+    struct golioth_client *client,
+    const struct golioth_lightdb_shadow_config *config);
+
+/// Destroy a LightDB State shadow
+///
+/// Dirty values are discarded, flush first to send them. Responses to earlier flushes refer to
+/// the shadow, so the client must be stopped before destroying it.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_shadow_create
+void golioth_lightdb_shadow_destroy(struct golioth_lightdb_shadow *shadow);
+
+/// Set an integer in a LightDB State shadow at a particular path
+///
+/// The value is sent by the next flush of the shadow, if it changed.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_shadow_create
+/// @param path The path in LightDB state to set (e.g. "sensor/count")
+/// @param value The value to set at path
+///
+/// @retval GOLIOTH_OK value set
+/// @retval GOLIOTH_ERR_NULL invalid shadow handle or path
+/// @retval GOLIOTH_ERR_INVALID_FORMAT path is invalid, too deep, or conflicts with another path
+/// @retval GOLIOTH_ERR_MEM_ALLOC the shadow is full, or memory allocation error
+/// @return otherwise - the value was set, but flushing the shadow failed
+enum golioth_status golioth_lightdb_shadow_set_int(struct golioth_lightdb_shadow *shadow,
+                                                   const char *path,
+                                                   int32_t value);
+
+/// Set a bool in a LightDB State shadow at a particular path
+///
+/// Same as @ref golioth_lightdb_shadow_set_int, but for type bool
+enum golioth_status golioth_lightdb_shadow_set_bool(struct golioth_lightdb_shadow *shadow,
+                                                    const char *path,
+                                                    bool value);
+
+/// Set a float in a LightDB State shadow at a particular path
+///
+/// Same as @ref golioth_lightdb_shadow_set_int, but for type float
+enum golioth_status golioth_lightdb_shadow_set_float(struct golioth_lightdb_shadow *shadow,
+                                                     const char *path,
+                                                     float value);
+
+/// Set a string in a LightDB State shadow at a particular path
+///
+/// Same as @ref golioth_lightdb_shadow_set_int, but for type string. The string is copied.
+enum golioth_status golioth_lightdb_shadow_set_string(struct golioth_lightdb_shadow *shadow,
+                                                      const char *path,
+                                                      const char *str,
+                                                      size_t str_len);
+
+/// Flush a LightDB State shadow
+///
+/// Enqueue a request with the values that changed since the last flush, and return
+/// immediately. Values are split into several requests if they don't fit into
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE bytes. A value which doesn't fit on its own is
+/// logged and skipped. Nothing is sent if no value changed.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_shadow_create
+///
+/// @retval GOLIOTH_OK changed values enqueued, or none changed
+/// @retval GOLIOTH_ERR_NULL invalid shadow handle
+/// @retval GOLIOTH_ERR_MEM_ALLOC memory allocation error
+/// @return otherwise - error enqueueing the request, values are sent by the next flush
+enum golioth_status golioth_lightdb_shadow_flush(struct golioth_lightdb_shadow *shadow);
+
+/// Get the number of values in a LightDB State shadow changed since the last flush
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_shadow_create
+size_t golioth_lightdb_shadow_num_dirty(struct golioth_lightdb_shadow *shadow);
+
+//-------------------------------------------------------------------------------
+// LightDB State observed-value shadow
+//-------------------------------------------------------------------------------
+
+struct golioth_lightdb_observe_shadow;
+
+/// Callback function type for changes of an observed LightDB State value
+///
+/// @param client The client handle from the original request.
+/// @param path Path of the value, relative to the observed path (e.g. "sensor/temp"). "" when
+///     the observed path itself holds the value.
+/// @param value The new value, a single CBOR data item. NULL if the value was removed.
+/// @param value_len Length of value
+/// @param arg User argument, copied from the original request. Can be NULL.
+typedef void (*golioth_lightdb_change_cb_fn)(struct golioth_client *client,
+                                             const char *path,
+                                             const uint8_t *value,
+                                             size_t value_len,
+                                             void *arg);
+
+/// Create a LightDB State observed-value shadow
+///
+/// An observed-value shadow observes a path in LightDB State as CBOR, like
+/// @ref golioth_lightdb_observe, but instead of passing each notification to the application,
+/// it compares it with the previous one and only reports the values that changed. The
+/// notification is walked without decoding it into a document tree: maps are walked into,
+/// and anything else (including arrays, and maps nested deeper than
+/// CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH) is a single value. A copy of the
+/// encoded value is kept, for up to CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_LEAVES
+/// values. Changes of other values are not reported.
+///
+/// The first notification reports all values.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param path The path in LightDB state to observe (e.g. "desired"). "" observes the root.
+///
+/// @return pointer to the shadow
+/// @return NULL - Error creating the shadow
+struct golioth_lightdb_observe_shadow *golioth_lightdb_observe_shadow_create(
+    struct golioth_client *client,
+    const char *path);
+
+/// Destroy a LightDB State observed-value shadow
+///
+/// Notifications are handled by the client thread, which may still be using a started
+/// shadow. A started shadow can therefore only be destroyed once the client is stopped with
+/// @ref golioth_client_stop; its observation is then cancelled, so it is not re-established
+/// when the client is started again. The shadow must never be destroyed from one of its
+/// callbacks.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_observe_shadow_create
+///
+/// @retval GOLIOTH_OK Shadow destroyed
+/// @retval GOLIOTH_ERR_NULL Shadow handle invalid
+/// @retval GOLIOTH_ERR_INVALID_STATE Shadow is started and the client is running; the shadow
+///                                   is left intact
+enum golioth_status golioth_lightdb_observe_shadow_destroy(
+    struct golioth_lightdb_observe_shadow *shadow);
+
+/// Register a callback for changes in a LightDB State observed-value shadow
+///
+/// The callback is invoked for each changed, added or removed value at path or below it,
+/// from the client thread. Callbacks must be registered before the shadow is started.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_observe_shadow_create
+/// @param path Path relative to the observed path (e.g. "sensor"). "" matches every value.
+/// @param callback Callback to call on changes
+/// @param callback_arg Callback argument, passed directly when callback invoked. Can be NULL.
+///
+/// @retval GOLIOTH_OK callback registered
+/// @retval GOLIOTH_ERR_NULL invalid shadow handle, path or callback
+/// @retval GOLIOTH_ERR_INVALID_STATE the shadow was already started
+/// @retval GOLIOTH_ERR_MEM_ALLOC too many callbacks, or memory allocation error
+enum golioth_status golioth_lightdb_observe_shadow_on_change(
+    struct golioth_lightdb_observe_shadow *shadow,
+    const char *path,
+    golioth_lightdb_change_cb_fn callback,
+    void *callback_arg);
+
+/// Start observing the path of a LightDB State observed-value shadow
+///
+/// This function will enqueue a request and return immediately.
+///
+/// @param shadow Shadow handle from @ref golioth_lightdb_observe_shadow_create
+///
+/// @retval GOLIOTH_OK request enqueued
+/// @retval GOLIOTH_ERR_NULL invalid shadow handle
+/// @retval GOLIOTH_ERR_INVALID_STATE the shadow was already started, or the client is not
+///     running
+/// @retval GOLIOTH_ERR_MEM_ALLOC memory allocation error
+/// @retval GOLIOTH_ERR_QUEUE_FULL request queue is full, this request is dropped
+enum golioth_status golioth_lightdb_observe_shadow_start(
+    struct golioth_lightdb_observe_shadow *shadow);
+
 /// @}
 
 #ifdef __cplusplus
@@ -58,6 +58,38 @@ enum golioth_status golioth_log_debug(struct golioth_client *client,
                                       golioth_set_cb_fn callback,
                                       void *callback_arg);
 
+/// Counters of log records sent in batches
+///
+/// Only used with CONFIG_GOLIOTH_LOG_BATCH.
+struct golioth_log_batch_stats
+{
+    /// Log records sent in batches
+    uint32_t records;
+    /// Requests that carried them
+    uint32_t requests;
+    /// Estimate of the CoAP bytes not sent, compared to one request per record
+    uint32_t bytes_saved;
+};
+
+/// Send the log records batched for a client
+///
+/// With CONFIG_GOLIOTH_LOG_BATCH, log records without a callback are collected and sent
+/// together in one request, as a CBOR array of records. A batch is sent when the next record
+/// does not fit in CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE, when its oldest record is older than
+/// CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS, or right after a record with a level at or above
+/// CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL. Call this to send the batch sooner, e.g. before
+/// stopping or destroying the client.
+///
+/// @param client The client handle from @ref golioth_client_create
+enum golioth_status golioth_log_flush(struct golioth_client *client);
+
+/// Get the counters of log records sent in batches
+///
+/// All counters are zero without CONFIG_GOLIOTH_LOG_BATCH.
+///
+/// @param stats Filled with the counters
+void golioth_log_batch_get_stats(struct golioth_log_batch_stats *stats);
+
 /// @}
 
 #ifdef __cplusplus
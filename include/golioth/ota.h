@@ -85,6 +85,9 @@ struct golioth_ota_component
     uint8_t hash[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
     /// Artifact uri (e.g. "/.u/c/main@1.2.3")
     char uri[GOLIOTH_OTA_MAX_COMPONENT_URI_LEN + 1];
+    /// True if this describes the decompressed image of a compressed component, as passed to
+    /// the download callbacks (see @ref golioth_ota_decompress)
+    bool decompressed;
 };
 
 /// An OTA manifest, composed of multiple components/artifacts
@@ -114,6 +117,19 @@ enum golioth_status golioth_ota_payload_as_manifest(const uint8_t *payload,
 /// GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE)
 size_t golioth_ota_size_to_nblocks(size_t component_size);
 
+/// Convert a size in bytes to a number of blocks, in the units of the block index passed to @ref
+/// golioth_ota_download_component and reported to @ref ota_component_download_end_cb
+///
+/// Blocks are of the resume block size of the client (see @ref
+/// golioth_client_get_download_resume_block_size), which does not change with the block size
+/// selected by path MTU discovery.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param component_size Size of the component, in bytes
+///
+/// @return The number of blocks, or 0 if client is NULL
+size_t golioth_ota_size_to_resume_nblocks(struct golioth_client *client, size_t component_size);
+
 /// Find a component by package name in a manifest, or NULL if not found.
 ///
 /// @param manifest manifest to find component in
@@ -132,6 +148,12 @@ const struct golioth_ota_component *golioth_ota_find_component(
 /// Updates will also be pushed directly to the device if a manifest changes while
 /// the device is connected.
 ///
+/// When CONFIG_GOLIOTH_OTA_MANIFEST_CACHE is enabled, the callback is only called when the
+/// manifest changed since the previous call, so applications do not parse unchanged manifests.
+/// The first manifest after subscribing is always passed to the callback. Periodic fetches are
+/// then conditional (ETag), so the server can confirm an unchanged manifest without resending
+/// it. Errors are always passed to the callback.
+///
 /// @param client The client handle from @ref golioth_client_create
 /// @param callback Callback function to register
 /// @param arg Optional argument, forwarded directly to the callback when invoked. Can be NULL.
@@ -178,7 +200,9 @@ enum golioth_status golioth_ota_blockwise_manifest(struct golioth_client *client
 ///
 /// Will be called 0 or more times, once for each block received from the server.
 ///
-/// @param component The @ref golioth_ota_component pointer from the original request
+/// @param component The @ref golioth_ota_component pointer from the original request, or a
+/// description of the decompressed image for compressed components (see @ref
+/// golioth_ota_decompress)
 /// @param block_idx The block number in sequence (starting with 0)
 /// @param block_buffer The component payload in the response packet.
 /// @param block_buffer_len The length of the component payload, in bytes.
@@ -201,9 +225,12 @@ typedef enum golioth_status (*ota_component_block_write_cb)(
 /// @param status The result of the blockwise download
 /// @param rsp_code If status is GOLIOTH_ERR_COAP_RESPONSE then this pointer contains the CoAP
 /// response code
-/// @param component The @ref golioth_ota_component pointer from the original request
+/// @param component The @ref golioth_ota_component pointer from the original request, or a
+/// description of the decompressed image for compressed components (see @ref
+/// golioth_ota_decompress)
 /// @param block_idx The Users can resume an OTA download by passing this value to the block_idx
-/// argument of @ref golioth_ota_download_component
+/// argument of @ref golioth_ota_download_component. It counts blocks of the resume block size (see
+/// @ref golioth_client_get_download_resume_block_size), not of negotiated_block_size.
 /// @param arg User supplied argument. Can be NULL.
 typedef void (*ota_component_download_end_cb)(enum golioth_status status,
                                               const struct golioth_coap_rsp_code *rsp_code,
@@ -228,7 +255,8 @@ typedef void (*ota_component_download_end_cb)(enum golioth_status status,
 /// @param component One @ref golioth_ota_component instance present in the @ref
 /// golioth_ota_manifest
 /// @param block_idx The index of the first block to download. Callers can resume a blockwise
-/// download by passing in a non-zero block_idx.
+/// download by passing in a non-zero block_idx, in units of the resume block size (see @ref
+/// golioth_client_get_download_resume_block_size).
 /// @param block_cb Callback for receiving a block of data. See @ref ota_component_block_write_cb
 /// @param end_cb Callabck for the end of a download. See @ref ota_component_download_end_cb
 /// @param arg Optional argument, forwarded directly to the callback when invoked. Can be NULL.
@@ -243,6 +271,74 @@ enum golioth_status golioth_ota_download_component(struct golioth_client *client
                                                    ota_component_download_end_cb end_cb,
                                                    void *arg);
 
+/// One component of a parallel download, see @ref golioth_ota_download_components
+struct golioth_ota_download_job
+{
+    /// One @ref golioth_ota_component instance present in the @ref golioth_ota_manifest
+    const struct golioth_ota_component *component;
+    /// The index of the first block to download, non-zero to resume a download
+    uint32_t block_idx;
+    /// Callback for receiving a block of data. See @ref ota_component_block_write_cb
+    ota_component_block_write_cb block_cb;
+    /// Callback for the end of the download of this component. See @ref
+    /// ota_component_download_end_cb
+    ota_component_download_end_cb end_cb;
+    /// Optional argument, forwarded to the callbacks of this component. Can be NULL.
+    void *arg;
+};
+
+/// Callback for the progress of one component of a parallel download
+///
+/// Called after each block successfully written by the block callback of the component.
+///
+/// @param component The component, as passed to the block callback
+/// @param bytes_downloaded Number of bytes of the component received so far
+/// @param arg The argument of the download job
+typedef void (*golioth_ota_download_progress_cb)(const struct golioth_ota_component *component,
+                                                 size_t bytes_downloaded,
+                                                 void *arg);
+
+/// Callback for the end of a parallel download
+///
+/// Called exactly one time, after the end callbacks of all components have been called.
+///
+/// @param num_failed Number of components that did not download successfully
+/// @param arg User argument, copied from the original request. Can be NULL.
+typedef void (*golioth_ota_download_components_end_cb)(size_t num_failed, void *arg);
+
+/// Download several OTA components in parallel
+///
+/// Up to \p max_in_flight components are downloaded at the same time over the client session.
+/// Each of them keeps one block request queued at a time, so the client interleaves their
+/// blocks in turn. Remaining components are started as others complete. As each download in
+/// flight holds its own transfer state, and decompressor state for compressed components,
+/// \p max_in_flight also bounds the memory used by the download.
+///
+/// The callbacks of each job behave as with @ref golioth_ota_download_component. A failed
+/// component does not stop the download of the others.
+///
+/// @param client The client handle from @ref golioth_client_create
+/// @param jobs The components to download. Copied, the array does not need to remain valid.
+/// @param num_jobs Number of jobs, at most CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS
+/// @param max_in_flight Maximum number of components downloaded at the same time, or 0 for
+///                      CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS
+/// @param progress_cb Callback for the progress of each component. Can be NULL.
+/// @param end_cb Callback for the end of the whole download. Can be NULL.
+/// @param arg Optional argument, forwarded directly to end_cb. Can be NULL.
+///
+/// @retval GOLIOTH_OK download started, end_cb will be called
+/// @retval GOLIOTH_ERR_NULL invalid client handle or jobs
+/// @retval GOLIOTH_ERR_INVALID_FORMAT no jobs, or more than CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS
+/// @retval GOLIOTH_ERR_MEM_ALLOC unable to allocate necessary memory
+enum golioth_status golioth_ota_download_components(
+    struct golioth_client *client,
+    const struct golioth_ota_download_job *jobs,
+    size_t num_jobs,
+    size_t max_in_flight,
+    golioth_ota_download_progress_cb progress_cb,
+    golioth_ota_download_components_end_cb end_cb,
+    void *arg);
+
 /// Report the state of OTA update to Golioth server synchronously
 ///
 /// @param client The client handle from @ref golioth_client_create
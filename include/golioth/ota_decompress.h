@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_status.h>
+#include <golioth/config.h>
+
+/// @defgroup golioth_ota_decompress golioth_ota_decompress
+/// Decompression of OTA components while they are downloaded
+///
+/// When CONFIG_GOLIOTH_OTA_DECOMPRESS is enabled, @ref golioth_ota_download_component recognizes
+/// compressed components by their header, and passes the decompressed image to the block
+/// callback instead of the downloaded bytes. Compressed components are a header followed by the
+/// compressed image. All integers are little-endian.
+///
+///     header:  "GCMP" | u8 algorithm | u8 params[2] | u8 reserved | u32 image_size
+///              | u8 image_sha256[32]
+///
+/// The component passed to the block and end callbacks then describes the decompressed image:
+/// its size and hash are image_size and image_sha256, and block indices and offsets refer to the
+/// decompressed image. Applications verify the decompressed image against that hash, as they
+/// would verify an uncompressed component.
+///
+/// The compressed component is checked against the hash of the manifest before the last block
+/// is passed on, and the download fails if they don't match.
+///
+/// The end callback still reports the block index of the compressed component, so downloads
+/// interrupted by a transient error can be resumed while the device is running. The decompressor
+/// state is kept for each interrupted component, and restored to its state at the start of the
+/// failed block, so that block can be downloaded again. Resuming after a reboot is not supported,
+/// as the decompressor state is not persisted. Applications tell decompressed images apart by the
+/// decompressed flag of the component passed to the callbacks.
+///
+/// Components can be compressed with scripts/ota_compress/make_compressed.py.
+/// @{
+
+/// Magic number at the start of a compressed component
+#define GOLIOTH_OTA_DECOMPRESS_MAGIC "GCMP"
+/// Length of the compressed component header, in bytes
+#define GOLIOTH_OTA_DECOMPRESS_HEADER_LEN 44
+
+/// Compression algorithms of compressed components
+enum golioth_ota_compression
+{
+    /// heatshrink (LZSS). params[0] is the window size and params[1] the lookahead size, both as
+    /// a power of 2. Built-in, supports windows up to CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2.
+    GOLIOTH_OTA_COMPRESSION_HEATSHRINK = 1,
+    /// zlib (deflate). Not built-in, see @ref golioth_ota_register_decompressor
+    GOLIOTH_OTA_COMPRESSION_ZLIB = 2,
+};
+
+/// Callback for decompressed data
+///
+/// @param data Decompressed data
+/// @param len Length of data, in bytes
+/// @param arg Argument passed to the process function of the decompressor
+///
+/// @retval GOLIOTH_OK Data consumed, continue decompressing
+/// @retval Otherwise Abort decompression, and return this status from process
+typedef enum golioth_status (*golioth_ota_decompress_output_cb)(const uint8_t *data,
+                                                                size_t len,
+                                                                void *arg);
+
+/// A streaming decompressor
+struct golioth_ota_decompressor
+{
+    /// Algorithm handled by this decompressor, see @ref golioth_ota_compression
+    uint8_t algorithm;
+    /// Size of the decompressor state, in bytes. Allocated by the SDK for each download. The
+    /// state is copied with memcpy() to checkpoint it at the start of each downloaded block, so it
+    /// must be self-contained, without pointers into itself or to other allocations.
+    size_t state_size;
+    /// Prepare state for a new image, with the params from the component header
+    enum golioth_status (*init)(void *state, const uint8_t params[2]);
+    /// Decompress the next bytes of the image, calling output as decompressed data is available
+    enum golioth_status (*process)(void *state,
+                                   const uint8_t *data,
+                                   size_t len,
+                                   golioth_ota_decompress_output_cb output,
+                                   void *output_arg);
+    /// Release resources held by state, if any. Can be NULL.
+    void (*deinit)(void *state);
+};
+
+/// Built-in heatshrink decompressor
+extern const struct golioth_ota_decompressor golioth_ota_decompressor_heatshrink;
+
+/// Register a decompressor for an additional algorithm
+///
+/// Allows using a decompressor provided by the platform, such as a zlib inflater, for
+/// components compressed with an algorithm that is not built-in. The decompressor is
+/// shallow-copied and must remain valid.
+///
+/// @param decompressor The decompressor, or NULL to unregister
+void golioth_ota_register_decompressor(const struct golioth_ota_decompressor *decompressor);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_status.h>
+#include <golioth/golioth_sys.h>
+#include <golioth/config.h>
+#include <golioth/ota_decompress.h>
+
+/// @defgroup golioth_ota_delta golioth_ota_delta
+/// Streaming application of delta (binary patch) OTA components
+///
+/// A delta component is a patch that transforms the currently running image (the source) into
+/// the new image (the target). It is applied while being downloaded, block by block, so RAM use is
+/// bounded by CONFIG_GOLIOTH_OTA_DELTA_BUFFER_SIZE (plus the decompressor window, for compressed
+/// patches) regardless of the image size.
+///
+/// The patch follows the bsdiff design: a sequence of records, each made of a diff part and an
+/// extra part. All integers are little-endian.
+///
+///     header:  "GDLT" | u8 compression | u8 params[2] | u8 reserved | u32 target_size
+///              | u8 target_sha256[32]
+///     body:    record*
+///     record:  u32 diff_len | u32 extra_len | i32 seek | diff[diff_len] | extra[extra_len]
+///
+/// For each record, diff_len bytes of the target are produced by adding (modulo 256) each diff
+/// byte to the source byte at the current source position, which then advances by diff_len. Then
+/// the extra_len bytes of the record are appended to the target. Finally, seek is added to the
+/// source position. Records follow each other until target_size bytes have been produced.
+///
+/// Diff parts cover regions of the target that are similar to the source, such as code in which
+/// only addresses changed, so they are mostly zeros. The body is compressed as a single stream
+/// with the algorithm of @ref golioth_ota_compression given by compression, using params, or
+/// stored as is when compression is 0.
+///
+/// Patches can be created from two images with scripts/ota_delta/make_delta.py.
+/// @{
+
+/// Magic number at the start of a delta component
+#define GOLIOTH_OTA_DELTA_MAGIC "GDLT"
+/// Length of the delta component header, in bytes
+#define GOLIOTH_OTA_DELTA_HEADER_LEN 44
+/// Length of a delta record header, in bytes
+#define GOLIOTH_OTA_DELTA_RECORD_LEN 12
+
+/// Callback to read the source image
+///
+/// @param offset Offset in the source image
+/// @param buf Buffer to read into
+/// @param len Number of bytes to read
+/// @param arg User argument, copied from @ref golioth_ota_delta_init
+///
+/// @retval GOLIOTH_OK All len bytes were read
+typedef enum golioth_status (*golioth_ota_delta_read_cb)(size_t offset,
+                                                         uint8_t *buf,
+                                                         size_t len,
+                                                         void *arg);
+
+/// Callback to write the target image. Called with consecutive offsets.
+///
+/// @param offset Offset in the target image
+/// @param buf Data to write
+/// @param len Number of bytes to write
+/// @param target_size Total size of the target image, in bytes
+/// @param arg User argument, copied from @ref golioth_ota_delta_init
+///
+/// @retval GOLIOTH_OK All len bytes were written
+typedef enum golioth_status (*golioth_ota_delta_write_cb)(size_t offset,
+                                                          const uint8_t *buf,
+                                                          size_t len,
+                                                          size_t target_size,
+                                                          void *arg);
+
+/// State of a delta patcher. Allocated by the caller, all members are private.
+struct golioth_ota_delta
+{
+    golioth_ota_delta_read_cb read_cb;
+    golioth_ota_delta_write_cb write_cb;
+    void *arg;
+    golioth_sys_sha256_t sha;
+    const struct golioth_ota_decompressor *decompressor;
+    void *decompressor_state;
+    uint8_t state;
+    uint8_t hdr[GOLIOTH_OTA_DELTA_HEADER_LEN];
+    size_t hdr_len;
+    size_t target_size;
+    uint8_t target_hash[32];
+    size_t src_pos;
+    size_t diff_left;
+    size_t extra_left;
+    int32_t seek;
+    size_t out_offset;
+    size_t out_len;
+    uint8_t out[CONFIG_GOLIOTH_OTA_DELTA_BUFFER_SIZE];
+};
+
+/// Check whether a component is a delta patch, based on its first bytes
+///
+/// @param data First bytes of the component
+/// @param len Length of data, in bytes
+///
+/// @return true if data starts with @ref GOLIOTH_OTA_DELTA_MAGIC
+bool golioth_ota_delta_is_patch(const uint8_t *data, size_t len);
+
+/// Prepare a patcher to apply a new delta component
+///
+/// @param delta Patcher state, allocated by the caller
+/// @param read_cb Callback to read the source image
+/// @param write_cb Callback to write the target image
+/// @param arg User argument passed to the callbacks, can be NULL
+///
+/// @retval GOLIOTH_OK Patcher ready
+/// @retval GOLIOTH_ERR_MEM_ALLOC Failed to create the sha256 context
+enum golioth_status golioth_ota_delta_init(struct golioth_ota_delta *delta,
+                                           golioth_ota_delta_read_cb read_cb,
+                                           golioth_ota_delta_write_cb write_cb,
+                                           void *arg);
+
+/// Apply the next bytes of the patch. May be called with chunks of any size.
+///
+/// @param delta Patcher state
+/// @param data Next bytes of the patch
+/// @param len Length of data, in bytes
+///
+/// @retval GOLIOTH_OK Data applied
+/// @retval GOLIOTH_ERR_INVALID_FORMAT The patch is malformed
+/// @retval GOLIOTH_ERR_NOT_IMPLEMENTED The patch is compressed with an unsupported algorithm
+/// @retval GOLIOTH_ERR_MEM_ALLOC Failed to allocate the decompressor state
+/// @retval Otherwise Error returned by read_cb or write_cb
+enum golioth_status golioth_ota_delta_apply(struct golioth_ota_delta *delta,
+                                            const uint8_t *data,
+                                            size_t len);
+
+/// Finish applying the patch, and verify the target image
+///
+/// Releases resources allocated by @ref golioth_ota_delta_init, whatever the result.
+///
+/// @param delta Patcher state
+///
+/// @retval GOLIOTH_OK The complete target image was written and its SHA256 matches the patch
+/// @retval GOLIOTH_ERR_NO_MORE_DATA The patch is incomplete
+/// @retval GOLIOTH_ERR_FAIL The SHA256 of the target image does not match
+enum golioth_status golioth_ota_delta_finish(struct golioth_ota_delta *delta);
+
+/// Release resources of a patcher, without verifying the target image
+///
+/// @param delta Patcher state
+void golioth_ota_delta_abort(struct golioth_ota_delta *delta);
+
+/// @}
+
+#ifdef __cplusplus
+}
+#endif
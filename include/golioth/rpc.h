@@ -22,6 +22,9 @@ extern "C"
 
 struct golioth_rpc;
 
+/// Handle of a call to a deferred RPC method, see @ref golioth_rpc_register_deferred
+struct golioth_rpc_call;
+
 /// Enumeration of RPC status codes, sent in the RPC response
 enum golioth_rpc_status
 {
@@ -89,6 +92,74 @@ typedef enum golioth_rpc_status (*golioth_rpc_cb_fn)(zcbor_state_t *request_para
                                                      zcbor_state_t *response_detail_map,
                                                      void *callback_arg);
 
+/// Callback function type for deferred remote procedure call
+///
+/// Called on one of the CONFIG_GOLIOTH_RPC_NUM_WORKERS RPC worker threads, so it can take
+/// as long as needed without blocking the Golioth client. The response is sent when
+/// @ref golioth_rpc_call_complete is called with the call handle, which may happen before
+/// returning, or later from any thread.
+///
+/// @param call Handle of this call, to be passed to @ref golioth_rpc_call_complete
+/// @param request_params_array zcbor decode state, inside of the RPC request params array.
+///     Only valid until the callback returns.
+/// @param response_detail_map zcbor encode state, inside of the RPC response detail map.
+///     Valid until @ref golioth_rpc_call_complete is called.
+/// @param callback_arg callback_arg, unchanged from callback_arg of
+///     @ref golioth_rpc_register_deferred
+typedef void (*golioth_rpc_deferred_cb_fn)(struct golioth_rpc_call *call,
+                                           zcbor_state_t *request_params_array,
+                                           zcbor_state_t *response_detail_map,
+                                           void *callback_arg);
+
+/// Description of an RPC method, for @ref golioth_rpc_register_table
+struct golioth_rpc_method
+{
+    /// The name of the method
+    const char *method;
+    /// The callback to be invoked, when an RPC request with matching method name is received
+    golioth_rpc_cb_fn callback;
+    /// The callback to be invoked on an RPC worker thread instead. Only one of callback and
+    /// deferred_callback can be set.
+    golioth_rpc_deferred_cb_fn deferred_callback;
+    /// User data forwarded to callback when invoked. Optional, can be NULL.
+    void *callback_arg;
+};
+
+/// Table entry for an RPC method
+#define GOLIOTH_RPC_METHOD(_method, _callback, _callback_arg) \
+    {                                                         \
+        .method = (_method),                                  \
+        .callback = (_callback),                              \
+        .callback_arg = (_callback_arg),                      \
+    }
+
+/// Table entry for a deferred RPC method
+#define GOLIOTH_RPC_DEFERRED_METHOD(_method, _callback, _callback_arg) \
+    {                                                                  \
+        .method = (_method),                                           \
+        .deferred_callback = (_callback),                              \
+        .callback_arg = (_callback_arg),                               \
+    }
+
+/// RAM for one registered method, see @ref golioth_rpc_init_with_pool
+///
+/// Each method needs a slot, including methods of a table registered with
+/// @ref golioth_rpc_register_table. A slot holds a pointer to the method, the length and hash
+/// of its name, and two entries of the name index, which is stored across the slots (32 bytes
+/// on 64-bit Linux).
+///
+/// The members are private, and only declared so that pools can be statically allocated.
+struct golioth_rpc_slot
+{
+    /// @cond PRIVATE
+    const struct golioth_rpc_method *method;
+    size_t method_len;
+    uint32_t method_hash;
+    uint16_t index[2];
+    bool allocated;
+    /// @endcond
+};
+
 /// Initialize the RPC service
 ///
 /// @param client Golioth client handle
@@ -101,14 +172,24 @@ struct golioth_rpc *golioth_rpc_init(struct golioth_client *client);
 ///
 /// Cancel all registered RPCs and free the Golioth RPC service handle.
 ///
+/// Calls of deferred methods which were already accepted must be completed before calling
+/// this function. Otherwise nothing is deinitialized, and GOLIOTH_ERR_INVALID_STATE is returned.
+///
 /// @param grpc Golioth RPC service handle.
 ///
 /// @return GOLIOTH_OK - RPC service successfully deinitialized
+/// @return GOLIOTH_ERR_INVALID_STATE - Calls of deferred methods are not completed yet
 /// @return otherwise - Error deinitializing the RPC service
 enum golioth_status golioth_rpc_deinit(struct golioth_rpc *grpc);
 
 /// Register an RPC method
 ///
+/// The method runs on the Golioth client thread, which can't wait for blockwise uploads.
+/// Responses larger than the upload block size are handed to the worker threads of deferred
+/// methods, which send them blockwise. If no deferred method is registered, or
+/// CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS calls are in progress, they are sent with a single
+/// request instead, which may be too large for the path to Golioth.
+///
 /// @param grpc Golioth RPC service handle
 /// @param method The name of the method to register
 /// @param callback The callback to be invoked, when an RPC request with matching method name
@@ -122,6 +203,123 @@ enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
                                          golioth_rpc_cb_fn callback,
                                          void *callback_arg);
 
+/// Register a deferred RPC method
+///
+/// Unlike methods registered with @ref golioth_rpc_register, which run on the Golioth client
+/// thread, calls to deferred methods are queued to a pool of CONFIG_GOLIOTH_RPC_NUM_WORKERS
+/// worker threads, started by the first deferred registration.
+///
+/// Up to CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS deferred calls can be in progress at once, of
+/// which up to CONFIG_GOLIOTH_RPC_QUEUE_DEPTH can be waiting for a worker. Calls beyond these
+/// limits are answered right away with GOLIOTH_RPC_RESOURCE_EXHAUSTED.
+///
+/// @param grpc Golioth RPC service handle
+/// @param method The name of the method to register
+/// @param callback The callback to be invoked on a worker thread, when an RPC request with
+///         matching method name is received by the client.
+/// @param callback_arg User data forwarded to callback when invoked. Optional, can be NULL.
+///
+/// @return GOLIOTH_OK - RPC method successfully registered
+/// @return otherwise - Error registering RPC method or starting worker threads
+enum golioth_status golioth_rpc_register_deferred(struct golioth_rpc *grpc,
+                                                  const char *method,
+                                                  golioth_rpc_deferred_cb_fn callback,
+                                                  void *callback_arg);
+
+/// Complete a call to a deferred RPC method, and send its response
+///
+/// The call handle must not be used after this function returns.
+///
+/// Responses larger than the upload block size are sent blockwise. This function then blocks
+/// until the upload completes, so it must not be called from Golioth client callbacks.
+///
+/// @param call Handle passed to the @ref golioth_rpc_deferred_cb_fn callback
+/// @param status RPC status code to respond with
+///
+/// @return GOLIOTH_OK - Response enqueued for sending
+/// @return GOLIOTH_ERR_MEM_ALLOC - The response detail did not fit into
+///         CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN, no response was sent
+/// @return otherwise - Error sending the response
+enum golioth_status golioth_rpc_call_complete(struct golioth_rpc_call *call,
+                                              enum golioth_rpc_status status);
+
+/// Callback function type producing the detail of a streamed RPC response
+///
+/// Called repeatedly by @ref golioth_rpc_call_complete_streamed, each time with a fresh zcbor
+/// encode state inside of the detail map, with room for CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN
+/// bytes. Each call encodes the next entries of the detail map, which are sent before the
+/// callback is called again. An entry can't be split across calls.
+///
+/// @param response_detail_map zcbor encode state, inside of the RPC response detail map
+/// @param is_last Set to true once the last entries are encoded
+/// @param arg arg, unchanged from arg of @ref golioth_rpc_call_complete_streamed
+///
+/// @retval GOLIOTH_OK entries were encoded
+/// @return otherwise - the response is aborted
+typedef enum golioth_status (*golioth_rpc_stream_cb_fn)(zcbor_state_t *response_detail_map,
+                                                        bool *is_last,
+                                                        void *arg);
+
+/// Complete a call to a deferred RPC method, streaming a detail of any size
+///
+/// The response starts with the detail encoded into the response_detail_map of the
+/// @ref golioth_rpc_deferred_cb_fn callback, followed by the entries encoded by write_detail.
+/// It is sent blockwise as it is encoded, so that only one chunk of the response and one block
+/// are held in memory at a time.
+///
+/// This function blocks until the upload completes, so it must not be called from Golioth
+/// client callbacks. The call handle must not be used after this function returns.
+///
+/// Streaming needs indefinite-length CBOR maps. With CONFIG_ZCBOR_CANONICAL, the call is
+/// completed with GOLIOTH_RPC_UNIMPLEMENTED instead, and GOLIOTH_ERR_NOT_IMPLEMENTED returned.
+///
+/// @param call Handle passed to the @ref golioth_rpc_deferred_cb_fn callback
+/// @param status RPC status code to respond with, sent after the detail
+/// @param write_detail Callback encoding the rest of the detail
+/// @param arg User data forwarded to write_detail when invoked. Optional, can be NULL.
+///
+/// @return GOLIOTH_OK - Response sent
+/// @return otherwise - Error encoding or sending the response, or returned by write_detail
+enum golioth_status golioth_rpc_call_complete_streamed(struct golioth_rpc_call *call,
+                                                       enum golioth_rpc_status status,
+                                                       golioth_rpc_stream_cb_fn write_detail,
+                                                       void *arg);
+
+/// Initialize the RPC service, with methods registered in application memory
+///
+/// Unlike @ref golioth_rpc_init, which allocates room for CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS
+/// methods, the number of methods is only limited by the pool. Together with
+/// @ref golioth_rpc_register_table, this allows sizing RAM for methods per product, and
+/// CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS can then be 0.
+///
+/// @param client Golioth client handle
+/// @param slots Pool of slots, one per method. Must remain valid until @ref golioth_rpc_deinit.
+/// @param num_slots Number of slots in the pool
+///
+/// @return pointer to golioth rpc struct
+/// @return NULL - Error initializing RPC service
+struct golioth_rpc *golioth_rpc_init_with_pool(struct golioth_client *client,
+                                               struct golioth_rpc_slot *slots,
+                                               size_t num_slots);
+
+/// Register a table of RPC methods
+///
+/// The table is not copied, so it can be declared static const and live in ROM. Methods
+/// registered with @ref golioth_rpc_register allocate a copy of their description instead.
+/// Each method of the table still takes a @ref golioth_rpc_slot in RAM.
+///
+/// @param grpc Golioth RPC service handle
+/// @param table Methods to register. Must remain valid until @ref golioth_rpc_deinit.
+/// @param num_methods Number of methods in table
+///
+/// @return GOLIOTH_OK - RPC methods successfully registered
+/// @return GOLIOTH_ERR_MEM_ALLOC - Not enough free slots for all methods, none were registered
+/// @return GOLIOTH_ERR_NULL - The name or both callbacks of a method are NULL
+/// @return otherwise - Error registering RPC methods
+enum golioth_status golioth_rpc_register_table(struct golioth_rpc *grpc,
+                                               const struct golioth_rpc_method *table,
+                                               size_t num_methods);
+
 /// @}
 
 #ifdef __cplusplus
@@ -34,7 +34,8 @@ extern "C"
 /// 1. Application registers a callback to handle each setting.
 /// 2. This library observes for settings changes from cloud.
 /// 3. Cloud pushes settings changes to device.
-/// 4. For each setting, this library calls user-registered callbacks.
+/// 4. For each setting with a value different from the last one applied,
+///    this library calls user-registered callbacks.
 /// 5. This library reports status of applying settings to cloud.
 ///
 /// For each setting recieved, this library will check:
@@ -90,6 +91,108 @@ typedef enum golioth_settings_status (*golioth_string_setting_cb)(const char *ne
                                                                   size_t new_value_len,
                                                                   void *arg);
 
+/// Callback function type for golioth_settings_register_batch_cb
+///
+/// Called once per settings notification, after the callbacks of all settings in it.
+///
+/// @param changed_keys Names of the settings whose callbacks were called and returned
+///     GOLIOTH_SETTINGS_SUCCESS, as registered
+/// @param num_changed_keys Number of entries in changed_keys, never 0
+/// @param arg User's registered callback arg
+typedef void (*golioth_settings_batch_cb)(const char *const *changed_keys,
+                                          size_t num_changed_keys,
+                                          void *arg);
+
+/// Description of a setting, for @ref golioth_settings_register_table
+///
+/// Use the GOLIOTH_SETTINGS_* macros below to fill in the entries of a table.
+struct golioth_settings_entry
+{
+    /// The name of the setting
+    const char *name;
+    /// Type of the setting value, selects the callback
+    enum golioth_settings_value_type type;
+    /// Callback matching type
+    union
+    {
+        golioth_int_setting_cb int_cb;
+        golioth_bool_setting_cb bool_cb;
+        golioth_float_setting_cb float_cb;
+        golioth_string_setting_cb string_cb;
+    };
+    /// Minimum value, for type int only
+    int32_t int_min_val;
+    /// Maximum value, for type int only
+    int32_t int_max_val;
+    /// General-purpose user argument, forwarded as-is to the callback
+    void *cb_arg;
+};
+
+/// Table entry for a setting of type int with a range of values
+#define GOLIOTH_SETTINGS_INT_WITH_RANGE(_name, _min_val, _max_val, _cb, _cb_arg) \
+    {                                                                            \
+        .name = (_name),                                                         \
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_INT,                                 \
+        .int_cb = (_cb),                                                         \
+        .int_min_val = (_min_val),                                               \
+        .int_max_val = (_max_val),                                               \
+        .cb_arg = (_cb_arg),                                                     \
+    }
+
+/// Table entry for a setting of type int
+#define GOLIOTH_SETTINGS_INT(_name, _cb, _cb_arg) \
+    GOLIOTH_SETTINGS_INT_WITH_RANGE(_name, INT32_MIN, INT32_MAX, _cb, _cb_arg)
+
+/// Table entry for a setting of type bool
+#define GOLIOTH_SETTINGS_BOOL(_name, _cb, _cb_arg) \
+    {                                              \
+        .name = (_name),                           \
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_BOOL,  \
+        .bool_cb = (_cb),                          \
+        .cb_arg = (_cb_arg),                       \
+    }
+
+/// Table entry for a setting of type float
+#define GOLIOTH_SETTINGS_FLOAT(_name, _cb, _cb_arg) \
+    {                                               \
+        .name = (_name),                            \
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT,  \
+        .float_cb = (_cb),                          \
+        .cb_arg = (_cb_arg),                        \
+    }
+
+/// Table entry for a setting of type string
+#define GOLIOTH_SETTINGS_STRING(_name, _cb, _cb_arg) \
+    {                                                \
+        .name = (_name),                             \
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_STRING,  \
+        .string_cb = (_cb),                          \
+        .cb_arg = (_cb_arg),                         \
+    }
+
+/// RAM for one registered setting, see @ref golioth_settings_init_with_pool
+///
+/// Each setting needs a slot, including settings of a table registered with
+/// @ref golioth_settings_register_table. Besides the length and hash of the name and two
+/// entries of the name index, which is stored across the slots, a slot holds the last applied
+/// value, so that unchanged settings are skipped, and the description of a setting registered
+/// without a table (88 bytes on 64-bit Linux).
+///
+/// The members are private, and only declared so that pools can be statically allocated.
+struct golioth_settings_slot
+{
+    /// @cond PRIVATE
+    const struct golioth_settings_entry *entry;
+    struct golioth_settings_entry registered_entry;
+    uint64_t applied_value;
+    uint32_t applied_len;
+    size_t key_len;
+    uint32_t key_hash;
+    uint16_t index[2];
+    bool has_applied_value;
+    /// @endcond
+};
+
 /// Initialize the Settings service
 ///
 /// @param client Client handle
@@ -98,6 +201,24 @@ typedef enum golioth_settings_status (*golioth_string_setting_cb)(const char *ne
 /// @return NULL - Error initializing Settings service
 struct golioth_settings *golioth_settings_init(struct golioth_client *client);
 
+/// Initialize the Settings service, with settings registered in application memory
+///
+/// Unlike @ref golioth_settings_init, which allocates room for CONFIG_GOLIOTH_MAX_NUM_SETTINGS
+/// settings, the number of settings is only limited by the pool. Together with
+/// @ref golioth_settings_register_table, this allows sizing RAM for settings per product, and
+/// CONFIG_GOLIOTH_MAX_NUM_SETTINGS can then be 0.
+///
+/// @param client Client handle
+/// @param slots Pool of slots, one per setting. Must remain valid until
+///     @ref golioth_settings_deinit.
+/// @param num_slots Number of slots in the pool
+///
+/// @return pointer to golioth settings struct
+/// @return NULL - Error initializing Settings service
+struct golioth_settings *golioth_settings_init_with_pool(struct golioth_client *client,
+                                                         struct golioth_settings_slot *slots,
+                                                         size_t num_slots);
+
 /// Deinitialize the Settings service
 ///
 /// Cancel all registered settings and free the Golioth Settings service handle.
@@ -153,6 +274,84 @@ enum golioth_status golioth_settings_register_string(struct golioth_settings *se
                                                      const char *setting_name,
                                                      golioth_string_setting_cb callback,
                                                      void *callback_arg);
+
+/// Register a table of settings
+///
+/// The table is not copied, so it can be declared static const and live in ROM. Settings
+/// registered with golioth_settings_register_int() and similar functions keep a copy of
+/// their description in their slot instead. Each setting of the table still takes a
+/// @ref golioth_settings_slot in RAM.
+///
+/// @param settings Settings handle
+/// @param table Settings to register. Must remain valid until @ref golioth_settings_deinit.
+/// @param num_entries Number of entries in table
+///
+/// @retval GOLIOTH_OK Settings registered successfully
+/// @retval GOLIOTH_ERR_MEM_ALLOC Not enough free slots for all entries, none were registered
+/// @retval GOLIOTH_ERR_NULL The name or callback of an entry is NULL
+/// @retval GOLIOTH_ERR_INVALID_FORMAT The type of an entry is unknown
+enum golioth_status golioth_settings_register_table(struct golioth_settings *settings,
+                                                    const struct golioth_settings_entry *table,
+                                                    size_t num_entries);
+
+/// Register a callback for the set of settings changed by a notification
+///
+/// Setting callbacks are only called when the value differs from the last one they
+/// accepted, so a notification usually changes only some settings. Setting callbacks can
+/// store the new values, and leave applying them as one transaction to this callback.
+///
+/// @param settings Settings handle
+/// @param callback Callback function that will be called after each notification
+///     which changed at least one setting
+/// @param callback_arg General-purpose user argument, forwarded as-is to
+///     callback, can be NULL.
+///
+/// @retval GOLIOTH_OK Callback registered successfully
+/// @retval GOLIOTH_ERR_NULL callback is NULL
+enum golioth_status golioth_settings_register_batch_cb(struct golioth_settings *settings,
+                                                       golioth_settings_batch_cb callback,
+                                                       void *callback_arg);
+
+/// Storage for the last settings received from Golioth cloud.
+///
+/// When registered, the settings document received from the cloud is saved whenever its
+/// version changes, and the saved document is applied at boot before the device connects.
+/// Backends are provided by the application, e.g. a file on Linux, or NVS or Zephyr settings
+/// on embedded targets.
+struct golioth_settings_storage
+{
+    /// Store len bytes of settings, replacing previously stored settings
+    enum golioth_status (*save)(const void *data, size_t len, void *arg);
+    /// Load settings. On input *len is the size of data, on output the length loaded.
+    enum golioth_status (*load)(void *data, size_t *len, void *arg);
+    /// Arbitrary user argument passed to the functions above, can be NULL
+    void *arg;
+};
+
+/// Register storage used to apply the last known settings at boot.
+///
+/// The stored settings are loaded once, and applied to the settings registered so far, so
+/// this is best called after registering all settings. Settings registered afterwards get
+/// their value from the cloud. Settings received from the cloud later only call the callbacks
+/// of settings with a different value.
+///
+/// The storage struct is not copied and must remain valid. The storage remains registered
+/// when loading fails, e.g. as nothing was stored yet, and is used to save the next settings
+/// received from the cloud.
+///
+/// @param settings Settings handle
+/// @param storage Settings storage
+///
+/// @retval GOLIOTH_OK Storage registered and stored settings applied
+/// @retval GOLIOTH_ERR_MEM_ALLOC Failed to allocate CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN bytes
+///     for the cached settings
+/// @retval GOLIOTH_ERR_INVALID_FORMAT Stored settings are invalid and were discarded
+/// @retval GOLIOTH_ERR_INVALID_STATE Storage is already registered
+/// @retval GOLIOTH_ERR_NULL storage or one of its functions is NULL
+/// @retval Otherwise Error returned by the load function of the storage
+enum golioth_status golioth_settings_register_storage(
+    struct golioth_settings *settings,
+    const struct golioth_settings_storage *storage);
 /// @}
 
 #ifdef __cplusplus
@@ -115,7 +115,8 @@ void golioth_stream_blockwise_finish(struct blockwise_transfer *ctx);
 ///
 /// Call this function for each block. For each call you must increment the \p block_idx, adjust the
 /// \p block_buffer pointer and update the \p data_len. On the final block, set \p is_last to true.
-/// Block size is determined by the value of CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE.
+/// Block size is the value returned by \ref golioth_client_get_upload_block_size when \p ctx was
+/// created by \ref golioth_stream_blockwise_start.
 ///
 /// Create a new \p ctx by calling \ref golioth_stream_blockwise_start. The same \p ctx must be
 /// used for all blocks in a related upload. Generate a new \p ctx for each new upload operation.
@@ -128,8 +129,7 @@ void golioth_stream_blockwise_finish(struct blockwise_transfer *ctx);
 /// @param block_idx The index of the block being sent
 /// @param block_buffer The buffer where the data for this block is located
 /// @param data_len The actual length of data (in bytes) for this block. This should be equal to
-///        CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE for all blocks except for the final
-///        block, which may be shorter
+///        the block size for all blocks except for the final block, which may be shorter
 /// @param is_last Set this to true if this is the last block in the upload
 /// @param callback A callback that will be called after each block is sent (can be NULL)
 /// @param callback_arg An optional user provided argument that will be passed to \p callback (can
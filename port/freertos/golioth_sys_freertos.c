@@ -192,6 +192,11 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t thread)
     vTaskDelete((TaskHandle_t) thread);
 }
 
+golioth_sys_thread_id_t golioth_sys_thread_id(void)
+{
+    return (golioth_sys_thread_id_t) xTaskGetCurrentTaskHandle();
+}
+
 /*--------------------------------------------------
  * Misc
  *------------------------------------------------*/
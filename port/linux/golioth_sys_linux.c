@@ -379,6 +379,11 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t thread)
     // process exits.
 }
 
+golioth_sys_thread_id_t golioth_sys_thread_id(void)
+{
+    return (golioth_sys_thread_id_t) pthread_self();
+}
+
 /*--------------------------------------------------
  * Hash
  *------------------------------------------------*/
@@ -307,6 +307,11 @@ void golioth_sys_thread_destroy(golioth_sys_thread_t gthread)
     golioth_sys_free(thread);
 }
 
+golioth_sys_thread_id_t golioth_sys_thread_id(void)
+{
+    return (golioth_sys_thread_id_t) k_current_get();
+}
+
 /*--------------------------------------------------
  * Hash
  *------------------------------------------------*/
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Create a compressed OTA component from a firmware image.
+
+The image is compressed with heatshrink, and prefixed with the "GCMP" header by which the
+device recognizes compressed components. Upload the output as the OTA artifact instead of the
+image. See include/golioth/ota_decompress.h for the format.
+
+The window size must not exceed CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2 on the device.
+
+Usage: make_compressed.py [-w WINDOW_SZ2] [-l LOOKAHEAD_SZ2] <image> <component>
+"""
+
+import argparse
+import hashlib
+import struct
+
+MAGIC = b"GCMP"
+HEATSHRINK = 1
+# Number of candidate matches examined per position
+MAX_CHAIN = 64
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.bits = 0
+
+    def put(self, value, count):
+        for i in reversed(range(count)):
+            if self.bits == 0:
+                self.out.append(0)
+                self.bits = 8
+            self.bits -= 1
+            if value & (1 << i):
+                self.out[-1] |= 1 << self.bits
+
+
+def heatshrink_encode(data, window_sz2, lookahead_sz2):
+    window = 1 << window_sz2
+    lookahead = 1 << lookahead_sz2
+    backref_bits = 1 + window_sz2 + lookahead_sz2
+    chains = {}
+    w = BitWriter()
+
+    pos = 0
+    while pos < len(data):
+        best_len, best_dist = 0, 0
+        key = data[pos : pos + 3]
+        candidates = chains.get(key, []) if len(key) == 3 else []
+
+        for cand in reversed(candidates[-MAX_CHAIN:]):
+            if pos - cand > window:
+                break
+            length = 0
+            while (
+                length < lookahead
+                and pos + length < len(data)
+                and data[cand + length] == data[pos + length]
+            ):
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, pos - cand
+                if length == lookahead:
+                    break
+
+        step = 1
+        if best_len * 9 > backref_bits:
+            w.put(0, 1)
+            w.put(best_dist - 1, window_sz2)
+            w.put(best_len - 1, lookahead_sz2)
+            step = best_len
+        else:
+            w.put(1, 1)
+            w.put(data[pos], 8)
+
+        for p in range(pos, pos + step):
+            if p + 3 <= len(data):
+                chains.setdefault(data[p : p + 3], []).append(p)
+        pos += step
+
+    return bytes(w.out)
+
+
+def heatshrink_decode(data, size, window_sz2, lookahead_sz2):
+    """Reference implementation of the decoder, used to check the output"""
+    out = bytearray()
+    bitpos = 0
+
+    def get(count):
+        nonlocal bitpos
+        value = 0
+        for _ in range(count):
+            value = (value << 1) | ((data[bitpos // 8] >> (7 - bitpos % 8)) & 1)
+            bitpos += 1
+        return value
+
+    while len(out) < size:
+        if get(1):
+            out.append(get(8))
+        else:
+            offset = get(window_sz2) + 1
+            count = get(lookahead_sz2) + 1
+            for _ in range(count):
+                out.append(out[-offset] if offset <= len(out) else 0)
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-w", "--window", type=int, default=10, help="window size, as a power of 2")
+    parser.add_argument(
+        "-l", "--lookahead", type=int, default=4, help="lookahead size, as a power of 2"
+    )
+    parser.add_argument("image", help="firmware image")
+    parser.add_argument("component", help="output compressed component")
+    args = parser.parse_args()
+
+    if not 4 <= args.window <= 15 or not 3 <= args.lookahead < args.window:
+        raise SystemExit("Invalid window or lookahead size")
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    compressed = heatshrink_encode(image, args.window, args.lookahead)
+    if heatshrink_decode(compressed, len(image), args.window, args.lookahead) != image:
+        raise SystemExit("Internal error: compressed data does not reproduce the image")
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<BBBBI", HEATSHRINK, args.window, args.lookahead, 0, len(image))
+    out += hashlib.sha256(image).digest()
+    out += compressed
+
+    with open(args.component, "wb") as f:
+        f.write(out)
+
+    ratio = 100 * len(out) / max(len(image), 1)
+    print(f"{args.component}: {len(out)} bytes ({ratio:.1f}% of image)")
+
+
+if __name__ == "__main__":
+    main()
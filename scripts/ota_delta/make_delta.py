@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Create a delta (binary patch) OTA component from two firmware images.
+
+The patch transforms the source image, which must be the image currently running on the device,
+into the target image. Upload the patch as the OTA artifact instead of the target image. The
+device recognizes delta components by their "GDLT" magic. See include/golioth/ota_delta.h for
+the format.
+
+Matches are found and extended as in bsdiff: regions of the target that are similar to the source
+are stored as byte-wise differences, which are mostly zeros, and the rest as extra bytes. The body
+is then compressed with heatshrink, unless disabled with --no-compression.
+
+The window size must not exceed CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2 on the device.
+
+Usage: make_delta.py [-w WINDOW_SZ2] [-l LOOKAHEAD_SZ2] [--no-compression]
+                     <source image> <target image> <patch>
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ota_compress"))
+
+from make_compressed import HEATSHRINK, heatshrink_decode, heatshrink_encode  # noqa: E402
+
+MAGIC = b"GDLT"
+# Length of the substrings used to find matches between the images
+WINDOW = 8
+# Number of source positions indexed per substring
+MAX_CANDIDATES = 16
+
+
+def index_source(src):
+    index = {}
+    for pos in range(0, len(src) - WINDOW + 1):
+        candidates = index.setdefault(src[pos : pos + WINDOW], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(pos)
+    return index
+
+
+def match_len(a, a_pos, b, b_pos):
+    length = 0
+    limit = min(len(a) - a_pos, len(b) - b_pos)
+    # Compare in chunks first, which is much faster than byte by byte in Python
+    while length + 64 <= limit:
+        if a[a_pos + length : a_pos + length + 64] != b[b_pos + length : b_pos + length + 64]:
+            break
+        length += 64
+    while length < limit and a[a_pos + length] == b[b_pos + length]:
+        length += 1
+    return length
+
+
+def search(src, tgt, index, pos):
+    """Return (length, source position) of the longest exact match for tgt[pos:]"""
+    best_len, best_pos = 0, 0
+    for cand in index.get(tgt[pos : pos + WINDOW], ()):
+        length = match_len(src, cand, tgt, pos)
+        if length > best_len:
+            best_len, best_pos = length, cand
+    return best_len, best_pos
+
+
+def make_records(src, tgt):
+    """Return a list of (diff, extra, seek), following the main loop of bsdiff"""
+    index = index_source(src)
+    records = []
+
+    scan = length = pos = 0
+    last_scan = last_pos = last_offset = 0
+
+    while scan < len(tgt):
+        old_score = 0
+        scan += length
+        scsc = scan
+        while scan < len(tgt):
+            length, pos = search(src, tgt, index, scan)
+
+            while scsc < scan + length:
+                if scsc + last_offset < len(src) and src[scsc + last_offset] == tgt[scsc]:
+                    old_score += 1
+                scsc += 1
+
+            if (length == old_score and length != 0) or length > old_score + WINDOW:
+                break
+
+            if scan + last_offset < len(src) and src[scan + last_offset] == tgt[scan]:
+                old_score -= 1
+            scan += 1
+
+        if length == old_score and scan != len(tgt):
+            continue
+
+        # Extend the previous match forwards, and the new one backwards, as long as more than
+        # half of the bytes are the same
+        score = best = len_f = 0
+        i = 0
+        while last_scan + i < scan and last_pos + i < len(src):
+            if src[last_pos + i] == tgt[last_scan + i]:
+                score += 1
+            i += 1
+            if score * 2 - i > best * 2 - len_f:
+                best, len_f = score, i
+
+        len_b = 0
+        if scan < len(tgt):
+            score = best = 0
+            i = 1
+            while scan >= last_scan + i and pos >= i:
+                if src[pos - i] == tgt[scan - i]:
+                    score += 1
+                if score * 2 - i > best * 2 - len_b:
+                    best, len_b = score, i
+                i += 1
+
+        # Split overlapping extensions where the new match starts to be better
+        if last_scan + len_f > scan - len_b:
+            overlap = (last_scan + len_f) - (scan - len_b)
+            score = best = len_s = 0
+            for i in range(overlap):
+                if tgt[last_scan + len_f - overlap + i] == src[last_pos + len_f - overlap + i]:
+                    score += 1
+                if tgt[scan - len_b + i] == src[pos - len_b + i]:
+                    score -= 1
+                if score > best:
+                    best, len_s = score, i + 1
+            len_f += len_s - overlap
+            len_b -= len_s
+
+        diff = bytes((tgt[last_scan + i] - src[last_pos + i]) & 0xFF for i in range(len_f))
+        extra = tgt[last_scan + len_f : scan - len_b]
+        seek = (pos - len_b) - (last_pos + len_f) if scan < len(tgt) else 0
+        records.append((diff, extra, seek))
+
+        last_scan = scan - len_b
+        last_pos = pos - len_b
+        last_offset = pos - scan
+
+    return records
+
+
+def make_body(records):
+    body = bytearray()
+    for diff, extra, seek in records:
+        body += struct.pack("<IIi", len(diff), len(extra), seek)
+        body += diff
+        body += extra
+    return bytes(body)
+
+
+def apply_body(src, body, target_size):
+    """Reference implementation of the patcher, used to check the output"""
+    pos = 0
+    src_pos = 0
+    tgt = bytearray()
+    while len(tgt) < target_size:
+        diff_len, extra_len, seek = struct.unpack_from("<IIi", body, pos)
+        pos += 12
+        for i in range(diff_len):
+            tgt.append((src[src_pos + i] + body[pos + i]) & 0xFF)
+        pos += diff_len
+        src_pos += diff_len
+        tgt += body[pos : pos + extra_len]
+        pos += extra_len
+        src_pos += seek
+    if pos != len(body):
+        raise ValueError("Trailing data in patch")
+    return bytes(tgt)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-w", "--window", type=int, default=10, help="window size, as a power of 2")
+    parser.add_argument(
+        "-l", "--lookahead", type=int, default=4, help="lookahead size, as a power of 2"
+    )
+    parser.add_argument(
+        "--no-compression", action="store_true", help="store the patch body uncompressed"
+    )
+    parser.add_argument("source", help="image currently running on the device")
+    parser.add_argument("target", help="new image")
+    parser.add_argument("patch", help="output delta component")
+    args = parser.parse_args()
+
+    if not 4 <= args.window <= 15 or not 3 <= args.lookahead < args.window:
+        raise SystemExit("Invalid window or lookahead size")
+
+    with open(args.source, "rb") as f:
+        src = f.read()
+    with open(args.target, "rb") as f:
+        tgt = f.read()
+
+    body = make_body(make_records(src, tgt))
+    if apply_body(src, body, len(tgt)) != tgt:
+        raise SystemExit("Internal error: patch does not reproduce the target image")
+
+    out = bytearray(MAGIC)
+    if args.no_compression:
+        out += struct.pack("<BBBBI", 0, 0, 0, 0, len(tgt))
+        out += hashlib.sha256(tgt).digest()
+        out += body
+    else:
+        compressed = heatshrink_encode(body, args.window, args.lookahead)
+        if heatshrink_decode(compressed, len(body), args.window, args.lookahead) != body:
+            raise SystemExit("Internal error: compressed data does not reproduce the patch")
+
+        out += struct.pack("<BBBBI", HEATSHRINK, args.window, args.lookahead, 0, len(tgt))
+        out += hashlib.sha256(tgt).digest()
+        out += compressed
+
+    with open(args.patch, "wb") as f:
+        f.write(out)
+
+    ratio = 100 * len(out) / max(len(tgt), 1)
+    print(f"{args.patch}: {len(out)} bytes ({ratio:.1f}% of target)")
+
+
+if __name__ == "__main__":
+    main()
@@ -12,6 +12,7 @@
 #include <golioth/golioth_debug.h>
 #include "coap_client.h"
 #include "coap_blockwise.h"
+#include "golioth_util.h"
 
 LOG_TAG_DEFINE(coap_blockwise);
 
@@ -30,6 +31,8 @@ struct blockwise_transfer
     const char *path_prefix;
     char path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
     enum golioth_coap_request_type type;
+    /* Block size of uploads, selected when the upload is started */
+    uint8_t szx;
 
     enum golioth_status status;
     struct golioth_coap_rsp_code coap_rsp_code;
@@ -73,6 +76,186 @@ static void on_block_rcvd(struct golioth_client *client,
                           bool is_last,
                           void *arg);
 
+/* Path MTU discovery */
+
+#define PMTU_MIN_SZX BLOCKSIZE_TO_SZX(CONFIG_GOLIOTH_BLOCKWISE_PMTU_MIN_BLOCK_SIZE)
+
+_Static_assert(PMTU_MIN_SZX != -1,
+               "GOLIOTH_BLOCKWISE_PMTU_MIN_BLOCK_SIZE must be "
+               "one of the following: 16, 32, 64, 128, 256, 512, 1024");
+
+// Largest szx, not above max_block_size, for which a blockwise datagram fits in the path MTU.
+// Never below the minimum block size, unless max_block_size is smaller.
+static uint8_t pmtu_initial_szx(size_t max_block_size)
+{
+    uint8_t szx = BLOCKSIZE_TO_SZX(max_block_size);
+
+    while (szx > PMTU_MIN_SZX
+           && SZX_TO_BLOCKSIZE(szx) + CONFIG_GOLIOTH_BLOCKWISE_PACKET_OVERHEAD
+                  > CONFIG_GOLIOTH_BLOCKWISE_PATH_MTU)
+    {
+        szx--;
+    }
+
+    return szx;
+}
+
+// Unit of the block_idx of resumed downloads, as reported to end callbacks. Every block size that
+// may be selected is a multiple of it, so a download resumes at the exact offset where it stopped,
+// even if the block size changed meanwhile.
+#define RESUME_BLOCK_SIZE                                                                        \
+    (CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY                                                     \
+         ? min(SZX_TO_BLOCKSIZE(PMTU_MIN_SZX), CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE) \
+         : CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE)
+
+// szx for a transfer in one direction. Only new transfers probe again on a new session.
+static uint8_t pmtu_szx(struct golioth_client *client,
+                        struct golioth_coap_pmtu_dir *dir,
+                        size_t max_block_size,
+                        bool new_transfer)
+{
+    if (!CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY)
+    {
+        return BLOCKSIZE_TO_SZX(max_block_size);
+    }
+
+    struct golioth_coap_pmtu *pmtu = golioth_coap_client_get_pmtu(client);
+
+    golioth_sys_mutex_lock(pmtu->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (!dir->probed || (new_transfer && dir->gen != pmtu->session_gen))
+    {
+        dir->szx = pmtu_initial_szx(max_block_size);
+        dir->gen = pmtu->session_gen;
+        dir->acked = 0;
+        dir->probed = true;
+    }
+
+    uint8_t szx = dir->szx;
+
+    golioth_sys_mutex_unlock(pmtu->mutex);
+
+    return szx;
+}
+
+static uint8_t pmtu_download_szx(struct golioth_client *client, bool new_transfer)
+{
+    return pmtu_szx(client,
+                    &golioth_coap_client_get_pmtu(client)->download,
+                    CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE,
+                    new_transfer);
+}
+
+static uint8_t pmtu_upload_szx(struct golioth_client *client)
+{
+    return pmtu_szx(client,
+                    &golioth_coap_client_get_pmtu(client)->upload,
+                    CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE,
+                    true);
+}
+
+// Halve the block size of a transfer after a lost block, keeping the offset of block_idx. The
+// session szx is lowered as well, so that later transfers start at the smaller size.
+//
+// Returns false if the block size is already at the minimum.
+static bool pmtu_downgrade(struct golioth_client *client,
+                           struct golioth_coap_pmtu_dir *dir,
+                           size_t *block_size,
+                           uint32_t *block_idx)
+{
+    int szx = BLOCKSIZE_TO_SZX(*block_size);
+
+    if (!CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY || szx <= PMTU_MIN_SZX)
+    {
+        return false;
+    }
+
+    szx--;
+    *block_idx <<= 1;
+    *block_size = SZX_TO_BLOCKSIZE(szx);
+
+    struct golioth_coap_pmtu *pmtu = golioth_coap_client_get_pmtu(client);
+
+    golioth_sys_mutex_lock(pmtu->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (dir->szx > szx)
+    {
+        dir->szx = szx;
+    }
+    dir->acked = 0;
+
+    golioth_sys_mutex_unlock(pmtu->mutex);
+
+    GLTH_LOGW(TAG, "Block lost, reducing block size to %zu", *block_size);
+
+    return true;
+}
+
+// Count a block transferred at block_size. After enough blocks in a row at the session size, the
+// next size up is tried by transfers started from then on, so that a session recovers from losses
+// that were not caused by the block size.
+static void pmtu_block_acked(struct golioth_client *client,
+                             struct golioth_coap_pmtu_dir *dir,
+                             size_t block_size,
+                             size_t max_block_size)
+{
+    if (!CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY)
+    {
+        return;
+    }
+
+    struct golioth_coap_pmtu *pmtu = golioth_coap_client_get_pmtu(client);
+    uint8_t szx = BLOCKSIZE_TO_SZX(block_size);
+    bool upgraded = false;
+
+    golioth_sys_mutex_lock(pmtu->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (dir->szx == szx && szx < BLOCKSIZE_TO_SZX(max_block_size)
+        && ++dir->acked >= CONFIG_GOLIOTH_BLOCKWISE_PMTU_UPGRADE_BLOCKS)
+    {
+        dir->szx++;
+        dir->acked = 0;
+        upgraded = true;
+    }
+
+    golioth_sys_mutex_unlock(pmtu->mutex);
+
+    if (upgraded)
+    {
+        GLTH_LOGI(TAG, "Increasing block size to %zu", SZX_TO_BLOCKSIZE(szx + 1));
+    }
+}
+
+size_t golioth_client_get_download_block_size(struct golioth_client *client)
+{
+    if (NULL == client)
+    {
+        return 0;
+    }
+
+    return SZX_TO_BLOCKSIZE(pmtu_download_szx(client, false));
+}
+
+size_t golioth_client_get_download_resume_block_size(struct golioth_client *client)
+{
+    if (NULL == client)
+    {
+        return 0;
+    }
+
+    return RESUME_BLOCK_SIZE;
+}
+
+size_t golioth_client_get_upload_block_size(struct golioth_client *client)
+{
+    if (NULL == client)
+    {
+        return 0;
+    }
+
+    return SZX_TO_BLOCKSIZE(pmtu_upload_szx(client));
+}
+
 // Function to initialize the blockwise_transfer structure
 static int blockwise_transfer_init(struct blockwise_transfer *ctx,
                                    struct golioth_client *client,
@@ -213,6 +396,22 @@ static enum golioth_status process_blockwise_uploads(struct golioth_client *clie
         {
             /* Only advance block_idx if block was uploaded successfully */
             ctx->block_idx++;
+
+            pmtu_block_acked(client,
+                             &golioth_coap_client_get_pmtu(client)->upload,
+                             ctx->block_size,
+                             CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE);
+        }
+        else if (status == GOLIOTH_ERR_TIMEOUT
+                 && pmtu_downgrade(client,
+                                   &golioth_coap_client_get_pmtu(client)->upload,
+                                   &ctx->block_size,
+                                   &ctx->block_idx))
+        {
+            /* Read and send the lost block again, at the same offset with a smaller size */
+            ctx->negotiated_blocksize_szx = BLOCKSIZE_TO_SZX(ctx->block_size);
+            ctx->is_last = false;
+            status = GOLIOTH_OK;
         }
     }
     return status;
@@ -256,11 +455,11 @@ enum golioth_status golioth_blockwise_post(struct golioth_client *client,
 
     ctx.status = GOLIOTH_ERR_FAIL;
     ctx.is_last = false;
-    ctx.block_size = CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE;
+    ctx.negotiated_blocksize_szx = pmtu_upload_szx(client);
+    ctx.block_size = SZX_TO_BLOCKSIZE(ctx.negotiated_blocksize_szx);
     ctx.block_idx = 0;
     ctx.read_cb = read_cb;
     ctx.callback_arg = callback_arg;
-    ctx.negotiated_blocksize_szx = BLOCKSIZE_TO_SZX(CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE);
 
     while (!ctx.is_last)
     {
@@ -327,6 +526,7 @@ struct blockwise_transfer *golioth_blockwise_upload_start(struct golioth_client
         goto finish_with_ctx;
     }
     ctx->type = GOLIOTH_COAP_REQUEST_POST_BLOCK;
+    ctx->szx = pmtu_upload_szx(client);
 
     return ctx;
 
@@ -365,6 +565,11 @@ enum golioth_status golioth_blockwise_upload_block(struct blockwise_transfer *ct
         return GOLIOTH_ERR_NULL;
     }
 
+    if (block_len > SZX_TO_BLOCKSIZE(ctx->szx))
+    {
+        return GOLIOTH_ERR_INVALID_BLOCK_SIZE;
+    }
+
     struct get_block_ctx *rsp_ctx = NULL;
     coap_get_block_cb_fn rsp_cb = NULL;
     if (is_last && NULL != get_cb && NULL != end_cb)
@@ -389,7 +594,7 @@ enum golioth_status golioth_blockwise_upload_block(struct blockwise_transfer *ct
         is_last,
         ctx->content_type,
         block_idx,
-        BLOCKSIZE_TO_SZX(CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE),
+        ctx->szx,
         block_buffer,
         block_len,
         set_cb,
@@ -404,6 +609,18 @@ enum golioth_status golioth_blockwise_upload_block(struct blockwise_transfer *ct
 static enum golioth_status download_single_block(struct golioth_client *client,
                                                  struct get_block_ctx *ctx);
 
+// block_idx reported to end_cb. Downloads report it in units of the resume block size, as the
+// block size of the transfer may differ from the one it is resumed with.
+static uint32_t end_block_idx(const struct get_block_ctx *ctx)
+{
+    if (ctx->post_response)
+    {
+        return ctx->block_idx;
+    }
+
+    return ctx->block_idx * (ctx->block_size / RESUME_BLOCK_SIZE);
+}
+
 // Blockwise download's internal callback function that the COAP client calls
 static void on_block_rcvd(struct golioth_client *client,
                           enum golioth_status status,
@@ -419,8 +636,33 @@ static void on_block_rcvd(struct golioth_client *client,
     assert(payload_size <= CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
     struct get_block_ctx *ctx = arg;
 
+    if (GOLIOTH_ERR_TIMEOUT == status && !ctx->post_response
+        && pmtu_downgrade(client,
+                          &golioth_coap_client_get_pmtu(client)->download,
+                          &ctx->block_size,
+                          &ctx->block_idx))
+    {
+        /* Request the lost block again, at the same offset with a smaller size */
+        status = download_single_block(client, ctx);
+        if (GOLIOTH_OK != status)
+        {
+            ctx->end_cb(client, status, NULL, path, end_block_idx(ctx), ctx->callback_arg);
+
+            golioth_sys_free(ctx);
+        }
+        return;
+    }
+
     if (GOLIOTH_OK == status)
     {
+        if (!ctx->post_response)
+        {
+            pmtu_block_acked(client,
+                             &golioth_coap_client_get_pmtu(client)->download,
+                             ctx->block_size,
+                             CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE);
+        }
+
         status = ctx->get_cb(client,
                              path,
                              ctx->block_idx,
@@ -440,7 +682,7 @@ static void on_block_rcvd(struct golioth_client *client,
     }
     else if (is_last || GOLIOTH_OK != status)
     {
-        ctx->end_cb(client, status, coap_rsp_code, path, ctx->block_idx, ctx->callback_arg);
+        ctx->end_cb(client, status, coap_rsp_code, path, end_block_idx(ctx), ctx->callback_arg);
 
         golioth_sys_free(ctx);
     }
@@ -450,7 +692,7 @@ static void on_block_rcvd(struct golioth_client *client,
         status = download_single_block(client, ctx);
         if (GOLIOTH_OK != status)
         {
-            ctx->end_cb(client, status, NULL, path, ctx->block_idx, ctx->callback_arg);
+            ctx->end_cb(client, status, NULL, path, end_block_idx(ctx), ctx->callback_arg);
 
             golioth_sys_free(ctx);
         }
@@ -516,12 +758,22 @@ enum golioth_status golioth_blockwise_get(struct golioth_client *client,
     }
     ctx->transfer_ctx.type = GOLIOTH_COAP_REQUEST_GET_BLOCK;
 
-    ctx->block_size = CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE;
+    /* Resume with the largest block size, not above the current one, that has a boundary at the
+     * offset where the download stopped */
+    size_t offset = (size_t) block_idx * RESUME_BLOCK_SIZE;
+    uint8_t szx = pmtu_download_szx(client, 0 == block_idx);
+
+    while (offset % SZX_TO_BLOCKSIZE(szx) != 0)
+    {
+        szx--;
+    }
+
+    ctx->block_size = SZX_TO_BLOCKSIZE(szx);
     ctx->post_response = false;
     ctx->get_cb = block_cb;
     ctx->end_cb = end_cb;
     ctx->callback_arg = callback_arg;
-    ctx->block_idx = block_idx;
+    ctx->block_idx = offset / ctx->block_size;
 
     return download_single_block(client, ctx);
 }
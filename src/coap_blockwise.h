@@ -55,7 +55,9 @@ enum golioth_status golioth_blockwise_upload_block(struct blockwise_transfer *ct
  * This function is non-blocking. If the return value is GOLIOTH_OK, then
  * end_cb will be called exactly one time. block_cb may be called 0 or more
  * times. Blockwise downloads may be resumed by passing in a non-zero value
- * for block_idx.
+ * for block_idx. block_idx reported to end_cb, and passed to resume, is in
+ * units of golioth_client_get_download_resume_block_size(), while block_cb
+ * gets the index in units of the block size of each block.
  */
 enum golioth_status golioth_blockwise_get(struct golioth_client *client,
                                           const char *path_prefix,
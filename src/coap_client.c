@@ -111,6 +111,8 @@ static enum golioth_status golioth_coap_client_set_internal(
     const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
     const char *path_prefix,
     const char *path,
+    const uint8_t *header,
+    size_t header_size,
     const uint8_t *payload,
     size_t payload_size,
     enum golioth_coap_request_type type,
@@ -139,21 +141,28 @@ static enum golioth_status golioth_coap_client_set_internal(
         return GOLIOTH_ERR_INVALID_FORMAT;
     }
 
-    if (payload_size > 0)
+    if (header_size + payload_size > 0)
     {
         // We will allocate memory and copy the payload
         // to avoid payload lifetime and thread-safety issues.
         //
         // This memory will be free'd by the CoAP thread after handling the request,
         // or in this function if we fail to enqueue the request.
-        request_payload = (uint8_t *) golioth_sys_malloc(payload_size);
+        request_payload = (uint8_t *) golioth_sys_malloc(header_size + payload_size);
         if (!request_payload)
         {
             GLTH_LOGE(TAG, "Payload alloc failure");
             return GOLIOTH_ERR_MEM_ALLOC;
         }
-        memset(request_payload, 0, payload_size);
-        memcpy(request_payload, payload, payload_size);
+        if (header_size > 0)
+        {
+            memcpy(request_payload, header, header_size);
+        }
+        if (payload_size > 0)
+        {
+            memcpy(request_payload + header_size, payload, payload_size);
+        }
+        payload_size += header_size;
     }
 
     uint64_t ageout_ms = GOLIOTH_SYS_WAIT_FOREVER;
@@ -221,6 +230,8 @@ enum golioth_status golioth_coap_client_post(struct golioth_client *client,
                                             token,
                                             path_prefix,
                                             path,
+                                            NULL,
+                                            0,
                                             payload,
                                             payload_size,
                                             GOLIOTH_COAP_REQUEST_POST,
@@ -248,6 +259,39 @@ enum golioth_status golioth_coap_client_set(struct golioth_client *client,
                                             token,
                                             path_prefix,
                                             path,
+                                            NULL,
+                                            0,
+                                            payload,
+                                            payload_size,
+                                            GOLIOTH_COAP_REQUEST_POST,
+                                            &params,
+                                            timeout_s);
+}
+
+enum golioth_status golioth_coap_client_set_with_header(struct golioth_client *client,
+                                                        const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                        const char *path_prefix,
+                                                        const char *path,
+                                                        enum golioth_content_type content_type,
+                                                        const uint8_t *header,
+                                                        size_t header_size,
+                                                        const uint8_t *payload,
+                                                        size_t payload_size,
+                                                        golioth_set_cb_fn callback,
+                                                        void *callback_arg,
+                                                        int32_t timeout_s)
+{
+    struct golioth_coap_post_params params = {
+        .content_type = content_type,
+        .callback_set = callback,
+        .arg = callback_arg,
+    };
+    return golioth_coap_client_set_internal(client,
+                                            token,
+                                            path_prefix,
+                                            path,
+                                            header,
+                                            header_size,
                                             payload,
                                             payload_size,
                                             GOLIOTH_COAP_REQUEST_POST,
@@ -285,6 +329,8 @@ enum golioth_status golioth_coap_client_set_block(struct golioth_client *client,
                                             token,
                                             path_prefix,
                                             path,
+                                            NULL,
+                                            0,
                                             payload,
                                             payload_size,
                                             GOLIOTH_COAP_REQUEST_POST_BLOCK,
@@ -432,6 +478,43 @@ enum golioth_status golioth_coap_client_get(struct golioth_client *client,
                                             timeout_s);
 }
 
+enum golioth_status golioth_coap_client_get_etag(struct golioth_client *client,
+                                                 const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                 const char *path_prefix,
+                                                 const char *path,
+                                                 enum golioth_content_type content_type,
+                                                 const uint8_t *etag,
+                                                 size_t etag_len,
+                                                 coap_get_etag_cb_fn callback,
+                                                 void *arg,
+                                                 int32_t timeout_s)
+{
+    struct golioth_coap_get_params params = {
+        .content_type = content_type,
+        .etag_callback = callback,
+        .arg = arg,
+    };
+
+    if (etag_len > sizeof(params.etag))
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    if (etag_len > 0)
+    {
+        memcpy(params.etag, etag, etag_len);
+        params.etag_len = etag_len;
+    }
+
+    return golioth_coap_client_get_internal(client,
+                                            token,
+                                            path_prefix,
+                                            path,
+                                            GOLIOTH_COAP_REQUEST_GET,
+                                            &params,
+                                            timeout_s);
+}
+
 enum golioth_status golioth_coap_client_get_block(struct golioth_client *client,
                                                   const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
                                                   const char *path_prefix,
@@ -600,6 +683,12 @@ void golioth_coap_client_cancel_observations_by_prefix(struct golioth_client *cl
     golioth_cancel_all_observations_by_prefix(client, prefix);
 }
 
+void golioth_coap_client_cancel_observation(struct golioth_client *client,
+                                            const uint8_t token[GOLIOTH_COAP_TOKEN_LEN])
+{
+    golioth_cancel_observation(client, token);
+}
+
 void golioth_client_register_event_callback(struct golioth_client *client,
                                             golioth_client_event_cb_fn callback,
                                             void *arg)
@@ -626,6 +715,18 @@ golioth_sys_thread_t golioth_client_get_thread(struct golioth_client *client)
     return client->coap_thread_handle;
 }
 
+struct golioth_coap_pmtu *golioth_coap_client_get_pmtu(struct golioth_client *client)
+{
+    return &client->pmtu;
+}
+
+void golioth_coap_client_pmtu_new_session(struct golioth_client *client)
+{
+    golioth_sys_mutex_lock(client->pmtu.mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    client->pmtu.session_gen++;
+    golioth_sys_mutex_unlock(client->pmtu.mutex);
+}
+
 bool golioth_client_wait_for_connect(struct golioth_client *client, int timeout_ms)
 {
     const uint32_t poll_period_ms = 100;
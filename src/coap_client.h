@@ -15,6 +15,9 @@
 
 #define GOLIOTH_COAP_TOKEN_LEN 8
 
+/// Maximum length of an ETag option, per RFC 7252
+#define GOLIOTH_COAP_MAX_ETAG_LEN 8
+
 #define BLOCKSIZE_TO_SZX(blockSize) \
     ((blockSize == 16)         ? 0  \
          : (blockSize == 32)   ? 1  \
@@ -59,6 +62,23 @@ typedef void (*coap_get_block_cb_fn)(struct golioth_client *client,
                                      size_t payload_size,
                                      bool is_last,
                                      void *arg);
+/// Internal callback for conditional get requests
+///
+/// Same as @ref golioth_get_cb_fn, with the ETag option of the response. When the server
+/// validates the ETag sent in the request, \p coap_rsp_code is 2.03 (Valid) and there is no
+/// payload.
+///
+/// @param etag The ETag option of the response. Can be NULL.
+/// @param etag_len Length of etag, in bytes. 0 if the response has no ETag option.
+typedef void (*coap_get_etag_cb_fn)(struct golioth_client *client,
+                                    enum golioth_status status,
+                                    const struct golioth_coap_rsp_code *coap_rsp_code,
+                                    const char *path,
+                                    const uint8_t *etag,
+                                    size_t etag_len,
+                                    const uint8_t *payload,
+                                    size_t payload_size,
+                                    void *arg);
 struct golioth_coap_post_params
 {
     enum golioth_content_type content_type;
@@ -97,7 +117,12 @@ struct golioth_coap_get_params
 {
     enum golioth_content_type content_type;
     golioth_get_cb_fn callback;
+    // If set, called instead of callback
+    coap_get_etag_cb_fn etag_callback;
     void *arg;
+    // ETag sent in the request, to make it conditional. Not sent if etag_len is 0.
+    uint8_t etag[GOLIOTH_COAP_MAX_ETAG_LEN];
+    uint8_t etag_len;
 };
 
 struct golioth_coap_get_block_params
@@ -169,6 +194,35 @@ struct golioth_coap_observe_info
     struct golioth_coap_request_msg req;
 };
 
+/// Block size selected for one direction of blockwise transfers
+struct golioth_coap_pmtu_dir
+{
+    /// Value of golioth_coap_pmtu.session_gen when szx was last probed
+    uint32_t gen;
+    /// Number of blocks acknowledged in a row at szx since it last changed
+    uint32_t acked;
+    uint8_t szx;
+    bool probed;
+};
+
+/// Path MTU state of the client, used by blockwise transfers to select the largest
+/// block size that fits in a single datagram on the current session.
+struct golioth_coap_pmtu
+{
+    /// Protects the fields below, which are used by the client thread and by application
+    /// threads starting transfers
+    golioth_sys_mutex_t mutex;
+    /// Incremented by the client thread each time a new session is started
+    uint32_t session_gen;
+    struct golioth_coap_pmtu_dir download;
+    struct golioth_coap_pmtu_dir upload;
+};
+
+/// Make transfers started from now on probe their block size again.
+///
+/// Called by the client thread each time a new session is started.
+void golioth_coap_client_pmtu_new_session(struct golioth_client *client);
+
 /// Create the mutex that makes CoAP token generation thread-safe.
 void golioth_coap_token_mutex_create(void);
 
@@ -201,6 +255,23 @@ enum golioth_status golioth_coap_client_set(struct golioth_client *client,
                                             void *callback_arg,
                                             int32_t timeout_s);
 
+/// Same as @ref golioth_coap_client_set, with the payload made of header followed by payload.
+///
+/// Both are copied into a single request buffer, so callers can prepend a small encoded
+/// header (e.g. the head of a CBOR string) without assembling the payload themselves.
+enum golioth_status golioth_coap_client_set_with_header(struct golioth_client *client,
+                                                        const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                        const char *path_prefix,
+                                                        const char *path,
+                                                        enum golioth_content_type content_type,
+                                                        const uint8_t *header,
+                                                        size_t header_size,
+                                                        const uint8_t *payload,
+                                                        size_t payload_size,
+                                                        golioth_set_cb_fn callback,
+                                                        void *callback_arg,
+                                                        int32_t timeout_s);
+
 enum golioth_status golioth_coap_client_set_block(struct golioth_client *client,
                                                   const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
                                                   const char *path_prefix,
@@ -233,6 +304,18 @@ enum golioth_status golioth_coap_client_get(struct golioth_client *client,
                                             void *callback_arg,
                                             int32_t timeout_s);
 
+/* Get, with an optional ETag in the request, and the ETag of the response passed to callback */
+enum golioth_status golioth_coap_client_get_etag(struct golioth_client *client,
+                                                 const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                 const char *path_prefix,
+                                                 const char *path,
+                                                 enum golioth_content_type content_type,
+                                                 const uint8_t *etag,
+                                                 size_t etag_len,
+                                                 coap_get_etag_cb_fn callback,
+                                                 void *callback_arg,
+                                                 int32_t timeout_s);
+
 enum golioth_status golioth_coap_client_get_block(struct golioth_client *client,
                                                   const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
                                                   const char *path_prefix,
@@ -275,6 +358,10 @@ void golioth_coap_client_cancel_all_observations(struct golioth_client *client);
 void golioth_coap_client_cancel_observations_by_prefix(struct golioth_client *client,
                                                        const char *prefix);
 
+void golioth_coap_client_cancel_observation(struct golioth_client *client,
+                                            const uint8_t token[GOLIOTH_COAP_TOKEN_LEN]);
+
 /// Getters, for internal SDK code to access data within the
 /// coap client struct.
 golioth_sys_thread_t golioth_coap_client_get_thread(struct golioth_client *client);
+struct golioth_coap_pmtu *golioth_coap_client_get_pmtu(struct golioth_client *client);
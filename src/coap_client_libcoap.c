@@ -13,7 +13,9 @@
 #include <golioth/golioth_sys.h>
 #include "coap_client.h"
 #include "golioth_util.h"
+#include "log_internal.h"
 #include "mbox.h"
+#include "ota_decompress.h"
 #include "coap_client_libcoap.h"
 
 LOG_TAG_DEFINE(golioth_coap_client_libcoap);
@@ -177,7 +179,22 @@ static coap_response_t coap_response_handler(coap_session_t *session,
         {
             if (req->type == GOLIOTH_COAP_REQUEST_GET)
             {
-                if (req->get.callback)
+                if (req->get.etag_callback)
+                {
+                    coap_opt_iterator_t opt_iter;
+                    coap_opt_t *etag_opt = coap_check_option(received, COAP_OPTION_ETAG, &opt_iter);
+
+                    req->get.etag_callback(client,
+                                           status,
+                                           golioth_ptr_to_rsp_code(status, &coap_rsp_code),
+                                           req->path,
+                                           etag_opt ? coap_opt_value(etag_opt) : NULL,
+                                           etag_opt ? coap_opt_length(etag_opt) : 0,
+                                           data,
+                                           data_len,
+                                           req->get.arg);
+                }
+                else if (req->get.callback)
                 {
                     req->get.callback(client,
                                       status,
@@ -205,7 +222,7 @@ static coap_response_t coap_response_handler(coap_session_t *session,
                           ", offset 0x%08" PRIX32,
                           (uint32_t) req->get_block.block_index,
                           (uint32_t) opt_block_index,
-                          opt_block_index * 1024);
+                          (uint32_t) (opt_block_index * req->get_block.block_size));
                 GLTH_LOG_BUFFER_HEXDUMP(TAG,
                                         data,
                                         min(32, data_len),
@@ -543,6 +560,10 @@ static void golioth_coap_get(struct golioth_coap_request_msg *req, coap_session_
     }
 
     coap_add_token(req_pdu, GOLIOTH_COAP_TOKEN_LEN, req->token);
+    if (req->get.etag_len > 0)
+    {
+        coap_add_option(req_pdu, COAP_OPTION_ETAG, req->get.etag_len, req->get.etag);
+    }
     golioth_coap_add_path(req_pdu, req->path_prefix, req->path);
     golioth_coap_add_accept(req_pdu, req->get.content_type);
     coap_send(session, req_pdu);
@@ -706,6 +727,18 @@ static enum golioth_status add_observation(struct golioth_coap_request_msg *req,
 }
 
 
+static void cancel_observation(struct golioth_client *client,
+                               struct golioth_coap_observe_info *obs_info)
+{
+    obs_info->in_use = false;
+    golioth_coap_client_observe_release(client,
+                                        obs_info->req.token,
+                                        obs_info->req.path_prefix,
+                                        obs_info->req.path,
+                                        obs_info->req.observe.content_type,
+                                        NULL);
+}
+
 void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix)
 {
     struct golioth_coap_observe_info *obs_info = NULL;
@@ -719,13 +752,20 @@ void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, co
                 continue;
             }
 
-            obs_info->in_use = false;
-            golioth_coap_client_observe_release(client,
-                                                obs_info->req.token,
-                                                obs_info->req.path_prefix,
-                                                obs_info->req.path,
-                                                obs_info->req.observe.content_type,
-                                                NULL);
+            cancel_observation(client, obs_info);
+        }
+    }
+}
+
+void golioth_cancel_observation(struct golioth_client *client,
+                                const uint8_t token[GOLIOTH_COAP_TOKEN_LEN])
+{
+    for (int i = 0; i < CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS; i++)
+    {
+        struct golioth_coap_observe_info *obs_info = &client->observations[i];
+        if (obs_info->in_use && memcmp(token, obs_info->req.token, GOLIOTH_COAP_TOKEN_LEN) == 0)
+        {
+            cancel_observation(client, obs_info);
         }
     }
 }
@@ -1083,7 +1123,19 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
         // TODO - simplify, put callback directly in request which removes if/else branches
         enum golioth_status status = GOLIOTH_ERR_TIMEOUT;
 
-        if (request_msg.type == GOLIOTH_COAP_REQUEST_GET && request_msg.get.callback)
+        if (request_msg.type == GOLIOTH_COAP_REQUEST_GET && request_msg.get.etag_callback)
+        {
+            request_msg.get.etag_callback(client,
+                                          status,
+                                          NULL,
+                                          request_msg.path,
+                                          NULL,
+                                          0,
+                                          NULL,
+                                          0,
+                                          request_msg.get.arg);
+        }
+        else if (request_msg.type == GOLIOTH_COAP_REQUEST_GET && request_msg.get.callback)
         {
             request_msg.get
                 .callback(client, status, NULL, request_msg.path, NULL, 0, request_msg.get.arg);
@@ -1128,7 +1180,7 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client,
                                             status,
                                             NULL,
                                             request_msg.path,
-                                            request_msg.post_block.block_szx,
+                                            SZX_TO_BLOCKSIZE(request_msg.post_block.block_szx),
                                             request_msg.post_block.arg);
         }
         else if (request_msg.type == GOLIOTH_COAP_REQUEST_DELETE && request_msg.delete.callback)
@@ -1219,6 +1271,9 @@ static void golioth_coap_client_thread(void *arg)
             goto cleanup;
         }
 
+        // Block sizes are probed again for transfers started on the new session
+        golioth_coap_client_pmtu_new_session(client);
+
         // Seed the session token generator
         //
         // We should still do this even though Golioth generates CoAP tokens outside of libcoap.
@@ -1334,6 +1389,17 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
     golioth_sys_sem_give(new_client->run_sem);
 
     golioth_coap_token_mutex_create();
+    golioth_log_batch_init();
+    golioth_log_deferred_init();
+    golioth_log_governor_init();
+    ota_decompress_init();
+
+    new_client->pmtu.mutex = golioth_sys_mutex_create();
+    if (!new_client->pmtu.mutex)
+    {
+        GLTH_LOGE(TAG, "Failed to create PMTU mutex");
+        goto error;
+    }
 
     new_client->request_queue = golioth_mbox_create(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
                                                     sizeof(struct golioth_coap_request_msg));
@@ -1439,6 +1505,10 @@ void golioth_client_destroy(struct golioth_client *client)
         purge_request_mbox(client->request_queue);
         golioth_mbox_destroy(client->request_queue);
     }
+    if (client->pmtu.mutex)
+    {
+        golioth_sys_mutex_destroy(client->pmtu.mutex);
+    }
     if (client->run_sem)
     {
         golioth_sys_sem_destroy(client->run_sem);
@@ -15,10 +15,14 @@ struct golioth_client
     struct golioth_client_config config;
     struct golioth_coap_request_msg *pending_req;
     struct golioth_coap_observe_info observations[CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS];
+    struct golioth_coap_pmtu pmtu;
     golioth_client_event_cb_fn event_callback;
     void *event_callback_arg;
 };
 
 void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix);
 
+void golioth_cancel_observation(struct golioth_client *client,
+                                const uint8_t token[GOLIOTH_COAP_TOKEN_LEN]);
+
 void golioth_cancel_all_observations(struct golioth_client *client);
@@ -8,7 +8,9 @@
 #include <golioth/golioth_sys.h>
 #include "coap_client.h"
 #include "golioth_util.h"
+#include "log_internal.h"
 #include "mbox.h"
+#include "ota_decompress.h"
 
 #include "coap_client_zephyr.h"
 #include "pathv.h"
@@ -238,7 +240,19 @@ static int golioth_coap_cb(struct golioth_req_rsp *rsp)
         case GOLIOTH_COAP_REQUEST_OBSERVE_RELEASE:
             break;
         case GOLIOTH_COAP_REQUEST_GET:
-            if (req->get.callback)
+            if (req->get.etag_callback)
+            {
+                req->get.etag_callback(client,
+                                       rsp->status,
+                                       golioth_ptr_to_rsp_code(rsp),
+                                       req->path,
+                                       rsp->etag,
+                                       rsp->etag_len,
+                                       rsp->data,
+                                       rsp->len,
+                                       req->get.arg);
+            }
+            else if (req->get.callback)
             {
                 req->get.callback(client,
                                   rsp->status,
@@ -349,6 +363,70 @@ static int golioth_coap_cb(struct golioth_req_rsp *rsp)
     return rsp->status;
 }
 
+static int golioth_coap_get(struct golioth_coap_request_msg *req)
+{
+    const uint8_t **pathv = PATHV(req->path_prefix, req->path);
+    size_t path_len = coap_pathv_estimate_alloc_len(pathv);
+    struct golioth_coap_req *coap_req;
+    int err;
+
+    err = golioth_coap_req_new(&coap_req,
+                               req->client,
+                               req->token,
+                               COAP_METHOD_GET,
+                               COAP_TYPE_CON,
+                               GOLIOTH_COAP_MAX_NON_PAYLOAD_LEN + path_len + req->get.etag_len,
+                               golioth_coap_cb,
+                               req);
+    if (err)
+    {
+        return err;
+    }
+
+    if (req->get.etag_len > 0)
+    {
+        err = coap_packet_append_option(&coap_req->request,
+                                        COAP_OPTION_ETAG,
+                                        req->get.etag,
+                                        req->get.etag_len);
+        if (err)
+        {
+            GLTH_LOGE(TAG, "Unable to add ETag to packet, err: %d", err);
+            goto free_req;
+        }
+    }
+
+    err = coap_packet_append_uri_path_from_pathv(&coap_req->request, pathv);
+    if (err)
+    {
+        GLTH_LOGE(TAG, "Unable add uri path to packet");
+        goto free_req;
+    }
+
+    err = coap_append_option_int(&coap_req->request,
+                                 COAP_OPTION_ACCEPT,
+                                 golioth_content_type_to_coap_format(req->get.content_type));
+    if (err)
+    {
+        GLTH_LOGE(TAG, "Unable to add content type to packet, err: %d", err);
+        goto free_req;
+    }
+
+    err = golioth_coap_req_schedule(coap_req);
+    if (err)
+    {
+        GLTH_LOGE(TAG, "Failed to schedule CoAP GET: %d", err);
+        goto free_req;
+    }
+
+    return 0;
+
+free_req:
+    golioth_coap_req_free(coap_req);
+
+    return err;
+}
+
 static int golioth_coap_get_block(struct golioth_coap_request_msg *req)
 {
     const uint8_t **pathv = PATHV(req->path_prefix, req->path);
@@ -551,6 +629,17 @@ static int add_observation(struct golioth_coap_request_msg *req, struct golioth_
     return 0;
 }
 
+static void cancel_observation(struct golioth_client *client,
+                               struct golioth_coap_observe_info *obs_info)
+{
+    int err = golioth_coap_req_find_and_cancel_observation(client, &obs_info->req);
+    if (err)
+    {
+        GLTH_LOGW(TAG, "Error sending eager release for observation: %d", err);
+    }
+    obs_info->in_use = false;
+}
+
 void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix)
 {
     for (int i = 0; i < CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS; i++)
@@ -563,12 +652,20 @@ void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, co
                 continue;
             }
 
-            int err = golioth_coap_req_find_and_cancel_observation(client, &obs_info->req);
-            if (err)
-            {
-                GLTH_LOGW(TAG, "Error sending eager release for observation: %d", err);
-            }
-            obs_info->in_use = false;
+            cancel_observation(client, obs_info);
+        }
+    }
+}
+
+void golioth_cancel_observation(struct golioth_client *client,
+                                const uint8_t token[GOLIOTH_COAP_TOKEN_LEN])
+{
+    for (int i = 0; i < CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS; i++)
+    {
+        struct golioth_coap_observe_info *obs_info = &client->observations[i];
+        if (obs_info->in_use && memcmp(token, obs_info->req.token, GOLIOTH_COAP_TOKEN_LEN) == 0)
+        {
+            cancel_observation(client, obs_info);
         }
     }
 }
@@ -700,16 +797,7 @@ static enum golioth_status coap_io_loop_once(struct golioth_client *client)
             goto free_req;
         case GOLIOTH_COAP_REQUEST_GET:
             GLTH_LOGD(TAG, "Handle GET %s", req->path);
-            err = golioth_coap_req_cb(req->client,
-                                      req->token,
-                                      COAP_METHOD_GET,
-                                      PATHV(req->path_prefix, req->path),
-                                      golioth_content_type_to_coap_format(req->get.content_type),
-                                      NULL,
-                                      0,
-                                      golioth_coap_cb,
-                                      req,
-                                      0);
+            err = golioth_coap_get(req);
             break;
         case GOLIOTH_COAP_REQUEST_GET_BLOCK:
         case GOLIOTH_COAP_REQUEST_POST_BLOCK_RSP:
@@ -1270,6 +1358,9 @@ static void golioth_coap_client_thread(void *arg)
         GLTH_LOGI(TAG, "Golioth CoAP client connected");
         client->session_connected = true;
 
+        /* Block sizes are probed again for transfers started on the new session */
+        golioth_coap_client_pmtu_new_session(client);
+
         golioth_sys_client_connected(client);
         if (client->event_callback)
         {
@@ -1625,6 +1716,17 @@ struct golioth_client *golioth_client_create(const struct golioth_client_config
                       &new_client->run_sem);
 
     golioth_coap_token_mutex_create();
+    golioth_log_batch_init();
+    golioth_log_deferred_init();
+    golioth_log_governor_init();
+    ota_decompress_init();
+
+    new_client->pmtu.mutex = golioth_sys_mutex_create();
+    if (!new_client->pmtu.mutex)
+    {
+        GLTH_LOGE(TAG, "Failed to create PMTU mutex");
+        goto error;
+    }
 
     new_client->request_queue = golioth_mbox_create(CONFIG_GOLIOTH_COAP_REQUEST_QUEUE_MAX_ITEMS,
                                                     sizeof(struct golioth_coap_request_msg));
@@ -1741,6 +1843,10 @@ void golioth_client_destroy(struct golioth_client *client)
         purge_request_mbox(client->request_queue);
         golioth_mbox_destroy(client->request_queue);
     }
+    if (client->pmtu.mutex)
+    {
+        golioth_sys_mutex_destroy(client->pmtu.mutex);
+    }
 
     credentials_delete(&client->config);
 
@@ -50,6 +50,10 @@ struct golioth_req_rsp
 
     enum golioth_status status;
     struct golioth_coap_rsp_code coap_rsp_code;
+
+    /* ETag option of the response, if any */
+    const uint8_t *etag;
+    size_t etag_len;
 };
 
 /**
@@ -76,6 +80,7 @@ struct golioth_client
     bool session_connected;
     struct golioth_client_config config;
     struct golioth_coap_observe_info observations[CONFIG_GOLIOTH_MAX_NUM_OBSERVATIONS];
+    struct golioth_coap_pmtu pmtu;
 
     struct golioth_tls tls;
     uint8_t *rx_buffer;
@@ -103,4 +108,7 @@ int golioth_send_coap(struct golioth_client *client, struct coap_packet *packet)
 
 void golioth_cancel_all_observations_by_prefix(struct golioth_client *client, const char *prefix);
 
+void golioth_cancel_observation(struct golioth_client *client,
+                                const uint8_t token[GOLIOTH_COAP_TOKEN_LEN]);
+
 void golioth_cancel_all_observations(struct golioth_client *client);
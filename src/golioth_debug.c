@@ -5,6 +5,7 @@
  */
 #include <golioth/golioth_debug.h>
 #include <golioth/log.h>
+#include "log_internal.h"
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -86,6 +87,42 @@ void golioth_debug_hexdump(const char *tag, const void *addr, int len)
     printf("  %s\n", buff);
 }
 
+// Set while sending a message to Golioth, to avoid re-entering golioth_debug_printf()
+static bool log_in_progress = false;
+
+void golioth_debug_log_to_cloud(struct golioth_client *client,
+                                enum golioth_debug_log_level level,
+                                const char *tag,
+                                const char *msg)
+{
+    // Log to Golioth asynchronously.
+    //
+    // Setting the "in progress" flag ensures that we can't re-enter golioth_debug_printf()
+    // while calling the golioth_log_X_async functions, which might themselves
+    // use GLTH_LOGX statements (which would cause infinite re-entrance).
+    log_in_progress = true;
+    switch (level)
+    {
+        case GOLIOTH_DEBUG_LOG_LEVEL_ERROR:
+            golioth_log_error(client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_WARN:
+            golioth_log_warn(client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_INFO:
+            golioth_log_info(client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE:  // fallthrough
+        case GOLIOTH_DEBUG_LOG_LEVEL_DEBUG:
+            golioth_log_debug(client, tag, msg, NULL, NULL);
+            break;
+        case GOLIOTH_DEBUG_LOG_LEVEL_NONE:  // fallthrough
+        default:
+            break;
+    }
+    log_in_progress = false;
+}
+
 // Important Note!
 //
 // Do not use GLTH_LOGX statements in this function, as it can cause an infinite
@@ -108,15 +145,36 @@ void golioth_debug_printf(uint64_t tstamp_ms,
         return;
     }
 
+    va_list args;
+
+#if defined(CONFIG_GOLIOTH_LOG_DEFERRED)
+    // Capture the arguments only, the message is formatted by the deferred log thread. This is
+    // safe from any thread, including while another thread is sending a message.
+    va_start(args, format);
+    bool deferred = golioth_log_deferred_put(_client, tstamp_ms, level, tag, format, args);
+    va_end(args);
+
+    if (deferred)
+    {
+        return;
+    }
+#endif
+
     // Avoid re-entering this function
-    static bool log_in_progress = false;
     if (log_in_progress)
     {
         return;
     }
 
+#if defined(CONFIG_GOLIOTH_LOG_GOVERNOR)
+    // Rate limit before spending time formatting the message
+    if (!golioth_log_governor_allow(_client, tstamp_ms, level, tag, format))
+    {
+        return;
+    }
+#endif
+
     // Figure out how large of a char buffer we need to store this message
-    va_list args;
     va_start(args, format);
     int buffer_size = vsnprintf(NULL, 0, format, args) + 1;  // +1 for NULL
     va_end(args);
@@ -137,32 +195,7 @@ void golioth_debug_printf(uint64_t tstamp_ms,
     vsnprintf(msg_buffer, buffer_size, format, args);
     va_end(args);
 
-    // Log to Golioth asynchronously.
-    //
-    // Setting the "in progress" flag ensures that we can't re-enter this function
-    // while calling the golioth_log_X_async functions, which might themselves
-    // use GLTH_LOGX statements (which would cause infinite re-entrance).
-    log_in_progress = true;
-    switch (level)
-    {
-        case GOLIOTH_DEBUG_LOG_LEVEL_ERROR:
-            golioth_log_error(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_WARN:
-            golioth_log_warn(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_INFO:
-            golioth_log_info(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE:  // fallthrough
-        case GOLIOTH_DEBUG_LOG_LEVEL_DEBUG:
-            golioth_log_debug(_client, tag, msg_buffer, NULL, NULL);
-            break;
-        case GOLIOTH_DEBUG_LOG_LEVEL_NONE:  // fallthrough
-        default:
-            break;
-    }
-    log_in_progress = false;
+    golioth_debug_log_to_cloud(_client, level, tag, msg_buffer);
 
     // It's safe to free the message buffer, since the async log above
     // makes a copy of the message.
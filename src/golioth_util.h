@@ -5,6 +5,10 @@
  */
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef min
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
@@ -16,3 +20,98 @@
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 #endif
+
+// 32-bit FNV-1a hash, str does not need to be NULL-terminated
+static inline uint32_t fnv1a_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8_t) str[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// 64-bit FNV-1a hash, str does not need to be NULL-terminated
+static inline uint64_t fnv1a_hash64(const char *str, size_t len)
+{
+    uint64_t hash = 14695981039346656037u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8_t) str[i]) * 1099511628211u;
+    }
+
+    return hash;
+}
+
+/*
+ * Open addressing index of named slots by fnv1a_hash() of their name, kept at most half full.
+ * It has two entries per slot, stored in the slots at index_offset, so that it takes no memory
+ * of its own. Entries are the slot number + 1, or 0 when empty.
+ */
+struct hash_index
+{
+    void *slots;
+    size_t slot_size;
+    size_t index_offset;
+    size_t num_slots;
+};
+
+// Returns true if the slot has the name, whose hash is given to compare it first
+typedef bool (*hash_index_match_fn)(const void *slot,
+                                    const char *name,
+                                    size_t name_len,
+                                    uint32_t hash);
+
+static inline uint16_t *hash_index_entry(const struct hash_index *index, size_t i)
+{
+    uint8_t *slot = (uint8_t *) index->slots + (i / 2) * index->slot_size;
+
+    return &((uint16_t *) (slot + index->index_offset))[i % 2];
+}
+
+static inline void hash_index_add(const struct hash_index *index, size_t slot, uint32_t hash)
+{
+    size_t index_len = 2 * index->num_slots;
+    size_t i = hash % index_len;
+
+    while (*hash_index_entry(index, i) != 0)
+    {
+        i = (i + 1) % index_len;
+    }
+
+    *hash_index_entry(index, i) = (uint16_t) (slot + 1);
+}
+
+// Slots with the same name are found in the order they were added. Name does not need to be
+// NULL-terminated.
+static inline void *hash_index_find(const struct hash_index *index,
+                                    const char *name,
+                                    size_t name_len,
+                                    hash_index_match_fn match)
+{
+    size_t index_len = 2 * index->num_slots;
+
+    if (index_len == 0)
+    {
+        return NULL;
+    }
+
+    uint32_t hash = fnv1a_hash(name, name_len);
+
+    for (size_t i = hash % index_len; *hash_index_entry(index, i) != 0; i = (i + 1) % index_len)
+    {
+        size_t slot_num = *hash_index_entry(index, i) - 1;
+        void *slot = (uint8_t *) index->slots + slot_num * index->slot_size;
+
+        if (match(slot, name, name_len, hash))
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include "coap_client.h"
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+#include "golioth_util.h"
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE)
+
+LOG_TAG_DEFINE(lightdb_cache);
+
+#define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
+
+struct cache_entry
+{
+    char path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+    enum golioth_content_type content_type;
+    uint8_t etag[GOLIOTH_COAP_MAX_ETAG_LEN];
+    uint8_t etag_len;
+    // Allocated copy of the payload of the response that carried etag. NULL if unused.
+    uint8_t *payload;
+    size_t payload_size;
+    // Value of use_count when the entry was last used, to evict the least recently used one
+    uint32_t last_used;
+};
+
+/// Private struct to contain LightDB State GET cache data
+struct golioth_lightdb_cache
+{
+    struct golioth_client *client;
+    // Protects the entries and stats. Entries are only changed from the client thread, which
+    // runs the response callbacks, so payloads can be used there without holding it.
+    golioth_sys_mutex_t mutex;
+    uint32_t use_count;
+    // Sum of the payload sizes of all entries
+    size_t size;
+    struct golioth_lightdb_cache_stats stats;
+    struct cache_entry entries[CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_ENTRIES];
+};
+
+struct cache_request
+{
+    struct golioth_lightdb_cache *cache;
+    enum golioth_content_type content_type;
+    golioth_get_cb_fn callback;
+    void *arg;
+};
+
+static struct cache_entry *cache_find(struct golioth_lightdb_cache *cache,
+                                      const char *path,
+                                      enum golioth_content_type content_type)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(cache->entries); i++)
+    {
+        struct cache_entry *entry = &cache->entries[i];
+
+        if (entry->payload && entry->content_type == content_type
+            && strcmp(entry->path, path) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void cache_entry_release(struct golioth_lightdb_cache *cache, struct cache_entry *entry)
+{
+    cache->size -= entry->payload_size;
+    golioth_sys_free(entry->payload);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/* Free a slot, and enough payload memory for size more bytes, by evicting the LRU entries */
+static struct cache_entry *cache_make_room(struct golioth_lightdb_cache *cache, size_t size)
+{
+    while (true)
+    {
+        struct cache_entry *free_entry = NULL;
+        struct cache_entry *lru = NULL;
+
+        for (size_t i = 0; i < ARRAY_SIZE(cache->entries); i++)
+        {
+            struct cache_entry *entry = &cache->entries[i];
+
+            if (!entry->payload)
+            {
+                free_entry = entry;
+            }
+            else if (!lru || entry->last_used < lru->last_used)
+            {
+                lru = entry;
+            }
+        }
+
+        if (free_entry && cache->size + size <= CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE)
+        {
+            return free_entry;
+        }
+
+        if (!lru)
+        {
+            return NULL;
+        }
+
+        cache_entry_release(cache, lru);
+        cache->stats.evictions++;
+    }
+}
+
+static void cache_store(struct golioth_lightdb_cache *cache,
+                        const char *path,
+                        enum golioth_content_type content_type,
+                        const uint8_t *etag,
+                        size_t etag_len,
+                        const uint8_t *payload,
+                        size_t payload_size)
+{
+    golioth_sys_mutex_lock(cache->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    /* Whatever was cached for path is stale now */
+    struct cache_entry *entry = cache_find(cache, path, content_type);
+    if (entry)
+    {
+        cache_entry_release(cache, entry);
+    }
+
+    /* Only responses with an ETag can be validated later. Empty payloads are not cached, as
+     * a NULL payload marks unused entries. */
+    if (etag_len == 0 || etag_len > GOLIOTH_COAP_MAX_ETAG_LEN || payload_size == 0
+        || payload_size > CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE
+        || strlen(path) > CONFIG_GOLIOTH_COAP_MAX_PATH_LEN)
+    {
+        goto unlock;
+    }
+
+    entry = cache_make_room(cache, payload_size);
+    if (!entry)
+    {
+        goto unlock;
+    }
+
+    entry->payload = golioth_sys_malloc(payload_size);
+    if (!entry->payload)
+    {
+        goto unlock;
+    }
+
+    memcpy(entry->payload, payload, payload_size);
+    entry->payload_size = payload_size;
+    memcpy(entry->etag, etag, etag_len);
+    entry->etag_len = etag_len;
+    strcpy(entry->path, path);
+    entry->content_type = content_type;
+    entry->last_used = ++cache->use_count;
+    cache->size += payload_size;
+
+unlock:
+    golioth_sys_mutex_unlock(cache->mutex);
+}
+
+static enum golioth_status cache_request_send(struct cache_request *req,
+                                              const char *path,
+                                              const uint8_t *etag,
+                                              size_t etag_len);
+
+static void on_cache_response(struct golioth_client *client,
+                              enum golioth_status status,
+                              const struct golioth_coap_rsp_code *coap_rsp_code,
+                              const char *path,
+                              const uint8_t *etag,
+                              size_t etag_len,
+                              const uint8_t *payload,
+                              size_t payload_size,
+                              void *arg)
+{
+    struct cache_request *req = arg;
+    struct golioth_lightdb_cache *cache = req->cache;
+
+    if (status == GOLIOTH_OK && coap_rsp_code && coap_rsp_code->code_class == 2
+        && coap_rsp_code->code_detail == 3)
+    {
+        /* 2.03 Valid: the server confirmed the ETag of the cached payload */
+        golioth_sys_mutex_lock(cache->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        struct cache_entry *entry = cache_find(cache, path, req->content_type);
+        if (entry)
+        {
+            entry->last_used = ++cache->use_count;
+            cache->stats.validations++;
+        }
+        golioth_sys_mutex_unlock(cache->mutex);
+
+        if (!entry)
+        {
+            /* Evicted while the request was in flight, get the full value instead */
+            status = cache_request_send(req, path, NULL, 0);
+            if (status == GOLIOTH_OK)
+            {
+                return;
+            }
+
+            if (req->callback)
+            {
+                req->callback(client, status, coap_rsp_code, path, NULL, 0, req->arg);
+            }
+            golioth_sys_free(req);
+            return;
+        }
+
+        if (req->callback)
+        {
+            req->callback(client,
+                          status,
+                          coap_rsp_code,
+                          path,
+                          entry->payload,
+                          entry->payload_size,
+                          req->arg);
+        }
+        golioth_sys_free(req);
+        return;
+    }
+
+    if (status == GOLIOTH_OK)
+    {
+        golioth_sys_mutex_lock(cache->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        cache->stats.full_fetches++;
+        golioth_sys_mutex_unlock(cache->mutex);
+
+        cache_store(cache, path, req->content_type, etag, etag_len, payload, payload_size);
+    }
+
+    if (req->callback)
+    {
+        req->callback(client, status, coap_rsp_code, path, payload, payload_size, req->arg);
+    }
+    golioth_sys_free(req);
+}
+
+static enum golioth_status cache_request_send(struct cache_request *req,
+                                              const char *path,
+                                              const uint8_t *etag,
+                                              size_t etag_len)
+{
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    return golioth_coap_client_get_etag(req->cache->client,
+                                        token,
+                                        GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                        path,
+                                        req->content_type,
+                                        etag,
+                                        etag_len,
+                                        on_cache_response,
+                                        req,
+                                        GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+struct golioth_lightdb_cache *golioth_lightdb_cache_create(struct golioth_client *client)
+{
+    struct golioth_lightdb_cache *cache = golioth_sys_malloc(sizeof(*cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    cache->client = client;
+
+    cache->mutex = golioth_sys_mutex_create();
+    if (!cache->mutex)
+    {
+        golioth_sys_free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void golioth_lightdb_cache_destroy(struct golioth_lightdb_cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(cache->entries); i++)
+    {
+        golioth_sys_free(cache->entries[i].payload);
+    }
+
+    golioth_sys_mutex_destroy(cache->mutex);
+    golioth_sys_free(cache);
+}
+
+enum golioth_status golioth_lightdb_cache_get(struct golioth_lightdb_cache *cache,
+                                              const char *path,
+                                              enum golioth_content_type content_type,
+                                              golioth_get_cb_fn callback,
+                                              void *callback_arg)
+{
+    if (!cache || !path)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    struct cache_request *req = golioth_sys_malloc(sizeof(*req));
+    if (!req)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    *req = (struct cache_request) {
+        .cache = cache,
+        .content_type = content_type,
+        .callback = callback,
+        .arg = callback_arg,
+    };
+
+    uint8_t etag[GOLIOTH_COAP_MAX_ETAG_LEN];
+    size_t etag_len = 0;
+
+    golioth_sys_mutex_lock(cache->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    struct cache_entry *entry = cache_find(cache, path, content_type);
+    if (entry)
+    {
+        memcpy(etag, entry->etag, entry->etag_len);
+        etag_len = entry->etag_len;
+    }
+    golioth_sys_mutex_unlock(cache->mutex);
+
+    enum golioth_status status = cache_request_send(req, path, etag, etag_len);
+    if (status != GOLIOTH_OK)
+    {
+        golioth_sys_free(req);
+    }
+
+    return status;
+}
+
+void golioth_lightdb_cache_get_stats(struct golioth_lightdb_cache *cache,
+                                     struct golioth_lightdb_cache_stats *stats)
+{
+    if (!cache || !stats)
+    {
+        return;
+    }
+
+    golioth_sys_mutex_lock(cache->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    *stats = cache->stats;
+    golioth_sys_mutex_unlock(cache->mutex);
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE
@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <zcbor_decode.h>
+
+#include "coap_client.h"
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+#include "golioth_util.h"
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW)
+
+LOG_TAG_DEFINE(lightdb_observe_shadow);
+
+#define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
+
+struct observed_leaf
+{
+    // Allocated copy of the path, relative to the observed path
+    char *path;
+    // Allocated copy of the encoded value, NULL if it couldn't be copied
+    uint8_t *value;
+    size_t value_len;
+    // Generation of the last notification that contained this leaf
+    uint32_t generation;
+};
+
+struct observe_handler
+{
+    // Allocated copy of the path, relative to the observed path
+    char *path;
+    size_t path_len;
+    golioth_lightdb_change_cb_fn callback;
+    void *arg;
+};
+
+/// Private struct to contain LightDB State observed-value shadow data
+struct golioth_lightdb_observe_shadow
+{
+    struct golioth_client *client;
+    char *path;
+    bool started;
+    // Token of the observation, to cancel it
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    uint32_t generation;
+    // Values of the notification being walked which did not fit into leaves
+    size_t num_untracked;
+    size_t num_handlers;
+    struct observe_handler handlers[CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_HANDLERS];
+    size_t num_leaves;
+    // Sorted by path, for lookups while walking a notification
+    struct observed_leaf leaves[CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_LEAVES];
+    // Path of the leaf being walked
+    char walk_path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+};
+
+static bool leaf_find(const struct golioth_lightdb_observe_shadow *shadow,
+                      const char *path,
+                      size_t *pos)
+{
+    size_t lo = 0;
+    size_t hi = shadow->num_leaves;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(shadow->leaves[mid].path, path);
+
+        if (cmp == 0)
+        {
+            *pos = mid;
+            return true;
+        }
+
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return false;
+}
+
+/* A handler gets changes of its path, and of all paths below it */
+static bool handler_matches(const struct observe_handler *handler, const char *path)
+{
+    if (handler->path_len == 0)
+    {
+        return true;
+    }
+
+    return strncmp(path, handler->path, handler->path_len) == 0
+        && (path[handler->path_len] == '\0' || path[handler->path_len] == '/');
+}
+
+static void notify_change(struct golioth_lightdb_observe_shadow *shadow,
+                          const char *path,
+                          const uint8_t *value,
+                          size_t value_len)
+{
+    for (size_t i = 0; i < shadow->num_handlers; i++)
+    {
+        const struct observe_handler *handler = &shadow->handlers[i];
+
+        if (handler_matches(handler, path))
+        {
+            handler->callback(shadow->client, path, value, value_len, handler->arg);
+        }
+    }
+}
+
+/* Insert a leaf at pos, with a copy of path and no value */
+static struct observed_leaf *leaf_insert(struct golioth_lightdb_observe_shadow *shadow,
+                                         const char *path,
+                                         size_t pos)
+{
+    if (shadow->num_leaves == ARRAY_SIZE(shadow->leaves))
+    {
+        return NULL;
+    }
+
+    size_t path_len = strlen(path);
+    char *path_copy = golioth_sys_malloc(path_len + 1);
+    if (!path_copy)
+    {
+        return NULL;
+    }
+    memcpy(path_copy, path, path_len + 1);
+
+    memmove(&shadow->leaves[pos + 1],
+            &shadow->leaves[pos],
+            (shadow->num_leaves - pos) * sizeof(shadow->leaves[0]));
+    shadow->num_leaves++;
+
+    shadow->leaves[pos] = (struct observed_leaf) {
+        .path = path_copy,
+    };
+
+    return &shadow->leaves[pos];
+}
+
+static void observe_leaf(struct golioth_lightdb_observe_shadow *shadow,
+                         const uint8_t *value,
+                         size_t value_len)
+{
+    const char *path = shadow->walk_path;
+    struct observed_leaf *leaf;
+    size_t pos;
+
+    if (leaf_find(shadow, path, &pos))
+    {
+        leaf = &shadow->leaves[pos];
+
+        if (leaf->value && leaf->value_len == value_len
+            && memcmp(leaf->value, value, value_len) == 0)
+        {
+            leaf->generation = shadow->generation;
+            return;
+        }
+
+        golioth_sys_free(leaf->value);
+        leaf->value = NULL;
+    }
+    else
+    {
+        /* Untracked values are not reported, as their changes can't be told apart */
+        leaf = leaf_insert(shadow, path, pos);
+        if (!leaf)
+        {
+            shadow->num_untracked++;
+            return;
+        }
+    }
+
+    leaf->generation = shadow->generation;
+
+    /* Without a copy, the value is reported again by the next notification */
+    leaf->value = golioth_sys_malloc(value_len);
+    if (leaf->value)
+    {
+        memcpy(leaf->value, value, value_len);
+        leaf->value_len = value_len;
+    }
+
+    notify_change(shadow, path, value, value_len);
+}
+
+static bool walk_item(struct golioth_lightdb_observe_shadow *shadow,
+                      zcbor_state_t *zsd,
+                      size_t path_len,
+                      size_t depth);
+
+static bool walk_map(struct golioth_lightdb_observe_shadow *shadow,
+                     zcbor_state_t *zsd,
+                     size_t path_len,
+                     size_t depth)
+{
+    char *path = shadow->walk_path;
+    struct zcbor_string key;
+
+    if (!zcbor_map_start_decode(zsd))
+    {
+        return false;
+    }
+
+    while (!zcbor_list_or_map_end(zsd))
+    {
+        if (!zcbor_tstr_decode(zsd, &key))
+        {
+            return false;
+        }
+
+        size_t sep_len = (path_len > 0 ? 1 : 0);
+        if (key.len == 0 || memchr(key.value, '/', key.len)
+            || path_len + sep_len + key.len > sizeof(shadow->walk_path) - 1)
+        {
+            GLTH_LOGW(TAG, "Skipping observed key %.*s", (int) key.len, key.value);
+
+            if (!zcbor_any_skip(zsd, NULL))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (sep_len)
+        {
+            path[path_len] = '/';
+        }
+        memcpy(&path[path_len + sep_len], key.value, key.len);
+        path[path_len + sep_len + key.len] = '\0';
+
+        if (!walk_item(shadow, zsd, path_len + sep_len + key.len, depth + 1))
+        {
+            return false;
+        }
+    }
+
+    path[path_len] = '\0';
+
+    return zcbor_list_map_end_force_decode(zsd);
+}
+
+/* Maps are walked into, anything else is a leaf. Maps nested too deep are leaves as a whole. */
+static bool walk_item(struct golioth_lightdb_observe_shadow *shadow,
+                      zcbor_state_t *zsd,
+                      size_t path_len,
+                      size_t depth)
+{
+    if (zsd->payload >= zsd->payload_end)
+    {
+        return false;
+    }
+
+    if (ZCBOR_MAJOR_TYPE(*zsd->payload) == ZCBOR_MAJOR_TYPE_MAP
+        && depth < CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH)
+    {
+        return walk_map(shadow, zsd, path_len, depth);
+    }
+
+    const uint8_t *value = zsd->payload;
+
+    if (!zcbor_any_skip(zsd, NULL))
+    {
+        return false;
+    }
+
+    observe_leaf(shadow, value, zsd->payload - value);
+
+    return true;
+}
+
+/* Leaves that were not in the last notification were removed */
+static void remove_unseen_leaves(struct golioth_lightdb_observe_shadow *shadow)
+{
+    size_t num_kept = 0;
+
+    for (size_t i = 0; i < shadow->num_leaves; i++)
+    {
+        struct observed_leaf *leaf = &shadow->leaves[i];
+
+        if (leaf->generation == shadow->generation)
+        {
+            shadow->leaves[num_kept++] = *leaf;
+            continue;
+        }
+
+        notify_change(shadow, leaf->path, NULL, 0);
+        golioth_sys_free(leaf->value);
+        golioth_sys_free(leaf->path);
+    }
+
+    shadow->num_leaves = num_kept;
+}
+
+static void on_notification(struct golioth_client *client,
+                            enum golioth_status status,
+                            const struct golioth_coap_rsp_code *coap_rsp_code,
+                            const char *path,
+                            const uint8_t *payload,
+                            size_t payload_size,
+                            void *arg)
+{
+    struct golioth_lightdb_observe_shadow *shadow = arg;
+
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGW(TAG, "Observed LightDB State notification failed: %d", status);
+        return;
+    }
+
+    shadow->generation++;
+    shadow->num_untracked = 0;
+    shadow->walk_path[0] = '\0';
+
+    /* An empty or null document means that nothing is left at the observed path */
+    if (payload_size > 0 && !(payload_size == 1 && payload[0] == 0xF6))
+    {
+        ZCBOR_STATE_D(zsd,
+                      CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH,
+                      payload,
+                      payload_size,
+                      1,
+                      0);
+
+        if (!walk_item(shadow, zsd, 0, 0))
+        {
+            /* Changes up to the error were reported, keep the leaves that were not reached */
+            GLTH_LOGE(TAG, "Failed to decode observed LightDB State");
+            return;
+        }
+    }
+
+    if (shadow->num_untracked > 0)
+    {
+        GLTH_LOGW(TAG, "Not tracking %zu observed values", shadow->num_untracked);
+    }
+
+    remove_unseen_leaves(shadow);
+}
+
+struct golioth_lightdb_observe_shadow *golioth_lightdb_observe_shadow_create(
+    struct golioth_client *client,
+    const char *path)
+{
+    if (!path)
+    {
+        return NULL;
+    }
+
+    struct golioth_lightdb_observe_shadow *shadow = golioth_sys_malloc(sizeof(*shadow));
+    if (!shadow)
+    {
+        return NULL;
+    }
+
+    memset(shadow, 0, sizeof(*shadow));
+    shadow->client = client;
+
+    size_t path_len = strlen(path);
+    shadow->path = golioth_sys_malloc(path_len + 1);
+    if (!shadow->path)
+    {
+        golioth_sys_free(shadow);
+        return NULL;
+    }
+    memcpy(shadow->path, path, path_len + 1);
+
+    return shadow;
+}
+
+enum golioth_status golioth_lightdb_observe_shadow_destroy(
+    struct golioth_lightdb_observe_shadow *shadow)
+{
+    if (!shadow)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (shadow->started)
+    {
+        // The libcoap port dispatches notifications without holding a lock, so a cancel from
+        // this thread can race with on_notification() still running on the client thread.
+        if (golioth_client_is_running(shadow->client))
+        {
+            GLTH_LOGE(TAG, "Cannot destroy an observed shadow while the client is running");
+            return GOLIOTH_ERR_INVALID_STATE;
+        }
+
+        // Drop the observation so that it is not re-established when the client restarts
+        golioth_coap_client_cancel_observation(shadow->client, shadow->token);
+    }
+
+    for (size_t i = 0; i < shadow->num_leaves; i++)
+    {
+        golioth_sys_free(shadow->leaves[i].value);
+        golioth_sys_free(shadow->leaves[i].path);
+    }
+
+    for (size_t i = 0; i < shadow->num_handlers; i++)
+    {
+        golioth_sys_free(shadow->handlers[i].path);
+    }
+
+    golioth_sys_free(shadow->path);
+    golioth_sys_free(shadow);
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_lightdb_observe_shadow_on_change(
+    struct golioth_lightdb_observe_shadow *shadow,
+    const char *path,
+    golioth_lightdb_change_cb_fn callback,
+    void *callback_arg)
+{
+    if (!shadow || !path || !callback)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (shadow->started)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    if (shadow->num_handlers >= ARRAY_SIZE(shadow->handlers))
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    size_t path_len = strlen(path);
+    char *path_copy = golioth_sys_malloc(path_len + 1);
+    if (!path_copy)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+    memcpy(path_copy, path, path_len + 1);
+
+    shadow->handlers[shadow->num_handlers++] = (struct observe_handler) {
+        .path = path_copy,
+        .path_len = path_len,
+        .callback = callback,
+        .arg = callback_arg,
+    };
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_lightdb_observe_shadow_start(
+    struct golioth_lightdb_observe_shadow *shadow)
+{
+    if (!shadow)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (shadow->started)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    golioth_coap_next_token(shadow->token);
+
+    enum golioth_status status = golioth_coap_client_observe(shadow->client,
+                                                             shadow->token,
+                                                             GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                                             shadow->path,
+                                                             GOLIOTH_CONTENT_TYPE_CBOR,
+                                                             on_notification,
+                                                             shadow);
+    if (status == GOLIOTH_OK)
+    {
+        shadow->started = true;
+    }
+
+    return status;
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW
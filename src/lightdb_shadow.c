@@ -0,0 +1,708 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <zcbor_encode.h>
+
+#include "coap_client.h"
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+#include "golioth_util.h"
+#include "lightdb_tree.h"
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW)
+
+LOG_TAG_DEFINE(lightdb_shadow);
+
+#define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
+
+enum shadow_value_type
+{
+    SHADOW_VALUE_INT,
+    SHADOW_VALUE_BOOL,
+    SHADOW_VALUE_FLOAT,
+    SHADOW_VALUE_STRING,
+};
+
+struct shadow_value
+{
+    // Allocated copy of the path, and of string values
+    char *path;
+    enum shadow_value_type type;
+    union
+    {
+        int32_t i;
+        bool b;
+        float f;
+        struct
+        {
+            char *str;
+            size_t len;
+        } s;
+    };
+    bool dirty;
+};
+
+/// Private struct to contain LightDB State shadow data
+struct golioth_lightdb_shadow
+{
+    struct golioth_client *client;
+    struct golioth_lightdb_shadow_config config;
+    golioth_sys_mutex_t mutex;
+    // Held while sending, so that documents are sent in the order they were encoded. Responses
+    // take the mutex above, so it must not be held while sending.
+    golioth_sys_mutex_t flush_mutex;
+    golioth_sys_timer_t timer;
+    size_t num_dirty;
+    // Set when a flush was rejected by the server, so that the next one sends every value
+    bool resync;
+    bool flush_all;
+    size_t num_values;
+    // Sorted by path, so that values under the same path are next to each other
+    struct shadow_value values[CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES];
+};
+
+static int path_cmp(const char *value_path, const char *path, size_t path_len)
+{
+    int cmp = strncmp(value_path, path, path_len);
+    if (cmp == 0 && value_path[path_len] != '\0')
+    {
+        return 1;
+    }
+    return cmp;
+}
+
+/* Binary search for path, or for the position to insert it at */
+static bool shadow_find(const struct golioth_lightdb_shadow *shadow,
+                        const char *path,
+                        size_t path_len,
+                        size_t *pos)
+{
+    size_t lo = 0;
+    size_t hi = shadow->num_values;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = path_cmp(shadow->values[mid].path, path, path_len);
+
+        if (cmp == 0)
+        {
+            *pos = mid;
+            return true;
+        }
+
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return false;
+}
+
+/* A path can't hold both a value and other paths, as it is either a leaf or a map */
+static enum golioth_status shadow_check_path(const struct golioth_lightdb_shadow *shadow,
+                                             const char *path,
+                                             size_t pos)
+{
+    size_t path_len = strlen(path);
+    size_t depth = 1;
+    size_t parent_pos;
+
+    if (path_len == 0 || path[0] == '/' || path[path_len - 1] == '/')
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    for (const char *sep = strchr(path, '/'); sep; sep = strchr(sep + 1, '/'))
+    {
+        if (sep[1] == '/' || shadow_find(shadow, path, sep - path, &parent_pos))
+        {
+            return GOLIOTH_ERR_INVALID_FORMAT;
+        }
+        depth++;
+    }
+
+    if (depth > CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_DEPTH)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    /* Paths starting with this one are sorted right after it */
+    for (size_t i = pos;
+         i < shadow->num_values && strncmp(shadow->values[i].path, path, path_len) == 0;
+         i++)
+    {
+        if (shadow->values[i].path[path_len] == '/')
+        {
+            return GOLIOTH_ERR_INVALID_FORMAT;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+static bool shadow_value_equal(const struct shadow_value *a, const struct shadow_value *b)
+{
+    if (a->type != b->type)
+    {
+        return false;
+    }
+
+    switch (a->type)
+    {
+        case SHADOW_VALUE_INT:
+            return a->i == b->i;
+        case SHADOW_VALUE_BOOL:
+            return a->b == b->b;
+        case SHADOW_VALUE_FLOAT:
+            return a->f == b->f;
+        case SHADOW_VALUE_STRING:
+            return a->s.len == b->s.len && memcmp(a->s.str, b->s.str, a->s.len) == 0;
+    }
+
+    return false;
+}
+
+static bool encode_value(zcbor_state_t *zse, const struct shadow_value *value)
+{
+    switch (value->type)
+    {
+        case SHADOW_VALUE_INT:
+            return zcbor_int32_put(zse, value->i);
+        case SHADOW_VALUE_BOOL:
+            return zcbor_bool_put(zse, value->b);
+        case SHADOW_VALUE_FLOAT:
+            return zcbor_float32_put(zse, value->f);
+        case SHADOW_VALUE_STRING:
+            return zcbor_tstr_encode_ptr(zse, value->s.str, value->s.len);
+    }
+
+    return false;
+}
+
+static const char *shadow_value_path(void *ctx, size_t i)
+{
+    const struct golioth_lightdb_shadow *shadow = ctx;
+    return shadow->values[i].path;
+}
+
+static bool shadow_value_selected(void *ctx, size_t i)
+{
+    const struct golioth_lightdb_shadow *shadow = ctx;
+    return shadow->flush_all || shadow->values[i].dirty;
+}
+
+static bool shadow_value_encode(zcbor_state_t *zse, void *ctx, size_t i)
+{
+    const struct golioth_lightdb_shadow *shadow = ctx;
+    return encode_value(zse, &shadow->values[i]);
+}
+
+static void on_flushed(struct golioth_client *client,
+                       enum golioth_status status,
+                       const struct golioth_coap_rsp_code *coap_rsp_code,
+                       const char *path,
+                       void *arg)
+{
+    struct golioth_lightdb_shadow *shadow = arg;
+
+    if (status != GOLIOTH_OK)
+    {
+        GLTH_LOGW(TAG, "Failed to flush LightDB State shadow: %d", status);
+
+        golioth_sys_mutex_lock(shadow->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        shadow->resync = true;
+        golioth_sys_mutex_unlock(shadow->mutex);
+    }
+}
+
+/// Encoded document, waiting to be sent
+struct shadow_msg
+{
+    struct shadow_msg *next;
+    size_t len;
+    uint8_t payload[];
+};
+
+/* Encode the values in [first, last) as one document, split in halves if it doesn't fit. Documents
+ * are appended to the list at tail, and their values are no longer dirty. */
+static enum golioth_status shadow_encode_range(struct golioth_lightdb_shadow *shadow,
+                                               uint8_t *buf,
+                                               size_t first,
+                                               size_t last,
+                                               struct shadow_msg ***tail)
+{
+    const struct lightdb_tree tree = {
+        .ctx = shadow,
+        .path = shadow_value_path,
+        .selected = shadow_value_selected,
+        .encode = shadow_value_encode,
+    };
+    ZCBOR_STATE_E(zse,
+                  CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_DEPTH,
+                  buf,
+                  CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE,
+                  1);
+
+    bool ok = zcbor_map_start_encode(zse, SIZE_MAX)
+        && lightdb_tree_encode(zse, &tree, first, last, 0) && zcbor_map_end_encode(zse, SIZE_MAX);
+    if (!ok)
+    {
+        if (last - first > 1)
+        {
+            size_t mid = first + (last - first) / 2;
+
+            enum golioth_status status = shadow_encode_range(shadow, buf, first, mid, tail);
+            if (status != GOLIOTH_OK)
+            {
+                return status;
+            }
+
+            return shadow_encode_range(shadow, buf, mid, last, tail);
+        }
+
+        /* Never fits, skip it and don't try again */
+        GLTH_LOGE(TAG, "LightDB State shadow value %s is too large", shadow->values[first].path);
+        if (shadow->values[first].dirty)
+        {
+            shadow->values[first].dirty = false;
+            shadow->num_dirty--;
+        }
+        return GOLIOTH_OK;
+    }
+
+    size_t len = zse->payload - buf;
+
+    /* Nothing changed in this range */
+    if (len <= 2)
+    {
+        return GOLIOTH_OK;
+    }
+
+    struct shadow_msg *msg = golioth_sys_malloc(sizeof(*msg) + len);
+    if (!msg)
+    {
+        /* Values stay dirty, and are sent by the next flush */
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    msg->next = NULL;
+    msg->len = len;
+    memcpy(msg->payload, buf, len);
+
+    **tail = msg;
+    *tail = &msg->next;
+
+    for (size_t i = first; i < last; i++)
+    {
+        if (shadow->values[i].dirty)
+        {
+            shadow->values[i].dirty = false;
+            shadow->num_dirty--;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+/* Encode the changed values under the lock, and send them after releasing it */
+static enum golioth_status shadow_flush(struct golioth_lightdb_shadow *shadow)
+{
+    struct shadow_msg *msgs = NULL;
+    struct shadow_msg **tail = &msgs;
+    enum golioth_status status = GOLIOTH_OK;
+
+    golioth_sys_mutex_lock(shadow->flush_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    golioth_sys_mutex_lock(shadow->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (shadow->num_dirty == 0 && !shadow->resync)
+    {
+        goto unlock;
+    }
+
+    uint8_t *buf = golioth_sys_malloc(CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE);
+    if (!buf)
+    {
+        status = GOLIOTH_ERR_MEM_ALLOC;
+        goto unlock;
+    }
+
+    shadow->flush_all = shadow->resync;
+
+    status = shadow_encode_range(shadow, buf, 0, shadow->num_values, &tail);
+    if (status == GOLIOTH_OK)
+    {
+        shadow->resync = false;
+    }
+
+    golioth_sys_free(buf);
+
+unlock:
+    golioth_sys_mutex_unlock(shadow->mutex);
+
+    while (msgs)
+    {
+        struct shadow_msg *msg = msgs;
+        msgs = msg->next;
+
+        if (status == GOLIOTH_OK)
+        {
+            uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+            golioth_coap_next_token(token);
+
+            status = golioth_coap_client_set(shadow->client,
+                                             token,
+                                             GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                             "",
+                                             GOLIOTH_CONTENT_TYPE_CBOR,
+                                             msg->payload,
+                                             msg->len,
+                                             on_flushed,
+                                             shadow,
+                                             GOLIOTH_SYS_WAIT_FOREVER);
+            if (status != GOLIOTH_OK)
+            {
+                /* Values of this and the following documents are no longer dirty, so the next
+                 * flush sends every value */
+                golioth_sys_mutex_lock(shadow->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+                shadow->resync = true;
+                golioth_sys_mutex_unlock(shadow->mutex);
+            }
+        }
+
+        golioth_sys_free(msg);
+    }
+
+    golioth_sys_mutex_unlock(shadow->flush_mutex);
+
+    return status;
+}
+
+static void shadow_timer_expiry(golioth_sys_timer_t timer, void *user_arg)
+{
+    struct golioth_lightdb_shadow *shadow = user_arg;
+
+    if (golioth_client_is_running(shadow->client))
+    {
+        enum golioth_status status = shadow_flush(shadow);
+        if (status != GOLIOTH_OK)
+        {
+            GLTH_LOGE(TAG,
+                      "Periodic LightDB State shadow flush failed: %d (%s)",
+                      status,
+                      golioth_status_to_str(status));
+        }
+    }
+
+    golioth_sys_timer_reset(timer);
+}
+
+/* Insert a value at pos, with a copy of path */
+static struct shadow_value *shadow_insert(struct golioth_lightdb_shadow *shadow,
+                                          const char *path,
+                                          size_t pos)
+{
+    if (shadow->num_values == ARRAY_SIZE(shadow->values))
+    {
+        GLTH_LOGE(TAG, "Unable to add %s, shadow is full", path);
+        return NULL;
+    }
+
+    char *path_copy = golioth_sys_malloc(strlen(path) + 1);
+    if (!path_copy)
+    {
+        return NULL;
+    }
+    strcpy(path_copy, path);
+
+    struct shadow_value *value = &shadow->values[pos];
+
+    memmove(value + 1, value, (shadow->num_values - pos) * sizeof(*value));
+    shadow->num_values++;
+
+    *value = (struct shadow_value) {
+        .path = path_copy,
+        .type = SHADOW_VALUE_INT,
+    };
+
+    return value;
+}
+
+/* Copy a new value into the shadow, marking it dirty if it changed */
+static enum golioth_status shadow_set(struct golioth_lightdb_shadow *shadow,
+                                      const char *path,
+                                      const struct shadow_value *new_value)
+{
+    enum golioth_status status = GOLIOTH_OK;
+    struct shadow_value *value = NULL;
+    char *str = NULL;
+    bool flush = false;
+    size_t pos;
+
+    if (!shadow || !path)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    golioth_sys_mutex_lock(shadow->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    bool found = shadow_find(shadow, path, strlen(path), &pos);
+    if (found && shadow_value_equal(&shadow->values[pos], new_value))
+    {
+        goto unlock;
+    }
+
+    if (new_value->type == SHADOW_VALUE_STRING)
+    {
+        str = golioth_sys_malloc(new_value->s.len + 1);
+        if (!str)
+        {
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto unlock;
+        }
+        memcpy(str, new_value->s.str, new_value->s.len);
+    }
+
+    if (found)
+    {
+        value = &shadow->values[pos];
+    }
+    else
+    {
+        status = shadow_check_path(shadow, path, pos);
+        if (status != GOLIOTH_OK)
+        {
+            GLTH_LOGE(TAG, "Invalid LightDB State shadow path: %s", path);
+            goto free_str;
+        }
+
+        value = shadow_insert(shadow, path, pos);
+        if (!value)
+        {
+            status = GOLIOTH_ERR_MEM_ALLOC;
+            goto free_str;
+        }
+    }
+
+    if (value->type == SHADOW_VALUE_STRING)
+    {
+        golioth_sys_free(value->s.str);
+    }
+
+    char *path_copy = value->path;
+    bool dirty = value->dirty;
+
+    *value = *new_value;
+    value->path = path_copy;
+    value->dirty = dirty;
+    if (str)
+    {
+        value->s.str = str;
+    }
+
+    if (!value->dirty)
+    {
+        value->dirty = true;
+        shadow->num_dirty++;
+    }
+
+    flush = shadow->config.flush_dirty_count > 0
+        && shadow->num_dirty >= shadow->config.flush_dirty_count;
+
+    goto unlock;
+
+free_str:
+    golioth_sys_free(str);
+unlock:
+    golioth_sys_mutex_unlock(shadow->mutex);
+
+    if (flush)
+    {
+        status = shadow_flush(shadow);
+    }
+
+    return status;
+}
+
+struct golioth_lightdb_shadow *golioth_lightdb_shadow_create(
+    struct golioth_client *client,
+    const struct golioth_lightdb_shadow_config *config)
+{
+    struct golioth_lightdb_shadow *shadow = golioth_sys_malloc(sizeof(*shadow));
+    if (!shadow)
+    {
+        return NULL;
+    }
+
+    memset(shadow, 0, sizeof(*shadow));
+    shadow->client = client;
+    if (config)
+    {
+        shadow->config = *config;
+    }
+
+    shadow->mutex = golioth_sys_mutex_create();
+    if (!shadow->mutex)
+    {
+        goto free_shadow;
+    }
+
+    shadow->flush_mutex = golioth_sys_mutex_create();
+    if (!shadow->flush_mutex)
+    {
+        goto destroy_mutex;
+    }
+
+    if (shadow->config.flush_interval_ms > 0)
+    {
+        struct golioth_timer_config timer_cfg = {
+            .name = "lightdb_shadow",
+            .expiration_ms = shadow->config.flush_interval_ms,
+            .fn = shadow_timer_expiry,
+            .user_arg = shadow,
+        };
+
+        shadow->timer = golioth_sys_timer_create(&timer_cfg);
+        if (!shadow->timer)
+        {
+            goto destroy_flush_mutex;
+        }
+
+        golioth_sys_timer_start(shadow->timer);
+    }
+
+    return shadow;
+
+destroy_flush_mutex:
+    golioth_sys_mutex_destroy(shadow->flush_mutex);
+destroy_mutex:
+    golioth_sys_mutex_destroy(shadow->mutex);
+free_shadow:
+    golioth_sys_free(shadow);
+    return NULL;
+}
+
+void golioth_lightdb_shadow_destroy(struct golioth_lightdb_shadow *shadow)
+{
+    if (!shadow)
+    {
+        return;
+    }
+
+    if (shadow->timer)
+    {
+        golioth_sys_timer_destroy(shadow->timer);
+    }
+
+    for (size_t i = 0; i < shadow->num_values; i++)
+    {
+        if (shadow->values[i].type == SHADOW_VALUE_STRING)
+        {
+            golioth_sys_free(shadow->values[i].s.str);
+        }
+        golioth_sys_free(shadow->values[i].path);
+    }
+
+    golioth_sys_mutex_destroy(shadow->flush_mutex);
+    golioth_sys_mutex_destroy(shadow->mutex);
+    golioth_sys_free(shadow);
+}
+
+enum golioth_status golioth_lightdb_shadow_set_int(struct golioth_lightdb_shadow *shadow,
+                                                   const char *path,
+                                                   int32_t value)
+{
+    struct shadow_value new_value = {
+        .type = SHADOW_VALUE_INT,
+        .i = value,
+    };
+
+    return shadow_set(shadow, path, &new_value);
+}
+
+enum golioth_status golioth_lightdb_shadow_set_bool(struct golioth_lightdb_shadow *shadow,
+                                                    const char *path,
+                                                    bool value)
+{
+    struct shadow_value new_value = {
+        .type = SHADOW_VALUE_BOOL,
+        .b = value,
+    };
+
+    return shadow_set(shadow, path, &new_value);
+}
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+
+enum golioth_status golioth_lightdb_shadow_set_float(struct golioth_lightdb_shadow *shadow,
+                                                     const char *path,
+                                                     float value)
+{
+    struct shadow_value new_value = {
+        .type = SHADOW_VALUE_FLOAT,
+        .f = value,
+    };
+
+    return shadow_set(shadow, path, &new_value);
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+enum golioth_status golioth_lightdb_shadow_set_string(struct golioth_lightdb_shadow *shadow,
+                                                      const char *path,
+                                                      const char *str,
+                                                      size_t str_len)
+{
+    if (!str)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    struct shadow_value new_value = {
+        .type = SHADOW_VALUE_STRING,
+        .s =
+            {
+                .str = (char *) str,
+                .len = str_len,
+            },
+    };
+
+    return shadow_set(shadow, path, &new_value);
+}
+
+enum golioth_status golioth_lightdb_shadow_flush(struct golioth_lightdb_shadow *shadow)
+{
+    if (!shadow)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    return shadow_flush(shadow);
+}
+
+size_t golioth_lightdb_shadow_num_dirty(struct golioth_lightdb_shadow *shadow)
+{
+    if (!shadow)
+    {
+        return 0;
+    }
+
+    golioth_sys_mutex_lock(shadow->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    size_t num_dirty = shadow->num_dirty;
+    golioth_sys_mutex_unlock(shadow->mutex);
+
+    return num_dirty;
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW
@@ -4,13 +4,16 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <assert.h>
-#include <stdio.h>
 #include <string.h>
+#include <zcbor_encode.h>
 
 #include "coap_client.h"
+#include <golioth/config.h>
 #include <golioth/lightdb_state.h>
 // #include <golioth/payload_utils.h>
 #include "golioth_util.h"
+#include "lightdb_tree.h"
+#include <golioth/golioth_debug.h>
 #include <golioth/golioth_sys.h>
 
 #if defined(CONFIG_GOLIOTH_LIGHTDB_STATE)
@@ -19,28 +22,147 @@ LOG_TAG_DEFINE(lightdb_state);
 
 #define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
 
-enum golioth_status golioth_lightdb_set_int(struct golioth_client *client,
+enum batch_value_type
+{
+    BATCH_VALUE_INT,
+    BATCH_VALUE_BOOL,
+    BATCH_VALUE_FLOAT,
+    BATCH_VALUE_STRING,
+    BATCH_VALUE_RAW,
+};
+
+struct batch_entry
+{
+    // Not copied, valid until the batch is committed
+    const char *path;
+    enum batch_value_type type;
+    union
+    {
+        int32_t i;
+        bool b;
+        float f;
+        struct
+        {
+            const void *buf;
+            size_t len;
+        } data;
+    };
+};
+
+/// Private struct to contain a LightDB State batch
+struct golioth_lightdb_batch
+{
+    struct golioth_client *client;
+    // First error of golioth_lightdb_batch_add_*(), returned by the commit
+    enum golioth_status status;
+    size_t max_depth;
+    size_t num_entries;
+    // Sorted by path, so that entries under the same path are next to each other
+    struct batch_entry entries[CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES];
+};
+
+// Largest CBOR head of a typed value: a float32, or the head of a string with a 64-bit length
+#define LIGHTDB_VALUE_HEAD_MAX 9
+
+/* Typed values are encoded as CBOR, straight from their native representation, instead of
+ * being formatted as JSON text. The payload is the encoded head, followed by the string data
+ * for strings, both copied by the CoAP client into its single request buffer. */
+
+static size_t lightdb_encode_int(uint8_t head[LIGHTDB_VALUE_HEAD_MAX], int32_t value)
+{
+    ZCBOR_STATE_E(zse, 0, head, LIGHTDB_VALUE_HEAD_MAX, 1);
+
+    if (!zcbor_int32_put(zse, value))
+    {
+        return 0;
+    }
+
+    return zse->payload_mut - head;
+}
+
+static size_t lightdb_encode_bool(uint8_t head[LIGHTDB_VALUE_HEAD_MAX], bool value)
+{
+    ZCBOR_STATE_E(zse, 0, head, LIGHTDB_VALUE_HEAD_MAX, 1);
+
+    if (!zcbor_bool_put(zse, value))
+    {
+        return 0;
+    }
+
+    return zse->payload_mut - head;
+}
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+
+static size_t lightdb_encode_float(uint8_t head[LIGHTDB_VALUE_HEAD_MAX], float value)
+{
+    ZCBOR_STATE_E(zse, 0, head, LIGHTDB_VALUE_HEAD_MAX, 1);
+
+    if (!zcbor_float32_put(zse, value))
+    {
+        return 0;
+    }
+
+    return zse->payload_mut - head;
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+static size_t lightdb_encode_string_head(uint8_t head[LIGHTDB_VALUE_HEAD_MAX], size_t str_len)
+{
+    ZCBOR_STATE_E(zse, 0, head, LIGHTDB_VALUE_HEAD_MAX, 1);
+
+    // A text string head is the length encoded like an unsigned integer, with another major type
+    if (!zcbor_uint64_put(zse, str_len))
+    {
+        return 0;
+    }
+    head[0] |= ZCBOR_MAJOR_TYPE_TSTR << 5;
+
+    return zse->payload_mut - head;
+}
+
+static enum golioth_status lightdb_set_cbor(struct golioth_client *client,
                                             const char *path,
-                                            int32_t value,
+                                            const uint8_t *head,
+                                            size_t head_len,
+                                            const uint8_t *data,
+                                            size_t data_len,
                                             golioth_set_cb_fn callback,
                                             void *callback_arg)
 {
-    char buf[16] = {};
-    snprintf(buf, sizeof(buf), "%" PRId32, value);
+    if (head_len == 0)
+    {
+        return GOLIOTH_ERR_SERIALIZE;
+    }
 
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     golioth_coap_next_token(token);
 
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   callback,
-                                   callback_arg,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return golioth_coap_client_set_with_header(client,
+                                               token,
+                                               GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                               path,
+                                               GOLIOTH_CONTENT_TYPE_CBOR,
+                                               head,
+                                               head_len,
+                                               data,
+                                               data_len,
+                                               callback,
+                                               callback_arg,
+                                               GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+enum golioth_status golioth_lightdb_set_int(struct golioth_client *client,
+                                            const char *path,
+                                            int32_t value,
+                                            golioth_set_cb_fn callback,
+                                            void *callback_arg)
+{
+    uint8_t head[LIGHTDB_VALUE_HEAD_MAX];
+    size_t head_len = lightdb_encode_int(head, value);
+
+    return lightdb_set_cbor(client, path, head, head_len, NULL, 0, callback, callback_arg);
 }
 
 enum golioth_status golioth_lightdb_set_bool(struct golioth_client *client,
@@ -49,21 +171,10 @@ enum golioth_status golioth_lightdb_set_bool(struct golioth_client *client,
                                              golioth_set_cb_fn callback,
                                              void *callback_arg)
 {
-    const char *valuestr = (value ? "true" : "false");
-
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    uint8_t head[LIGHTDB_VALUE_HEAD_MAX];
+    size_t head_len = lightdb_encode_bool(head, value);
 
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) valuestr,
-                                   strlen(valuestr),
-                                   callback,
-                                   callback_arg,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_cbor(client, path, head, head_len, NULL, 0, callback, callback_arg);
 }
 
 #if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
@@ -74,22 +185,10 @@ enum golioth_status golioth_lightdb_set_float(struct golioth_client *client,
                                               golioth_set_cb_fn callback,
                                               void *callback_arg)
 {
-    char buf[32] = {};
-    snprintf(buf, sizeof(buf), "%f", (double) value);
+    uint8_t head[LIGHTDB_VALUE_HEAD_MAX];
+    size_t head_len = lightdb_encode_float(head, value);
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
-
-    return golioth_coap_client_set(client,
-                                   token,
-                                   GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                   path,
-                                   GOLIOTH_CONTENT_TYPE_JSON,
-                                   (const uint8_t *) buf,
-                                   strlen(buf),
-                                   callback,
-                                   callback_arg,
-                                   GOLIOTH_SYS_WAIT_FOREVER);
+    return lightdb_set_cbor(client, path, head, head_len, NULL, 0, callback, callback_arg);
 }
 
 #endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
@@ -101,33 +200,23 @@ enum golioth_status golioth_lightdb_set_string(struct golioth_client *client,
                                                golioth_set_cb_fn callback,
                                                void *callback_arg)
 {
-    // Server requires that non-JSON-formatted strings
-    // be surrounded with literal ".
-    size_t bufsize = str_len + 3;  // two " and a NULL
-    char *buf = golioth_sys_malloc(bufsize);
-    if (!buf)
+    if (!str && str_len > 0)
     {
-        return GOLIOTH_ERR_MEM_ALLOC;
+        return GOLIOTH_ERR_NULL;
     }
-    memset(buf, 0, bufsize);
-    snprintf(buf, bufsize, "\"%s\"", str);
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    // The string is sent as is, CBOR text strings need no quoting or escaping
+    uint8_t head[LIGHTDB_VALUE_HEAD_MAX];
+    size_t head_len = lightdb_encode_string_head(head, str_len);
 
-    enum golioth_status status = golioth_coap_client_set(client,
-                                                         token,
-                                                         GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
-                                                         path,
-                                                         GOLIOTH_CONTENT_TYPE_JSON,
-                                                         (const uint8_t *) buf,
-                                                         bufsize - 1,  // excluding NULL
-                                                         callback,
-                                                         callback_arg,
-                                                         GOLIOTH_SYS_WAIT_FOREVER);
-
-    golioth_sys_free(buf);
-    return status;
+    return lightdb_set_cbor(client,
+                            path,
+                            head,
+                            head_len,
+                            (const uint8_t *) str,
+                            str_len,
+                            callback,
+                            callback_arg);
 }
 
 enum golioth_status golioth_lightdb_set(struct golioth_client *client,
@@ -203,4 +292,312 @@ enum golioth_status golioth_lightdb_observe(struct golioth_client *client,
                                        arg);
 }
 
+static enum golioth_status batch_add(struct golioth_lightdb_batch *batch,
+                                     const char *path,
+                                     const struct batch_entry *entry)
+{
+    if (!batch)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (batch->status != GOLIOTH_OK)
+    {
+        return batch->status;
+    }
+
+    bool has_data = (entry->type == BATCH_VALUE_STRING || entry->type == BATCH_VALUE_RAW);
+    if (!path || (has_data && !entry->data.buf))
+    {
+        batch->status = GOLIOTH_ERR_NULL;
+        return batch->status;
+    }
+
+    size_t depth = 1;
+    bool valid = (path[0] != '\0');
+
+    for (const char *sep = strchr(path, '/'); valid && sep; sep = strchr(sep + 1, '/'))
+    {
+        valid = (sep != path && sep[1] != '/' && sep[1] != '\0');
+        depth++;
+    }
+
+    if (!valid)
+    {
+        GLTH_LOGE(TAG, "Invalid LightDB State batch path: %s", path);
+        batch->status = GOLIOTH_ERR_INVALID_FORMAT;
+        return batch->status;
+    }
+
+    if (batch->num_entries == ARRAY_SIZE(batch->entries))
+    {
+        batch->status = GOLIOTH_ERR_MEM_ALLOC;
+        GLTH_LOGE(TAG, "Unable to add %s, batch is full", path);
+        return batch->status;
+    }
+
+    size_t pos = batch->num_entries;
+    while (pos > 0 && strcmp(batch->entries[pos - 1].path, path) > 0)
+    {
+        pos--;
+    }
+
+    memmove(&batch->entries[pos + 1],
+            &batch->entries[pos],
+            (batch->num_entries - pos) * sizeof(batch->entries[0]));
+    batch->entries[pos] = *entry;
+    batch->entries[pos].path = path;
+    batch->num_entries++;
+    batch->max_depth = max(batch->max_depth, depth);
+
+    return GOLIOTH_OK;
+}
+
+static const char *batch_entry_path(void *ctx, size_t i)
+{
+    const struct golioth_lightdb_batch *batch = ctx;
+    return batch->entries[i].path;
+}
+
+static bool batch_entry_encode(zcbor_state_t *zse, void *ctx, size_t i)
+{
+    const struct golioth_lightdb_batch *batch = ctx;
+    const struct batch_entry *entry = &batch->entries[i];
+
+    switch (entry->type)
+    {
+        case BATCH_VALUE_INT:
+            return zcbor_int32_put(zse, entry->i);
+        case BATCH_VALUE_BOOL:
+            return zcbor_bool_put(zse, entry->b);
+        case BATCH_VALUE_FLOAT:
+            return zcbor_float32_put(zse, entry->f);
+        case BATCH_VALUE_STRING:
+            return zcbor_tstr_encode_ptr(zse, entry->data.buf, entry->data.len);
+        case BATCH_VALUE_RAW:
+            /* Already encoded, copied as is */
+            if ((size_t) (zse->payload_end - zse->payload) < entry->data.len)
+            {
+                return false;
+            }
+            memcpy(zse->payload_mut, entry->data.buf, entry->data.len);
+            zse->payload_mut += entry->data.len;
+            zse->elem_count++;
+            return true;
+    }
+
+    return false;
+}
+
+/* Length of the deepest path containing every entry, which the batch is posted to */
+static size_t batch_parent_len(const struct golioth_lightdb_batch *batch)
+{
+    /* Entries are sorted, so the first and last ones have the shortest common prefix */
+    const char *first = batch->entries[0].path;
+    const char *last = batch->entries[batch->num_entries - 1].path;
+    size_t parent_len = 0;
+
+    for (size_t i = 0; first[i] != '\0' && first[i] == last[i]; i++)
+    {
+        if (first[i] == '/')
+        {
+            parent_len = i;
+        }
+    }
+
+    return parent_len;
+}
+
+/* Encode entries relative to their parent path into buf, returning the length or 0 on failure */
+static size_t batch_encode(const struct golioth_lightdb_batch *batch,
+                           const struct lightdb_tree *tree,
+                           size_t parent_len,
+                           uint8_t *buf)
+{
+    ZCBOR_STATE_E(zse, batch->max_depth, buf, CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE, 1);
+
+    bool ok = zcbor_map_start_encode(zse, SIZE_MAX)
+        && lightdb_tree_encode(zse, tree, 0, batch->num_entries, parent_len ? parent_len + 1 : 0)
+        && zcbor_map_end_encode(zse, SIZE_MAX);
+
+    return ok ? zse->payload - buf : 0;
+}
+
+struct golioth_lightdb_batch *golioth_lightdb_batch_begin(struct golioth_client *client)
+{
+    struct golioth_lightdb_batch *batch = golioth_sys_malloc(sizeof(*batch));
+
+    if (batch)
+    {
+        memset(batch, 0, sizeof(*batch));
+        batch->client = client;
+        batch->status = GOLIOTH_OK;
+    }
+
+    return batch;
+}
+
+enum golioth_status golioth_lightdb_batch_add_int(struct golioth_lightdb_batch *batch,
+                                                  const char *path,
+                                                  int32_t value)
+{
+    struct batch_entry entry = {
+        .type = BATCH_VALUE_INT,
+        .i = value,
+    };
+
+    return batch_add(batch, path, &entry);
+}
+
+enum golioth_status golioth_lightdb_batch_add_bool(struct golioth_lightdb_batch *batch,
+                                                   const char *path,
+                                                   bool value)
+{
+    struct batch_entry entry = {
+        .type = BATCH_VALUE_BOOL,
+        .b = value,
+    };
+
+    return batch_add(batch, path, &entry);
+}
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS)
+
+enum golioth_status golioth_lightdb_batch_add_float(struct golioth_lightdb_batch *batch,
+                                                    const char *path,
+                                                    float value)
+{
+    struct batch_entry entry = {
+        .type = BATCH_VALUE_FLOAT,
+        .f = value,
+    };
+
+    return batch_add(batch, path, &entry);
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+
+enum golioth_status golioth_lightdb_batch_add_string(struct golioth_lightdb_batch *batch,
+                                                     const char *path,
+                                                     const char *str,
+                                                     size_t str_len)
+{
+    struct batch_entry entry = {
+        .type = BATCH_VALUE_STRING,
+        .data =
+            {
+                .buf = str,
+                .len = str_len,
+            },
+    };
+
+    return batch_add(batch, path, &entry);
+}
+
+enum golioth_status golioth_lightdb_batch_add_raw(struct golioth_lightdb_batch *batch,
+                                                  const char *path,
+                                                  const uint8_t *cbor,
+                                                  size_t cbor_len)
+{
+    struct batch_entry entry = {
+        .type = BATCH_VALUE_RAW,
+        .data =
+            {
+                .buf = cbor,
+                .len = cbor_len,
+            },
+    };
+
+    return batch_add(batch, path, &entry);
+}
+
+void golioth_lightdb_batch_abort(struct golioth_lightdb_batch *batch)
+{
+    golioth_sys_free(batch);
+}
+
+enum golioth_status golioth_lightdb_batch_commit(struct golioth_lightdb_batch *batch,
+                                                 golioth_set_cb_fn callback,
+                                                 void *callback_arg)
+{
+    if (!batch)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    const struct lightdb_tree tree = {
+        .ctx = batch,
+        .path = batch_entry_path,
+        .encode = batch_entry_encode,
+    };
+    enum golioth_status status = batch->status;
+    uint8_t *buf = NULL;
+
+    if (status != GOLIOTH_OK)
+    {
+        goto free_batch;
+    }
+
+    if (batch->num_entries == 0)
+    {
+        status = GOLIOTH_ERR_INVALID_STATE;
+        goto free_batch;
+    }
+
+    if (!lightdb_tree_valid(&tree, batch->num_entries))
+    {
+        GLTH_LOGE(TAG, "LightDB State batch paths overlap");
+        status = GOLIOTH_ERR_INVALID_FORMAT;
+        goto free_batch;
+    }
+
+    size_t parent_len = batch_parent_len(batch);
+    char parent[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+
+    if (parent_len >= sizeof(parent))
+    {
+        status = GOLIOTH_ERR_INVALID_FORMAT;
+        goto free_batch;
+    }
+    memcpy(parent, batch->entries[0].path, parent_len);
+    parent[parent_len] = '\0';
+
+    buf = golioth_sys_malloc(CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE);
+    if (!buf)
+    {
+        status = GOLIOTH_ERR_MEM_ALLOC;
+        goto free_batch;
+    }
+
+    size_t len = batch_encode(batch, &tree, parent_len, buf);
+    if (len == 0)
+    {
+        GLTH_LOGE(TAG,
+                  "LightDB State batch does not fit into %d bytes",
+                  CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE);
+        status = GOLIOTH_ERR_MEM_ALLOC;
+        goto free_batch;
+    }
+
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    status = golioth_coap_client_set(batch->client,
+                                     token,
+                                     GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                     parent,
+                                     GOLIOTH_CONTENT_TYPE_CBOR,
+                                     buf,
+                                     len,
+                                     callback,
+                                     callback_arg,
+                                     GOLIOTH_SYS_WAIT_FOREVER);
+
+free_batch:
+    golioth_sys_free(buf);
+    golioth_sys_free(batch);
+
+    return status;
+}
+
 #endif  // CONFIG_GOLIOTH_LIGHTDB_STATE
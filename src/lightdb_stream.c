@@ -0,0 +1,685 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coap_blockwise.h"
+#include <golioth/config.h>
+#include <golioth/lightdb_state.h>
+#include "golioth_util.h"
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM)
+
+LOG_TAG_DEFINE(lightdb_stream);
+
+#define GOLIOTH_LIGHTDB_STATE_PATH_PREFIX ".d/"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_BSTR 2
+#define CBOR_MAJOR_TSTR 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_AI_FALSE 20
+#define CBOR_AI_TRUE 21
+#define CBOR_AI_NULL 22
+#define CBOR_AI_UNDEFINED 23
+#define CBOR_AI_HALF 25
+#define CBOR_AI_FLOAT 26
+#define CBOR_AI_DOUBLE 27
+#define CBOR_AI_INDEFINITE 31
+
+enum stream_state
+{
+    // Waiting for the initial byte of a data item
+    STREAM_HEAD,
+    // Waiting for the argument bytes following the initial byte
+    STREAM_ARG,
+    // Waiting for the contents of a string
+    STREAM_STRING,
+    // The top-level data item is complete
+    STREAM_DONE,
+};
+
+/* An array or map being parsed */
+struct stream_level
+{
+    bool is_map;
+    bool indefinite;
+    // Only in maps: the next item is a key
+    bool expect_key;
+    // Items (arrays) or pairs (maps) left, if not indefinite
+    uint64_t remaining;
+    // Only in arrays: index of the next item, which is its path segment
+    uint32_t index;
+    // Length of the path of the container itself
+    size_t path_len;
+};
+
+/* Resumable CBOR tokenizer, fed with consecutive parts of a single CBOR document */
+struct lightdb_stream
+{
+    golioth_lightdb_stream_cb_fn value_cb;
+    void *arg;
+    // First error, returned by every later call
+    enum golioth_status status;
+    enum stream_state state;
+    bool started;
+    // Initial byte and argument of the data item being parsed
+    uint8_t initial;
+    uint8_t arg_len;
+    uint8_t arg_received;
+    uint64_t argument;
+    // String being parsed: a key is appended to the path, a value is reported
+    bool string_is_key;
+    uint8_t string_major;
+    uint64_t string_len;
+    uint64_t string_offset;
+    // Short string values are reported as a whole
+    size_t string_buf_len;
+    uint8_t string_buf[CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_STRING_BUF_SIZE];
+    size_t depth;
+    struct stream_level levels[CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_DEPTH];
+    size_t path_len;
+    char path[CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN + 1];
+};
+
+struct lightdb_stream_get
+{
+    struct lightdb_stream stream;
+    golioth_end_block_cb_fn end_cb;
+    void *arg;
+};
+
+static struct stream_level *stream_top(struct lightdb_stream *stream)
+{
+    return stream->depth > 0 ? &stream->levels[stream->depth - 1] : NULL;
+}
+
+static void stream_truncate_path(struct lightdb_stream *stream, size_t path_len)
+{
+    stream->path_len = path_len;
+    stream->path[path_len] = '\0';
+}
+
+/* Append a segment to the path of the container at the top of the stack */
+static enum golioth_status stream_append_segment(struct lightdb_stream *stream,
+                                                 const char *segment,
+                                                 size_t segment_len)
+{
+    const struct stream_level *top = stream_top(stream);
+    size_t sep_len = (top->path_len > 0 ? 1 : 0);
+
+    if (top->path_len + sep_len + segment_len > sizeof(stream->path) - 1)
+    {
+        GLTH_LOGE(TAG, "Path too long below %s", stream->path);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    stream_truncate_path(stream, top->path_len);
+    if (sep_len)
+    {
+        stream->path[stream->path_len++] = '/';
+    }
+    memcpy(&stream->path[stream->path_len], segment, segment_len);
+    stream_truncate_path(stream, stream->path_len + segment_len);
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status stream_append_number(struct lightdb_stream *stream, int64_t number)
+{
+    char digits[20];
+    size_t num_digits = 0;
+    uint64_t magnitude = (number < 0 ? -(uint64_t) number : (uint64_t) number);
+    char segment[21];
+    size_t segment_len = 0;
+
+    do
+    {
+        digits[num_digits++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (number < 0)
+    {
+        segment[segment_len++] = '-';
+    }
+    while (num_digits > 0)
+    {
+        segment[segment_len++] = digits[--num_digits];
+    }
+
+    return stream_append_segment(stream, segment, segment_len);
+}
+
+static enum golioth_status stream_report(struct lightdb_stream *stream,
+                                         struct golioth_lightdb_stream_value *value)
+{
+    value->path = stream->path;
+
+    return stream->value_cb(value, stream->arg);
+}
+
+/* A data item is complete, which may complete the containers around it */
+static void stream_item_done(struct lightdb_stream *stream)
+{
+    struct stream_level *top;
+
+    while ((top = stream_top(stream)))
+    {
+        if (top->is_map)
+        {
+            top->expect_key = !top->expect_key;
+            if (!top->expect_key)
+            {
+                /* That was a key, its value follows */
+                return;
+            }
+        }
+        else
+        {
+            top->index++;
+        }
+
+        if (top->indefinite || --top->remaining > 0)
+        {
+            return;
+        }
+
+        stream_truncate_path(stream, top->path_len);
+        stream->depth--;
+    }
+
+    stream->state = STREAM_DONE;
+}
+
+static enum golioth_status stream_push(struct lightdb_stream *stream,
+                                       bool is_map,
+                                       bool indefinite,
+                                       uint64_t count)
+{
+    if (!indefinite && count == 0)
+    {
+        /* Empty containers hold no values */
+        stream_item_done(stream);
+        return GOLIOTH_OK;
+    }
+
+    if (stream->depth >= ARRAY_SIZE(stream->levels))
+    {
+        GLTH_LOGE(TAG, "Nested too deep at %s", stream->path);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    stream->levels[stream->depth++] = (struct stream_level) {
+        .is_map = is_map,
+        .indefinite = indefinite,
+        .expect_key = is_map,
+        .remaining = count,
+        .path_len = stream->path_len,
+    };
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status stream_pop_indefinite(struct lightdb_stream *stream)
+{
+    struct stream_level *top = stream_top(stream);
+
+    /* A break ends an indefinite container, between two items or pairs */
+    if (!top || !top->indefinite || (top->is_map && !top->expect_key))
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    stream_truncate_path(stream, top->path_len);
+    stream->depth--;
+    stream_item_done(stream);
+
+    return GOLIOTH_OK;
+}
+
+static double half_to_double(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    double mantissa = half & 0x3ff;
+    double value;
+
+    if (exponent == 0)
+    {
+        value = mantissa / (1 << 24);
+    }
+    else if (exponent == 31)
+    {
+        value = (mantissa == 0) ? INFINITY : NAN;
+    }
+    else
+    {
+        value = (mantissa + 1024) * (exponent > 25 ? (double) (1 << (exponent - 25))
+                                                   : 1.0 / (1 << (25 - exponent)));
+    }
+
+    return (half & 0x8000) ? -value : value;
+}
+
+static enum golioth_status stream_simple(struct lightdb_stream *stream,
+                                         uint8_t ai,
+                                         uint64_t argument)
+{
+    struct golioth_lightdb_stream_value value = {};
+
+    switch (ai)
+    {
+        case CBOR_AI_FALSE:
+        case CBOR_AI_TRUE:
+            value.type = GOLIOTH_LIGHTDB_STREAM_TYPE_BOOL;
+            value.b = (ai == CBOR_AI_TRUE);
+            break;
+        case CBOR_AI_NULL:
+        case CBOR_AI_UNDEFINED:
+            value.type = GOLIOTH_LIGHTDB_STREAM_TYPE_NULL;
+            break;
+        case CBOR_AI_HALF:
+            value.type = GOLIOTH_LIGHTDB_STREAM_TYPE_FLOAT;
+            value.f = half_to_double(argument);
+            break;
+        case CBOR_AI_FLOAT:
+        {
+            uint32_t bits = argument;
+            float f;
+
+            memcpy(&f, &bits, sizeof(f));
+            value.type = GOLIOTH_LIGHTDB_STREAM_TYPE_FLOAT;
+            value.f = f;
+            break;
+        }
+        case CBOR_AI_DOUBLE:
+            value.type = GOLIOTH_LIGHTDB_STREAM_TYPE_FLOAT;
+            memcpy(&value.f, &argument, sizeof(value.f));
+            break;
+        default:
+            return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    enum golioth_status status = stream_report(stream, &value);
+    if (status == GOLIOTH_OK)
+    {
+        stream_item_done(stream);
+    }
+
+    return status;
+}
+
+static enum golioth_status stream_string_done(struct lightdb_stream *stream)
+{
+    if (!stream->string_is_key && stream->string_len <= sizeof(stream->string_buf))
+    {
+        struct golioth_lightdb_stream_value value = {
+            .type = (stream->string_major == CBOR_MAJOR_TSTR ? GOLIOTH_LIGHTDB_STREAM_TYPE_STRING
+                                                             : GOLIOTH_LIGHTDB_STREAM_TYPE_BYTES),
+            .str =
+                {
+                    .data = stream->string_buf,
+                    .len = stream->string_buf_len,
+                    .offset = 0,
+                    .total_len = stream->string_len,
+                },
+        };
+
+        enum golioth_status status = stream_report(stream, &value);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+    }
+
+    stream->state = STREAM_HEAD;
+    stream_item_done(stream);
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status stream_string_data(struct lightdb_stream *stream,
+                                              const uint8_t *data,
+                                              size_t len)
+{
+    if (stream->string_is_key)
+    {
+        /* The key was checked to fit into the path when it started */
+        memcpy(&stream->path[stream->path_len], data, len);
+        stream_truncate_path(stream, stream->path_len + len);
+    }
+    else if (stream->string_len <= sizeof(stream->string_buf))
+    {
+        memcpy(&stream->string_buf[stream->string_buf_len], data, len);
+        stream->string_buf_len += len;
+    }
+    else
+    {
+        /* Long strings are reported in parts, as they arrive */
+        struct golioth_lightdb_stream_value value = {
+            .type = (stream->string_major == CBOR_MAJOR_TSTR ? GOLIOTH_LIGHTDB_STREAM_TYPE_STRING
+                                                             : GOLIOTH_LIGHTDB_STREAM_TYPE_BYTES),
+            .str =
+                {
+                    .data = data,
+                    .len = len,
+                    .offset = stream->string_offset,
+                    .total_len = stream->string_len,
+                },
+        };
+
+        enum golioth_status status = stream_report(stream, &value);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+    }
+
+    stream->string_offset += len;
+
+    if (stream->string_offset == stream->string_len)
+    {
+        return stream_string_done(stream);
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status stream_string_start(struct lightdb_stream *stream,
+                                               uint8_t major,
+                                               bool is_key,
+                                               uint64_t len)
+{
+    stream->string_is_key = is_key;
+    stream->string_major = major;
+    stream->string_len = len;
+    stream->string_offset = 0;
+    stream->string_buf_len = 0;
+
+    if (is_key)
+    {
+        enum golioth_status status = stream_append_segment(stream, "", 0);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+
+        if (stream->path_len + len > sizeof(stream->path) - 1)
+        {
+            GLTH_LOGE(TAG, "Path too long below %s", stream->path);
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    if (len == 0)
+    {
+        return stream_string_done(stream);
+    }
+
+    stream->state = STREAM_STRING;
+
+    return GOLIOTH_OK;
+}
+
+/* The initial byte and argument of a data item were received */
+static enum golioth_status stream_head(struct lightdb_stream *stream)
+{
+    uint8_t major = stream->initial >> 5;
+    uint8_t ai = stream->initial & 0x1f;
+    bool indefinite = (ai == CBOR_AI_INDEFINITE);
+    uint64_t argument = stream->argument;
+    struct stream_level *top = stream_top(stream);
+    bool is_key = top && top->is_map && top->expect_key;
+
+    stream->state = STREAM_HEAD;
+
+    if (major == CBOR_MAJOR_SIMPLE && indefinite)
+    {
+        return stream_pop_indefinite(stream);
+    }
+
+    /* Tags only annotate the following data item */
+    if (major == CBOR_MAJOR_TAG)
+    {
+        return indefinite ? GOLIOTH_ERR_INVALID_FORMAT : GOLIOTH_OK;
+    }
+
+    if (top && !top->is_map)
+    {
+        enum golioth_status status = stream_append_number(stream, top->index);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+    }
+
+    switch (major)
+    {
+        case CBOR_MAJOR_UINT:
+        case CBOR_MAJOR_NINT:
+        {
+            if (argument > INT64_MAX)
+            {
+                return GOLIOTH_ERR_INVALID_FORMAT;
+            }
+
+            int64_t number =
+                (major == CBOR_MAJOR_UINT ? (int64_t) argument : -1 - (int64_t) argument);
+
+            if (is_key)
+            {
+                enum golioth_status status = stream_append_number(stream, number);
+                if (status == GOLIOTH_OK)
+                {
+                    stream_item_done(stream);
+                }
+                return status;
+            }
+
+            struct golioth_lightdb_stream_value value = {
+                .type = GOLIOTH_LIGHTDB_STREAM_TYPE_INT,
+                .i = number,
+            };
+
+            enum golioth_status status = stream_report(stream, &value);
+            if (status == GOLIOTH_OK)
+            {
+                stream_item_done(stream);
+            }
+            return status;
+        }
+        case CBOR_MAJOR_BSTR:
+        case CBOR_MAJOR_TSTR:
+            /* Indefinite-length strings are not sent by the server */
+            if (indefinite || (is_key && major != CBOR_MAJOR_TSTR))
+            {
+                return GOLIOTH_ERR_INVALID_FORMAT;
+            }
+            return stream_string_start(stream, major, is_key, argument);
+        case CBOR_MAJOR_ARRAY:
+        case CBOR_MAJOR_MAP:
+            if (is_key)
+            {
+                return GOLIOTH_ERR_INVALID_FORMAT;
+            }
+            return stream_push(stream, major == CBOR_MAJOR_MAP, indefinite, argument);
+        default:
+            if (is_key)
+            {
+                return GOLIOTH_ERR_INVALID_FORMAT;
+            }
+            return stream_simple(stream, ai, argument);
+    }
+}
+
+static void lightdb_stream_init(struct lightdb_stream *stream,
+                                golioth_lightdb_stream_cb_fn value_cb,
+                                void *arg)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->value_cb = value_cb;
+    stream->arg = arg;
+}
+
+static enum golioth_status lightdb_stream_feed(struct lightdb_stream *stream,
+                                               const uint8_t *data,
+                                               size_t len)
+{
+    while (len > 0 && stream->status == GOLIOTH_OK)
+    {
+        stream->started = true;
+
+        switch (stream->state)
+        {
+            case STREAM_HEAD:
+            {
+                uint8_t ai = *data & 0x1f;
+
+                stream->initial = *data;
+                data++;
+                len--;
+
+                if (ai < 24 || ai == CBOR_AI_INDEFINITE)
+                {
+                    stream->argument = ai;
+                    stream->status = stream_head(stream);
+                }
+                else if (ai <= 27)
+                {
+                    stream->argument = 0;
+                    stream->arg_len = 1 << (ai - 24);
+                    stream->arg_received = 0;
+                    stream->state = STREAM_ARG;
+                }
+                else
+                {
+                    stream->status = GOLIOTH_ERR_INVALID_FORMAT;
+                }
+                break;
+            }
+            case STREAM_ARG:
+                stream->argument = (stream->argument << 8) | *data;
+                data++;
+                len--;
+
+                if (++stream->arg_received == stream->arg_len)
+                {
+                    stream->status = stream_head(stream);
+                }
+                break;
+            case STREAM_STRING:
+            {
+                size_t chunk_len = min(len, stream->string_len - stream->string_offset);
+
+                stream->status = stream_string_data(stream, data, chunk_len);
+                data += chunk_len;
+                len -= chunk_len;
+                break;
+            }
+            case STREAM_DONE:
+                GLTH_LOGE(TAG, "Data after the end of the document");
+                stream->status = GOLIOTH_ERR_INVALID_FORMAT;
+                break;
+        }
+    }
+
+    return stream->status;
+}
+
+static enum golioth_status lightdb_stream_finish(struct lightdb_stream *stream)
+{
+    if (stream->status == GOLIOTH_OK && stream->started && stream->state != STREAM_DONE)
+    {
+        GLTH_LOGE(TAG, "Document ended early");
+        stream->status = GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    return stream->status;
+}
+
+static enum golioth_status on_stream_block(struct golioth_client *client,
+                                           const char *path,
+                                           uint32_t block_idx,
+                                           const uint8_t *block_buffer,
+                                           size_t block_buffer_len,
+                                           bool is_last,
+                                           size_t negotiated_block_size,
+                                           void *arg)
+{
+    struct lightdb_stream_get *get = arg;
+
+    enum golioth_status status = lightdb_stream_feed(&get->stream, block_buffer, block_buffer_len);
+    if (status == GOLIOTH_OK && is_last)
+    {
+        status = lightdb_stream_finish(&get->stream);
+    }
+
+    return status;
+}
+
+static void on_stream_end(struct golioth_client *client,
+                          enum golioth_status status,
+                          const struct golioth_coap_rsp_code *coap_rsp_code,
+                          const char *path,
+                          uint32_t block_idx,
+                          void *arg)
+{
+    struct lightdb_stream_get *get = arg;
+
+    if (get->end_cb)
+    {
+        get->end_cb(client, status, coap_rsp_code, path, block_idx, get->arg);
+    }
+
+    golioth_sys_free(get);
+}
+
+enum golioth_status golioth_lightdb_stream_get(struct golioth_client *client,
+                                               const char *path,
+                                               golioth_lightdb_stream_cb_fn value_cb,
+                                               golioth_end_block_cb_fn end_cb,
+                                               void *callback_arg)
+{
+    if (!client || !path || !value_cb)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    struct lightdb_stream_get *get = golioth_sys_malloc(sizeof(*get));
+    if (!get)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    lightdb_stream_init(&get->stream, value_cb, callback_arg);
+    get->end_cb = end_cb;
+    get->arg = callback_arg;
+
+    enum golioth_status status = golioth_blockwise_get(client,
+                                                       GOLIOTH_LIGHTDB_STATE_PATH_PREFIX,
+                                                       path,
+                                                       GOLIOTH_CONTENT_TYPE_CBOR,
+                                                       0,
+                                                       on_stream_block,
+                                                       on_stream_end,
+                                                       get);
+    if (status != GOLIOTH_OK)
+    {
+        golioth_sys_free(get);
+    }
+
+    return status;
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <zcbor_encode.h>
+
+#include <golioth/config.h>
+#include "lightdb_tree.h"
+
+#if defined(CONFIG_GOLIOTH_LIGHTDB_STATE)
+
+static bool tree_selected(const struct lightdb_tree *tree, size_t i)
+{
+    return !tree->selected || tree->selected(tree->ctx, i);
+}
+
+bool lightdb_tree_valid(const struct lightdb_tree *tree, size_t num_values)
+{
+    for (size_t i = 0; i < num_values; i++)
+    {
+        const char *path = tree->path(tree->ctx, i);
+        size_t path_len = strlen(path);
+
+        /* Paths starting with this one are sorted right after it */
+        for (size_t j = i + 1; j < num_values; j++)
+        {
+            const char *next = tree->path(tree->ctx, j);
+
+            if (strncmp(next, path, path_len) != 0)
+            {
+                break;
+            }
+
+            if (next[path_len] == '\0' || next[path_len] == '/')
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool lightdb_tree_encode(zcbor_state_t *zse,
+                         const struct lightdb_tree *tree,
+                         size_t first,
+                         size_t last,
+                         size_t prefix_len)
+{
+    size_t i = first;
+
+    while (i < last)
+    {
+        const char *key = &tree->path(tree->ctx, i)[prefix_len];
+        const char *sep = strchr(key, '/');
+
+        if (!sep)
+        {
+            if (tree_selected(tree, i)
+                && !(zcbor_tstr_encode_ptr(zse, key, strlen(key))
+                     && tree->encode(zse, tree->ctx, i)))
+            {
+                return false;
+            }
+            i++;
+            continue;
+        }
+
+        /* Values under the same key form a nested map, left out if none of them is selected */
+        size_t key_len = sep - key;
+        size_t end = i;
+        bool selected = false;
+
+        while (end < last
+               && strncmp(&tree->path(tree->ctx, end)[prefix_len], key, key_len + 1) == 0)
+        {
+            selected = selected || tree_selected(tree, end);
+            end++;
+        }
+
+        if (selected
+            && !(zcbor_tstr_encode_ptr(zse, key, key_len) && zcbor_map_start_encode(zse, SIZE_MAX)
+                 && lightdb_tree_encode(zse, tree, i, end, prefix_len + key_len + 1)
+                 && zcbor_map_end_encode(zse, SIZE_MAX)))
+        {
+            return false;
+        }
+
+        i = end;
+    }
+
+    return true;
+}
+
+#endif  // CONFIG_GOLIOTH_LIGHTDB_STATE
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <zcbor_common.h>
+
+/*
+ * Values keyed by LightDB State path, such as "sensor/temp", encoded into one document with a
+ * nested map per path segment. Values are accessed by index, and must be sorted by path, so that
+ * values under the same path are next to each other.
+ */
+struct lightdb_tree
+{
+    void *ctx;
+    const char *(*path)(void *ctx, size_t i);
+    // Whether value i is part of the document. Can be NULL to include all values.
+    bool (*selected)(void *ctx, size_t i);
+    bool (*encode)(zcbor_state_t *zse, void *ctx, size_t i);
+};
+
+/* Check that no path is repeated, or holds both a value and other paths */
+bool lightdb_tree_valid(const struct lightdb_tree *tree, size_t num_values);
+
+/*
+ * Encode values [first, last) into the current map. Their paths all start with the same
+ * prefix_len bytes, the path of the current map, which are left out of the keys.
+ */
+bool lightdb_tree_encode(zcbor_state_t *zse,
+                         const struct lightdb_tree *tree,
+                         size_t first,
+                         size_t last,
+                         size_t prefix_len);
@@ -4,8 +4,11 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <assert.h>
+#include <string.h>
 #include <zcbor_encode.h>
 #include "coap_client.h"
+#include "log_internal.h"
+#include <golioth/config.h>
 #include <golioth/log.h>
 #include <golioth/golioth_debug.h>
 #include <golioth/zcbor_utils.h>
@@ -43,6 +46,281 @@ static const char *_level_to_str[GOLIOTH_LOG_LEVEL_DEBUG + 1] = {
     [GOLIOTH_LOG_LEVEL_INFO] = "info",
     [GOLIOTH_LOG_LEVEL_DEBUG] = "debug"};
 
+static bool log_encode_record(zcbor_state_t *zse,
+                              enum golioth_log_level level,
+                              const char *tag,
+                              const char *log_message)
+{
+    return zcbor_map_start_encode(zse, 3) && zcbor_tstr_put_lit(zse, "level")
+        && zcbor_tstr_put_term(zse, _level_to_str[level], 5) && zcbor_tstr_put_lit(zse, "module")
+        && zcbor_tstr_put_term(zse, tag, SIZE_MAX) && zcbor_tstr_put_lit(zse, "msg")
+        && zcbor_tstr_put_term(zse, log_message, SIZE_MAX) && zcbor_map_end_encode(zse, 3);
+}
+
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+
+// CoAP bytes of a log request besides its payload: header, token, Uri-Path options (the path,
+// with about one option byte per segment in place of the slashes), Content-Format option and
+// payload marker. Used to estimate what batching saves; DTLS overhead comes on top.
+#define LOG_REQUEST_OVERHEAD \
+    (4 + GOLIOTH_COAP_TOKEN_LEN + sizeof(GOLIOTH_LOG_PATH_PREFIX GOLIOTH_LOG_PATH) + 2 + 1)
+
+// Maximum size of the CBOR head of the array of records
+#define LOG_BATCH_HEAD_MAX 5
+
+struct log_batch
+{
+    // Protects everything below. Created by golioth_log_batch_init().
+    golioth_sys_mutex_t mutex;
+    golioth_sys_timer_t timer;
+    // Client the batched records are sent with
+    struct golioth_client *client;
+    // Set while the batch is enqueued, with the mutex released
+    bool sending;
+    // Encoded records, without the head of the array that holds them
+    uint8_t buf[CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE];
+    size_t len;
+    uint32_t num_records;
+    uint64_t first_record_ms;
+    struct golioth_log_batch_stats stats;
+};
+
+static struct log_batch batch;
+
+/* Send the batched records as one request. Must be called with the mutex held.
+ *
+ * The mutex is released while the request is enqueued, as the CoAP client may log, e.g. when
+ * its queue is full. Records logged meanwhile are sent on their own. */
+static void log_batch_flush_locked(void)
+{
+    if (batch.num_records == 0 || batch.sending)
+    {
+        return;
+    }
+
+    uint8_t head[LOG_BATCH_HEAD_MAX];
+    ZCBOR_STATE_E(zse, 0, head, sizeof(head), 1);
+
+    // An array head is the number of items encoded like an unsigned integer, with another major
+    // type. It is sent in front of the records, which were encoded before their number was known.
+    if (zcbor_uint32_put(zse, batch.num_records))
+    {
+        head[0] |= ZCBOR_MAJOR_TYPE_LIST << 5;
+        size_t head_len = zse->payload_mut - head;
+
+        uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+        golioth_coap_next_token(token);
+
+        batch.sending = true;
+        golioth_sys_mutex_unlock(batch.mutex);
+
+        enum golioth_status status = golioth_coap_client_set_with_header(batch.client,
+                                                                         token,
+                                                                         GOLIOTH_LOG_PATH_PREFIX,
+                                                                         GOLIOTH_LOG_PATH,
+                                                                         GOLIOTH_CONTENT_TYPE_CBOR,
+                                                                         head,
+                                                                         head_len,
+                                                                         batch.buf,
+                                                                         batch.len,
+                                                                         NULL,
+                                                                         NULL,
+                                                                         GOLIOTH_SYS_WAIT_FOREVER);
+
+        golioth_sys_mutex_lock(batch.mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        batch.sending = false;
+
+        if (status == GOLIOTH_OK)
+        {
+            size_t saved = (batch.num_records - 1) * LOG_REQUEST_OVERHEAD;
+
+            batch.stats.requests++;
+            batch.stats.records += batch.num_records;
+            batch.stats.bytes_saved += (saved > head_len) ? saved - head_len : 0;
+        }
+    }
+
+    // Records that could not be sent are dropped, like a single log request that fails
+    batch.len = 0;
+    batch.num_records = 0;
+}
+
+static bool log_batch_encode_locked(enum golioth_log_level level,
+                                    const char *tag,
+                                    const char *log_message)
+{
+    ZCBOR_STATE_E(zse, 1, &batch.buf[batch.len], sizeof(batch.buf) - batch.len, 1);
+
+    if (!log_encode_record(zse, level, tag, log_message))
+    {
+        return false;
+    }
+
+    batch.len = zse->payload - batch.buf;
+
+    return true;
+}
+
+/* Add a record to the batch. Returns false if it is too large for a batch and must be sent
+ * on its own. */
+static bool log_batch_add(struct golioth_client *client,
+                          enum golioth_log_level level,
+                          const char *tag,
+                          const char *log_message)
+{
+    bool batched = true;
+    uint64_t now_ms = golioth_sys_now_ms();
+
+    golioth_sys_mutex_lock(batch.mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (batch.sending)
+    {
+        batched = false;
+        goto unlock;
+    }
+
+    if (batch.num_records > 0 && batch.client != client)
+    {
+        log_batch_flush_locked();
+    }
+
+    if (!log_batch_encode_locked(level, tag, log_message))
+    {
+        // Size threshold: send what is batched, and start a new batch with this record
+        if (batch.num_records == 0)
+        {
+            batched = false;
+            goto unlock;
+        }
+
+        log_batch_flush_locked();
+
+        if (!log_batch_encode_locked(level, tag, log_message))
+        {
+            batched = false;
+            goto unlock;
+        }
+    }
+
+    if (batch.num_records == 0)
+    {
+        batch.client = client;
+        batch.first_record_ms = now_ms;
+        golioth_sys_timer_start(batch.timer);
+    }
+    batch.num_records++;
+
+    // Level and age thresholds. CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL counts levels from 1 for
+    // errors, like CONFIG_GOLIOTH_DEBUG_DEFAULT_LOG_LEVEL.
+    if ((int) level < CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL
+        || now_ms - batch.first_record_ms >= CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS)
+    {
+        log_batch_flush_locked();
+    }
+
+unlock:
+    golioth_sys_mutex_unlock(batch.mutex);
+
+    return batched;
+}
+
+static void on_log_batch_timer(golioth_sys_timer_t timer, void *arg)
+{
+    // Don't wait in timer context. Check again later if a record is being added.
+    if (!golioth_sys_mutex_lock(batch.mutex, 0))
+    {
+        golioth_sys_timer_start(timer);
+        return;
+    }
+
+    if (batch.num_records > 0 && !batch.sending)
+    {
+        if (golioth_sys_now_ms() - batch.first_record_ms >= CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS)
+        {
+            log_batch_flush_locked();
+        }
+        else
+        {
+            golioth_sys_timer_start(timer);
+        }
+    }
+
+    golioth_sys_mutex_unlock(batch.mutex);
+}
+
+void golioth_log_batch_init(void)
+{
+    /* Called by golioth_client_create(); created once, never destroyed */
+    if (!batch.mutex)
+    {
+        batch.mutex = golioth_sys_mutex_create();
+        assert(batch.mutex);
+
+        struct golioth_timer_config timer_cfg = {
+            .name = "log_batch",
+            .expiration_ms = CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS,
+            .fn = on_log_batch_timer,
+        };
+
+        batch.timer = golioth_sys_timer_create(&timer_cfg);
+        assert(batch.timer);
+    }
+}
+
+enum golioth_status golioth_log_flush(struct golioth_client *client)
+{
+    if (!batch.mutex)
+    {
+        return GOLIOTH_OK;
+    }
+
+    golioth_sys_mutex_lock(batch.mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    if (batch.client == client)
+    {
+        log_batch_flush_locked();
+    }
+    golioth_sys_mutex_unlock(batch.mutex);
+
+    return GOLIOTH_OK;
+}
+
+void golioth_log_batch_get_stats(struct golioth_log_batch_stats *stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    if (!batch.mutex)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    golioth_sys_mutex_lock(batch.mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    *stats = batch.stats;
+    golioth_sys_mutex_unlock(batch.mutex);
+}
+
+#else  // CONFIG_GOLIOTH_LOG_BATCH
+
+void golioth_log_batch_init(void) {}
+
+enum golioth_status golioth_log_flush(struct golioth_client *client)
+{
+    return GOLIOTH_OK;
+}
+
+void golioth_log_batch_get_stats(struct golioth_log_batch_stats *stats)
+{
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+#endif  // CONFIG_GOLIOTH_LOG_BATCH
+
 static enum golioth_status golioth_log_internal(struct golioth_client *client,
                                                 enum golioth_log_level level,
                                                 const char *tag,
@@ -53,9 +331,16 @@ static enum golioth_status golioth_log_internal(struct golioth_client *client,
 {
     assert(level <= GOLIOTH_LOG_LEVEL_DEBUG);
 
+#if defined(CONFIG_GOLIOTH_LOG_BATCH)
+    // Records with a callback are sent on their own, so the callback gets their response
+    if (!callback && log_batch_add(client, level, tag, log_message))
+    {
+        return GOLIOTH_OK;
+    }
+#endif
+
     uint8_t *cbor_buf = malloc(CBOR_LOG_MAX_LEN);
     enum golioth_status status = GOLIOTH_ERR_SERIALIZE;
-    bool ok;
 
     if (!cbor_buf)
     {
@@ -64,22 +349,7 @@ static enum golioth_status golioth_log_internal(struct golioth_client *client,
 
     ZCBOR_STATE_E(zse, 1, cbor_buf, CBOR_LOG_MAX_LEN, 1);
 
-    ok = zcbor_map_start_encode(zse, 3);
-    if (!ok)
-    {
-        goto cleanup;
-    }
-
-    ok = zcbor_tstr_put_lit(zse, "level") && zcbor_tstr_put_term(zse, _level_to_str[level], 5)
-        && zcbor_tstr_put_lit(zse, "module") && zcbor_tstr_put_term(zse, tag, SIZE_MAX)
-        && zcbor_tstr_put_lit(zse, "msg") && zcbor_tstr_put_term(zse, log_message, SIZE_MAX);
-    if (!ok)
-    {
-        goto cleanup;
-    }
-
-    ok = zcbor_map_end_encode(zse, 3);
-    if (!ok)
+    if (!log_encode_record(zse, level, tag, log_message))
     {
         goto cleanup;
     }
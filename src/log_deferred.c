@@ -0,0 +1,798 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <golioth/config.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "golioth_util.h"
+#include "log_internal.h"
+#include "ringbuf.h"
+
+// Important Note!
+//
+// Do not use GLTH_LOGX statements in this file, as it can cause an infinite
+// recursion with golioth_debug_printf().
+//
+// If you must log, use printf instead.
+
+#if defined(CONFIG_GOLIOTH_LOG_DEFERRED)
+
+// Longest conversion specification that is deferred, e.g. "%-+#012.8llx"
+#define LOG_CONVERSION_MAX_LEN 16
+
+// Longest conversion specification once '*' widths and precisions are replaced by their values
+#define LOG_SPEC_MAX_LEN (LOG_CONVERSION_MAX_LEN + 2 * sizeof("-2147483648"))
+
+enum log_arg_type
+{
+    LOG_ARG_NONE,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_INTMAX,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+};
+
+struct log_conversion
+{
+    // Length of the specification, from '%' to the conversion character
+    size_t len;
+    // Number of int arguments for '*' widths and precisions, before the value
+    uint8_t num_stars;
+    // Precision, or -1 if there is none. Taken from the last '*' argument if precision_star is set.
+    int precision;
+    bool precision_star;
+    enum log_arg_type type;
+};
+
+// Value of an argument, read with its own type, as the size of promoted arguments differs
+union log_arg_value
+{
+    int i;
+    long l;
+    long long ll;
+    intmax_t j;
+    size_t z;
+    ptrdiff_t t;
+    double d;
+    long double ld;
+    void *p;
+};
+
+/// A log message captured by golioth_debug_printf(), formatted later by the log thread
+struct log_deferred_record
+{
+    struct golioth_client *client;
+    const char *tag;
+    // Identifies the message. Like tag, it points to a string literal, and is only read when
+    // the record is formatted.
+    const char *format;
+    uint64_t tstamp_ms;
+    uint8_t level;
+    // Raw values of the arguments, in the order of the format. Strings are copied.
+    uint8_t args[CONFIG_GOLIOTH_LOG_DEFERRED_ARGS_SIZE];
+};
+
+/// Staging ring of the records logged by a single thread. Only that thread puts records, and
+/// only the log thread gets them, so the ring is used without a lock.
+///
+/// Threads may exit without telling, so once all rings are claimed, a thread logging for the
+/// first time reclaims a ring that is empty. The thread putting a record, or claiming the ring,
+/// holds busy, so that the ring never has two writers.
+struct log_producer
+{
+    // Thread the ring is claimed by, only changed while holding busy
+    _Atomic(golioth_sys_thread_id_t) thread;
+    atomic_bool busy;
+    ringbuf_t records;
+    uint8_t buffer[RINGBUF_BUFFER_SIZE(sizeof(struct log_deferred_record),
+                                       CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE)];
+    // Client of the last dropped record, set before dropped is incremented
+    struct golioth_client *dropped_client;
+    // Records dropped because the ring was full, only incremented while holding busy
+    atomic_uint_least32_t dropped;
+    // Dropped records already reported by the log thread
+    uint32_t reported;
+};
+
+static struct log_producer log_producers[CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS];
+// Only taken by a thread claiming a producer, never when putting records into its own
+static golioth_sys_mutex_t log_producers_mutex;
+static golioth_sys_sem_t log_ready;
+static golioth_sys_thread_t log_thread;
+static volatile golioth_sys_thread_id_t log_thread_id;
+
+// Oldest record of each producer, already taken from its ring by the log thread
+static struct log_deferred_record log_heads[CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS];
+static bool log_heads_valid[CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS];
+static char log_msg[CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN];
+
+/* Parse the conversion specification starting with the '%' at spec. Returns false if it can't be
+ * deferred. */
+static bool log_parse_conversion(const char *spec, struct log_conversion *conv)
+{
+    const char *p = spec + 1;
+    enum log_arg_type int_type = LOG_ARG_INT;
+    bool long_double = false;
+
+    conv->num_stars = 0;
+    conv->precision = -1;
+    conv->precision_star = false;
+
+    p += strspn(p, "-+ #0");
+
+    if (*p == '*')
+    {
+        conv->num_stars++;
+        p++;
+    }
+    else
+    {
+        p += strspn(p, "0123456789");
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            conv->num_stars++;
+            conv->precision_star = true;
+            p++;
+        }
+        else
+        {
+            conv->precision = 0;
+            for (; *p >= '0' && *p <= '9'; p++)
+            {
+                // Large precisions only need to be bounded, as they don't fit in a message
+                conv->precision = min(conv->precision * 10 + (*p - '0'), 0xFFFF);
+            }
+        }
+    }
+
+    switch (*p)
+    {
+        case 'h':
+            // Promoted to int
+            p += (p[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            if (p[1] == 'l')
+            {
+                int_type = LOG_ARG_LLONG;
+                p += 2;
+            }
+            else
+            {
+                int_type = LOG_ARG_LONG;
+                p++;
+            }
+            break;
+        case 'j':
+            int_type = LOG_ARG_INTMAX;
+            p++;
+            break;
+        case 'z':
+            int_type = LOG_ARG_SIZE;
+            p++;
+            break;
+        case 't':
+            int_type = LOG_ARG_PTRDIFF;
+            p++;
+            break;
+        case 'L':
+            long_double = true;
+            p++;
+            break;
+        default:
+            break;
+    }
+
+    switch (*p)
+    {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            conv->type = int_type;
+            break;
+        case 'c':
+            // Wide characters are not supported
+            if (int_type != LOG_ARG_INT)
+            {
+                return false;
+            }
+            conv->type = LOG_ARG_INT;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            conv->type = long_double ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            // Wide strings are not supported
+            if (int_type != LOG_ARG_INT)
+            {
+                return false;
+            }
+            conv->type = LOG_ARG_STR;
+            break;
+        case 'p':
+            conv->type = LOG_ARG_PTR;
+            break;
+        case '%':
+            conv->type = LOG_ARG_NONE;
+            break;
+        default:
+            // %n, and anything unknown
+            return false;
+    }
+
+    conv->len = p + 1 - spec;
+
+    return conv->len <= LOG_CONVERSION_MAX_LEN;
+}
+
+static size_t log_arg_size(enum log_arg_type type)
+{
+    switch (type)
+    {
+        case LOG_ARG_INT:
+            return sizeof(int);
+        case LOG_ARG_LONG:
+            return sizeof(long);
+        case LOG_ARG_LLONG:
+            return sizeof(long long);
+        case LOG_ARG_INTMAX:
+            return sizeof(intmax_t);
+        case LOG_ARG_SIZE:
+            return sizeof(size_t);
+        case LOG_ARG_PTRDIFF:
+            return sizeof(ptrdiff_t);
+        case LOG_ARG_DOUBLE:
+            return sizeof(double);
+        case LOG_ARG_LDOUBLE:
+            return sizeof(long double);
+        case LOG_ARG_PTR:
+            return sizeof(void *);
+        default:
+            return 0;
+    }
+}
+
+/* Copy the raw values of the arguments into args. Returns false if the format can't be deferred,
+ * or the arguments don't fit. */
+static bool log_args_pack(uint8_t *args, size_t args_size, const char *format, va_list ap)
+{
+    size_t len = 0;
+
+    for (const char *p = strchr(format, '%'); p; p = strchr(p, '%'))
+    {
+        struct log_conversion conv;
+
+        if (!log_parse_conversion(p, &conv))
+        {
+            return false;
+        }
+        p += conv.len;
+
+        for (uint8_t i = 0; i < conv.num_stars; i++)
+        {
+            int value = va_arg(ap, int);
+
+            if (len + sizeof(value) > args_size)
+            {
+                return false;
+            }
+            memcpy(&args[len], &value, sizeof(value));
+            len += sizeof(value);
+
+            // A negative precision is taken as if it was omitted
+            if (conv.precision_star && i == conv.num_stars - 1)
+            {
+                conv.precision = max(value, -1);
+            }
+        }
+
+        union log_arg_value value;
+        const char *str;
+
+        switch (conv.type)
+        {
+            case LOG_ARG_NONE:
+                continue;
+            case LOG_ARG_INT:
+                value.i = va_arg(ap, int);
+                break;
+            case LOG_ARG_LONG:
+                value.l = va_arg(ap, long);
+                break;
+            case LOG_ARG_LLONG:
+                value.ll = va_arg(ap, long long);
+                break;
+            case LOG_ARG_INTMAX:
+                value.j = va_arg(ap, intmax_t);
+                break;
+            case LOG_ARG_SIZE:
+                value.z = va_arg(ap, size_t);
+                break;
+            case LOG_ARG_PTRDIFF:
+                value.t = va_arg(ap, ptrdiff_t);
+                break;
+            case LOG_ARG_DOUBLE:
+                value.d = va_arg(ap, double);
+                break;
+            case LOG_ARG_LDOUBLE:
+                value.ld = va_arg(ap, long double);
+                break;
+            case LOG_ARG_PTR:
+                value.p = va_arg(ap, void *);
+                break;
+            case LOG_ARG_STR:
+                // The string may not outlive the call, so it is copied
+                str = va_arg(ap, const char *);
+                if (!str)
+                {
+                    str = "(null)";
+                }
+
+                // With a precision, the string may not be terminated
+                size_t str_len =
+                    (conv.precision >= 0) ? strnlen(str, conv.precision) : strlen(str);
+                if (len + str_len + 1 > args_size)
+                {
+                    return false;
+                }
+                memcpy(&args[len], str, str_len);
+                args[len + str_len] = '\0';
+                len += str_len + 1;
+                continue;
+        }
+
+        size_t size = log_arg_size(conv.type);
+        if (len + size > args_size)
+        {
+            return false;
+        }
+        memcpy(&args[len], &value, size);
+        len += size;
+    }
+
+    return true;
+}
+
+/* Format a message from its format and the arguments packed by log_args_pack() */
+static void log_args_format(char *msg, size_t msg_size, const char *format, const uint8_t *args)
+{
+    size_t pos = 0;
+    const char *p = format;
+
+    while (*p && pos < msg_size - 1)
+    {
+        if (*p != '%')
+        {
+            msg[pos++] = *p++;
+            continue;
+        }
+
+        struct log_conversion conv;
+        log_parse_conversion(p, &conv);
+
+        if (conv.type == LOG_ARG_NONE)
+        {
+            msg[pos++] = '%';
+            p += conv.len;
+            continue;
+        }
+
+        // Rebuild the specification, with the values of '*' widths and precisions
+        char spec[LOG_SPEC_MAX_LEN];
+        size_t spec_len = 0;
+
+        for (size_t i = 0; i < conv.len; i++)
+        {
+            if (p[i] == '*')
+            {
+                int star;
+                memcpy(&star, args, sizeof(star));
+                args += sizeof(star);
+
+                // A negative precision is taken as if it was omitted
+                if (p[i - 1] == '.' && star < 0)
+                {
+                    spec_len--;
+                    continue;
+                }
+                spec_len += snprintf(&spec[spec_len], sizeof(spec) - spec_len, "%d", star);
+            }
+            else
+            {
+                spec[spec_len++] = p[i];
+            }
+        }
+        spec[spec_len] = '\0';
+        p += conv.len;
+
+        char *out = &msg[pos];
+        size_t out_size = msg_size - pos;
+        union log_arg_value value;
+        size_t size = log_arg_size(conv.type);
+        int n = 0;
+
+        memcpy(&value, args, size);
+        args += size;
+
+        switch (conv.type)
+        {
+            case LOG_ARG_INT:
+                n = snprintf(out, out_size, spec, value.i);
+                break;
+            case LOG_ARG_LONG:
+                n = snprintf(out, out_size, spec, value.l);
+                break;
+            case LOG_ARG_LLONG:
+                n = snprintf(out, out_size, spec, value.ll);
+                break;
+            case LOG_ARG_INTMAX:
+                n = snprintf(out, out_size, spec, value.j);
+                break;
+            case LOG_ARG_SIZE:
+                n = snprintf(out, out_size, spec, value.z);
+                break;
+            case LOG_ARG_PTRDIFF:
+                n = snprintf(out, out_size, spec, value.t);
+                break;
+            case LOG_ARG_DOUBLE:
+                n = snprintf(out, out_size, spec, value.d);
+                break;
+            case LOG_ARG_LDOUBLE:
+                n = snprintf(out, out_size, spec, value.ld);
+                break;
+            case LOG_ARG_PTR:
+                n = snprintf(out, out_size, spec, value.p);
+                break;
+            case LOG_ARG_STR:
+                n = snprintf(out, out_size, spec, (const char *) args);
+                args += strlen((const char *) args) + 1;
+                break;
+            case LOG_ARG_NONE:
+                break;
+        }
+
+        if (n < 0)
+        {
+            break;
+        }
+        pos += min((size_t) n, out_size - 1);
+    }
+
+    msg[pos] = '\0';
+}
+
+static void log_deferred_send(const struct log_deferred_record *record)
+{
+#if defined(CONFIG_GOLIOTH_LOG_GOVERNOR)
+    // Checked here rather than when the record is put, so that producers don't take a lock
+    if (!golioth_log_governor_allow(record->client,
+                                    record->tstamp_ms,
+                                    record->level,
+                                    record->tag,
+                                    record->format))
+    {
+        return;
+    }
+#endif
+
+    log_args_format(log_msg, sizeof(log_msg), record->format, record->args);
+
+    golioth_debug_log_to_cloud(record->client, record->level, record->tag, log_msg);
+}
+
+static void log_deferred_report_dropped(struct log_producer *producer)
+{
+    uint32_t dropped = atomic_load_explicit(&producer->dropped, memory_order_acquire);
+
+    if (dropped == producer->reported)
+    {
+        return;
+    }
+
+    snprintf(log_msg,
+             sizeof(log_msg),
+             "%" PRIu32 " log messages dropped",
+             (uint32_t) (dropped - producer->reported));
+    producer->reported = dropped;
+
+    golioth_debug_log_to_cloud(producer->dropped_client,
+                               GOLIOTH_DEBUG_LOG_LEVEL_WARN,
+                               "golioth_log",
+                               log_msg);
+}
+
+/* Send the records of all producers, oldest first, until all rings are empty. Dropped records are
+ * reported after the records of the same producer, or at the end, if the producer has none left. */
+static void log_deferred_drain(void)
+{
+    while (true)
+    {
+        int oldest = -1;
+
+        for (int i = 0; i < (int) ARRAY_SIZE(log_producers); i++)
+        {
+            if (!log_heads_valid[i])
+            {
+                log_heads_valid[i] = ringbuf_get(&log_producers[i].records, &log_heads[i]);
+            }
+
+            if (log_heads_valid[i]
+                && (oldest < 0 || log_heads[i].tstamp_ms < log_heads[oldest].tstamp_ms))
+            {
+                oldest = i;
+            }
+        }
+
+        if (oldest < 0)
+        {
+            break;
+        }
+
+        log_deferred_send(&log_heads[oldest]);
+        log_heads_valid[oldest] = false;
+
+        log_deferred_report_dropped(&log_producers[oldest]);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers); i++)
+    {
+        log_deferred_report_dropped(&log_producers[i]);
+    }
+}
+
+static void log_deferred_thread(void *arg)
+{
+    log_thread_id = golioth_sys_thread_id();
+
+    while (true)
+    {
+        if (golioth_sys_sem_take(log_ready, GOLIOTH_SYS_WAIT_FOREVER))
+        {
+            log_deferred_drain();
+        }
+    }
+}
+
+static bool log_producer_hold(struct log_producer *producer)
+{
+    return !atomic_exchange_explicit(&producer->busy, true, memory_order_acquire);
+}
+
+static void log_producer_release(struct log_producer *producer)
+{
+    atomic_store_explicit(&producer->busy, false, memory_order_release);
+}
+
+/* Get the producer claimed by the calling thread, held. Returns NULL if it has none, or if it is
+ * being reclaimed by another thread. */
+static struct log_producer *log_producer_hold_own(golioth_sys_thread_id_t thread)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers); i++)
+    {
+        struct log_producer *producer = &log_producers[i];
+
+        if (atomic_load(&producer->thread) != thread)
+        {
+            continue;
+        }
+
+        if (!log_producer_hold(producer))
+        {
+            return NULL;
+        }
+
+        // Reclaimed before it was held
+        if (atomic_load(&producer->thread) != thread)
+        {
+            log_producer_release(producer);
+            return NULL;
+        }
+
+        return producer;
+    }
+
+    return NULL;
+}
+
+/* Claim a free producer, or else reclaim one with an empty ring, for the calling thread. The
+ * producer is returned held. Returns NULL if all rings have records. */
+static struct log_producer *log_producer_claim(golioth_sys_thread_id_t thread)
+{
+    struct log_producer *producer = NULL;
+
+    golioth_sys_mutex_lock(log_producers_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers) && !producer; i++)
+    {
+        if (!atomic_load(&log_producers[i].thread))
+        {
+            producer = &log_producers[i];
+        }
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers) && !producer; i++)
+    {
+        if (ringbuf_is_empty(&log_producers[i].records))
+        {
+            producer = &log_producers[i];
+        }
+    }
+
+    if (producer && !log_producer_hold(producer))
+    {
+        // Its owner is putting a record
+        producer = NULL;
+    }
+
+    if (producer)
+    {
+        // The owner may have put a record since the ring was checked, but can't while it is held
+        if (atomic_load(&producer->thread) && !ringbuf_is_empty(&producer->records))
+        {
+            log_producer_release(producer);
+            producer = NULL;
+        }
+        else
+        {
+            atomic_store(&producer->thread, thread);
+        }
+    }
+
+    golioth_sys_mutex_unlock(log_producers_mutex);
+
+    return producer;
+}
+
+void golioth_log_deferred_init(void)
+{
+    /* Called by golioth_client_create(); started once, never stopped */
+    if (log_thread)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers); i++)
+    {
+        struct log_producer *producer = &log_producers[i];
+
+        producer->records.buffer = producer->buffer;
+        producer->records.buffer_size = sizeof(producer->buffer);
+        producer->records.item_size = sizeof(struct log_deferred_record);
+    }
+
+    log_producers_mutex = golioth_sys_mutex_create();
+    if (!log_producers_mutex)
+    {
+        goto finish;
+    }
+
+    log_ready = golioth_sys_sem_create(ARRAY_SIZE(log_producers)
+                                           * CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE,
+                                       0);
+    if (!log_ready)
+    {
+        goto destroy_mutex;
+    }
+
+    struct golioth_thread_config thread_cfg = {
+        .name = "golioth_log",
+        .fn = log_deferred_thread,
+        .user_arg = NULL,
+        .stack_size = CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_STACK_SIZE,
+        .prio = CONFIG_GOLIOTH_LOG_DEFERRED_THREAD_PRIORITY,
+    };
+
+    log_thread = golioth_sys_thread_create(&thread_cfg);
+    if (log_thread)
+    {
+        return;
+    }
+
+    golioth_sys_sem_destroy(log_ready);
+    log_ready = NULL;
+
+destroy_mutex:
+    golioth_sys_mutex_destroy(log_producers_mutex);
+    log_producers_mutex = NULL;
+
+finish:
+    // Messages are formatted right away instead, until the next attempt to start the thread
+    printf("Failed to start the deferred log thread\n");
+}
+
+bool golioth_log_deferred_put(struct golioth_client *client,
+                              uint64_t tstamp_ms,
+                              enum golioth_debug_log_level level,
+                              const char *tag,
+                              const char *format,
+                              va_list args)
+{
+    if (!log_thread)
+    {
+        return false;
+    }
+
+    golioth_sys_thread_id_t thread = golioth_sys_thread_id();
+
+    // Logged while sending a message to Golioth, which would be logged again, and again
+    if (thread == log_thread_id)
+    {
+        return true;
+    }
+
+    struct log_deferred_record record = {
+        .client = client,
+        .tag = tag,
+        .format = format,
+        .tstamp_ms = tstamp_ms,
+        .level = level,
+    };
+
+    va_list ap;
+    va_copy(ap, args);
+    bool packed = log_args_pack(record.args, sizeof(record.args), format, ap);
+    va_end(ap);
+
+    if (!packed)
+    {
+        return false;
+    }
+
+    struct log_producer *producer = log_producer_hold_own(thread);
+    if (!producer)
+    {
+        producer = log_producer_claim(thread);
+    }
+    if (!producer)
+    {
+        return false;
+    }
+
+    if (!ringbuf_put(&producer->records, &record))
+    {
+        producer->dropped_client = client;
+        atomic_fetch_add_explicit(&producer->dropped, 1, memory_order_release);
+    }
+
+    log_producer_release(producer);
+
+    // Also wakes up the log thread to report dropped records
+    golioth_sys_sem_give(log_ready);
+
+    return true;
+}
+
+#else  // CONFIG_GOLIOTH_LOG_DEFERRED
+
+void golioth_log_deferred_init(void) {}
+
+#endif  // CONFIG_GOLIOTH_LOG_DEFERRED
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+
+#include <golioth/config.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "golioth_util.h"
+#include "log_internal.h"
+
+// Important Note!
+//
+// Do not use GLTH_LOGX statements in this file, as it can cause an infinite
+// recursion with golioth_debug_printf().
+//
+// If you must log, use printf instead.
+
+#if defined(CONFIG_GOLIOTH_LOG_GOVERNOR)
+
+// Tokens are counted in thousandths, so that they refill every millisecond
+#define LOG_TOKEN_SCALE 1000
+
+#define LOG_SUMMARY_MAX_LEN 96
+
+/// Recently logged message, identified by its tag and format
+struct log_governor_entry
+{
+    // Like for deferred messages, tag and format point to string literals, so are compared by
+    // address
+    const char *tag;
+    const char *format;
+    struct golioth_client *client;
+    uint64_t last_ms;
+    uint64_t last_sent_ms;
+    uint32_t suppressed;
+    uint8_t level;
+};
+
+/// Suppressed messages to report, collected under the lock and sent after releasing it
+struct log_governor_summary
+{
+    struct golioth_client *client;
+    const char *tag;
+    // NULL for the messages of evicted entries
+    const char *format;
+    uint32_t suppressed;
+    uint8_t level;
+};
+
+struct log_governor_bucket
+{
+    uint32_t tokens;
+    uint64_t last_ms;
+};
+
+static golioth_sys_mutex_t log_governor_mutex;
+static struct log_governor_entry log_entries[CONFIG_GOLIOTH_LOG_GOVERNOR_ENTRIES];
+static struct log_governor_bucket log_buckets[GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE + 1];
+static golioth_sys_timer_t log_summary_timer;
+// Set from the first message suppressed after summaries were sent, until the timer sends them
+static bool log_summary_pending;
+// Suppressed messages of evicted entries, reported together with the next summaries
+static struct log_governor_summary log_evicted = {
+    .tag = "golioth_log",
+    .level = GOLIOTH_DEBUG_LOG_LEVEL_WARN,
+};
+
+/* Take a token from the bucket of the level, after refilling it for the time elapsed since it was
+ * last used. Returns false if the bucket is empty. */
+static bool log_bucket_take(struct log_governor_bucket *bucket, uint64_t now_ms)
+{
+    const uint32_t max_tokens = CONFIG_GOLIOTH_LOG_GOVERNOR_BURST * LOG_TOKEN_SCALE;
+
+    if (bucket->last_ms == 0)
+    {
+        bucket->tokens = max_tokens;
+    }
+    else if (now_ms > bucket->last_ms)
+    {
+        uint64_t refill = (now_ms - bucket->last_ms) * CONFIG_GOLIOTH_LOG_GOVERNOR_RATE;
+
+        bucket->tokens = min(bucket->tokens + refill, max_tokens);
+    }
+    bucket->last_ms = now_ms;
+
+    if (bucket->tokens < LOG_TOKEN_SCALE)
+    {
+        return false;
+    }
+
+    bucket->tokens -= LOG_TOKEN_SCALE;
+
+    return true;
+}
+
+static void log_summary_add(struct log_governor_summary *summaries,
+                            size_t *num_summaries,
+                            struct log_governor_entry *entry)
+{
+    if (entry->suppressed == 0)
+    {
+        return;
+    }
+
+    summaries[(*num_summaries)++] = (struct log_governor_summary){
+        .client = entry->client,
+        .tag = entry->tag,
+        .format = entry->format,
+        .suppressed = entry->suppressed,
+        .level = entry->level,
+    };
+    entry->suppressed = 0;
+}
+
+/* Find the entry of a message, or replace the least recently used one. The suppressed messages of
+ * a replaced entry are added to the evicted count. */
+static struct log_governor_entry *log_entry_get(const char *tag, const char *format)
+{
+    struct log_governor_entry *lru = &log_entries[0];
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_entries); i++)
+    {
+        struct log_governor_entry *entry = &log_entries[i];
+
+        if (entry->tag == tag && entry->format == format)
+        {
+            return entry;
+        }
+
+        if (entry->last_ms < lru->last_ms)
+        {
+            lru = entry;
+        }
+    }
+
+    if (lru->suppressed > 0)
+    {
+        log_evicted.client = lru->client;
+        log_evicted.suppressed += lru->suppressed;
+    }
+
+    *lru = (struct log_governor_entry){
+        .tag = tag,
+        .format = format,
+    };
+
+    return lru;
+}
+
+static void on_log_summary_timer(golioth_sys_timer_t timer, void *arg)
+{
+    // One summary per entry, and one for evicted entries
+    struct log_governor_summary summaries[CONFIG_GOLIOTH_LOG_GOVERNOR_ENTRIES + 1];
+    size_t num_summaries = 0;
+
+    // Don't wait in timer context. Check again later if a message is being governed.
+    if (!golioth_sys_mutex_lock(log_governor_mutex, 0))
+    {
+        golioth_sys_timer_start(timer);
+        return;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_entries); i++)
+    {
+        log_summary_add(summaries, &num_summaries, &log_entries[i]);
+    }
+
+    if (log_evicted.suppressed > 0)
+    {
+        summaries[num_summaries++] = log_evicted;
+        log_evicted.suppressed = 0;
+    }
+
+    log_summary_pending = false;
+
+    golioth_sys_mutex_unlock(log_governor_mutex);
+
+    // Summaries are not rate limited, as there are at most one per entry, and one for evicted
+    // entries, per summary interval
+    for (size_t i = 0; i < num_summaries; i++)
+    {
+        char msg[LOG_SUMMARY_MAX_LEN];
+
+        if (summaries[i].format)
+        {
+            snprintf(msg,
+                     sizeof(msg),
+                     "%" PRIu32 " similar messages suppressed: %s",
+                     summaries[i].suppressed,
+                     summaries[i].format);
+        }
+        else
+        {
+            snprintf(msg,
+                     sizeof(msg),
+                     "%" PRIu32 " other messages suppressed",
+                     summaries[i].suppressed);
+        }
+
+        golioth_debug_log_to_cloud(summaries[i].client, summaries[i].level, summaries[i].tag, msg);
+    }
+}
+
+void golioth_log_governor_init(void)
+{
+    /* Called by golioth_client_create(); created once, never destroyed */
+    if (log_governor_mutex)
+    {
+        return;
+    }
+
+    log_governor_mutex = golioth_sys_mutex_create();
+    if (!log_governor_mutex)
+    {
+        return;
+    }
+
+    struct golioth_timer_config timer_cfg = {
+        .name = "log_governor",
+        .expiration_ms = CONFIG_GOLIOTH_LOG_GOVERNOR_SUMMARY_INTERVAL_MS,
+        .fn = on_log_summary_timer,
+    };
+
+    log_summary_timer = golioth_sys_timer_create(&timer_cfg);
+    if (!log_summary_timer)
+    {
+        // Messages are not governed, rather than suppressed without summaries
+        golioth_sys_mutex_destroy(log_governor_mutex);
+        log_governor_mutex = NULL;
+    }
+}
+
+bool golioth_log_governor_allow(struct golioth_client *client,
+                                uint64_t tstamp_ms,
+                                enum golioth_debug_log_level level,
+                                const char *tag,
+                                const char *format)
+{
+    bool allow = true;
+
+    if (!log_governor_mutex || level > GOLIOTH_DEBUG_LOG_LEVEL_VERBOSE)
+    {
+        return true;
+    }
+
+    // Zero means never, so timestamps start at 1
+    uint64_t now_ms = max(tstamp_ms, 1);
+
+    golioth_sys_mutex_lock(log_governor_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    struct log_governor_entry *entry = log_entry_get(tag, format);
+
+    // Same message again, too soon after the last one that was sent
+    if (entry->last_sent_ms != 0
+        && now_ms < entry->last_sent_ms + CONFIG_GOLIOTH_LOG_GOVERNOR_DEDUP_INTERVAL_MS)
+    {
+        allow = false;
+    }
+    else if (!log_bucket_take(&log_buckets[level], now_ms))
+    {
+        allow = false;
+    }
+
+    entry->client = client;
+    entry->level = level;
+    entry->last_ms = now_ms;
+
+    if (allow)
+    {
+        entry->last_sent_ms = now_ms;
+    }
+    else
+    {
+        entry->suppressed++;
+
+        // Summaries are sent by the timer, even if nothing is logged afterwards
+        if (!log_summary_pending)
+        {
+            log_summary_pending = golioth_sys_timer_start(log_summary_timer);
+        }
+    }
+
+    golioth_sys_mutex_unlock(log_governor_mutex);
+
+    return allow;
+}
+
+#else  // CONFIG_GOLIOTH_LOG_GOVERNOR
+
+void golioth_log_governor_init(void) {}
+
+#endif  // CONFIG_GOLIOTH_LOG_GOVERNOR
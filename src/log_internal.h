@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <golioth/golioth_debug.h>
+
+/* Create the resources used to batch log records. Called by golioth_client_create(). */
+void golioth_log_batch_init(void);
+
+/* Start the thread that formats deferred log messages. Called by golioth_client_create(). */
+void golioth_log_deferred_init(void);
+
+/* Capture a log message to be formatted and sent to Golioth by the deferred log thread.
+ *
+ * Only the raw arguments are copied, so tag and format must stay valid, like string literals.
+ * The message is added to the staging queue of the calling thread without taking a lock. It is
+ * dropped, and true is returned, if the queue is full or the message is logged by the deferred
+ * log thread itself. Returns false if the message can't be deferred, and must be formatted right
+ * away. */
+bool golioth_log_deferred_put(struct golioth_client *client,
+                              uint64_t tstamp_ms,
+                              enum golioth_debug_log_level level,
+                              const char *tag,
+                              const char *format,
+                              va_list args);
+
+/* Create the lock and summary timer of the log governor. Called by golioth_client_create(). */
+void golioth_log_governor_init(void);
+
+/* Decide if a message logged to Golioth is sent, or suppressed because the same tag and format
+ * were sent recently, or too many messages were sent at this level.
+ *
+ * Called by the deferred log thread, or by the logging thread if messages aren't deferred.
+ * Summaries of suppressed messages are sent to Golioth by a timer, once per summary interval. */
+bool golioth_log_governor_allow(struct golioth_client *client,
+                                uint64_t tstamp_ms,
+                                enum golioth_debug_log_level level,
+                                const char *tag,
+                                const char *format);
+
+/* Send a formatted message to Golioth, at the log level matching a GLTH_LOGX level */
+void golioth_debug_log_to_cloud(struct golioth_client *client,
+                                enum golioth_debug_log_level level,
+                                const char *tag,
+                                const char *msg);
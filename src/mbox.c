@@ -70,7 +70,10 @@ bool golioth_mbox_recv(golioth_mbox_t mbox, void *item, int32_t timeout_ms)
     bool received = golioth_sys_sem_take(mbox->fill_count_sem, timeout_ms);
     if (received)
     {
-        bool ret = ringbuf_get(&mbox->ringbuf, item);
+        bool ret = golioth_sys_sem_take(mbox->ringbuf_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        assert(ret);
+        ret = ringbuf_get(&mbox->ringbuf, item);
+        golioth_sys_sem_give(mbox->ringbuf_mutex);
         (void) ret;
         assert(ret);
     }
@@ -8,12 +8,12 @@
 #include <golioth/golioth_sys.h>
 #include "ringbuf.h"
 
-/// A multi-producer, single-consumer queue.
+/// A multi-producer, multi-consumer queue.
 ///
 /// This is basically a ringbuffer+semaphore+mutex. The semaphore is for
-/// signaling when queue has items, so the consumer can be efficiently notified.
-/// The mutex is for preventing multiple producers from accessing the ringbuffer
-/// at once.
+/// signaling when queue has items, so consumers can be efficiently notified.
+/// The mutex is for preventing multiple producers and consumers from accessing
+/// the ringbuffer at once.
 
 struct golioth_mbox
 {
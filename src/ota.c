@@ -13,6 +13,7 @@
 #include <golioth/ota.h>
 #include "coap_blockwise.h"
 #include "coap_client.h"
+#include "ota_decompress.h"
 #include <golioth/golioth_debug.h>
 #include <golioth/golioth_sys.h>
 #include "golioth/client.h"
@@ -69,6 +70,22 @@ size_t golioth_ota_size_to_nblocks(size_t component_size)
     return nblocks;
 }
 
+size_t golioth_ota_size_to_resume_nblocks(struct golioth_client *client, size_t component_size)
+{
+    size_t block_size = golioth_client_get_download_resume_block_size(client);
+    if (0 == block_size)
+    {
+        return 0;
+    }
+
+    size_t nblocks = component_size / block_size;
+    if ((component_size % block_size) != 0)
+    {
+        nblocks++;
+    }
+    return nblocks;
+}
+
 const struct golioth_ota_component *golioth_ota_find_component(
     const struct golioth_ota_manifest *manifest,
     const char *package)
@@ -88,14 +105,137 @@ const struct golioth_ota_component *golioth_ota_find_component(
     return found;
 }
 
+/* Digest and ETag of the last manifest passed to the subscription callback */
+static struct
+{
+    bool valid;
+    uint8_t digest[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
+    uint8_t etag[GOLIOTH_COAP_MAX_ETAG_LEN];
+    uint8_t etag_len;
+} _manifest_cache;
+
+static bool manifest_digest(const uint8_t *payload, size_t payload_size, uint8_t *digest)
+{
+    golioth_sys_sha256_t sha = golioth_sys_sha256_create();
+    if (NULL == sha)
+    {
+        return false;
+    }
+
+    bool ok = (GOLIOTH_OK == golioth_sys_sha256_update(sha, payload, payload_size))
+        && (GOLIOTH_OK == golioth_sys_sha256_finish(sha, digest));
+
+    golioth_sys_sha256_destroy(sha);
+
+    return ok;
+}
+
+/* Returns true if payload is the manifest last passed to the subscription callback */
+static bool manifest_cache_hit(const uint8_t *payload,
+                               size_t payload_size,
+                               const uint8_t *etag,
+                               size_t etag_len)
+{
+    uint8_t digest[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
+
+    if (!manifest_digest(payload, payload_size, digest))
+    {
+        /* Unable to tell, so treat the manifest as changed */
+        _manifest_cache.valid = false;
+        _manifest_cache.etag_len = 0;
+        return false;
+    }
+
+    bool hit = _manifest_cache.valid && 0 == memcmp(digest, _manifest_cache.digest, sizeof(digest));
+
+    /* Keep the ETag of an unchanged manifest if the response did not have one (notifications) */
+    if (!hit || etag_len > 0)
+    {
+        _manifest_cache.etag_len = 0;
+        if (etag_len > 0 && etag_len <= sizeof(_manifest_cache.etag))
+        {
+            memcpy(_manifest_cache.etag, etag, etag_len);
+            _manifest_cache.etag_len = etag_len;
+        }
+    }
+
+    memcpy(_manifest_cache.digest, digest, sizeof(digest));
+    _manifest_cache.valid = true;
+
+    return hit;
+}
+
+static void ota_manifest_deliver(struct golioth_client *client,
+                                 enum golioth_status status,
+                                 const struct golioth_coap_rsp_code *coap_rsp_code,
+                                 const char *path,
+                                 const uint8_t *etag,
+                                 size_t etag_len,
+                                 const uint8_t *payload,
+                                 size_t payload_size,
+                                 void *arg)
+{
+    struct manifest_get_args *get_args = arg;
+
+    if (GOLIOTH_OK == status)
+    {
+        /* 2.03 Valid: the server confirmed the ETag of the cached manifest */
+        if (coap_rsp_code && 2 == coap_rsp_code->code_class && 3 == coap_rsp_code->code_detail)
+        {
+            GLTH_LOGD(TAG, "OTA manifest unchanged (validated)");
+            return;
+        }
+
+        if (manifest_cache_hit(payload, payload_size, etag, etag_len))
+        {
+            GLTH_LOGD(TAG, "OTA manifest unchanged");
+            return;
+        }
+    }
+
+    get_args->cb(client, status, coap_rsp_code, path, payload, payload_size, get_args->arg);
+}
+
+static void ota_manifest_observe_cb(struct golioth_client *client,
+                                    enum golioth_status status,
+                                    const struct golioth_coap_rsp_code *coap_rsp_code,
+                                    const char *path,
+                                    const uint8_t *payload,
+                                    size_t payload_size,
+                                    void *arg)
+{
+    ota_manifest_deliver(client, status, coap_rsp_code, path, NULL, 0, payload, payload_size, arg);
+}
+
+static enum golioth_status ota_manifest_poll(struct manifest_get_args *get_args)
+{
+    if (!CONFIG_GOLIOTH_OTA_MANIFEST_CACHE)
+    {
+        return golioth_ota_get_manifest(get_args->client, get_args->cb, get_args->arg);
+    }
+
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    return golioth_coap_client_get_etag(get_args->client,
+                                        token,
+                                        GOLIOTH_OTA_MANIFEST_PATH_PREFIX,
+                                        GOLIOTH_OTA_MANIFEST_PATH_DESIRED,
+                                        GOLIOTH_CONTENT_TYPE_CBOR,
+                                        _manifest_cache.etag,
+                                        _manifest_cache.etag_len,
+                                        ota_manifest_deliver,
+                                        get_args,
+                                        GOLIOTH_SYS_WAIT_FOREVER);
+}
+
 static void ota_manifest_timer_expiry(golioth_sys_timer_t timer, void *user_arg)
 {
     struct manifest_get_args *get_args = user_arg;
 
     if (golioth_client_is_running(get_args->client))
     {
-        enum golioth_status status =
-            golioth_ota_get_manifest(get_args->client, get_args->cb, get_args->arg);
+        enum golioth_status status = ota_manifest_poll(get_args);
 
         if (GOLIOTH_OK != status)
         {
@@ -120,22 +260,27 @@ enum golioth_status golioth_ota_manifest_subscribe(struct golioth_client *client
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     golioth_coap_next_token(token);
 
-    enum golioth_status status = golioth_coap_client_observe(client,
-                                                             token,
-                                                             GOLIOTH_OTA_MANIFEST_PATH_PREFIX,
-                                                             GOLIOTH_OTA_MANIFEST_PATH_DESIRED,
-                                                             GOLIOTH_CONTENT_TYPE_CBOR,
-                                                             callback,
-                                                             arg);
+    manifest_timer_arg.client = client;
+    manifest_timer_arg.cb = callback;
+    manifest_timer_arg.arg = arg;
+
+    /* Always pass the first manifest after subscribing */
+    _manifest_cache.valid = false;
+    _manifest_cache.etag_len = 0;
+
+    enum golioth_status status = golioth_coap_client_observe(
+        client,
+        token,
+        GOLIOTH_OTA_MANIFEST_PATH_PREFIX,
+        GOLIOTH_OTA_MANIFEST_PATH_DESIRED,
+        GOLIOTH_CONTENT_TYPE_CBOR,
+        CONFIG_GOLIOTH_OTA_MANIFEST_CACHE ? ota_manifest_observe_cb : callback,
+        CONFIG_GOLIOTH_OTA_MANIFEST_CACHE ? (void *) &manifest_timer_arg : arg);
     if (GOLIOTH_OK != status)
     {
         return status;
     }
 
-    manifest_timer_arg.client = client;
-    manifest_timer_arg.cb = callback;
-    manifest_timer_arg.arg = arg;
-
     if (!manifest_timer_initialized && CONFIG_GOLIOTH_OTA_MANIFEST_SUBSCRIPTION_POLL_INTERVAL_S > 0)
     {
         struct golioth_timer_config cfg = {
@@ -411,6 +556,7 @@ struct ota_component_blockwise_ctx
     ota_component_block_write_cb block_cb;
     ota_component_download_end_cb end_cb;
     void *arg;
+    struct ota_decompress_stage *decompress;
 };
 
 static enum golioth_status ota_component_write_cb_wrapper(struct golioth_client *client,
@@ -425,6 +571,27 @@ static enum golioth_status ota_component_write_cb_wrapper(struct golioth_client
     assert(arg);
     struct ota_component_blockwise_ctx *ctx = arg;
 
+    if (CONFIG_GOLIOTH_OTA_DECOMPRESS && !ctx->decompress && 0 == block_idx
+        && ota_decompress_is_compressed(block_buffer, block_buffer_len))
+    {
+        ctx->decompress = ota_decompress_stage_create(ctx->component);
+        if (!ctx->decompress)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    if (ctx->decompress)
+    {
+        return ota_decompress_stage_write(ctx->decompress,
+                                          block_idx * negotiated_block_size,
+                                          block_buffer,
+                                          block_buffer_len,
+                                          is_last,
+                                          ctx->block_cb,
+                                          ctx->arg);
+    }
+
     enum golioth_status status = ctx->block_cb(ctx->component,
                                                block_idx,
                                                block_buffer,
@@ -445,8 +612,28 @@ static void ota_component_download_end_cb_wrapper(struct golioth_client *client,
 {
     assert(arg);
     struct ota_component_blockwise_ctx *ctx = arg;
+    const struct golioth_ota_component *component = ctx->component;
+
+    if (ctx->decompress)
+    {
+        component = ota_decompress_stage_component(ctx->decompress);
+
+    }
 
-    ctx->end_cb(status, coap_rsp_code, ctx->component, block_idx, ctx->arg);
+    ctx->end_cb(status, coap_rsp_code, component, block_idx, ctx->arg);
+
+    if (ctx->decompress)
+    {
+        /* Keep the decompressor state, in case the download is resumed */
+        if (GOLIOTH_OK != status)
+        {
+            ota_decompress_stage_save(ctx->decompress);
+        }
+        else
+        {
+            ota_decompress_stage_destroy(ctx->decompress);
+        }
+    }
 
     golioth_sys_free(ctx);
 }
@@ -460,20 +647,46 @@ enum golioth_status golioth_ota_download_component(struct golioth_client *client
 {
     struct ota_component_blockwise_ctx *ctx =
         golioth_sys_malloc(sizeof(struct ota_component_blockwise_ctx));
+    if (!ctx)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
     ctx->component = component;
     ctx->block_cb = block_cb;
     ctx->end_cb = end_cb;
     ctx->arg = arg;
+    ctx->decompress = NULL;
+
+    enum golioth_status status = GOLIOTH_OK;
+    if (CONFIG_GOLIOTH_OTA_DECOMPRESS)
+    {
+        status = ota_decompress_stage_restore(component, block_idx, &ctx->decompress);
+        if (GOLIOTH_OK != status)
+        {
+            golioth_sys_free(ctx);
+            return status;
+        }
+    }
 
+    status = golioth_blockwise_get(client,
+                                   "",
+                                   component->uri,
+                                   GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
+                                   block_idx,
+                                   ota_component_write_cb_wrapper,
+                                   ota_component_download_end_cb_wrapper,
+                                   ctx);
+    if (GOLIOTH_OK != status)
+    {
+        if (ctx->decompress)
+        {
+            ota_decompress_stage_save(ctx->decompress);
+        }
+        golioth_sys_free(ctx);
+    }
 
-    return golioth_blockwise_get(client,
-                                 "",
-                                 component->uri,
-                                 GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
-                                 block_idx,
-                                 ota_component_write_cb_wrapper,
-                                 ota_component_download_end_cb_wrapper,
-                                 ctx);
+    return status;
 }
 
 enum golioth_ota_state golioth_ota_get_state(void)
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+#include "ota_decompress.h"
+#include "golioth_util.h"
+
+#if defined(CONFIG_GOLIOTH_OTA) || defined(CONFIG_GOLIOTH_FW_UPDATE)
+
+LOG_TAG_DEFINE(golioth_ota_decompress);
+
+/* Stage as it was before the current input block, restored if the block fails */
+struct ota_decompress_checkpoint
+{
+    size_t hdr_len;
+    size_t produced;
+    uint32_t out_block_idx;
+    size_t out_len;
+    uint8_t out[CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE];
+};
+
+struct ota_decompress_stage
+{
+    /* Describes the decompressed image, passed to the callbacks */
+    struct golioth_ota_component component;
+    uint8_t artifact_hash[GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN];
+    /* Hash of the compressed component, updated as each input block is accepted */
+    golioth_sys_sha256_t sha;
+    uint8_t hdr[GOLIOTH_OTA_DECOMPRESS_HEADER_LEN];
+    size_t hdr_len;
+    const struct golioth_ota_decompressor *decompressor;
+    void *state;
+    void *checkpoint_state;
+    struct ota_decompress_checkpoint checkpoint;
+    size_t in_offset;
+    size_t produced;
+    ota_component_block_write_cb block_cb;
+    void *arg;
+    uint32_t out_block_idx;
+    size_t out_len;
+    uint8_t out[CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE];
+};
+
+static const struct golioth_ota_decompressor *_custom_decompressor;
+
+/* Stages of interrupted downloads, at most one per component and oldest first, so that each
+ * download can be resumed independently of the others */
+static golioth_sys_mutex_t _saved_stages_mutex;
+static struct ota_decompress_stage *_saved_stages[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+static size_t _num_saved_stages;
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return (uint32_t) buf[0] | ((uint32_t) buf[1] << 8) | ((uint32_t) buf[2] << 16)
+        | ((uint32_t) buf[3] << 24);
+}
+
+/*--------------------------------------------------
+ * heatshrink
+ *------------------------------------------------*/
+
+enum hs_state
+{
+    HS_STATE_TAG,
+    HS_STATE_LITERAL,
+    HS_STATE_INDEX,
+    HS_STATE_COUNT,
+};
+
+struct hs_decoder
+{
+    uint8_t window_sz2;
+    uint8_t lookahead_sz2;
+    uint8_t state;
+    uint8_t bit_count;
+    uint32_t bit_buf;
+    size_t index;
+    /* Next position written in window, and start of the bytes not yet output */
+    size_t head;
+    size_t flushed;
+    uint8_t window[1 << CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2];
+};
+
+static enum golioth_status hs_init(void *state, const uint8_t params[2])
+{
+    struct hs_decoder *hs = state;
+
+    if (params[0] < 4 || params[0] > CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2 || params[1] < 3
+        || params[1] >= params[0])
+    {
+        GLTH_LOGE(TAG, "Unsupported heatshrink parameters: -w %u -l %u", params[0], params[1]);
+        return GOLIOTH_ERR_NOT_IMPLEMENTED;
+    }
+
+    memset(hs, 0, sizeof(*hs));
+    hs->window_sz2 = params[0];
+    hs->lookahead_sz2 = params[1];
+    hs->state = HS_STATE_TAG;
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status hs_flush(struct hs_decoder *hs,
+                                    golioth_ota_decompress_output_cb output,
+                                    void *output_arg)
+{
+    enum golioth_status status = GOLIOTH_OK;
+
+    if (hs->head > hs->flushed)
+    {
+        status = output(&hs->window[hs->flushed], hs->head - hs->flushed, output_arg);
+    }
+
+    hs->flushed = hs->head;
+
+    return status;
+}
+
+// Append a byte to the window. Output is flushed when the window wraps around.
+static enum golioth_status hs_put(struct hs_decoder *hs,
+                                  uint8_t byte,
+                                  golioth_ota_decompress_output_cb output,
+                                  void *output_arg)
+{
+    hs->window[hs->head++] = byte;
+
+    if (hs->head < ((size_t) 1 << hs->window_sz2))
+    {
+        return GOLIOTH_OK;
+    }
+
+    enum golioth_status status = hs_flush(hs, output, output_arg);
+    hs->head = 0;
+    hs->flushed = 0;
+
+    return status;
+}
+
+static enum golioth_status hs_backref(struct hs_decoder *hs,
+                                      size_t count,
+                                      golioth_ota_decompress_output_cb output,
+                                      void *output_arg)
+{
+    size_t mask = ((size_t) 1 << hs->window_sz2) - 1;
+    size_t offset = hs->index + 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        enum golioth_status status =
+            hs_put(hs, hs->window[(hs->head - offset) & mask], output, output_arg);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status hs_process(void *state,
+                                      const uint8_t *data,
+                                      size_t len,
+                                      golioth_ota_decompress_output_cb output,
+                                      void *output_arg)
+{
+    struct hs_decoder *hs = state;
+    enum golioth_status status = GOLIOTH_OK;
+
+    for (size_t i = 0; i < len && GOLIOTH_OK == status; i++)
+    {
+        hs->bit_buf = (hs->bit_buf << 8) | data[i];
+        hs->bit_count += 8;
+
+        while (GOLIOTH_OK == status)
+        {
+            uint8_t need = 1;
+            if (HS_STATE_LITERAL == hs->state)
+            {
+                need = 8;
+            }
+            else if (HS_STATE_INDEX == hs->state)
+            {
+                need = hs->window_sz2;
+            }
+            else if (HS_STATE_COUNT == hs->state)
+            {
+                need = hs->lookahead_sz2;
+            }
+
+            if (hs->bit_count < need)
+            {
+                break;
+            }
+
+            /* Values are stored MSB first */
+            hs->bit_count -= need;
+            uint32_t value = (hs->bit_buf >> hs->bit_count) & ((1U << need) - 1);
+
+            switch (hs->state)
+            {
+                case HS_STATE_TAG:
+                    hs->state = value ? HS_STATE_LITERAL : HS_STATE_INDEX;
+                    break;
+                case HS_STATE_LITERAL:
+                    status = hs_put(hs, (uint8_t) value, output, output_arg);
+                    hs->state = HS_STATE_TAG;
+                    break;
+                case HS_STATE_INDEX:
+                    hs->index = value;
+                    hs->state = HS_STATE_COUNT;
+                    break;
+                default:
+                    status = hs_backref(hs, value + 1, output, output_arg);
+                    hs->state = HS_STATE_TAG;
+                    break;
+            }
+        }
+    }
+
+    if (GOLIOTH_OK == status)
+    {
+        status = hs_flush(hs, output, output_arg);
+    }
+
+    return status;
+}
+
+const struct golioth_ota_decompressor golioth_ota_decompressor_heatshrink = {
+    .algorithm = GOLIOTH_OTA_COMPRESSION_HEATSHRINK,
+    .state_size = sizeof(struct hs_decoder),
+    .init = hs_init,
+    .process = hs_process,
+};
+
+/*--------------------------------------------------
+ * Decompression stage
+ *------------------------------------------------*/
+
+void golioth_ota_register_decompressor(const struct golioth_ota_decompressor *decompressor)
+{
+    _custom_decompressor = decompressor;
+}
+
+const struct golioth_ota_decompressor *ota_decompressor_find(uint8_t algorithm)
+{
+    if (golioth_ota_decompressor_heatshrink.algorithm == algorithm)
+    {
+        return &golioth_ota_decompressor_heatshrink;
+    }
+    if (_custom_decompressor && _custom_decompressor->algorithm == algorithm)
+    {
+        return _custom_decompressor;
+    }
+
+    GLTH_LOGE(TAG, "No decompressor for algorithm %u", algorithm);
+    return NULL;
+}
+
+void ota_decompress_init(void)
+{
+    /* Called by golioth_client_create(); created once, never destroyed */
+    if (_saved_stages_mutex)
+    {
+        return;
+    }
+
+    _saved_stages_mutex = golioth_sys_mutex_create();
+}
+
+bool ota_decompress_is_compressed(const uint8_t *data, size_t len)
+{
+    return (len >= 4) && (0 == memcmp(data, GOLIOTH_OTA_DECOMPRESS_MAGIC, 4));
+}
+
+struct ota_decompress_stage *ota_decompress_stage_create(
+    const struct golioth_ota_component *component)
+{
+    struct ota_decompress_stage *stage = golioth_sys_malloc(sizeof(struct ota_decompress_stage));
+    if (!stage)
+    {
+        return NULL;
+    }
+
+    memset(stage, 0, sizeof(*stage));
+    memcpy(&stage->component, component, sizeof(stage->component));
+    memcpy(stage->artifact_hash, component->hash, sizeof(stage->artifact_hash));
+    stage->component.decompressed = true;
+
+    stage->sha = golioth_sys_sha256_create();
+    if (!stage->sha)
+    {
+        golioth_sys_free(stage);
+        return NULL;
+    }
+
+    return stage;
+}
+
+static void stage_free_state(struct ota_decompress_stage *stage)
+{
+    if (stage->state)
+    {
+        if (stage->decompressor->deinit)
+        {
+            stage->decompressor->deinit(stage->state);
+        }
+        golioth_sys_free(stage->state);
+        stage->state = NULL;
+    }
+
+    golioth_sys_free(stage->checkpoint_state);
+    stage->checkpoint_state = NULL;
+}
+
+void ota_decompress_stage_destroy(struct ota_decompress_stage *stage)
+{
+    if (!stage)
+    {
+        return;
+    }
+
+    stage_free_state(stage);
+
+    if (stage->sha)
+    {
+        golioth_sys_sha256_destroy(stage->sha);
+    }
+
+    golioth_sys_free(stage);
+}
+
+void ota_decompress_stage_save(struct ota_decompress_stage *stage)
+{
+    struct ota_decompress_stage *evicted = NULL;
+
+    golioth_sys_mutex_lock(_saved_stages_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (_num_saved_stages == ARRAY_SIZE(_saved_stages))
+    {
+        evicted = _saved_stages[0];
+        _num_saved_stages--;
+        memmove(&_saved_stages[0], &_saved_stages[1], _num_saved_stages * sizeof(_saved_stages[0]));
+    }
+
+    _saved_stages[_num_saved_stages++] = stage;
+
+    golioth_sys_mutex_unlock(_saved_stages_mutex);
+
+    if (evicted)
+    {
+        GLTH_LOGW(TAG, "Dropping decompressor state of %s", evicted->component.uri);
+        ota_decompress_stage_destroy(evicted);
+    }
+}
+
+enum golioth_status ota_decompress_stage_restore(const struct golioth_ota_component *component,
+                                                 uint32_t block_idx,
+                                                 struct ota_decompress_stage **stage)
+{
+    struct ota_decompress_stage *saved = NULL;
+
+    *stage = NULL;
+
+    golioth_sys_mutex_lock(_saved_stages_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    for (size_t i = 0; i < _num_saved_stages; i++)
+    {
+        if (0 == strcmp(_saved_stages[i]->component.uri, component->uri))
+        {
+            saved = _saved_stages[i];
+            _num_saved_stages--;
+            memmove(&_saved_stages[i],
+                    &_saved_stages[i + 1],
+                    (_num_saved_stages - i) * sizeof(_saved_stages[0]));
+            break;
+        }
+    }
+
+    golioth_sys_mutex_unlock(_saved_stages_mutex);
+
+    if (0 == block_idx)
+    {
+        /* Starting over, compression is detected again from the header */
+        ota_decompress_stage_destroy(saved);
+        return GOLIOTH_OK;
+    }
+
+    if (saved
+        && (!saved->sha
+            || 0 != memcmp(saved->artifact_hash, component->hash, sizeof(saved->artifact_hash))))
+    {
+        GLTH_LOGE(TAG, "Can't resume decompression of %s", component->uri);
+        ota_decompress_stage_destroy(saved);
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    *stage = saved;
+
+    return GOLIOTH_OK;
+}
+
+const struct golioth_ota_component *ota_decompress_stage_component(
+    const struct ota_decompress_stage *stage)
+{
+    return &stage->component;
+}
+
+static enum golioth_status stage_deliver(struct ota_decompress_stage *stage, bool is_last)
+{
+    enum golioth_status status = stage->block_cb(&stage->component,
+                                                 stage->out_block_idx,
+                                                 stage->out,
+                                                 stage->out_len,
+                                                 is_last,
+                                                 sizeof(stage->out),
+                                                 stage->arg);
+
+    stage->out_block_idx++;
+    stage->out_len = 0;
+
+    return status;
+}
+
+// Collect decompressed data into blocks. A full block is only passed on once more data
+// follows, so that the last block can be flagged as such.
+static enum golioth_status stage_output(const uint8_t *data, size_t len, void *arg)
+{
+    struct ota_decompress_stage *stage = arg;
+
+    if (len > (size_t) stage->component.size - stage->produced)
+    {
+        GLTH_LOGE(TAG, "Decompressed image exceeds %" PRId32 " bytes", stage->component.size);
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    stage->produced += len;
+
+    while (len > 0)
+    {
+        if (stage->out_len == sizeof(stage->out))
+        {
+            enum golioth_status status = stage_deliver(stage, false);
+            if (GOLIOTH_OK != status)
+            {
+                return status;
+            }
+        }
+
+        size_t n = min(len, sizeof(stage->out) - stage->out_len);
+        memcpy(&stage->out[stage->out_len], data, n);
+        stage->out_len += n;
+        data += n;
+        len -= n;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status stage_parse_header(struct ota_decompress_stage *stage)
+{
+    uint8_t algorithm = stage->hdr[4];
+
+    stage->decompressor = ota_decompressor_find(algorithm);
+    if (!stage->decompressor)
+    {
+        return GOLIOTH_ERR_NOT_IMPLEMENTED;
+    }
+
+    uint32_t image_size = get_le32(&stage->hdr[8]);
+    if (image_size > INT32_MAX)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    stage->component.size = (int32_t) image_size;
+    memcpy(stage->component.hash, &stage->hdr[12], sizeof(stage->component.hash));
+
+    stage->state = golioth_sys_malloc(stage->decompressor->state_size);
+    stage->checkpoint_state = golioth_sys_malloc(stage->decompressor->state_size);
+    if (!stage->state || !stage->checkpoint_state)
+    {
+        golioth_sys_free(stage->state);
+        golioth_sys_free(stage->checkpoint_state);
+        stage->state = NULL;
+        stage->checkpoint_state = NULL;
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    GLTH_LOGI(TAG,
+              "Decompressing %" PRId32 " byte image (algorithm %u)",
+              stage->component.size,
+              algorithm);
+
+    return stage->decompressor->init(stage->state, &stage->hdr[5]);
+}
+
+// Save the stage before an input block, so that the block can be fed again if it fails,
+// such as when the block callback fails after part of its output was passed on
+static void stage_checkpoint(struct ota_decompress_stage *stage)
+{
+    struct ota_decompress_checkpoint *cp = &stage->checkpoint;
+
+    cp->hdr_len = stage->hdr_len;
+    cp->produced = stage->produced;
+    cp->out_block_idx = stage->out_block_idx;
+    cp->out_len = stage->out_len;
+    memcpy(cp->out, stage->out, stage->out_len);
+
+    if (stage->state)
+    {
+        memcpy(stage->checkpoint_state, stage->state, stage->decompressor->state_size);
+    }
+}
+
+static void stage_rollback(struct ota_decompress_stage *stage)
+{
+    struct ota_decompress_checkpoint *cp = &stage->checkpoint;
+
+    if (cp->hdr_len < sizeof(stage->hdr))
+    {
+        /* The header was completed by the failed block, parse it again */
+        stage_free_state(stage);
+    }
+    else
+    {
+        memcpy(stage->state, stage->checkpoint_state, stage->decompressor->state_size);
+    }
+
+    stage->hdr_len = cp->hdr_len;
+    stage->produced = cp->produced;
+    stage->out_block_idx = cp->out_block_idx;
+    stage->out_len = cp->out_len;
+    memcpy(stage->out, cp->out, cp->out_len);
+}
+
+// Check the compressed component against the hash of the manifest. The hash is consumed, so the
+// stage can't be resumed afterwards.
+static enum golioth_status stage_verify(struct ota_decompress_stage *stage)
+{
+    uint8_t hash[sizeof(stage->artifact_hash)];
+
+    golioth_sys_sha256_finish(stage->sha, hash);
+    golioth_sys_sha256_destroy(stage->sha);
+    stage->sha = NULL;
+
+    if (0 != memcmp(hash, stage->artifact_hash, sizeof(hash)))
+    {
+        GLTH_LOGE(TAG, "Compressed component sha256 doesn't match");
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status ota_decompress_stage_write(struct ota_decompress_stage *stage,
+                                               size_t offset,
+                                               const uint8_t *data,
+                                               size_t len,
+                                               bool is_last,
+                                               ota_component_block_write_cb block_cb,
+                                               void *arg)
+{
+    enum golioth_status status = GOLIOTH_OK;
+    const uint8_t *block = data;
+    size_t block_len = len;
+
+    if (!stage->sha)
+    {
+        GLTH_LOGE(TAG, "Decompression already ended");
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    if (offset != stage->in_offset)
+    {
+        GLTH_LOGE(TAG, "Can't resume decompression at offset %zu", offset);
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    stage->block_cb = block_cb;
+    stage->arg = arg;
+
+    stage_checkpoint(stage);
+
+    if (stage->hdr_len < sizeof(stage->hdr))
+    {
+        size_t n = min(len, sizeof(stage->hdr) - stage->hdr_len);
+
+        memcpy(&stage->hdr[stage->hdr_len], data, n);
+        stage->hdr_len += n;
+        data += n;
+        len -= n;
+
+        if (stage->hdr_len == sizeof(stage->hdr))
+        {
+            status = stage_parse_header(stage);
+        }
+    }
+
+    if (GOLIOTH_OK == status && len > 0)
+    {
+        status = stage->decompressor->process(stage->state, data, len, stage_output, stage);
+    }
+
+    if (GOLIOTH_OK == status && is_last
+        && (stage->hdr_len < sizeof(stage->hdr)
+            || stage->produced != (size_t) stage->component.size))
+    {
+        GLTH_LOGE(TAG, "Compressed component is truncated");
+        status = GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    if (GOLIOTH_OK != status)
+    {
+        stage_rollback(stage);
+        return status;
+    }
+
+    golioth_sys_sha256_update(stage->sha, block, block_len);
+    stage->in_offset = offset + block_len;
+
+    if (is_last)
+    {
+        status = stage_verify(stage);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+
+        return stage_deliver(stage, true);
+    }
+
+    return GOLIOTH_OK;
+}
+
+#else  // CONFIG_GOLIOTH_OTA || CONFIG_GOLIOTH_FW_UPDATE
+
+void ota_decompress_init(void) {}
+
+#endif  // CONFIG_GOLIOTH_OTA || CONFIG_GOLIOTH_FW_UPDATE
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <golioth/ota.h>
+#include <golioth/ota_decompress.h>
+
+/* Decompresses one component, and passes the image to the block callback in fixed-size blocks */
+struct ota_decompress_stage;
+
+/* Create the lock of the saved stages. Called by golioth_client_create(). */
+void ota_decompress_init(void);
+
+/* Built-in or registered decompressor for algorithm, or NULL if there is none */
+const struct golioth_ota_decompressor *ota_decompressor_find(uint8_t algorithm);
+
+bool ota_decompress_is_compressed(const uint8_t *data, size_t len);
+
+struct ota_decompress_stage *ota_decompress_stage_create(
+    const struct golioth_ota_component *component);
+
+void ota_decompress_stage_destroy(struct ota_decompress_stage *stage);
+
+/* Keep the stage of an interrupted download, so that it can be resumed */
+void ota_decompress_stage_save(struct ota_decompress_stage *stage);
+
+/* Take the saved stage of component, if any, to download it from block_idx. Fails if the
+ * download of a compressed component is resumed, but its stage can't continue it. */
+enum golioth_status ota_decompress_stage_restore(const struct golioth_ota_component *component,
+                                                 uint32_t block_idx,
+                                                 struct ota_decompress_stage **stage);
+
+/* Component describing the decompressed image, valid until the stage is destroyed */
+const struct golioth_ota_component *ota_decompress_stage_component(
+    const struct ota_decompress_stage *stage);
+
+/* Decompress the downloaded bytes at offset in the compressed component */
+enum golioth_status ota_decompress_stage_write(struct ota_decompress_stage *stage,
+                                               size_t offset,
+                                               const uint8_t *data,
+                                               size_t len,
+                                               bool is_last,
+                                               ota_component_block_write_cb block_cb,
+                                               void *arg);
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/ota_delta.h>
+#include "golioth_util.h"
+#include "ota_decompress.h"
+
+#if defined(CONFIG_GOLIOTH_OTA) || defined(CONFIG_GOLIOTH_FW_UPDATE)
+
+LOG_TAG_DEFINE(golioth_ota_delta);
+
+enum delta_state
+{
+    DELTA_STATE_HEADER,
+    DELTA_STATE_RECORD,
+    DELTA_STATE_DIFF,
+    DELTA_STATE_EXTRA,
+    DELTA_STATE_DONE,
+};
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return (uint32_t) buf[0] | ((uint32_t) buf[1] << 8) | ((uint32_t) buf[2] << 16)
+        | ((uint32_t) buf[3] << 24);
+}
+
+// Accumulate fixed-size headers, which may be split across chunks
+static size_t fill_hdr(struct golioth_ota_delta *delta,
+                       const uint8_t *data,
+                       size_t len,
+                       size_t hdr_size)
+{
+    size_t n = min(len, hdr_size - delta->hdr_len);
+
+    memcpy(&delta->hdr[delta->hdr_len], data, n);
+    delta->hdr_len += n;
+
+    return n;
+}
+
+static enum golioth_status flush_out(struct golioth_ota_delta *delta)
+{
+    if (0 == delta->out_len)
+    {
+        return GOLIOTH_OK;
+    }
+
+    enum golioth_status status = delta->write_cb(delta->out_offset,
+                                                 delta->out,
+                                                 delta->out_len,
+                                                 delta->target_size,
+                                                 delta->arg);
+    if (GOLIOTH_OK != status)
+    {
+        return status;
+    }
+
+    golioth_sys_sha256_update(delta->sha, delta->out, delta->out_len);
+    delta->out_offset += delta->out_len;
+    delta->out_len = 0;
+
+    return GOLIOTH_OK;
+}
+
+static void next_record(struct golioth_ota_delta *delta)
+{
+    size_t produced = delta->out_offset + delta->out_len;
+
+    delta->state = (produced == delta->target_size) ? DELTA_STATE_DONE : DELTA_STATE_RECORD;
+    delta->hdr_len = 0;
+}
+
+static enum golioth_status parse_header(struct golioth_ota_delta *delta)
+{
+    if (0 != memcmp(delta->hdr, GOLIOTH_OTA_DELTA_MAGIC, 4))
+    {
+        GLTH_LOGE(TAG, "Invalid delta magic");
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    uint8_t compression = delta->hdr[4];
+
+    delta->target_size = get_le32(&delta->hdr[8]);
+    memcpy(delta->target_hash, &delta->hdr[12], sizeof(delta->target_hash));
+
+    if (0 != compression)
+    {
+        delta->decompressor = ota_decompressor_find(compression);
+        if (!delta->decompressor)
+        {
+            return GOLIOTH_ERR_NOT_IMPLEMENTED;
+        }
+
+        delta->decompressor_state = golioth_sys_malloc(delta->decompressor->state_size);
+        if (!delta->decompressor_state)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        enum golioth_status status =
+            delta->decompressor->init(delta->decompressor_state, &delta->hdr[5]);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+    }
+
+    GLTH_LOGI(TAG,
+              "Applying delta, target size %zu (compression %u)",
+              delta->target_size,
+              compression);
+
+    next_record(delta);
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status end_record(struct golioth_ota_delta *delta)
+{
+    if (delta->seek < 0 && (size_t) -(int64_t) delta->seek > delta->src_pos)
+    {
+        GLTH_LOGE(TAG, "Delta seeks before start of source");
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    delta->src_pos += delta->seek;
+    next_record(delta);
+
+    return GOLIOTH_OK;
+}
+
+// Move on to the next part of the record once the current one is complete
+static enum golioth_status advance_record(struct golioth_ota_delta *delta)
+{
+    if (DELTA_STATE_DIFF == delta->state && 0 == delta->diff_left)
+    {
+        delta->state = DELTA_STATE_EXTRA;
+    }
+    if (DELTA_STATE_EXTRA == delta->state && 0 == delta->extra_left)
+    {
+        return end_record(delta);
+    }
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status parse_record(struct golioth_ota_delta *delta)
+{
+    size_t diff_len = get_le32(&delta->hdr[0]);
+    size_t extra_len = get_le32(&delta->hdr[4]);
+    size_t produced = delta->out_offset + delta->out_len;
+
+    if (diff_len > delta->target_size - produced
+        || extra_len > delta->target_size - produced - diff_len)
+    {
+        GLTH_LOGE(TAG, "Delta record exceeds target size");
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    delta->diff_left = diff_len;
+    delta->extra_left = extra_len;
+    delta->seek = (int32_t) get_le32(&delta->hdr[8]);
+    delta->state = DELTA_STATE_DIFF;
+
+    return advance_record(delta);
+}
+
+// Apply the next bytes of the (decompressed) patch body
+static enum golioth_status apply_body(const uint8_t *data, size_t len, void *arg)
+{
+    struct golioth_ota_delta *delta = arg;
+    enum golioth_status status = GOLIOTH_OK;
+
+    while (GOLIOTH_OK == status && len > 0)
+    {
+        size_t n = 0;
+
+        switch (delta->state)
+        {
+            case DELTA_STATE_RECORD:
+                n = fill_hdr(delta, data, len, GOLIOTH_OTA_DELTA_RECORD_LEN);
+                if (delta->hdr_len == GOLIOTH_OTA_DELTA_RECORD_LEN)
+                {
+                    status = parse_record(delta);
+                }
+                break;
+            case DELTA_STATE_DIFF:
+            {
+                /* Read source bytes straight into the output buffer, then add the diff */
+                uint8_t *out = &delta->out[delta->out_len];
+
+                n = min(min(len, delta->diff_left), sizeof(delta->out) - delta->out_len);
+
+                status = delta->read_cb(delta->src_pos, out, n, delta->arg);
+                if (GOLIOTH_OK != status)
+                {
+                    break;
+                }
+
+                for (size_t i = 0; i < n; i++)
+                {
+                    out[i] += data[i];
+                }
+
+                delta->src_pos += n;
+                delta->diff_left -= n;
+                delta->out_len += n;
+                status = advance_record(delta);
+                break;
+            }
+            case DELTA_STATE_EXTRA:
+                n = min(min(len, delta->extra_left), sizeof(delta->out) - delta->out_len);
+                memcpy(&delta->out[delta->out_len], data, n);
+                delta->extra_left -= n;
+                delta->out_len += n;
+                status = advance_record(delta);
+                break;
+            default:
+                GLTH_LOGE(TAG, "Unexpected data after end of delta");
+                return GOLIOTH_ERR_INVALID_FORMAT;
+        }
+
+        data += n;
+        len -= n;
+
+        if (GOLIOTH_OK == status && delta->out_len == sizeof(delta->out))
+        {
+            status = flush_out(delta);
+        }
+    }
+
+    return status;
+}
+
+bool golioth_ota_delta_is_patch(const uint8_t *data, size_t len)
+{
+    return (len >= 4) && (0 == memcmp(data, GOLIOTH_OTA_DELTA_MAGIC, 4));
+}
+
+enum golioth_status golioth_ota_delta_init(struct golioth_ota_delta *delta,
+                                           golioth_ota_delta_read_cb read_cb,
+                                           golioth_ota_delta_write_cb write_cb,
+                                           void *arg)
+{
+    if (!delta || !read_cb || !write_cb)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    memset(delta, 0, sizeof(*delta));
+    delta->read_cb = read_cb;
+    delta->write_cb = write_cb;
+    delta->arg = arg;
+    delta->state = DELTA_STATE_HEADER;
+
+    delta->sha = golioth_sys_sha256_create();
+    if (!delta->sha)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_ota_delta_apply(struct golioth_ota_delta *delta,
+                                            const uint8_t *data,
+                                            size_t len)
+{
+    if (DELTA_STATE_HEADER == delta->state)
+    {
+        size_t n = fill_hdr(delta, data, len, GOLIOTH_OTA_DELTA_HEADER_LEN);
+
+        data += n;
+        len -= n;
+
+        if (delta->hdr_len < GOLIOTH_OTA_DELTA_HEADER_LEN)
+        {
+            return GOLIOTH_OK;
+        }
+
+        enum golioth_status status = parse_header(delta);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+    }
+
+    if (0 == len)
+    {
+        return GOLIOTH_OK;
+    }
+
+    if (delta->decompressor)
+    {
+        return delta->decompressor->process(delta->decompressor_state,
+                                            data,
+                                            len,
+                                            apply_body,
+                                            delta);
+    }
+
+    return apply_body(data, len, delta);
+}
+
+enum golioth_status golioth_ota_delta_finish(struct golioth_ota_delta *delta)
+{
+    uint8_t hash[sizeof(delta->target_hash)];
+    enum golioth_status status = GOLIOTH_OK;
+
+    if (DELTA_STATE_DONE != delta->state)
+    {
+        GLTH_LOGE(TAG, "Delta is incomplete");
+        status = GOLIOTH_ERR_NO_MORE_DATA;
+        goto finish;
+    }
+
+    status = flush_out(delta);
+    if (GOLIOTH_OK != status)
+    {
+        goto finish;
+    }
+
+    golioth_sys_sha256_finish(delta->sha, hash);
+    if (0 != memcmp(hash, delta->target_hash, sizeof(hash)))
+    {
+        GLTH_LOGE(TAG, "Delta target sha256 doesn't match");
+        status = GOLIOTH_ERR_FAIL;
+    }
+
+finish:
+    golioth_ota_delta_abort(delta);
+    return status;
+}
+
+void golioth_ota_delta_abort(struct golioth_ota_delta *delta)
+{
+    if (delta->decompressor_state)
+    {
+        if (delta->decompressor->deinit)
+        {
+            delta->decompressor->deinit(delta->decompressor_state);
+        }
+        golioth_sys_free(delta->decompressor_state);
+        delta->decompressor_state = NULL;
+    }
+
+    if (delta->sha)
+    {
+        golioth_sys_sha256_destroy(delta->sha);
+        delta->sha = NULL;
+    }
+}
+
+#endif  // CONFIG_GOLIOTH_OTA || CONFIG_GOLIOTH_FW_UPDATE
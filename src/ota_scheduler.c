@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <golioth/ota.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_sys.h>
+
+#if defined(CONFIG_GOLIOTH_OTA) || defined(CONFIG_GOLIOTH_FW_UPDATE)
+
+LOG_TAG_DEFINE(golioth_ota_scheduler);
+
+struct ota_scheduler;
+
+enum scheduler_event
+{
+    /* golioth_ota_download_components() is done starting the first jobs */
+    SCHEDULER_EVENT_STARTED,
+    SCHEDULER_EVENT_JOB_SUCCEEDED,
+    SCHEDULER_EVENT_JOB_FAILED,
+};
+
+struct ota_scheduled_job
+{
+    struct golioth_ota_download_job job;
+    struct ota_scheduler *scheduler;
+};
+
+/*
+ * Jobs are started from the caller thread and from the end callbacks of other jobs, on the
+ * client thread. All counters are protected by the mutex.
+ */
+struct ota_scheduler
+{
+    struct golioth_client *client;
+    golioth_sys_mutex_t mutex;
+    struct ota_scheduled_job jobs[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+    size_t num_jobs;
+    size_t next_job;
+    size_t in_flight;
+    size_t max_in_flight;
+    size_t num_done;
+    size_t num_failed;
+    /* Keeps the scheduler alive until SCHEDULER_EVENT_STARTED */
+    bool starting;
+    golioth_ota_download_progress_cb progress_cb;
+    golioth_ota_download_components_end_cb end_cb;
+    void *arg;
+};
+
+static enum golioth_status scheduled_block_cb(const struct golioth_ota_component *component,
+                                              uint32_t block_idx,
+                                              const uint8_t *block_buffer,
+                                              size_t block_buffer_len,
+                                              bool is_last,
+                                              size_t negotiated_block_size,
+                                              void *arg)
+{
+    struct ota_scheduled_job *sjob = arg;
+
+    enum golioth_status status = sjob->job.block_cb(component,
+                                                    block_idx,
+                                                    block_buffer,
+                                                    block_buffer_len,
+                                                    is_last,
+                                                    negotiated_block_size,
+                                                    sjob->job.arg);
+
+    if (GOLIOTH_OK == status && sjob->scheduler->progress_cb)
+    {
+        sjob->scheduler->progress_cb(component,
+                                     block_idx * negotiated_block_size + block_buffer_len,
+                                     sjob->job.arg);
+    }
+
+    return status;
+}
+
+static void scheduled_end_cb(enum golioth_status status,
+                             const struct golioth_coap_rsp_code *rsp_code,
+                             const struct golioth_ota_component *component,
+                             uint32_t block_idx,
+                             void *arg);
+
+/*
+ * Start jobs until the in-flight budget is used, then account for event. The thread which
+ * accounts for the last event frees the scheduler, so the scheduler must not be accessed after
+ * calling this function.
+ */
+static void scheduler_run(struct ota_scheduler *scheduler, enum scheduler_event event)
+{
+    golioth_sys_mutex_lock(scheduler->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    if (SCHEDULER_EVENT_STARTED != event)
+    {
+        scheduler->in_flight--;
+        scheduler->num_done++;
+        scheduler->num_failed += (SCHEDULER_EVENT_JOB_FAILED == event);
+    }
+
+    while (scheduler->in_flight < scheduler->max_in_flight
+           && scheduler->next_job < scheduler->num_jobs)
+    {
+        struct ota_scheduled_job *sjob = &scheduler->jobs[scheduler->next_job++];
+        scheduler->in_flight++;
+
+        /* Do not hold the mutex while enqueuing, the job may end before this returns */
+        golioth_sys_mutex_unlock(scheduler->mutex);
+
+        GLTH_LOGI(TAG, "Downloading %s", sjob->job.component->package);
+
+        enum golioth_status status = golioth_ota_download_component(scheduler->client,
+                                                                    sjob->job.component,
+                                                                    sjob->job.block_idx,
+                                                                    scheduled_block_cb,
+                                                                    scheduled_end_cb,
+                                                                    sjob);
+        if (GOLIOTH_OK != status)
+        {
+            GLTH_LOGE(TAG,
+                      "Failed to start download of %s: %d",
+                      sjob->job.component->package,
+                      status);
+
+            sjob->job.end_cb(status,
+                             NULL,
+                             sjob->job.component,
+                             sjob->job.block_idx,
+                             sjob->job.arg);
+        }
+
+        golioth_sys_mutex_lock(scheduler->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+        if (GOLIOTH_OK != status)
+        {
+            scheduler->in_flight--;
+            scheduler->num_done++;
+            scheduler->num_failed++;
+        }
+    }
+
+    if (SCHEDULER_EVENT_STARTED == event)
+    {
+        scheduler->starting = false;
+    }
+
+    bool finished = !scheduler->starting && scheduler->num_done == scheduler->num_jobs;
+
+    golioth_sys_mutex_unlock(scheduler->mutex);
+
+    if (finished)
+    {
+        GLTH_LOGI(TAG,
+                  "Downloaded %zu of %zu components",
+                  scheduler->num_jobs - scheduler->num_failed,
+                  scheduler->num_jobs);
+
+        if (scheduler->end_cb)
+        {
+            scheduler->end_cb(scheduler->num_failed, scheduler->arg);
+        }
+
+        golioth_sys_mutex_destroy(scheduler->mutex);
+        golioth_sys_free(scheduler);
+    }
+}
+
+static void scheduled_end_cb(enum golioth_status status,
+                             const struct golioth_coap_rsp_code *rsp_code,
+                             const struct golioth_ota_component *component,
+                             uint32_t block_idx,
+                             void *arg)
+{
+    struct ota_scheduled_job *sjob = arg;
+
+    sjob->job.end_cb(status, rsp_code, component, block_idx, sjob->job.arg);
+
+    scheduler_run(sjob->scheduler,
+                  (GOLIOTH_OK == status) ? SCHEDULER_EVENT_JOB_SUCCEEDED
+                                         : SCHEDULER_EVENT_JOB_FAILED);
+}
+
+enum golioth_status golioth_ota_download_components(
+    struct golioth_client *client,
+    const struct golioth_ota_download_job *jobs,
+    size_t num_jobs,
+    size_t max_in_flight,
+    golioth_ota_download_progress_cb progress_cb,
+    golioth_ota_download_components_end_cb end_cb,
+    void *arg)
+{
+    if (NULL == client || NULL == jobs)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (0 == num_jobs || num_jobs > CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS)
+    {
+        return GOLIOTH_ERR_INVALID_FORMAT;
+    }
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        if (NULL == jobs[i].component || NULL == jobs[i].block_cb || NULL == jobs[i].end_cb)
+        {
+            return GOLIOTH_ERR_NULL;
+        }
+    }
+
+    struct ota_scheduler *scheduler = golioth_sys_malloc(sizeof(struct ota_scheduler));
+    if (NULL == scheduler)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    memset(scheduler, 0, sizeof(*scheduler));
+
+    scheduler->mutex = golioth_sys_mutex_create();
+    if (NULL == scheduler->mutex)
+    {
+        golioth_sys_free(scheduler);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    scheduler->client = client;
+    scheduler->num_jobs = num_jobs;
+    scheduler->max_in_flight =
+        (0 == max_in_flight) ? CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS : max_in_flight;
+    scheduler->starting = true;
+    scheduler->progress_cb = progress_cb;
+    scheduler->end_cb = end_cb;
+    scheduler->arg = arg;
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        scheduler->jobs[i].job = jobs[i];
+        scheduler->jobs[i].scheduler = scheduler;
+    }
+
+    /* May finish right away, if all jobs end before this returns */
+    scheduler_run(scheduler, SCHEDULER_EVENT_STARTED);
+
+    return GOLIOTH_OK;
+}
+
+#endif  // CONFIG_GOLIOTH_OTA || CONFIG_GOLIOTH_FW_UPDATE
@@ -8,26 +8,32 @@
 
 /// When ringbuf is empty, write_index == read_index.
 /// When ringbuf is full, write_index == read_index - 1, modulo total_items
+///
+/// With a single writer and a single reader, no lock is needed: each side only stores its own
+/// index, with release order after copying an item, and loads the index of the other side with
+/// acquire order before copying an item.
 
 static size_t total_items(const ringbuf_t *ringbuf)
 {
     return ringbuf->buffer_size / ringbuf->item_size;
 }
 
-static ringbuf_index_t next_write_index(const ringbuf_t *ringbuf)
+static ringbuf_index_t next_index(const ringbuf_t *ringbuf, ringbuf_index_t index)
 {
-    return (ringbuf->write_index + 1) % total_items(ringbuf);
+    return (index + 1) % total_items(ringbuf);
 }
 
 bool ringbuf_is_empty(const ringbuf_t *ringbuf)
 {
-    return (ringbuf->write_index == ringbuf->read_index);
+    return (atomic_load_explicit(&ringbuf->write_index, memory_order_acquire)
+            == atomic_load_explicit(&ringbuf->read_index, memory_order_acquire));
 }
 
 bool ringbuf_is_full(const ringbuf_t *ringbuf)
 {
-    ringbuf_index_t next_wr_index = (ringbuf->write_index + 1) % total_items(ringbuf);
-    return (next_wr_index == ringbuf->read_index);
+    ringbuf_index_t write_index = atomic_load_explicit(&ringbuf->write_index, memory_order_acquire);
+    return (next_index(ringbuf, write_index)
+            == atomic_load_explicit(&ringbuf->read_index, memory_order_acquire));
 }
 
 bool ringbuf_put(ringbuf_t *ringbuf, const void *item)
@@ -37,34 +43,46 @@ bool ringbuf_put(ringbuf_t *ringbuf, const void *item)
         return false;
     }
 
-    if (ringbuf_is_full(ringbuf))
+    // Only stored by this side
+    ringbuf_index_t write_index = atomic_load_explicit(&ringbuf->write_index, memory_order_relaxed);
+    ringbuf_index_t next_wr_index = next_index(ringbuf, write_index);
+
+    if (next_wr_index == atomic_load_explicit(&ringbuf->read_index, memory_order_acquire))
     {
+        // Full
         return false;
     }
 
-    uint8_t *buffer_wr_ptr = ringbuf->buffer + ringbuf->write_index * ringbuf->item_size;
+    uint8_t *buffer_wr_ptr = ringbuf->buffer + write_index * ringbuf->item_size;
     memcpy(buffer_wr_ptr, item, ringbuf->item_size);
-    ringbuf->write_index = next_write_index(ringbuf);
+
+    atomic_store_explicit(&ringbuf->write_index, next_wr_index, memory_order_release);
 
     return true;
 }
 
 bool ringbuf_get_internal(ringbuf_t *ringbuf, void *item, bool remove)
 {
-    if (ringbuf_is_empty(ringbuf))
+    // Only stored by this side
+    ringbuf_index_t read_index = atomic_load_explicit(&ringbuf->read_index, memory_order_relaxed);
+
+    if (read_index == atomic_load_explicit(&ringbuf->write_index, memory_order_acquire))
     {
+        // Empty
         return false;
     }
 
     if (item)
     {
-        const uint8_t *buffer_rd_ptr = ringbuf->buffer + ringbuf->read_index * ringbuf->item_size;
+        const uint8_t *buffer_rd_ptr = ringbuf->buffer + read_index * ringbuf->item_size;
         memcpy(item, buffer_rd_ptr, ringbuf->item_size);
     }
 
     if (remove)
     {
-        ringbuf->read_index = (ringbuf->read_index + 1) % total_items(ringbuf);
+        atomic_store_explicit(&ringbuf->read_index,
+                              next_index(ringbuf, read_index),
+                              memory_order_release);
     }
 
     return true;
@@ -82,8 +100,8 @@ bool ringbuf_peek(ringbuf_t *ringbuf, void *item)
 
 size_t ringbuf_size(const ringbuf_t *ringbuf)
 {
-    ringbuf_index_t write_index = ringbuf->write_index;
-    ringbuf_index_t read_index = ringbuf->read_index;
+    ringbuf_index_t write_index = atomic_load_explicit(&ringbuf->write_index, memory_order_acquire);
+    ringbuf_index_t read_index = atomic_load_explicit(&ringbuf->read_index, memory_order_acquire);
 
     if (write_index > read_index)
     {
@@ -109,6 +127,6 @@ size_t ringbuf_capacity(const ringbuf_t *ringbuf)
 
 void ringbuf_reset(ringbuf_t *ringbuf)
 {
-    ringbuf->write_index = 0;
-    ringbuf->read_index = 0;
+    atomic_store(&ringbuf->write_index, 0);
+    atomic_store(&ringbuf->read_index, 0);
 }
@@ -5,17 +5,19 @@
  */
 #pragma once
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
-// This type must be atomic. If you are on an 8-bit CPU, you would change the type to uint8_t.
+// Indices are atomic, so that a single writer and a single reader don't need a lock. If you are
+// on an 8-bit CPU, you would change the type to uint8_t, so that it is lock-free.
 typedef uint32_t ringbuf_index_t;
 
 typedef struct
 {
-    volatile ringbuf_index_t write_index;
-    volatile ringbuf_index_t read_index;
+    _Atomic ringbuf_index_t write_index;
+    _Atomic ringbuf_index_t read_index;
     uint8_t *buffer;
     size_t buffer_size;
     size_t item_size;
@@ -7,7 +7,9 @@
 #include <string.h>
 #include <zcbor_decode.h>
 #include <zcbor_encode.h>
+#include "coap_blockwise.h"
 #include "coap_client.h"
+#include "mbox.h"
 #include <golioth/config.h>
 #include <golioth/rpc.h>
 #include "golioth_util.h"
@@ -36,28 +38,112 @@ LOG_TAG_DEFINE(golioth_rpc);
 
 #define GOLIOTH_RPC_PATH_PREFIX ".rpc/"
 
-/// Private struct to contain data about a single registered method
-struct golioth_rpc_method
-{
-    const char *method;
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_rpc_cb_fn callback;
-    void *callback_arg;
-};
+#define RPC_RSP_BACKUPS 1
+
+/* Index entries are 16-bit slot numbers + 1 */
+#define RPC_MAX_SLOTS (UINT16_MAX - 1)
+
+#if CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS > RPC_MAX_SLOTS
+#error "CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS is too large"
+#endif
 
 /// Private struct to contain RPC state data
 struct golioth_rpc
 {
     struct golioth_client *client;
-    int num_rpcs;
-    struct golioth_rpc_method rpcs[CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS];
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    size_t num_rpcs;
+    size_t max_rpcs;
+    // Worker threads for deferred methods, started by the first deferred registration
+    golioth_mbox_t call_queue;
+    golioth_sys_mutex_t calls_mutex;
+    golioth_sys_sem_t workers_stopped;
+    size_t num_calls;
+    // Set by golioth_rpc_deinit(), no more calls are accepted
+    bool stopping;
+    size_t num_workers;
+    golioth_sys_thread_t workers[CONFIG_GOLIOTH_RPC_NUM_WORKERS];
+    // Allocated with this struct by golioth_rpc_init(), or supplied by the application
+    struct golioth_rpc_slot *rpcs;
+    // Slots allocated by golioth_rpc_init()
+    struct golioth_rpc_slot default_slots[];
 };
 
+/// Private struct to contain a call to a deferred method
+struct golioth_rpc_call
+{
+    struct golioth_rpc *grpc;
+    const struct golioth_rpc_method *method;
+    zcbor_state_t zse[RPC_RSP_BACKUPS + 2];
+    uint8_t response_buf[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
+    // Length of a response already encoded by a regular method, which only needs to be sent
+    size_t response_len;
+    // Encoded params array, copied out of the request
+    size_t params_len;
+    uint8_t params[];
+};
+
+struct rpc_params
+{
+    zcbor_state_t zsd;
+    const uint8_t *start;
+    const uint8_t *end;
+};
+
+static struct hash_index rpc_index(struct golioth_rpc *grpc)
+{
+    return (struct hash_index){
+        .slots = grpc->rpcs,
+        .slot_size = sizeof(*grpc->rpcs),
+        .index_offset = offsetof(struct golioth_rpc_slot, index),
+        .num_slots = grpc->max_rpcs,
+    };
+}
+
+static bool method_match(const void *slot, const char *method, size_t method_len, uint32_t hash)
+{
+    const struct golioth_rpc_slot *s = slot;
+
+    return s->method_hash == hash && s->method_len == method_len
+        && memcmp(s->method->method, method, method_len) == 0;
+}
+
+// Method does not need to be NULL-terminated
+static const struct golioth_rpc_method *find_registered_method(struct golioth_rpc *grpc,
+                                                               const char *method,
+                                                               size_t method_len)
+{
+    struct hash_index index = rpc_index(grpc);
+    const struct golioth_rpc_slot *slot =
+        hash_index_find(&index, method, method_len, method_match);
+
+    return slot ? slot->method : NULL;
+}
+
+static void add_method(struct golioth_rpc *grpc,
+                       const struct golioth_rpc_method *method,
+                       bool allocated)
+{
+    struct golioth_rpc_slot *slot = &grpc->rpcs[grpc->num_rpcs];
+
+    slot->method = method;
+    slot->method_len = strlen(method->method);
+    slot->method_hash = fnv1a_hash(method->method, slot->method_len);
+    slot->allocated = allocated;
+
+    struct hash_index index = rpc_index(grpc);
+    hash_index_add(&index, grpc->num_rpcs, slot->method_hash);
+
+    grpc->num_rpcs++;
+}
+
 static int params_decode(zcbor_state_t *zsd, void *value)
 {
-    zcbor_state_t *params_zsd = value;
+    struct rpc_params *params = value;
     bool ok;
 
+    params->start = zsd->payload;
+
     ok = zcbor_list_start_decode(zsd);
     if (!ok)
     {
@@ -65,7 +151,7 @@ static int params_decode(zcbor_state_t *zsd, void *value)
         return -EBADMSG;
     }
 
-    memcpy(params_zsd, zsd, sizeof(*params_zsd));
+    memcpy(&params->zsd, zsd, sizeof(params->zsd));
 
     while (!zcbor_list_or_map_end(zsd))
     {
@@ -84,9 +170,528 @@ static int params_decode(zcbor_state_t *zsd, void *value)
         return -EBADMSG;
     }
 
+    params->end = zsd->payload;
+
     return 0;
 }
 
+struct rpc_response
+{
+    const uint8_t *buf;
+    size_t len;
+};
+
+static enum golioth_status read_response_block(uint32_t block_idx,
+                                               uint8_t *block_buffer,
+                                               size_t *block_size,
+                                               bool *is_last,
+                                               void *callback_arg)
+{
+    const struct rpc_response *response = callback_arg;
+    size_t offset = block_idx * *block_size;
+
+    if (offset >= response->len)
+    {
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    size_t len = min(*block_size, response->len - offset);
+
+    memcpy(block_buffer, &response->buf[offset], len);
+    *block_size = len;
+    *is_last = (offset + len == response->len);
+
+    return GOLIOTH_OK;
+}
+
+/* Send an encoded response. Blockwise uploads block until complete, so on the client thread
+ * (may_block false) responses are always sent with a single request. Larger responses of regular
+ * methods are handed to the worker threads first, see rpc_hand_response_to_workers(). */
+static enum golioth_status rpc_send_response(struct golioth_client *client,
+                                             const uint8_t *buf,
+                                             size_t len,
+                                             bool may_block)
+{
+    if (may_block && len > golioth_client_get_upload_block_size(client))
+    {
+        struct rpc_response response = {
+            .buf = buf,
+            .len = len,
+        };
+
+        return golioth_blockwise_post(client,
+                                      GOLIOTH_RPC_PATH_PREFIX,
+                                      "status",
+                                      GOLIOTH_CONTENT_TYPE_CBOR,
+                                      read_response_block,
+                                      NULL,
+                                      &response);
+    }
+
+    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
+    golioth_coap_next_token(token);
+
+    return golioth_coap_client_set(client,
+                                   token,
+                                   GOLIOTH_RPC_PATH_PREFIX,
+                                   "status",
+                                   GOLIOTH_CONTENT_TYPE_CBOR,
+                                   buf,
+                                   len,
+                                   NULL,
+                                   NULL,
+                                   GOLIOTH_SYS_WAIT_FOREVER);
+}
+
+/* Encode a response without detail into buf, returning its length or 0 on failure */
+static size_t rpc_encode_status(uint8_t *buf,
+                                size_t buf_size,
+                                const struct zcbor_string *id,
+                                enum golioth_rpc_status rpc_status)
+{
+    ZCBOR_STATE_E(zse, RPC_RSP_BACKUPS, buf, buf_size, 1);
+
+    bool ok = zcbor_map_start_encode(zse, 1) && zcbor_tstr_put_lit(zse, "id")
+        && zcbor_tstr_encode(zse, id) && zcbor_tstr_put_lit(zse, "statusCode")
+        && zcbor_uint64_put(zse, rpc_status) && zcbor_map_end_encode(zse, 1);
+
+    return ok ? zse->payload - buf : 0;
+}
+
+static void rpc_call_free(struct golioth_rpc_call *call)
+{
+    struct golioth_rpc *grpc = call->grpc;
+
+    golioth_sys_mutex_lock(grpc->calls_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    grpc->num_calls--;
+    golioth_sys_mutex_unlock(grpc->calls_mutex);
+
+    golioth_sys_free(call);
+}
+
+/* Allocate a call, counted against CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS */
+static struct golioth_rpc_call *rpc_call_alloc(struct golioth_rpc *grpc, size_t params_len)
+{
+    struct golioth_rpc_call *call = NULL;
+
+    golioth_sys_mutex_lock(grpc->calls_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    if (!grpc->stopping && grpc->num_calls < CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS)
+    {
+        call = golioth_sys_malloc(sizeof(*call) + params_len);
+        if (call)
+        {
+            grpc->num_calls++;
+        }
+    }
+    golioth_sys_mutex_unlock(grpc->calls_mutex);
+
+    return call;
+}
+
+/* Hand a response encoded on the client thread, which is larger than a block, to the worker
+ * threads to send it blockwise. Returns false if it must be sent with a single request instead,
+ * as no worker threads were started, or too many calls are in progress. */
+static bool rpc_hand_response_to_workers(struct golioth_rpc *grpc,
+                                         const struct golioth_rpc_method *rpc,
+                                         const uint8_t *buf,
+                                         size_t len)
+{
+    if (len <= golioth_client_get_upload_block_size(grpc->client) || !grpc->call_queue
+        || grpc->num_workers == 0)
+    {
+        return false;
+    }
+
+    struct golioth_rpc_call *call = rpc_call_alloc(grpc, 0);
+    if (!call)
+    {
+        return false;
+    }
+
+    call->grpc = grpc;
+    call->method = rpc;
+    call->params_len = 0;
+    call->response_len = len;
+    memcpy(call->response_buf, buf, len);
+
+    if (!golioth_mbox_try_send(grpc->call_queue, &call))
+    {
+        rpc_call_free(call);
+        return false;
+    }
+
+    return true;
+}
+
+/* Hand a call to the worker threads, which respond once the method completes */
+static enum golioth_rpc_status rpc_defer(struct golioth_rpc *grpc,
+                                         const struct golioth_rpc_method *rpc,
+                                         const struct zcbor_string *id,
+                                         const struct rpc_params *params)
+{
+    size_t params_len = params->end - params->start;
+    struct golioth_rpc_call *call = rpc_call_alloc(grpc, params_len);
+
+    if (!call)
+    {
+        GLTH_LOGW(TAG, "Unable to start RPC, too many calls in progress");
+        return GOLIOTH_RPC_RESOURCE_EXHAUSTED;
+    }
+
+    call->grpc = grpc;
+    call->method = rpc;
+    call->params_len = params_len;
+    call->response_len = 0;
+    memcpy(call->params, params->start, params_len);
+
+    zcbor_new_encode_state(call->zse,
+                           ARRAY_SIZE(call->zse),
+                           call->response_buf,
+                           sizeof(call->response_buf),
+                           1);
+
+    bool ok = zcbor_map_start_encode(call->zse, 1) && zcbor_tstr_put_lit(call->zse, "id")
+        && zcbor_tstr_encode(call->zse, id) && zcbor_tstr_put_lit(call->zse, "detail")
+        && zcbor_map_start_encode(call->zse, SIZE_MAX);
+    if (!ok)
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC response");
+        rpc_call_free(call);
+        return GOLIOTH_RPC_RESOURCE_EXHAUSTED;
+    }
+
+    if (!golioth_mbox_try_send(grpc->call_queue, &call))
+    {
+        GLTH_LOGW(TAG, "Unable to start RPC, queue full");
+        rpc_call_free(call);
+        return GOLIOTH_RPC_RESOURCE_EXHAUSTED;
+    }
+
+    return GOLIOTH_RPC_OK;
+}
+
+static void rpc_call_run(struct golioth_rpc_call *call)
+{
+    ZCBOR_STATE_D(zsd, 2, call->params, call->params_len, 1, 0);
+
+    if (call->response_len > 0)
+    {
+        rpc_send_response(call->grpc->client, call->response_buf, call->response_len, true);
+        rpc_call_free(call);
+        return;
+    }
+
+    if (!zcbor_list_start_decode(zsd))
+    {
+        golioth_rpc_call_complete(call, GOLIOTH_RPC_INVALID_ARGUMENT);
+        return;
+    }
+
+    GLTH_LOGD(TAG, "Calling deferred RPC method: %s", call->method->method);
+
+    call->method->deferred_callback(call, zsd, call->zse, call->method->callback_arg);
+}
+
+static void rpc_worker_thread(void *arg)
+{
+    struct golioth_rpc *grpc = arg;
+    struct golioth_rpc_call *call;
+
+    while (true)
+    {
+        if (!golioth_mbox_recv(grpc->call_queue, &call, GOLIOTH_SYS_WAIT_FOREVER))
+        {
+            continue;
+        }
+
+        if (!call)
+        {
+            break;
+        }
+
+        rpc_call_run(call);
+    }
+
+    /* Stopped by golioth_rpc_deinit(), wait to be destroyed */
+    golioth_sys_sem_give(grpc->workers_stopped);
+
+    while (true)
+    {
+        golioth_sys_msleep(1000);
+    }
+}
+
+/* Close the detail map of a call's response, and encode the rest of it */
+static bool rpc_call_encode_status(struct golioth_rpc_call *call, enum golioth_rpc_status status)
+{
+    return zcbor_map_end_encode(call->zse, SIZE_MAX)
+        && zcbor_tstr_put_lit(call->zse, "statusCode") && zcbor_uint64_put(call->zse, status)
+        && zcbor_map_end_encode(call->zse, 1);
+}
+
+enum golioth_status golioth_rpc_call_complete(struct golioth_rpc_call *call,
+                                              enum golioth_rpc_status status)
+{
+    enum golioth_status ret;
+
+    if (!call)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    bool ok = rpc_call_encode_status(call, status);
+    if (ok)
+    {
+        ret = rpc_send_response(call->grpc->client,
+                                call->response_buf,
+                                call->zse->payload - call->response_buf,
+                                true);
+    }
+    else
+    {
+        GLTH_LOGE(TAG, "Failed to encode RPC response for %s", call->method->method);
+        ret = GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    rpc_call_free(call);
+
+    return ret;
+}
+
+#ifndef CONFIG_ZCBOR_CANONICAL
+
+enum rpc_stream_stage
+{
+    RPC_STREAM_DETAIL,
+    RPC_STREAM_STATUS,
+    RPC_STREAM_DONE,
+};
+
+/* Response streamed from the call's response_buf, one chunk at a time */
+struct rpc_stream
+{
+    struct golioth_rpc_call *call;
+    golioth_rpc_stream_cb_fn write_detail;
+    void *arg;
+    enum golioth_rpc_status status;
+    enum rpc_stream_stage stage;
+    // Encoded bytes not yet read into a block
+    const uint8_t *pending;
+    size_t pending_len;
+    // Number of bytes read into blocks so far
+    size_t offset;
+    // The last bytes read, so that a lost block can be read again at a smaller size
+    size_t history_len;
+    size_t history_size;
+    uint8_t history[];
+};
+
+/* Encode the next chunk of a streamed response */
+static enum golioth_status rpc_stream_next(struct rpc_stream *stream)
+{
+    struct golioth_rpc_call *call = stream->call;
+
+    switch (stream->stage)
+    {
+        case RPC_STREAM_DETAIL:
+        {
+            ZCBOR_STATE_E(zse, RPC_RSP_BACKUPS, call->response_buf, sizeof(call->response_buf), 1);
+            bool is_last = false;
+
+            enum golioth_status status = stream->write_detail(zse, &is_last, stream->arg);
+            if (status != GOLIOTH_OK)
+            {
+                GLTH_LOGE(TAG, "Failed to stream RPC response for %s", call->method->method);
+                return status;
+            }
+
+            stream->pending = call->response_buf;
+            stream->pending_len = zse->payload - call->response_buf;
+            if (is_last)
+            {
+                stream->stage = RPC_STREAM_STATUS;
+            }
+            return GOLIOTH_OK;
+        }
+        case RPC_STREAM_STATUS:
+            /* The detail was sent, encode the rest from the start of the buffer */
+            call->zse->payload_mut = call->response_buf;
+            if (!rpc_call_encode_status(call, stream->status))
+            {
+                return GOLIOTH_ERR_SERIALIZE;
+            }
+
+            stream->pending = call->response_buf;
+            stream->pending_len = call->zse->payload - call->response_buf;
+            stream->stage = RPC_STREAM_DONE;
+            return GOLIOTH_OK;
+        default:
+            return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+}
+
+static void rpc_stream_keep_history(struct rpc_stream *stream, const uint8_t *buf, size_t len)
+{
+    if (len > stream->history_size)
+    {
+        stream->history_len = 0;
+        return;
+    }
+
+    size_t keep = min(stream->history_len, stream->history_size - len);
+
+    memmove(stream->history, &stream->history[stream->history_len - keep], keep);
+    memcpy(&stream->history[keep], buf, len);
+    stream->history_len = keep + len;
+}
+
+static enum golioth_status read_stream_block(uint32_t block_idx,
+                                             uint8_t *block_buffer,
+                                             size_t *block_size,
+                                             bool *is_last,
+                                             void *callback_arg)
+{
+    struct rpc_stream *stream = callback_arg;
+    size_t offset = block_idx * *block_size;
+    size_t len = 0;
+
+    if (offset > stream->offset || offset < stream->offset - stream->history_len)
+    {
+        GLTH_LOGE(TAG, "Can't read streamed RPC response at offset %zu", offset);
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    /* Bytes read before, when the block was lost and is now read at a smaller size */
+    if (offset < stream->offset)
+    {
+        size_t history_start = stream->offset - stream->history_len;
+
+        len = min(*block_size, stream->offset - offset);
+        memcpy(block_buffer, &stream->history[offset - history_start], len);
+    }
+
+    size_t new_start = len;
+
+    while (len < *block_size)
+    {
+        if (stream->pending_len == 0)
+        {
+            enum golioth_status status = rpc_stream_next(stream);
+            if (status == GOLIOTH_ERR_NO_MORE_DATA)
+            {
+                break;
+            }
+            if (status != GOLIOTH_OK)
+            {
+                return status;
+            }
+            continue;
+        }
+
+        size_t chunk_len = min(*block_size - len, stream->pending_len);
+
+        memcpy(&block_buffer[len], stream->pending, chunk_len);
+        stream->pending += chunk_len;
+        stream->pending_len -= chunk_len;
+        len += chunk_len;
+    }
+
+    if (len == 0)
+    {
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    rpc_stream_keep_history(stream, &block_buffer[new_start], len - new_start);
+    stream->offset += len - new_start;
+
+    *block_size = len;
+    *is_last = (offset + len == stream->offset && stream->stage == RPC_STREAM_DONE
+                && stream->pending_len == 0);
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_rpc_call_complete_streamed(struct golioth_rpc_call *call,
+                                                       enum golioth_rpc_status status,
+                                                       golioth_rpc_stream_cb_fn write_detail,
+                                                       void *arg)
+{
+    enum golioth_status ret;
+
+    if (!call || !write_detail)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    /* Lost blocks are only read again with a smaller size by PMTU discovery */
+    size_t history_size = CONFIG_GOLIOTH_BLOCKWISE_PMTU_DISCOVERY
+        ? CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE
+        : 0;
+    struct rpc_stream *stream = golioth_sys_malloc(sizeof(*stream) + history_size);
+
+    if (stream)
+    {
+        *stream = (struct rpc_stream){
+            .call = call,
+            .write_detail = write_detail,
+            .arg = arg,
+            .status = status,
+            .stage = RPC_STREAM_DETAIL,
+            /* Start with the id and the detail encoded by the deferred callback */
+            .pending = call->response_buf,
+            .pending_len = call->zse->payload - call->response_buf,
+            .history_size = history_size,
+        };
+
+        ret = golioth_blockwise_post(call->grpc->client,
+                                     GOLIOTH_RPC_PATH_PREFIX,
+                                     "status",
+                                     GOLIOTH_CONTENT_TYPE_CBOR,
+                                     read_stream_block,
+                                     NULL,
+                                     stream);
+
+        golioth_sys_free(stream);
+    }
+    else
+    {
+        ret = GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    if (ret != GOLIOTH_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to stream RPC response for %s: %d", call->method->method, ret);
+    }
+
+    rpc_call_free(call);
+
+    return ret;
+}
+
+#else  // CONFIG_ZCBOR_CANONICAL
+
+/*
+ * Canonical maps are encoded with their number of entries, which is unknown when the start of a
+ * streamed detail map is sent, and the encoder state can't be reset to the start of the buffer.
+ */
+enum golioth_status golioth_rpc_call_complete_streamed(struct golioth_rpc_call *call,
+                                                       enum golioth_rpc_status status,
+                                                       golioth_rpc_stream_cb_fn write_detail,
+                                                       void *arg)
+{
+    if (!call || !write_detail)
+    {
+        return GOLIOTH_ERR_NULL;
+    }
+
+    GLTH_LOGE(TAG, "Streamed RPC responses are not supported with CONFIG_ZCBOR_CANONICAL");
+    golioth_rpc_call_complete(call, GOLIOTH_RPC_UNIMPLEMENTED);
+
+    return GOLIOTH_ERR_NOT_IMPLEMENTED;
+}
+
+#endif  // CONFIG_ZCBOR_CANONICAL
+
 static void on_rpc(struct golioth_client *client,
                    enum golioth_status status,
                    const struct golioth_coap_rsp_code *coap_rsp_code,
@@ -96,12 +701,12 @@ static void on_rpc(struct golioth_client *client,
                    void *arg)
 {
     ZCBOR_STATE_D(zsd, 2, payload, payload_size, 1, 0);
-    zcbor_state_t params_zsd;
+    struct rpc_params params;
     struct zcbor_string id, method;
     struct zcbor_map_entry map_entries[] = {
         ZCBOR_TSTR_LIT_MAP_ENTRY("id", zcbor_map_tstr_decode, &id),
         ZCBOR_TSTR_LIT_MAP_ENTRY("method", zcbor_map_tstr_decode, &method),
-        ZCBOR_TSTR_LIT_MAP_ENTRY("params", params_decode, &params_zsd),
+        ZCBOR_TSTR_LIT_MAP_ENTRY("params", params_decode, &params),
     };
     int err;
     bool ok;
@@ -132,41 +737,37 @@ static void on_rpc(struct golioth_client *client,
         return;
     }
 
-    /* Start encoding response */
-    static uint8_t response_buf[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
-    ZCBOR_STATE_E(zse, 1, response_buf, sizeof(response_buf), 1);
+    struct golioth_rpc *grpc = arg;
 
-    ok = zcbor_map_start_encode(zse, 1);
-    if (!ok)
+    const struct golioth_rpc_method *matching_rpc =
+        find_registered_method(grpc, (const char *) method.value, method.len);
+    enum golioth_rpc_status rpc_status = GOLIOTH_RPC_UNKNOWN;
+
+    if (matching_rpc && matching_rpc->deferred_callback)
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC response map");
-        return;
+        rpc_status = rpc_defer(grpc, matching_rpc, &id, &params);
+        if (rpc_status == GOLIOTH_RPC_OK)
+        {
+            /* Response is sent by golioth_rpc_call_complete() */
+            return;
+        }
     }
 
-    ok = zcbor_tstr_put_lit(zse, "id") && zcbor_tstr_encode(zse, &id);
-    if (!ok)
+    /* Start encoding response, in a buffer of its own so that calls don't share state */
+    uint8_t *response_buf = golioth_sys_malloc(CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN);
+    if (!response_buf)
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "id");
+        GLTH_LOGE(TAG, "Failed to allocate RPC response");
         return;
     }
 
-    struct golioth_rpc *grpc = arg;
+    ZCBOR_STATE_E(zse, RPC_RSP_BACKUPS, response_buf, CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN, 1);
 
-    const struct golioth_rpc_method *matching_rpc = NULL;
-    enum golioth_rpc_status rpc_status = GOLIOTH_RPC_UNKNOWN;
+    ok = zcbor_map_start_encode(zse, 1) && zcbor_tstr_put_lit(zse, "id")
+        && zcbor_tstr_encode(zse, &id);
 
-    for (int i = 0; i < grpc->num_rpcs; i++)
-    {
-        const struct golioth_rpc_method *rpc = &grpc->rpcs[i];
-        if (strlen(rpc->method) == method.len
-            && strncmp(rpc->method, (char *) method.value, method.len) == 0)
-        {
-            matching_rpc = rpc;
-            break;
-        }
-    }
-
-    if (matching_rpc)
+    /* Deferred calls get here only when rpc_defer() failed, and only report the status */
+    if (ok && matching_rpc && !matching_rpc->deferred_callback)
     {
         GLTH_LOGD(TAG, "Calling registered RPC method: %s", matching_rpc->method);
 
@@ -174,35 +775,20 @@ static void on_rpc(struct golioth_client *client,
          * Call callback while decode context is inside the params array
          * and encode context is inside the detail map.
          */
-        ok = zcbor_tstr_put_lit(zse, "detail");
-        if (!ok)
+        ok = zcbor_tstr_put_lit(zse, "detail") && zcbor_map_start_encode(zse, SIZE_MAX);
+        if (ok)
         {
-            GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "detail");
-            return;
-        }
+            rpc_status = matching_rpc->callback(&params.zsd, zse, matching_rpc->callback_arg);
 
-        ok = zcbor_map_start_encode(zse, SIZE_MAX);
-        if (!ok)
-        {
-            GLTH_LOGE(TAG, "Did not start CBOR map correctly");
-            return;
-        }
-
-        rpc_status = matching_rpc->callback(&params_zsd, zse, matching_rpc->callback_arg);
-
-        char call_id_str[id.len + 1];
-        memcpy(call_id_str, id.value, id.len);
-        call_id_str[id.len] = '\0';
-        GLTH_LOGD(TAG, "RPC status code %d for call id :%s", rpc_status, call_id_str);
+            char call_id_str[id.len + 1];
+            memcpy(call_id_str, id.value, id.len);
+            call_id_str[id.len] = '\0';
+            GLTH_LOGD(TAG, "RPC status code %d for call id :%s", rpc_status, call_id_str);
 
-        ok = zcbor_map_end_encode(zse, SIZE_MAX);
-        if (!ok)
-        {
-            GLTH_LOGE(TAG, "Failed to close '%s'", "detail");
-            return;
+            ok = zcbor_map_end_encode(zse, SIZE_MAX);
         }
     }
-    else
+    else if (!matching_rpc)
     {
         rpc_status = GOLIOTH_RPC_NOT_FOUND;
 
@@ -212,44 +798,177 @@ static void on_rpc(struct golioth_client *client,
         GLTH_LOGW(TAG, "Method %s not registered", method_str);
     }
 
-    ok = zcbor_tstr_put_lit(zse, "statusCode") && zcbor_uint64_put(zse, rpc_status);
+    ok = ok && zcbor_tstr_put_lit(zse, "statusCode") && zcbor_uint64_put(zse, rpc_status)
+        && zcbor_map_end_encode(zse, 1);
+
+    size_t response_len = zse->payload - response_buf;
+
     if (!ok)
     {
-        GLTH_LOGE(TAG, "Failed to encode RPC '%s'", "statusCode");
-        return;
+        /* The detail is dropped, so that the cloud learns about the failure */
+        GLTH_LOGE(TAG,
+                  "RPC response exceeds CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN (%d)",
+                  CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN);
+        response_len = rpc_encode_status(response_buf,
+                                         CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN,
+                                         &id,
+                                         GOLIOTH_RPC_RESOURCE_EXHAUSTED);
     }
 
-    /* root response map */
-    ok = zcbor_map_end_encode(zse, 1);
-    if (!ok)
+    if (response_len > 0
+        && !rpc_hand_response_to_workers(grpc, matching_rpc, response_buf, response_len))
     {
-        GLTH_LOGE(TAG, "Failed to close '%s'", "root");
-        return;
+        rpc_send_response(client, response_buf, response_len, false);
     }
 
-    uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
-    golioth_coap_next_token(token);
+    golioth_sys_free(response_buf);
+}
+
+static struct golioth_rpc *rpc_start(struct golioth_rpc *grpc,
+                                     struct golioth_client *client,
+                                     struct golioth_rpc_slot *slots,
+                                     size_t num_slots)
+{
+    grpc->client = client;
+    grpc->num_rpcs = 0;
+    grpc->max_rpcs = num_slots;
+    grpc->rpcs = slots;
+
+    return grpc;
+}
+
+static enum golioth_status rpc_workers_start(struct golioth_rpc *grpc)
+{
+    if (!grpc->call_queue)
+    {
+        grpc->calls_mutex = golioth_sys_mutex_create();
+        if (!grpc->calls_mutex)
+        {
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        grpc->workers_stopped = golioth_sys_sem_create(CONFIG_GOLIOTH_RPC_NUM_WORKERS, 0);
+        if (!grpc->workers_stopped)
+        {
+            golioth_sys_mutex_destroy(grpc->calls_mutex);
+            grpc->calls_mutex = NULL;
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        grpc->call_queue = golioth_mbox_create(CONFIG_GOLIOTH_RPC_QUEUE_DEPTH,
+                                               sizeof(struct golioth_rpc_call *));
+        if (!grpc->call_queue)
+        {
+            /* Created again by the next deferred registration */
+            golioth_sys_sem_destroy(grpc->workers_stopped);
+            golioth_sys_mutex_destroy(grpc->calls_mutex);
+            grpc->workers_stopped = NULL;
+            grpc->calls_mutex = NULL;
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+    }
+
+    /* Workers which failed to start before are retried */
+    while (grpc->num_workers < CONFIG_GOLIOTH_RPC_NUM_WORKERS)
+    {
+        struct golioth_thread_config thread_cfg = {
+            .name = "rpc_worker",
+            .fn = rpc_worker_thread,
+            .user_arg = grpc,
+            .stack_size = CONFIG_GOLIOTH_RPC_WORKER_STACK_SIZE,
+            .prio = CONFIG_GOLIOTH_RPC_WORKER_PRIORITY,
+        };
+
+        golioth_sys_thread_t worker = golioth_sys_thread_create(&thread_cfg);
+        if (!worker)
+        {
+            GLTH_LOGE(TAG, "Failed to create RPC worker thread");
+            return GOLIOTH_ERR_MEM_ALLOC;
+        }
+
+        grpc->workers[grpc->num_workers++] = worker;
+    }
+
+    return GOLIOTH_OK;
+}
+
+static void rpc_workers_stop(struct golioth_rpc *grpc)
+{
+    struct golioth_rpc_call *stop = NULL;
+
+    /* Workers finish the calls queued before their stop request */
+    for (size_t i = 0; i < grpc->num_workers; i++)
+    {
+        while (!golioth_mbox_try_send(grpc->call_queue, &stop))
+        {
+            golioth_sys_msleep(10);
+        }
+    }
 
-    golioth_coap_client_set(client,
-                            token,
-                            GOLIOTH_RPC_PATH_PREFIX,
-                            "status",
-                            GOLIOTH_CONTENT_TYPE_CBOR,
-                            response_buf,
-                            zse->payload - response_buf,
-                            NULL,
-                            NULL,
-                            GOLIOTH_SYS_WAIT_FOREVER);
+    for (size_t i = 0; i < grpc->num_workers; i++)
+    {
+        golioth_sys_sem_take(grpc->workers_stopped, GOLIOTH_SYS_WAIT_FOREVER);
+    }
+
+    for (size_t i = 0; i < grpc->num_workers; i++)
+    {
+        golioth_sys_thread_destroy(grpc->workers[i]);
+    }
+
+    golioth_mbox_destroy(grpc->call_queue);
+    golioth_sys_sem_destroy(grpc->workers_stopped);
+    golioth_sys_mutex_destroy(grpc->calls_mutex);
+}
+
+/* Free everything allocated after golioth_rpc_init*() */
+static void rpc_release(struct golioth_rpc *grpc)
+{
+    if (grpc->call_queue)
+    {
+        rpc_workers_stop(grpc);
+    }
+
+    for (size_t i = 0; i < grpc->num_rpcs; i++)
+    {
+        if (grpc->rpcs[i].allocated)
+        {
+            golioth_sys_free((void *) grpc->rpcs[i].method);
+        }
+    }
 }
 
 struct golioth_rpc *golioth_rpc_init(struct golioth_client *client)
 {
+    size_t size = sizeof(struct golioth_rpc)
+        + CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS * sizeof(struct golioth_rpc_slot);
+    struct golioth_rpc *grpc = golioth_sys_malloc(size);
+
+    if (grpc != NULL)
+    {
+        memset(grpc, 0, size);
+        rpc_start(grpc, client, grpc->default_slots, CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS);
+    }
+
+    return grpc;
+}
+
+struct golioth_rpc *golioth_rpc_init_with_pool(struct golioth_client *client,
+                                               struct golioth_rpc_slot *slots,
+                                               size_t num_slots)
+{
+    if (num_slots > RPC_MAX_SLOTS)
+    {
+        GLTH_LOGE(TAG, "Too many RPC slots: %zu", num_slots);
+        return NULL;
+    }
+
     struct golioth_rpc *grpc = golioth_sys_malloc(sizeof(struct golioth_rpc));
 
     if (grpc != NULL)
     {
-        grpc->client = client;
-        grpc->num_rpcs = 0;
+        memset(grpc, 0, sizeof(*grpc));
+        memset(slots, 0, num_slots * sizeof(*slots));
+        rpc_start(grpc, client, slots, num_slots);
     }
 
     return grpc;
@@ -264,43 +983,155 @@ enum golioth_status golioth_rpc_deinit(struct golioth_rpc *grpc)
         return GOLIOTH_ERR_NULL;
     }
 
+    if (grpc->call_queue)
+    {
+        /* Pending calls still reference the handle, and are completed by the application */
+        golioth_sys_mutex_lock(grpc->calls_mutex, GOLIOTH_SYS_WAIT_FOREVER);
+        size_t num_calls = grpc->num_calls;
+        grpc->stopping = (num_calls == 0);
+        golioth_sys_mutex_unlock(grpc->calls_mutex);
+
+        if (num_calls > 0)
+        {
+            GLTH_LOGE(TAG, "%zu deferred RPC calls are not completed", num_calls);
+            return GOLIOTH_ERR_INVALID_STATE;
+        }
+    }
+
     golioth_coap_client_cancel_observations_by_prefix(grpc->client, GOLIOTH_RPC_PATH_PREFIX);
+    rpc_release(grpc);
     free(grpc);
     return GOLIOTH_OK;
 }
 
+/* Observe RPCs once the first methods are registered */
+static enum golioth_status rpc_registered(struct golioth_rpc *grpc, bool first)
+{
+    if (first)
+    {
+        golioth_coap_next_token(grpc->token);
+
+        return golioth_coap_client_observe(grpc->client,
+                                           grpc->token,
+                                           GOLIOTH_RPC_PATH_PREFIX,
+                                           "",
+                                           GOLIOTH_CONTENT_TYPE_CBOR,
+                                           on_rpc,
+                                           grpc);
+    }
+    return GOLIOTH_OK;
+}
+
+/* Register a copy of a method built by golioth_rpc_register*() */
+static enum golioth_status register_method(struct golioth_rpc *grpc,
+                                           const struct golioth_rpc_method *method)
+{
+    if (grpc->num_rpcs >= grpc->max_rpcs)
+    {
+        GLTH_LOGE(TAG, "Unable to register, can't register more than %zu methods", grpc->max_rpcs);
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    struct golioth_rpc_method *rpc = golioth_sys_malloc(sizeof(*rpc));
+    if (!rpc)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    *rpc = *method;
+
+    bool first = (grpc->num_rpcs == 0);
+
+    add_method(grpc, rpc, true);
+
+    return rpc_registered(grpc, first);
+}
+
 enum golioth_status golioth_rpc_register(struct golioth_rpc *grpc,
                                          const char *method,
                                          golioth_rpc_cb_fn callback,
                                          void *callback_arg)
 {
-    if (grpc->num_rpcs >= CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS)
+    struct golioth_rpc_method rpc = {
+        .method = method,
+        .callback = callback,
+        .callback_arg = callback_arg,
+    };
+
+    return register_method(grpc, &rpc);
+}
+
+enum golioth_status golioth_rpc_register_deferred(struct golioth_rpc *grpc,
+                                                  const char *method,
+                                                  golioth_rpc_deferred_cb_fn callback,
+                                                  void *callback_arg)
+{
+    if (!callback)
     {
-        GLTH_LOGE(TAG,
-                  "Unable to register, can't register more than %d methods",
-                  CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS);
+        GLTH_LOGE(TAG, "Callback must not be NULL");
+        return GOLIOTH_ERR_NULL;
+    }
+
+    enum golioth_status status = rpc_workers_start(grpc);
+    if (status != GOLIOTH_OK)
+    {
+        return status;
+    }
+
+    struct golioth_rpc_method rpc = {
+        .method = method,
+        .deferred_callback = callback,
+        .callback_arg = callback_arg,
+    };
+
+    return register_method(grpc, &rpc);
+}
+
+enum golioth_status golioth_rpc_register_table(struct golioth_rpc *grpc,
+                                               const struct golioth_rpc_method *table,
+                                               size_t num_methods)
+{
+    bool deferred = false;
+
+    for (size_t i = 0; i < num_methods; i++)
+    {
+        if (!table[i].method || (!table[i].callback && !table[i].deferred_callback))
+        {
+            GLTH_LOGE(TAG, "Name and callback of table entry %zu must not be NULL", i);
+            return GOLIOTH_ERR_NULL;
+        }
+
+        deferred = deferred || table[i].deferred_callback;
+    }
+
+    if (num_methods > grpc->max_rpcs - grpc->num_rpcs)
+    {
+        GLTH_LOGE(TAG, "Unable to register, can't register more than %zu methods", grpc->max_rpcs);
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    struct golioth_rpc_method *rpc = &grpc->rpcs[grpc->num_rpcs];
+    if (num_methods == 0)
+    {
+        return GOLIOTH_OK;
+    }
 
-    rpc->method = method;
-    rpc->callback = callback;
-    rpc->callback_arg = callback_arg;
-    golioth_coap_next_token(rpc->token);
+    if (deferred)
+    {
+        enum golioth_status status = rpc_workers_start(grpc);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+    }
 
-    grpc->num_rpcs++;
-    if (grpc->num_rpcs == 1)
+    bool first = (grpc->num_rpcs == 0);
+
+    for (size_t i = 0; i < num_methods; i++)
     {
-        return golioth_coap_client_observe(grpc->client,
-                                           rpc->token,
-                                           GOLIOTH_RPC_PATH_PREFIX,
-                                           "",
-                                           GOLIOTH_CONTENT_TYPE_CBOR,
-                                           on_rpc,
-                                           grpc);
+        add_method(grpc, &table[i], false);
     }
-    return GOLIOTH_OK;
+
+    return rpc_registered(grpc, first);
 }
 
 #endif  // CONFIG_GOLIOTH_RPC
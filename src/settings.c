@@ -42,7 +42,12 @@ LOG_TAG_DEFINE(golioth_settings);
 #define SETTINGS_PATH_PREFIX ".c/"
 #define SETTINGS_STATUS_PATH "status"
 
-#define GOLIOTH_SETTINGS_MAX_NAME_LEN 63 /* not including NULL */
+/* Index entries refer to slots by number + 1 */
+#define SETTINGS_MAX_SLOTS (UINT16_MAX - 1)
+
+#if CONFIG_GOLIOTH_MAX_NUM_SETTINGS > SETTINGS_MAX_SLOTS
+#error "CONFIG_GOLIOTH_MAX_NUM_SETTINGS is too large for the settings index"
+#endif
 
 #ifdef CONFIG_ZCBOR_CANONICAL
 #define SETTINGS_RSP_BACKUPS 3
@@ -50,31 +55,26 @@ LOG_TAG_DEFINE(golioth_settings);
 #define SETTINGS_RSP_BACKUPS 1
 #endif
 
-/// Private struct for storing a single setting
-struct golioth_setting
-{
-    bool is_valid;
-    const char *key;  // aka name
-    enum golioth_settings_value_type type;
-    union
-    {
-        golioth_int_setting_cb int_cb;
-        golioth_bool_setting_cb bool_cb;
-        golioth_float_setting_cb float_cb;
-        golioth_string_setting_cb string_cb;
-    };
-    int32_t int_min_val;  // applies only to integers
-    int32_t int_max_val;  // applies only to integers
-    void *cb_arg;
-};
-
 /// Private struct to contain settings state data
 struct golioth_settings
 {
     struct golioth_client *client;
     uint8_t token[GOLIOTH_COAP_TOKEN_LEN];
     size_t num_settings;
-    struct golioth_setting settings[CONFIG_GOLIOTH_MAX_NUM_SETTINGS];
+    size_t max_settings;
+    // Allocated with this struct by golioth_settings_init(), or supplied by the application
+    struct golioth_settings_slot *settings;
+    golioth_settings_batch_cb batch_cb;
+    void *batch_cb_arg;
+    // Serializes registration and applying documents from the cloud and from storage
+    golioth_sys_mutex_t mutex;
+    const struct golioth_settings_storage *storage;
+    // Last applied settings document, saved to storage when its version changes
+    uint8_t *cache;
+    size_t cache_len;
+    int64_t cache_version;
+    // Slots allocated by golioth_settings_init()
+    struct golioth_settings_slot default_slots[];
 };
 
 struct settings_response
@@ -82,6 +82,9 @@ struct settings_response
     zcbor_state_t zse[SETTINGS_RSP_BACKUPS + 2];
     uint8_t buf[CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN];
     size_t num_errors;
+    size_t num_changed;
+    // Keys changed by this document, only collected for the batch callback
+    const char **changed_keys;
     struct golioth_settings *settings;
 };
 
@@ -103,6 +106,7 @@ static void response_init(struct settings_response *response, struct golioth_set
 
 static void add_error_to_response(struct settings_response *response,
                                   const char *key,
+                                  size_t key_len,
                                   enum golioth_settings_status code)
 {
     if (response->num_errors == 0)
@@ -114,7 +118,7 @@ static void add_error_to_response(struct settings_response *response,
     zcbor_map_start_encode(response->zse, 2);
 
     zcbor_tstr_put_lit(response->zse, "setting_key");
-    zcbor_tstr_put_term(response->zse, key, SIZE_MAX);
+    zcbor_tstr_encode_ptr(response->zse, key, key_len);
 
     zcbor_tstr_put_lit(response->zse, "error_code");
     zcbor_int64_put(response->zse, code);
@@ -124,22 +128,45 @@ static void add_error_to_response(struct settings_response *response,
     response->num_errors++;
 }
 
-static struct golioth_setting *find_registered_setting(struct golioth_settings *gsettings,
-                                                       const char *key)
+static struct hash_index settings_index(struct golioth_settings *gsettings)
 {
-    for (size_t i = 0; i < gsettings->num_settings; i++)
-    {
-        struct golioth_setting *s = &gsettings->settings[i];
-        if (!s->is_valid)
-        {
-            continue;
-        }
-        if (strcmp(s->key, key) == 0)
-        {
-            return s;
-        }
-    }
-    return NULL;
+    return (struct hash_index){
+        .slots = gsettings->settings,
+        .slot_size = sizeof(*gsettings->settings),
+        .index_offset = offsetof(struct golioth_settings_slot, index),
+        .num_slots = gsettings->max_settings,
+    };
+}
+
+/*
+ * Values are compared to the last applied one. Strings are compared by length and 64-bit hash,
+ * so that their values don't need to be kept.
+ */
+static bool setting_unchanged(const struct golioth_settings_slot *setting,
+                              uint64_t value,
+                              size_t len)
+{
+    return setting->has_applied_value && setting->applied_value == value
+        && setting->applied_len == len;
+}
+
+static bool setting_match(const void *slot, const char *key, size_t key_len, uint32_t hash)
+{
+    const struct golioth_settings_slot *s = slot;
+
+    return s->key_hash == hash && s->key_len == key_len
+        && memcmp(s->entry->name, key, key_len) == 0;
+}
+
+// Key does not need to be NULL-terminated
+static struct golioth_settings_slot *find_registered_setting(
+    struct golioth_settings *gsettings,
+    const char *key,
+    size_t key_len)
+{
+    struct hash_index index = settings_index(gsettings);
+
+    return hash_index_find(&index, key, key_len, setting_match);
 }
 
 static int finalize_and_send_response(struct golioth_client *client,
@@ -200,7 +227,6 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
     struct settings_response *settings_response = value;
     struct golioth_settings *gsettings = settings_response->settings;
     struct zcbor_string label;
-    enum golioth_settings_status setting_status = GOLIOTH_SETTINGS_SUCCESS;
     bool ok;
 
     if (zcbor_nil_expect(zsd, NULL))
@@ -226,21 +252,26 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
             return -EBADMSG;
         }
 
-        char key[GOLIOTH_SETTINGS_MAX_NAME_LEN + 1] = {};
-
-        /* Copy setting label/name and ensure it's NULL-terminated */
-        memcpy(key, label.value, MIN(GOLIOTH_SETTINGS_MAX_NAME_LEN, label.len));
+        const char *key = (const char *) label.value;
 
+        enum golioth_settings_status setting_status = GOLIOTH_SETTINGS_SUCCESS;
         bool data_type_valid = true;
+        bool unchanged = false;
+        uint64_t applied_value = 0;
+        size_t applied_len = 0;
 
         zcbor_major_type_t major_type = ZCBOR_MAJOR_TYPE(*zsd->payload);
 
-        GLTH_LOGD(TAG, "key = %s, major_type = %d", key, major_type);
+        GLTH_LOGD(TAG, "key = %.*s, major_type = %d", (int) label.len, key, major_type);
 
-        const struct golioth_setting *registered_setting = find_registered_setting(gsettings, key);
+        struct golioth_settings_slot *registered_setting =
+            find_registered_setting(gsettings, key, label.len);
         if (!registered_setting)
         {
-            add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_KEY_NOT_RECOGNIZED);
+            add_error_to_response(settings_response,
+                                  key,
+                                  label.len,
+                                  GOLIOTH_SETTINGS_KEY_NOT_RECOGNIZED);
 
             ok = zcbor_any_skip(zsd, NULL);
             if (!ok)
@@ -252,13 +283,15 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
             continue;
         }
 
+        const struct golioth_settings_entry *entry = registered_setting->entry;
+
         switch (major_type)
         {
             case ZCBOR_MAJOR_TYPE_TSTR:
             {
                 struct zcbor_string str;
 
-                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_STRING)
+                if (entry->type != GOLIOTH_SETTINGS_VALUE_TYPE_STRING)
                 {
                     data_type_valid = false;
                     break;
@@ -271,9 +304,15 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
                     break;
                 }
 
-                setting_status = registered_setting->string_cb((char *) str.value,
-                                                               str.len,
-                                                               registered_setting->cb_arg);
+                applied_value = fnv1a_hash64((const char *) str.value, str.len);
+                applied_len = str.len;
+                unchanged = setting_unchanged(registered_setting, applied_value, applied_len);
+                if (unchanged)
+                {
+                    break;
+                }
+
+                setting_status = entry->string_cb((char *) str.value, str.len, entry->cb_arg);
                 break;
             }
             case ZCBOR_MAJOR_TYPE_PINT:
@@ -281,7 +320,7 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
             {
                 int64_t value;
 
-                if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_INT)
+                if (entry->type != GOLIOTH_SETTINGS_VALUE_TYPE_INT)
                 {
                     data_type_valid = false;
                     break;
@@ -294,15 +333,20 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
                     break;
                 }
 
-                if ((value < registered_setting->int_min_val)
-                    || (value > registered_setting->int_max_val))
+                if ((value < entry->int_min_val) || (value > entry->int_max_val))
                 {
                     setting_status = GOLIOTH_SETTINGS_VALUE_OUTSIDE_RANGE;
                     break;
                 }
 
-                setting_status =
-                    registered_setting->int_cb((int32_t) value, registered_setting->cb_arg);
+                applied_value = (uint64_t) value;
+                unchanged = setting_unchanged(registered_setting, applied_value, applied_len);
+                if (unchanged)
+                {
+                    break;
+                }
+
+                setting_status = entry->int_cb((int32_t) value, entry->cb_arg);
                 break;
             }
             case ZCBOR_MAJOR_TYPE_SIMPLE:
@@ -312,29 +356,45 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
 
                 if (zcbor_float_decode(zsd, &value_double))
                 {
-                    if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT)
+                    if (entry->type != GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT)
                     {
                         data_type_valid = false;
                         break;
                     }
 
-                    setting_status = registered_setting->float_cb((float) value_double,
-                                                                  registered_setting->cb_arg);
+                    float value_float = (float) value_double;
+                    uint32_t value_bits;
+
+                    memcpy(&value_bits, &value_float, sizeof(value_bits));
+                    applied_value = value_bits;
+                    unchanged = setting_unchanged(registered_setting, applied_value, applied_len);
+                    if (unchanged)
+                    {
+                        break;
+                    }
+
+                    setting_status = entry->float_cb(value_float, entry->cb_arg);
                 }
                 else if (zcbor_bool_decode(zsd, &value_bool))
                 {
-                    if (registered_setting->type != GOLIOTH_SETTINGS_VALUE_TYPE_BOOL)
+                    if (entry->type != GOLIOTH_SETTINGS_VALUE_TYPE_BOOL)
                     {
                         data_type_valid = false;
                         break;
                     }
 
-                    setting_status =
-                        registered_setting->bool_cb(value_bool, registered_setting->cb_arg);
+                    applied_value = value_bool;
+                    unchanged = setting_unchanged(registered_setting, applied_value, applied_len);
+                    if (unchanged)
+                    {
+                        break;
+                    }
+
+                    setting_status = entry->bool_cb(value_bool, entry->cb_arg);
                 }
                 else
                 {
-                    break;
+                    data_type_valid = false;
                 }
                 break;
             }
@@ -347,12 +407,37 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
         {
             if (setting_status != GOLIOTH_SETTINGS_SUCCESS)
             {
-                add_error_to_response(settings_response, key, setting_status);
+                /* Not remembered, so the callback is retried with the next notification */
+                add_error_to_response(settings_response, key, label.len, setting_status);
+            }
+            else if (unchanged)
+            {
+                GLTH_LOGD(TAG, "Skipping unchanged %.*s", (int) label.len, key);
+            }
+            else
+            {
+                registered_setting->has_applied_value = true;
+                registered_setting->applied_value = applied_value;
+                registered_setting->applied_len = applied_len;
+
+                /* Bounded in case of duplicate keys in the notification */
+                if (settings_response->num_changed < gsettings->max_settings)
+                {
+                    if (settings_response->changed_keys)
+                    {
+                        settings_response->changed_keys[settings_response->num_changed] =
+                            entry->name;
+                    }
+                    settings_response->num_changed++;
+                }
             }
         }
         else
         {
-            add_error_to_response(settings_response, key, GOLIOTH_SETTINGS_VALUE_FORMAT_NOT_VALID);
+            add_error_to_response(settings_response,
+                                  key,
+                                  label.len,
+                                  GOLIOTH_SETTINGS_VALUE_FORMAT_NOT_VALID);
 
             ok = zcbor_any_skip(zsd, NULL);
             if (!ok)
@@ -373,6 +458,81 @@ static int settings_decode(zcbor_state_t *zsd, void *value)
     return 0;
 }
 
+/* Decode a settings document and call the callbacks of the registered settings in it */
+static int settings_apply(struct golioth_settings *settings,
+                          const uint8_t *payload,
+                          size_t payload_size,
+                          struct settings_response *settings_response,
+                          int64_t *version)
+{
+    ZCBOR_STATE_D(zsd, 2, payload, payload_size, 1, 0);
+    struct zcbor_map_entry map_entries[] = {
+        ZCBOR_TSTR_LIT_MAP_ENTRY("settings", settings_decode, settings_response),
+        ZCBOR_TSTR_LIT_MAP_ENTRY("version", zcbor_map_int64_decode, version),
+    };
+
+    golioth_settings_batch_cb batch_cb = settings->batch_cb;
+
+    response_init(settings_response, settings);
+
+    /* Local to this pass, as documents can be applied by several threads */
+    if (batch_cb)
+    {
+        settings_response->changed_keys =
+            golioth_sys_malloc(settings->max_settings * sizeof(*settings_response->changed_keys));
+        if (!settings_response->changed_keys)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    int err = zcbor_map_decode(zsd, map_entries, ARRAY_SIZE(map_entries));
+
+    if (!err && batch_cb && settings_response->num_changed > 0)
+    {
+        batch_cb(settings_response->changed_keys,
+                 settings_response->num_changed,
+                 settings->batch_cb_arg);
+    }
+
+    golioth_sys_free(settings_response->changed_keys);
+    settings_response->changed_keys = NULL;
+
+    return err;
+}
+
+/*
+ * Remember a settings document received from the cloud, unless it is the cached version. Called
+ * with the settings mutex held. Returns true if the document needs to be saved to storage.
+ */
+static bool cache_settings(struct golioth_settings *settings,
+                           const uint8_t *payload,
+                           size_t payload_size,
+                           int64_t version)
+{
+    if (!settings->storage)
+    {
+        return false;
+    }
+
+    if (payload_size > CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN)
+    {
+        GLTH_LOGW(TAG, "Settings too large to cache: %zu", payload_size);
+        return false;
+    }
+
+    if (settings->cache_len != 0 && settings->cache_version == version)
+    {
+        return false;
+    }
+
+    memcpy(settings->cache, payload, payload_size);
+    settings->cache_len = payload_size;
+    settings->cache_version = version;
+
+    return true;
+}
+
 static void on_settings(struct golioth_client *client,
                         enum golioth_status status,
                         const struct golioth_coap_rsp_code *coap_rsp_code,
@@ -394,14 +554,9 @@ static void on_settings(struct golioth_client *client,
         return;
     }
 
-    ZCBOR_STATE_D(zsd, 2, payload, payload_size, 1, 0);
     int64_t version;
     struct golioth_settings *settings = arg;
     struct settings_response settings_response;
-    struct zcbor_map_entry map_entries[] = {
-        ZCBOR_TSTR_LIT_MAP_ENTRY("settings", settings_decode, &settings_response),
-        ZCBOR_TSTR_LIT_MAP_ENTRY("version", zcbor_map_int64_decode, &version),
-    };
     int err;
 
     GLTH_LOG_BUFFER_HEXDUMP(TAG, payload, payload_size, GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
@@ -414,9 +569,13 @@ static void on_settings(struct golioth_client *client,
 
     GLTH_LOG_BUFFER_HEXDUMP(TAG, payload, min(64, payload_size), GOLIOTH_DEBUG_LOG_LEVEL_DEBUG);
 
-    response_init(&settings_response, settings);
+    golioth_sys_mutex_lock(settings->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    err = settings_apply(settings, payload, payload_size, &settings_response, &version);
+    bool save = !err && cache_settings(settings, payload, payload_size, version);
+
+    golioth_sys_mutex_unlock(settings->mutex);
 
-    err = zcbor_map_decode(zsd, map_entries, ARRAY_SIZE(map_entries));
     if (err)
     {
         if (err != -ENOENT)
@@ -426,6 +585,17 @@ static void on_settings(struct golioth_client *client,
         return;
     }
 
+    if (save)
+    {
+        /* From the caller's buffer, the cache may be replaced by a newer version meanwhile */
+        enum golioth_status status =
+            settings->storage->save(payload, payload_size, settings->storage->arg);
+        if (GOLIOTH_OK != status)
+        {
+            GLTH_LOGW(TAG, "Failed to save settings: %d", status);
+        }
+    }
+
     err = finalize_and_send_response(client, &settings_response, version);
     if (err)
     {
@@ -434,17 +604,36 @@ static void on_settings(struct golioth_client *client,
     }
 }
 
-static struct golioth_setting *alloc_setting(struct golioth_settings *settings)
+/* Called with the settings mutex held */
+static enum golioth_status add_setting(struct golioth_settings *settings,
+                                       const struct golioth_settings_entry *entry,
+                                       bool copy)
 {
-    if (settings->num_settings == CONFIG_GOLIOTH_MAX_NUM_SETTINGS)
+    if (settings->num_settings == settings->max_settings)
     {
-        GLTH_LOGE(TAG,
-                  "Exceeded CONFIG_GOLIOTH_MAX_NUM_SETTINGS (%d)",
-                  CONFIG_GOLIOTH_MAX_NUM_SETTINGS);
-        return NULL;
+        GLTH_LOGE(TAG, "Exceeded the number of settings slots (%zu)", settings->max_settings);
+        return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    return &settings->settings[settings->num_settings++];
+    struct golioth_settings_slot *setting = &settings->settings[settings->num_settings];
+
+    if (copy)
+    {
+        setting->registered_entry = *entry;
+        entry = &setting->registered_entry;
+    }
+
+    setting->entry = entry;
+    setting->key_len = strlen(entry->name);
+    setting->key_hash = fnv1a_hash(entry->name, setting->key_len);
+    setting->has_applied_value = false;
+
+    struct hash_index index = settings_index(settings);
+    hash_index_add(&index, settings->num_settings, setting->key_hash);
+
+    settings->num_settings++;
+
+    return GOLIOTH_OK;
 }
 
 static enum golioth_status request_settings(struct golioth_settings *settings)
@@ -462,19 +651,40 @@ static enum golioth_status request_settings(struct golioth_settings *settings)
                                    GOLIOTH_SYS_WAIT_FOREVER);
 }
 
-struct golioth_settings *golioth_settings_init(struct golioth_client *client)
+
+/* Register a copy of an entry built by one of golioth_settings_register_*() */
+static enum golioth_status register_setting(struct golioth_settings *settings,
+                                            const struct golioth_settings_entry *entry)
 {
-    struct golioth_settings *gsettings = golioth_sys_malloc(sizeof(struct golioth_settings));
+    golioth_sys_mutex_lock(settings->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+    enum golioth_status status = add_setting(settings, entry, true);
+    golioth_sys_mutex_unlock(settings->mutex);
 
-    if (gsettings == NULL)
+    if (status != GOLIOTH_OK)
     {
-        goto finish;
+        return status;
     }
 
+    return request_settings(settings);
+}
+
+static struct golioth_settings *settings_start(struct golioth_settings *gsettings,
+                                               struct golioth_client *client,
+                                               struct golioth_settings_slot *slots,
+                                               size_t num_slots)
+{
     gsettings->client = client;
-    gsettings->num_settings = 0;
+    gsettings->settings = slots;
+    gsettings->max_settings = num_slots;
     golioth_coap_next_token(gsettings->token);
 
+    gsettings->mutex = golioth_sys_mutex_create();
+    if (!gsettings->mutex)
+    {
+        golioth_sys_free(gsettings);
+        return NULL;
+    }
+
     enum golioth_status status = golioth_coap_client_observe(client,
                                                              gsettings->token,
                                                              SETTINGS_PATH_PREFIX,
@@ -486,14 +696,63 @@ struct golioth_settings *golioth_settings_init(struct golioth_client *client)
     if (status != GOLIOTH_OK)
     {
         GLTH_LOGE(TAG, "Failed to observe settings %d (%s)", status, golioth_status_to_str(status));
+        golioth_sys_mutex_destroy(gsettings->mutex);
         golioth_sys_free(gsettings);
-        gsettings = NULL;
+        return NULL;
     }
 
-finish:
     return gsettings;
 }
 
+/* Free everything allocated after golioth_settings_init*() */
+static void settings_release(struct golioth_settings *settings)
+{
+    golioth_sys_free(settings->cache);
+    golioth_sys_mutex_destroy(settings->mutex);
+}
+
+struct golioth_settings *golioth_settings_init(struct golioth_client *client)
+{
+    size_t size = sizeof(struct golioth_settings)
+        + CONFIG_GOLIOTH_MAX_NUM_SETTINGS * sizeof(struct golioth_settings_slot);
+    struct golioth_settings *gsettings = golioth_sys_malloc(size);
+
+    if (gsettings == NULL)
+    {
+        return NULL;
+    }
+
+    memset(gsettings, 0, size);
+
+    return settings_start(gsettings,
+                          client,
+                          gsettings->default_slots,
+                          CONFIG_GOLIOTH_MAX_NUM_SETTINGS);
+}
+
+struct golioth_settings *golioth_settings_init_with_pool(struct golioth_client *client,
+                                                         struct golioth_settings_slot *slots,
+                                                         size_t num_slots)
+{
+    if (num_slots > SETTINGS_MAX_SLOTS)
+    {
+        GLTH_LOGE(TAG, "Too many settings slots: %zu", num_slots);
+        return NULL;
+    }
+
+    struct golioth_settings *gsettings = golioth_sys_malloc(sizeof(struct golioth_settings));
+
+    if (gsettings == NULL)
+    {
+        return NULL;
+    }
+
+    memset(gsettings, 0, sizeof(*gsettings));
+    memset(slots, 0, num_slots * sizeof(*slots));
+
+    return settings_start(gsettings, client, slots, num_slots);
+}
+
 enum golioth_status golioth_settings_deinit(struct golioth_settings *settings)
 {
 
@@ -504,6 +763,7 @@ enum golioth_status golioth_settings_deinit(struct golioth_settings *settings)
     }
 
     golioth_coap_client_cancel_observations_by_prefix(settings->client, SETTINGS_PATH_PREFIX);
+    settings_release(settings);
     free(settings);
     return GOLIOTH_OK;
 }
@@ -534,21 +794,16 @@ enum golioth_status golioth_settings_register_int_with_range(struct golioth_sett
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
-    if (!new_setting)
-    {
-        return GOLIOTH_ERR_MEM_ALLOC;
-    }
-
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
-    new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_INT;
-    new_setting->int_cb = callback;
-    new_setting->int_min_val = min_val;
-    new_setting->int_max_val = max_val;
-    new_setting->cb_arg = callback_arg;
+    struct golioth_settings_entry entry = {
+        .name = setting_name,
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_INT,
+        .int_cb = callback,
+        .int_min_val = min_val,
+        .int_max_val = max_val,
+        .cb_arg = callback_arg,
+    };
 
-    return request_settings(settings);
+    return register_setting(settings, &entry);
 }
 
 enum golioth_status golioth_settings_register_bool(struct golioth_settings *settings,
@@ -562,19 +817,14 @@ enum golioth_status golioth_settings_register_bool(struct golioth_settings *sett
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
-    if (!new_setting)
-    {
-        return GOLIOTH_ERR_MEM_ALLOC;
-    }
-
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
-    new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_BOOL;
-    new_setting->bool_cb = callback;
-    new_setting->cb_arg = callback_arg;
+    struct golioth_settings_entry entry = {
+        .name = setting_name,
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_BOOL,
+        .bool_cb = callback,
+        .cb_arg = callback_arg,
+    };
 
-    return request_settings(settings);
+    return register_setting(settings, &entry);
 }
 
 enum golioth_status golioth_settings_register_float(struct golioth_settings *settings,
@@ -588,19 +838,14 @@ enum golioth_status golioth_settings_register_float(struct golioth_settings *set
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
-    if (!new_setting)
-    {
-        return GOLIOTH_ERR_MEM_ALLOC;
-    }
-
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
-    new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT;
-    new_setting->float_cb = callback;
-    new_setting->cb_arg = callback_arg;
+    struct golioth_settings_entry entry = {
+        .name = setting_name,
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT,
+        .float_cb = callback,
+        .cb_arg = callback_arg,
+    };
 
-    return request_settings(settings);
+    return register_setting(settings, &entry);
 }
 
 enum golioth_status golioth_settings_register_string(struct golioth_settings *settings,
@@ -614,18 +859,138 @@ enum golioth_status golioth_settings_register_string(struct golioth_settings *se
         return GOLIOTH_ERR_NULL;
     }
 
-    struct golioth_setting *new_setting = alloc_setting(settings);
-    if (!new_setting)
+    struct golioth_settings_entry entry = {
+        .name = setting_name,
+        .type = GOLIOTH_SETTINGS_VALUE_TYPE_STRING,
+        .string_cb = callback,
+        .cb_arg = callback_arg,
+    };
+
+    return register_setting(settings, &entry);
+}
+
+enum golioth_status golioth_settings_register_table(struct golioth_settings *settings,
+                                                    const struct golioth_settings_entry *table,
+                                                    size_t num_entries)
+{
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        const struct golioth_settings_entry *entry = &table[i];
+        bool has_cb = false;
+
+        switch (entry->type)
+        {
+            case GOLIOTH_SETTINGS_VALUE_TYPE_INT:
+                has_cb = (entry->int_cb != NULL);
+                break;
+            case GOLIOTH_SETTINGS_VALUE_TYPE_BOOL:
+                has_cb = (entry->bool_cb != NULL);
+                break;
+            case GOLIOTH_SETTINGS_VALUE_TYPE_FLOAT:
+                has_cb = (entry->float_cb != NULL);
+                break;
+            case GOLIOTH_SETTINGS_VALUE_TYPE_STRING:
+                has_cb = (entry->string_cb != NULL);
+                break;
+            default:
+                GLTH_LOGE(TAG, "Unknown type %d of table entry %zu", entry->type, i);
+                return GOLIOTH_ERR_INVALID_FORMAT;
+        }
+
+        if (!entry->name || !has_cb)
+        {
+            GLTH_LOGE(TAG, "Name and callback of table entry %zu must not be NULL", i);
+            return GOLIOTH_ERR_NULL;
+        }
+    }
+
+    if (num_entries > settings->max_settings - settings->num_settings)
     {
+        GLTH_LOGE(TAG, "Exceeded the number of settings slots (%zu)", settings->max_settings);
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    new_setting->is_valid = true;
-    new_setting->key = setting_name;
-    new_setting->type = GOLIOTH_SETTINGS_VALUE_TYPE_STRING;
-    new_setting->string_cb = callback;
-    new_setting->cb_arg = callback_arg;
+    golioth_sys_mutex_lock(settings->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        add_setting(settings, &table[i], false);
+    }
+
+    golioth_sys_mutex_unlock(settings->mutex);
 
     return request_settings(settings);
 }
+
+enum golioth_status golioth_settings_register_batch_cb(struct golioth_settings *settings,
+                                                       golioth_settings_batch_cb callback,
+                                                       void *callback_arg)
+{
+    if (!callback)
+    {
+        GLTH_LOGE(TAG, "Callback must not be NULL");
+        return GOLIOTH_ERR_NULL;
+    }
+
+    settings->batch_cb = callback;
+    settings->batch_cb_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_settings_register_storage(
+    struct golioth_settings *settings,
+    const struct golioth_settings_storage *storage)
+{
+    if (!storage || !storage->save || !storage->load)
+    {
+        GLTH_LOGE(TAG, "Storage must not be NULL");
+        return GOLIOTH_ERR_NULL;
+    }
+
+    if (settings->storage)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    settings->cache = golioth_sys_malloc(CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN);
+    if (!settings->cache)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    struct settings_response settings_response;
+    size_t len = CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN;
+
+    /* Applied once, before any document from the cloud can replace the cache */
+    golioth_sys_mutex_lock(settings->mutex, GOLIOTH_SYS_WAIT_FOREVER);
+
+    settings->storage = storage;
+
+    enum golioth_status status = storage->load(settings->cache, &len, storage->arg);
+    if (GOLIOTH_OK != status)
+    {
+        GLTH_LOGI(TAG, "No cached settings: %d", status);
+        goto unlock;
+    }
+
+    int err = settings_apply(settings,
+                             settings->cache,
+                             len,
+                             &settings_response,
+                             &settings->cache_version);
+    if (err)
+    {
+        GLTH_LOGW(TAG, "Discarding invalid cached settings: %d", err);
+        status = (-ENOMEM == err) ? GOLIOTH_ERR_MEM_ALLOC : GOLIOTH_ERR_INVALID_FORMAT;
+        goto unlock;
+    }
+
+    settings->cache_len = len;
+
+unlock:
+    golioth_sys_mutex_unlock(settings->mutex);
+
+    return status;
+}
 #endif  // CONFIG_GOLIOTH_SETTINGS
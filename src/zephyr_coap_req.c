@@ -130,6 +130,13 @@ static int golioth_coap_req_reply_handler(struct golioth_coap_req *req,
         .coap_rsp_code.code_detail = (uint8_t) (code & 0x1f),
     };
 
+    struct coap_option etag;
+    if (coap_find_options(response, COAP_OPTION_ETAG, &etag, 1) == 1)
+    {
+        rsp.etag = etag.value;
+        rsp.etag_len = etag.len;
+    }
+
     GLTH_LOGD(TAG,
               "CoAP response code: 0x%x (class %u detail %u)",
               (unsigned int) code,
@@ -118,13 +118,15 @@ void test_multi_block_upload(struct golioth_client *client)
         GLTH_LOGE(TAG, "Error allocating context");
     }
 
+    size_t block_size = golioth_client_get_upload_block_size(client);
+
     while (true)
     {
-        bu_offset = block_idx * CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE;
-        bu_data_len = CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE;
+        bu_offset = block_idx * block_size;
+        bu_data_len = block_size;
         bu_data_remaining = test_data_json_len - bu_offset;
 
-        if (bu_data_remaining <= CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE)
+        if (bu_data_remaining <= block_size)
         {
             bu_data_len = bu_data_remaining;
             is_last = true;
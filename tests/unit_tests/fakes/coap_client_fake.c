@@ -10,6 +10,16 @@ DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
                        uint32_t,
                        golioth_get_cb_fn,
                        void *);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_get,
+                       struct golioth_client *,
+                       const uint8_t *,
+                       const char *,
+                       const char *,
+                       enum golioth_content_type,
+                       golioth_get_cb_fn,
+                       void *,
+                       int32_t);
 DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
                        golioth_coap_client_set,
                        struct golioth_client *,
@@ -22,7 +32,24 @@ DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
                        golioth_set_cb_fn,
                        void *,
                        int32_t);
+DEFINE_FAKE_VALUE_FUNC(enum golioth_status,
+                       golioth_coap_client_set_with_header,
+                       struct golioth_client *,
+                       const uint8_t *,
+                       const char *,
+                       const char *,
+                       enum golioth_content_type,
+                       const uint8_t *,
+                       size_t,
+                       const uint8_t *,
+                       size_t,
+                       golioth_set_cb_fn,
+                       void *,
+                       int32_t);
 DEFINE_FAKE_VOID_FUNC(golioth_coap_client_cancel_observations_by_prefix,
                       struct golioth_client *,
                       const char *);
+DEFINE_FAKE_VOID_FUNC(golioth_coap_client_cancel_observation,
+                      struct golioth_client *,
+                      const uint8_t *);
 DEFINE_FAKE_VOID_FUNC(golioth_coap_next_token, uint8_t *);
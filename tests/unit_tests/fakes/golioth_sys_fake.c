@@ -0,0 +1,32 @@
+#include <fff.h>
+#include "golioth_sys_fake.h"
+
+DEFINE_FAKE_VALUE_FUNC(golioth_sys_mutex_t, golioth_sys_mutex_create);
+DEFINE_FAKE_VALUE_FUNC(bool, golioth_sys_mutex_lock, golioth_sys_mutex_t, int32_t);
+DEFINE_FAKE_VALUE_FUNC(bool, golioth_sys_mutex_unlock, golioth_sys_mutex_t);
+DEFINE_FAKE_VOID_FUNC(golioth_sys_mutex_destroy, golioth_sys_mutex_t);
+DEFINE_FAKE_VALUE_FUNC(golioth_sys_timer_t,
+                       golioth_sys_timer_create,
+                       const struct golioth_timer_config *);
+DEFINE_FAKE_VALUE_FUNC(bool, golioth_sys_timer_start, golioth_sys_timer_t);
+DEFINE_FAKE_VALUE_FUNC(bool, golioth_sys_timer_reset, golioth_sys_timer_t);
+DEFINE_FAKE_VOID_FUNC(golioth_sys_timer_destroy, golioth_sys_timer_t);
+
+void golioth_sys_fake_reset(void)
+{
+    RESET_FAKE(golioth_sys_mutex_create);
+    RESET_FAKE(golioth_sys_mutex_lock);
+    RESET_FAKE(golioth_sys_mutex_unlock);
+    RESET_FAKE(golioth_sys_mutex_destroy);
+    RESET_FAKE(golioth_sys_timer_create);
+    RESET_FAKE(golioth_sys_timer_start);
+    RESET_FAKE(golioth_sys_timer_reset);
+    RESET_FAKE(golioth_sys_timer_destroy);
+
+    golioth_sys_mutex_create_fake.return_val = (golioth_sys_mutex_t) 1;
+    golioth_sys_mutex_lock_fake.return_val = true;
+    golioth_sys_mutex_unlock_fake.return_val = true;
+    golioth_sys_timer_create_fake.return_val = (golioth_sys_timer_t) 1;
+    golioth_sys_timer_start_fake.return_val = true;
+    golioth_sys_timer_reset_fake.return_val = true;
+}
@@ -0,0 +1,22 @@
+/* Include after the CONFIG_* definitions of a test, and before the source under test. Logs are
+ * compiled out, and mutexes and timers are fakes, which golioth_sys_fake_reset() makes succeed. */
+#define CONFIG_GOLIOTH_DEBUG_LOG
+#define GLTH_LOGX(...)
+#define GLTH_LOG_BUFFER_HEXDUMP(...)
+
+#include <fff.h>
+
+#include <golioth/golioth_sys.h>
+
+DECLARE_FAKE_VALUE_FUNC(golioth_sys_mutex_t, golioth_sys_mutex_create);
+DECLARE_FAKE_VALUE_FUNC(bool, golioth_sys_mutex_lock, golioth_sys_mutex_t, int32_t);
+DECLARE_FAKE_VALUE_FUNC(bool, golioth_sys_mutex_unlock, golioth_sys_mutex_t);
+DECLARE_FAKE_VOID_FUNC(golioth_sys_mutex_destroy, golioth_sys_mutex_t);
+DECLARE_FAKE_VALUE_FUNC(golioth_sys_timer_t,
+                        golioth_sys_timer_create,
+                        const struct golioth_timer_config *);
+DECLARE_FAKE_VALUE_FUNC(bool, golioth_sys_timer_start, golioth_sys_timer_t);
+DECLARE_FAKE_VALUE_FUNC(bool, golioth_sys_timer_reset, golioth_sys_timer_t);
+DECLARE_FAKE_VOID_FUNC(golioth_sys_timer_destroy, golioth_sys_timer_t);
+
+void golioth_sys_fake_reset(void);
@@ -0,0 +1,303 @@
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_ENTRIES 2
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_CACHE_MAX_SIZE 8
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_cache.c"
+
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_coap_client_get_etag,
+                struct golioth_client *,
+                const uint8_t *,
+                const char *,
+                const char *,
+                enum golioth_content_type,
+                const uint8_t *,
+                size_t,
+                coap_get_etag_cb_fn,
+                void *,
+                int32_t);
+FAKE_VOID_FUNC(test_get_cb,
+               struct golioth_client *,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const char *,
+               const uint8_t *,
+               size_t,
+               void *);
+
+static struct golioth_lightdb_cache *cache;
+static uint8_t sent_etag[GOLIOTH_COAP_MAX_ETAG_LEN];
+static size_t sent_etag_len;
+static uint8_t received_payload[16];
+
+static const struct golioth_coap_rsp_code rsp_content = {2, 5};
+static const struct golioth_coap_rsp_code rsp_valid = {2, 3};
+
+enum golioth_status golioth_coap_client_get_etag_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    enum golioth_content_type content_type,
+    const uint8_t *etag,
+    size_t etag_len,
+    coap_get_etag_cb_fn callback,
+    void *callback_arg,
+    int32_t timeout_s)
+{
+    TEST_ASSERT_EQUAL_STRING(".d/", path_prefix);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(sent_etag), etag_len);
+
+    memcpy(sent_etag, etag, etag_len);
+    sent_etag_len = etag_len;
+
+    return GOLIOTH_OK;
+}
+
+/* The payload is only valid during the callback */
+static void test_get_cb_custom_fake(struct golioth_client *client,
+                                    enum golioth_status status,
+                                    const struct golioth_coap_rsp_code *coap_rsp_code,
+                                    const char *path,
+                                    const uint8_t *payload,
+                                    size_t payload_size,
+                                    void *arg)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(received_payload), payload_size);
+
+    memcpy(received_payload, payload, payload_size);
+}
+
+static void get(const char *path)
+{
+    TEST_ASSERT_EQUAL(
+        GOLIOTH_OK,
+        golioth_lightdb_cache_get(cache, path, GOLIOTH_CONTENT_TYPE_CBOR, test_get_cb, NULL));
+}
+
+/* Respond to the last request, like the CoAP client does */
+static void respond(const struct golioth_coap_rsp_code *rsp_code,
+                    const char *etag,
+                    const char *payload)
+{
+    coap_get_etag_cb_fn callback = golioth_coap_client_get_etag_fake.arg7_val;
+    void *arg = golioth_coap_client_get_etag_fake.arg8_val;
+
+    callback(NULL,
+             GOLIOTH_OK,
+             rsp_code,
+             golioth_coap_client_get_etag_fake.arg3_val,
+             (const uint8_t *) etag,
+             etag ? strlen(etag) : 0,
+             (const uint8_t *) payload,
+             payload ? strlen(payload) : 0,
+             arg);
+}
+
+static void assert_stats(uint32_t validations, uint32_t full_fetches, uint32_t evictions)
+{
+    struct golioth_lightdb_cache_stats stats;
+
+    golioth_lightdb_cache_get_stats(cache, &stats);
+
+    TEST_ASSERT_EQUAL(validations, stats.validations);
+    TEST_ASSERT_EQUAL(full_fetches, stats.full_fetches);
+    TEST_ASSERT_EQUAL(evictions, stats.evictions);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    golioth_coap_client_get_etag_fake.custom_fake = golioth_coap_client_get_etag_custom_fake;
+    test_get_cb_fake.custom_fake = test_get_cb_custom_fake;
+    cache = golioth_lightdb_cache_create(NULL);
+    TEST_ASSERT_NOT_NULL(cache);
+}
+
+void tearDown(void)
+{
+    golioth_lightdb_cache_destroy(cache);
+    sent_etag_len = 0;
+    RESET_FAKE(golioth_coap_client_get_etag);
+    RESET_FAKE(test_get_cb);
+    FFF_RESET_HISTORY();
+}
+
+void test_cache_validated(void)
+{
+    get("cfg");
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+    respond(&rsp_content, "e1", "abc");
+
+    TEST_ASSERT_EQUAL(1, test_get_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(3, test_get_cb_fake.arg5_val);
+
+    /* The next GET is conditional, and answered from the cache */
+    get("cfg");
+    TEST_ASSERT_EQUAL(2, sent_etag_len);
+    TEST_ASSERT_EQUAL_MEMORY("e1", sent_etag, 2);
+    respond(&rsp_valid, NULL, NULL);
+
+    TEST_ASSERT_EQUAL(2, test_get_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, test_get_cb_fake.arg1_val);
+    TEST_ASSERT_EQUAL_PTR(&rsp_valid, test_get_cb_fake.arg2_val);
+    TEST_ASSERT_EQUAL(3, test_get_cb_fake.arg5_val);
+    TEST_ASSERT_EQUAL_MEMORY("abc", received_payload, 3);
+
+    assert_stats(1, 1, 0);
+}
+
+void test_cache_changed(void)
+{
+    get("cfg");
+    respond(&rsp_content, "e1", "abc");
+
+    get("cfg");
+    respond(&rsp_content, "e2", "xy");
+
+    TEST_ASSERT_EQUAL_MEMORY("xy", received_payload, 2);
+
+    /* The new value and ETag replaced the old ones */
+    get("cfg");
+    TEST_ASSERT_EQUAL_MEMORY("e2", sent_etag, 2);
+    respond(&rsp_valid, NULL, NULL);
+
+    TEST_ASSERT_EQUAL(2, test_get_cb_fake.arg5_val);
+    TEST_ASSERT_EQUAL_MEMORY("xy", received_payload, 2);
+
+    assert_stats(1, 2, 0);
+}
+
+void test_cache_no_etag(void)
+{
+    get("cfg");
+    respond(&rsp_content, NULL, "abc");
+
+    /* Without an ETag the value can't be validated */
+    get("cfg");
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+}
+
+void test_cache_per_path(void)
+{
+    get("a");
+    respond(&rsp_content, "ea", "1");
+
+    get("b");
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+    respond(&rsp_content, "eb", "2");
+
+    get("a");
+    TEST_ASSERT_EQUAL_MEMORY("ea", sent_etag, 2);
+
+    /* Other content types are cached separately */
+    golioth_lightdb_cache_get(cache, "a", GOLIOTH_CONTENT_TYPE_JSON, NULL, NULL);
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+}
+
+void test_cache_eviction(void)
+{
+    get("a");
+    respond(&rsp_content, "ea", "111");
+    get("b");
+    respond(&rsp_content, "eb", "222");
+
+    /* "a" is used more recently than "b" */
+    get("a");
+    respond(&rsp_valid, NULL, NULL);
+
+    /* Doesn't fit in the total size without evicting "b" */
+    get("c");
+    respond(&rsp_content, "ec", "333");
+
+    get("b");
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+    get("a");
+    TEST_ASSERT_EQUAL(2, sent_etag_len);
+
+    assert_stats(1, 3, 1);
+}
+
+void test_cache_too_large(void)
+{
+    get("a");
+    respond(&rsp_content, "ea", "123456789");
+
+    TEST_ASSERT_EQUAL(9, test_get_cb_fake.arg5_val);
+
+    get("a");
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+}
+
+void test_cache_evicted_in_flight(void)
+{
+    get("a");
+    respond(&rsp_content, "ea", "1111");
+
+    /* Conditional GET of "a", then "a" is evicted before its response */
+    get("a");
+    void *a_arg = golioth_coap_client_get_etag_fake.arg8_val;
+    get("b");
+    respond(&rsp_content, "eb", "22222222");
+
+    coap_get_etag_cb_fn callback = golioth_coap_client_get_etag_fake.arg7_val;
+    callback(NULL, GOLIOTH_OK, &rsp_valid, "a", NULL, 0, NULL, 0, a_arg);
+
+    /* The full value is requested instead of passing no value to the callback */
+    TEST_ASSERT_EQUAL(4, golioth_coap_client_get_etag_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("a", golioth_coap_client_get_etag_fake.arg3_val);
+    TEST_ASSERT_EQUAL(0, sent_etag_len);
+    TEST_ASSERT_EQUAL(2, test_get_cb_fake.call_count);
+
+    respond(&rsp_content, "ea", "1111");
+    TEST_ASSERT_EQUAL(3, test_get_cb_fake.call_count);
+    TEST_ASSERT_EQUAL_MEMORY("1111", received_payload, 4);
+}
+
+void test_cache_error(void)
+{
+    get("a");
+    respond(&rsp_content, "ea", "1");
+
+    get("a");
+    coap_get_etag_cb_fn callback = golioth_coap_client_get_etag_fake.arg7_val;
+    callback(NULL,
+             GOLIOTH_ERR_TIMEOUT,
+             NULL,
+             "a",
+             NULL,
+             0,
+             NULL,
+             0,
+             golioth_coap_client_get_etag_fake.arg8_val);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_TIMEOUT, test_get_cb_fake.arg1_val);
+
+    /* The cached value is kept */
+    get("a");
+    TEST_ASSERT_EQUAL(2, sent_etag_len);
+    assert_stats(0, 1, 0);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cache_validated);
+    RUN_TEST(test_cache_changed);
+    RUN_TEST(test_cache_no_etag);
+    RUN_TEST(test_cache_per_path);
+    RUN_TEST(test_cache_eviction);
+    RUN_TEST(test_cache_too_large);
+    RUN_TEST(test_cache_evicted_in_flight);
+    RUN_TEST(test_cache_error);
+    return UNITY_END();
+}
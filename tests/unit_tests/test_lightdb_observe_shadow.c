@@ -0,0 +1,331 @@
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_LEAVES 4
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_OBSERVE_SHADOW_MAX_DEPTH 2
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_observe_shadow.c"
+
+FAKE_VALUE_FUNC(bool, golioth_client_is_running, struct golioth_client *);
+
+struct change
+{
+    char path[32];
+    uint8_t value[16];
+    size_t value_len;
+    bool removed;
+    void *arg;
+};
+
+static struct golioth_lightdb_observe_shadow *shadow;
+static struct change changes[8];
+static size_t num_changes;
+
+static void record_change(struct golioth_client *client,
+                          const char *path,
+                          const uint8_t *value,
+                          size_t value_len,
+                          void *arg)
+{
+    TEST_ASSERT_LESS_THAN(ARRAY_SIZE(changes), num_changes);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(changes[0].value), value_len);
+
+    struct change *change = &changes[num_changes++];
+
+    strcpy(change->path, path);
+    change->removed = (value == NULL);
+    if (value)
+    {
+        memcpy(change->value, value, value_len);
+    }
+    change->value_len = value_len;
+    change->arg = arg;
+}
+
+/* Deliver a notification to the shadow, like the CoAP client does */
+static void notify(const uint8_t *payload, size_t payload_size)
+{
+    golioth_get_cb_fn callback = golioth_coap_client_observe_fake.arg5_val;
+    void *arg = golioth_coap_client_observe_fake.arg6_val;
+
+    num_changes = 0;
+    callback(NULL, GOLIOTH_OK, NULL, "desired", payload, payload_size, arg);
+}
+
+static void assert_change(size_t i, const char *path, const uint8_t *value, size_t value_len)
+{
+    TEST_ASSERT_LESS_THAN(num_changes, i);
+    TEST_ASSERT_EQUAL_STRING(path, changes[i].path);
+    TEST_ASSERT_FALSE(changes[i].removed);
+    TEST_ASSERT_EQUAL(value_len, changes[i].value_len);
+    TEST_ASSERT_EQUAL_MEMORY(value, changes[i].value, value_len);
+}
+
+static void assert_removed(size_t i, const char *path)
+{
+    TEST_ASSERT_LESS_THAN(num_changes, i);
+    TEST_ASSERT_EQUAL_STRING(path, changes[i].path);
+    TEST_ASSERT_TRUE(changes[i].removed);
+}
+
+static void start_shadow(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_observe_shadow_start(shadow));
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_observe_fake.call_count);
+}
+
+void setUp(void)
+{
+    shadow = golioth_lightdb_observe_shadow_create(NULL, "desired");
+    TEST_ASSERT_NOT_NULL(shadow);
+}
+
+void tearDown(void)
+{
+    golioth_lightdb_observe_shadow_destroy(shadow);
+    num_changes = 0;
+    RESET_FAKE(golioth_coap_client_observe);
+    RESET_FAKE(golioth_coap_client_cancel_observation);
+    RESET_FAKE(golioth_client_is_running);
+    FFF_RESET_HISTORY();
+}
+
+static const uint8_t doc_initial[] = {
+    0xBF,      /* map(*) */
+    0x61, 'a', /* "a" */
+    0xBF,      /* map(*) */
+    0x61, 'b', /* "b" */
+    0x01,      /* unsigned(1) */
+    0x61, 'c', /* "c" */
+    0xF5,      /* true */
+    0xFF,      /* primitive(*) */
+    0x61, 'x', /* "x" */
+    0x02,      /* unsigned(2) */
+    0xFF,      /* primitive(*) */
+};
+
+void test_observe_shadow_start(void)
+{
+    start_shadow();
+
+    TEST_ASSERT_EQUAL_STRING(".d/", golioth_coap_client_observe_fake.arg2_val);
+    TEST_ASSERT_EQUAL_STRING("desired", golioth_coap_client_observe_fake.arg3_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, golioth_coap_client_observe_fake.arg4_val);
+
+    /* Handlers can't be added to a running observation */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE,
+                      golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE, golioth_lightdb_observe_shadow_start(shadow));
+}
+
+void test_observe_shadow_initial(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, (void *) 1);
+    start_shadow();
+
+    notify(doc_initial, sizeof(doc_initial));
+
+    TEST_ASSERT_EQUAL(3, num_changes);
+    assert_change(0, "a/b", (const uint8_t[]) {0x01}, 1);
+    assert_change(1, "a/c", (const uint8_t[]) {0xF5}, 1);
+    assert_change(2, "x", (const uint8_t[]) {0x02}, 1);
+    TEST_ASSERT_EQUAL_PTR((void *) 1, changes[0].arg);
+}
+
+void test_observe_shadow_changed_only(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+    notify(doc_initial, sizeof(doc_initial));
+
+    /* Same document, in another order, with one value changed */
+    const uint8_t doc[] = {
+        0xA2,       /* map(2) */
+        0x61, 'x',  /* "x" */
+        0x02,       /* unsigned(2) */
+        0x61, 'a',  /* "a" */
+        0xA2,       /* map(2) */
+        0x61, 'c',  /* "c" */
+        0xF5,       /* true */
+        0x61, 'b',  /* "b" */
+        0x18, 0x64, /* unsigned(100) */
+    };
+    notify(doc, sizeof(doc));
+
+    TEST_ASSERT_EQUAL(1, num_changes);
+    assert_change(0, "a/b", (const uint8_t[]) {0x18, 0x64}, 2);
+
+    notify(doc, sizeof(doc));
+    TEST_ASSERT_EQUAL(0, num_changes);
+}
+
+void test_observe_shadow_removed(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+    notify(doc_initial, sizeof(doc_initial));
+
+    /* "a" turned from a map into a value */
+    const uint8_t doc[] = {
+        0xA2,      /* map(2) */
+        0x61, 'a', /* "a" */
+        0x00,      /* unsigned(0) */
+        0x61, 'x', /* "x" */
+        0x02,      /* unsigned(2) */
+    };
+    notify(doc, sizeof(doc));
+
+    TEST_ASSERT_EQUAL(3, num_changes);
+    assert_change(0, "a", (const uint8_t[]) {0x00}, 1);
+    assert_removed(1, "a/b");
+    assert_removed(2, "a/c");
+
+    /* Everything was deleted */
+    notify((const uint8_t[]) {0xF6}, 1);
+
+    TEST_ASSERT_EQUAL(2, num_changes);
+    assert_removed(0, "a");
+    assert_removed(1, "x");
+}
+
+void test_observe_shadow_handler_path(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "a", record_change, (void *) 1);
+    golioth_lightdb_observe_shadow_on_change(shadow, "x", record_change, (void *) 2);
+    start_shadow();
+
+    /* "ab" is not below "a" */
+    const uint8_t doc[] = {
+        0xA2,           /* map(2) */
+        0x62, 'a', 'b', /* "ab" */
+        0x01,           /* unsigned(1) */
+        0x61, 'a',      /* "a" */
+        0xA1,           /* map(1) */
+        0x61, 'b',      /* "b" */
+        0x02,           /* unsigned(2) */
+    };
+    notify(doc, sizeof(doc));
+
+    TEST_ASSERT_EQUAL(1, num_changes);
+    assert_change(0, "a/b", (const uint8_t[]) {0x02}, 1);
+    TEST_ASSERT_EQUAL_PTR((void *) 1, changes[0].arg);
+}
+
+void test_observe_shadow_deep_map(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+
+    /* Maps deeper than MAX_DEPTH, and arrays, are single values */
+    const uint8_t doc[] = {
+        0xA2,            /* map(2) */
+        0x61, 'a',       /* "a" */
+        0xA1,            /* map(1) */
+        0x61, 'b',       /* "b" */
+        0xA1,            /* map(1) */
+        0x61, 'c',       /* "c" */
+        0x01,            /* unsigned(1) */
+        0x61, 'l',       /* "l" */
+        0x82, 0x01, 0x02 /* [1, 2] */
+    };
+    notify(doc, sizeof(doc));
+
+    TEST_ASSERT_EQUAL(2, num_changes);
+    assert_change(0, "a/b", (const uint8_t[]) {0xA1, 0x61, 'c', 0x01}, 4);
+    assert_change(1, "l", (const uint8_t[]) {0x82, 0x01, 0x02}, 3);
+}
+
+void test_observe_shadow_leaf(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+
+    /* The observed path holds a value */
+    notify((const uint8_t[]) {0x05}, 1);
+
+    TEST_ASSERT_EQUAL(1, num_changes);
+    assert_change(0, "", (const uint8_t[]) {0x05}, 1);
+}
+
+void test_observe_shadow_too_many_leaves(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+
+    const uint8_t doc[] = {
+        0xA5,                       /* map(5) */
+        0x61, 'a', 0x01, 0x61, 'b', /* "a": 1, "b" */
+        0x02, 0x61, 'c', 0x03,      /* 2, "c": 3 */
+        0x61, 'd', 0x04, 0x61, 'e', /* "d": 4, "e" */
+        0x05,                       /* 5 */
+    };
+    notify(doc, sizeof(doc));
+    TEST_ASSERT_EQUAL(4, num_changes);
+    assert_change(3, "d", (const uint8_t[]) {0x04}, 1);
+
+    /* The value which is not tracked is not reported */
+    notify(doc, sizeof(doc));
+    TEST_ASSERT_EQUAL(0, num_changes);
+}
+
+void test_observe_shadow_destroy(void)
+{
+    /* Not observed yet */
+    golioth_client_is_running_fake.return_val = true;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_observe_shadow_destroy(shadow));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_cancel_observation_fake.call_count);
+
+    shadow = golioth_lightdb_observe_shadow_create(NULL, "desired");
+    start_shadow();
+
+    /* Notifications may still be in flight while the client runs */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE, golioth_lightdb_observe_shadow_destroy(shadow));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_cancel_observation_fake.call_count);
+
+    /* Cancelled with the token it was observed with, once the client is stopped */
+    golioth_client_is_running_fake.return_val = false;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_observe_shadow_destroy(shadow));
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_cancel_observation_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(golioth_coap_client_observe_fake.arg1_val,
+                          golioth_coap_client_cancel_observation_fake.arg1_val);
+
+    shadow = NULL;
+}
+
+void test_observe_shadow_malformed(void)
+{
+    golioth_lightdb_observe_shadow_on_change(shadow, "", record_change, NULL);
+    start_shadow();
+    notify(doc_initial, sizeof(doc_initial));
+
+    /* Truncated after the first value, which did not change */
+    notify(doc_initial, 7);
+    TEST_ASSERT_EQUAL(0, num_changes);
+
+    /* Values that were not reached are kept */
+    notify(doc_initial, sizeof(doc_initial));
+    TEST_ASSERT_EQUAL(0, num_changes);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_observe_shadow_start);
+    RUN_TEST(test_observe_shadow_initial);
+    RUN_TEST(test_observe_shadow_changed_only);
+    RUN_TEST(test_observe_shadow_removed);
+    RUN_TEST(test_observe_shadow_handler_path);
+    RUN_TEST(test_observe_shadow_deep_map);
+    RUN_TEST(test_observe_shadow_leaf);
+    RUN_TEST(test_observe_shadow_too_many_leaves);
+    RUN_TEST(test_observe_shadow_malformed);
+    RUN_TEST(test_observe_shadow_destroy);
+    return UNITY_END();
+}
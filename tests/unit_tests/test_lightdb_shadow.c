@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES 8
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE 32
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_shadow.c"
+#include "../../src/lightdb_tree.c"
+
+FAKE_VALUE_FUNC(bool, golioth_client_is_running, struct golioth_client *);
+FAKE_VALUE_FUNC(const char *, golioth_status_to_str, enum golioth_status);
+
+static struct golioth_lightdb_shadow *shadow;
+static uint8_t coap_payloads[4][CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_BUF_SIZE];
+static size_t coap_payload_sizes[4];
+static golioth_set_cb_fn last_set_cb;
+static void *last_set_cb_arg;
+
+enum golioth_status golioth_coap_client_set_custom_fake(struct golioth_client *client,
+                                                        const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                        const char *path_prefix,
+                                                        const char *path,
+                                                        uint32_t content_type,
+                                                        const uint8_t *payload,
+                                                        size_t payload_size,
+                                                        golioth_set_cb_fn callback,
+                                                        void *callback_arg,
+                                                        int32_t timeout_s)
+{
+    size_t i = golioth_coap_client_set_fake.call_count - 1;
+
+    TEST_ASSERT_LESS_THAN(ARRAY_SIZE(coap_payloads), i);
+    TEST_ASSERT_EQUAL_STRING(".d/", path_prefix);
+    TEST_ASSERT_EQUAL_STRING("", path);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, content_type);
+
+    /* Only the flush mutex is held, as responses take the shadow mutex */
+    TEST_ASSERT_EQUAL(1,
+                      golioth_sys_mutex_lock_fake.call_count
+                          - golioth_sys_mutex_unlock_fake.call_count);
+
+    memcpy(coap_payloads[i], payload, payload_size);
+    coap_payload_sizes[i] = payload_size;
+    last_set_cb = callback;
+    last_set_cb_arg = callback_arg;
+
+    return GOLIOTH_OK;
+}
+
+static void assert_payload(size_t i, const uint8_t *expected, size_t expected_size)
+{
+    TEST_ASSERT_EQUAL(expected_size, coap_payload_sizes[i]);
+    TEST_ASSERT_EQUAL_MEMORY(expected, coap_payloads[i], expected_size);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    shadow = golioth_lightdb_shadow_create(NULL, NULL);
+    TEST_ASSERT_NOT_NULL(shadow);
+}
+
+void tearDown(void)
+{
+    golioth_lightdb_shadow_destroy(shadow);
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_client_is_running);
+    FFF_RESET_HISTORY();
+}
+
+void test_shadow_flush_merged(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_int(shadow, "x", 2));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_bool(shadow, "a/c", true));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_int(shadow, "a/b", 1));
+
+    /* Sets only update the shadow */
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(3, golioth_lightdb_shadow_num_dirty(shadow));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_shadow_num_dirty(shadow));
+
+    const uint8_t expected[] = {
+        0xBF,      /* map(*) */
+        0x61, 'a', /* "a" */
+        0xBF,      /* map(*) */
+        0x61, 'b', /* "b" */
+        0x01,      /* unsigned(1) */
+        0x61, 'c', /* "c" */
+        0xF5,      /* true */
+        0xFF,      /* primitive(*) */
+        0x61, 'x', /* "x" */
+        0x02,      /* unsigned(2) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_payload(0, expected, sizeof(expected));
+}
+
+void test_shadow_flush_changed_only(void)
+{
+    golioth_lightdb_shadow_set_int(shadow, "a/b", 1);
+    golioth_lightdb_shadow_set_bool(shadow, "a/c", true);
+    golioth_lightdb_shadow_set_string(shadow, "x", "foo", 3);
+    golioth_lightdb_shadow_flush(shadow);
+
+    /* Nothing is sent when no value changed */
+    golioth_lightdb_shadow_set_bool(shadow, "a/c", true);
+    golioth_lightdb_shadow_set_string(shadow, "x", "foo", 3);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_shadow_num_dirty(shadow));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+
+    /* Maps without changed values are skipped */
+    golioth_lightdb_shadow_set_string(shadow, "x", "bar", 3);
+    golioth_lightdb_shadow_set_int(shadow, "x", 4);
+    TEST_ASSERT_EQUAL(1, golioth_lightdb_shadow_num_dirty(shadow));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_fake.call_count);
+
+    const uint8_t expected[] = {
+        0xBF,      /* map(*) */
+        0x61, 'x', /* "x" */
+        0x04,      /* unsigned(4) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_payload(1, expected, sizeof(expected));
+}
+
+void test_shadow_invalid_paths(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_int(shadow, "a/b", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_int(shadow, "a-b", 1));
+
+    /* A path holds either a value or other paths */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_shadow_set_int(shadow, "a", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_lightdb_shadow_set_int(shadow, "a/b/c", 1));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_shadow_set_int(shadow, "", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_lightdb_shadow_set_int(shadow, "b//c", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_lightdb_shadow_set_int(shadow, "b/c/d/e/f", 1));
+    TEST_ASSERT_EQUAL(2, golioth_lightdb_shadow_num_dirty(shadow));
+}
+
+void test_shadow_full(void)
+{
+    char paths[CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES + 1][4];
+
+    for (size_t i = 0; i < ARRAY_SIZE(paths); i++)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "v%zu", i);
+    }
+
+    for (size_t i = 0; i < CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES; i++)
+    {
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_set_int(shadow, paths[i], i));
+    }
+
+    const char *extra_path = paths[CONFIG_GOLIOTH_LIGHTDB_STATE_SHADOW_MAX_VALUES];
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, golioth_lightdb_shadow_set_int(shadow, extra_path, 0));
+}
+
+void test_shadow_flush_dirty_count(void)
+{
+    golioth_lightdb_shadow_destroy(shadow);
+
+    struct golioth_lightdb_shadow_config config = {
+        .flush_dirty_count = 2,
+    };
+    shadow = golioth_lightdb_shadow_create(NULL, &config);
+
+    golioth_lightdb_shadow_set_int(shadow, "a", 1);
+    golioth_lightdb_shadow_set_int(shadow, "a", 2);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    golioth_lightdb_shadow_set_int(shadow, "b", 3);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_shadow_num_dirty(shadow));
+}
+
+void test_shadow_flush_periodic(void)
+{
+    golioth_lightdb_shadow_set_int(shadow, "a", 1);
+
+    /* Not flushed while the client is stopped */
+    golioth_client_is_running_fake.return_val = false;
+    shadow_timer_expiry(NULL, shadow);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    golioth_client_is_running_fake.return_val = true;
+    shadow_timer_expiry(NULL, shadow);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+}
+
+void test_shadow_flush_failed(void)
+{
+    golioth_lightdb_shadow_set_int(shadow, "a", 1);
+    golioth_lightdb_shadow_set_int(shadow, "b", 2);
+    golioth_lightdb_shadow_flush(shadow);
+    last_set_cb(NULL, GOLIOTH_ERR_TIMEOUT, NULL, "", last_set_cb_arg);
+
+    /* Values might not have been stored, so they are all sent again */
+    golioth_lightdb_shadow_set_int(shadow, "b", 3);
+    golioth_lightdb_shadow_flush(shadow);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_fake.call_count);
+
+    const uint8_t expected[] = {
+        0xBF,      /* map(*) */
+        0x61, 'a', /* "a" */
+        0x01,      /* unsigned(1) */
+        0x61, 'b', /* "b" */
+        0x03,      /* unsigned(3) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_payload(1, expected, sizeof(expected));
+
+    /* Enqueue failures also send all values again */
+    golioth_coap_client_set_fake.custom_fake = NULL;
+    golioth_coap_client_set_fake.return_val = GOLIOTH_ERR_QUEUE_FULL;
+    golioth_lightdb_shadow_set_int(shadow, "a", 4);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_QUEUE_FULL, golioth_lightdb_shadow_flush(shadow));
+
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(4, golioth_coap_client_set_fake.call_count);
+
+    const uint8_t expected_resync[] = {
+        0xBF,      /* map(*) */
+        0x61, 'a', /* "a" */
+        0x04,      /* unsigned(4) */
+        0x61, 'b', /* "b" */
+        0x03,      /* unsigned(3) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_payload(3, expected_resync, sizeof(expected_resync));
+}
+
+void test_shadow_flush_split(void)
+{
+    /* Together, the values don't fit into the flush buffer */
+    golioth_lightdb_shadow_set_string(shadow, "a", "0123456789", 10);
+    golioth_lightdb_shadow_set_string(shadow, "b", "0123456789", 10);
+    golioth_lightdb_shadow_set_string(shadow, "c", "0123456789", 10);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_shadow_num_dirty(shadow));
+
+    /* A value which never fits is dropped, the others are still sent */
+    golioth_lightdb_shadow_set_string(shadow, "d", "0123456789012345678901234567890", 31);
+    golioth_lightdb_shadow_set_int(shadow, "e", 5);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_shadow_flush(shadow));
+    TEST_ASSERT_EQUAL(3, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_lightdb_shadow_num_dirty(shadow));
+
+    const uint8_t expected[] = {
+        0xBF,      /* map(*) */
+        0x61, 'e', /* "e" */
+        0x05,      /* unsigned(5) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_payload(2, expected, sizeof(expected));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_shadow_flush_merged);
+    RUN_TEST(test_shadow_flush_changed_only);
+    RUN_TEST(test_shadow_invalid_paths);
+    RUN_TEST(test_shadow_full);
+    RUN_TEST(test_shadow_flush_dirty_count);
+    RUN_TEST(test_shadow_flush_periodic);
+    RUN_TEST(test_shadow_flush_failed);
+    RUN_TEST(test_shadow_flush_split);
+    return UNITY_END();
+}
@@ -0,0 +1,442 @@
+#include <unity.h>
+#include <fff.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_FLOAT_HELPERS
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES 4
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE 32
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/lightdb_state.c"
+#include "../../src/lightdb_tree.c"
+
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_coap_client_delete,
+                struct golioth_client *,
+                const char *,
+                const char *,
+                golioth_set_cb_fn,
+                void *,
+                int32_t);
+FAKE_VOID_FUNC(test_set_cb,
+               struct golioth_client *,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const char *,
+               void *);
+
+static struct golioth_lightdb_batch *batch;
+static uint8_t last_coap_payload[CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_BUF_SIZE];
+static size_t last_coap_payload_size;
+static char last_coap_path[CONFIG_GOLIOTH_COAP_MAX_PATH_LEN + 1];
+
+enum golioth_status golioth_coap_client_set_custom_fake(struct golioth_client *client,
+                                                        const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                        const char *path_prefix,
+                                                        const char *path,
+                                                        uint32_t content_type,
+                                                        const uint8_t *payload,
+                                                        size_t payload_size,
+                                                        golioth_set_cb_fn callback,
+                                                        void *callback_arg,
+                                                        int32_t timeout_s)
+{
+    TEST_ASSERT_EQUAL_STRING(".d/", path_prefix);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, content_type);
+
+    strcpy(last_coap_path, path);
+    memcpy(last_coap_payload, payload, payload_size);
+    last_coap_payload_size = payload_size;
+
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_coap_client_set_with_header_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    enum golioth_content_type content_type,
+    const uint8_t *header,
+    size_t header_size,
+    const uint8_t *payload,
+    size_t payload_size,
+    golioth_set_cb_fn callback,
+    void *callback_arg,
+    int32_t timeout_s)
+{
+    TEST_ASSERT_EQUAL_STRING(".d/", path_prefix);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, content_type);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(last_coap_payload), header_size + payload_size);
+
+    strcpy(last_coap_path, path);
+    memcpy(last_coap_payload, header, header_size);
+    if (payload_size > 0)
+    {
+        memcpy(last_coap_payload + header_size, payload, payload_size);
+    }
+    last_coap_payload_size = header_size + payload_size;
+
+    return GOLIOTH_OK;
+}
+
+static void assert_value_sent(const char *path, const uint8_t *expected, size_t expected_size)
+{
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING(path, last_coap_path);
+    TEST_ASSERT_EQUAL(expected_size, last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, last_coap_payload, expected_size);
+}
+
+static void assert_batch_sent(const char *path, const uint8_t *expected, size_t expected_size)
+{
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING(path, last_coap_path);
+    TEST_ASSERT_EQUAL(expected_size, last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, last_coap_payload, expected_size);
+}
+
+void setUp(void)
+{
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    golioth_coap_client_set_with_header_fake.custom_fake =
+        golioth_coap_client_set_with_header_custom_fake;
+    batch = golioth_lightdb_batch_begin(NULL);
+    TEST_ASSERT_NOT_NULL(batch);
+}
+
+void tearDown(void)
+{
+    last_coap_payload_size = 0;
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_coap_client_set_with_header);
+    RESET_FAKE(test_set_cb);
+    FFF_RESET_HISTORY();
+}
+
+void test_set_int(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_set_int(NULL, "a/b", -500, test_set_cb, NULL));
+    TEST_ASSERT_EQUAL_PTR(test_set_cb, golioth_coap_client_set_with_header_fake.arg9_val);
+
+    const uint8_t expected[] = {
+        0x39, 0x01, 0xF3, /* negative(499) */
+    };
+    assert_value_sent("a/b", expected, sizeof(expected));
+}
+
+void test_set_bool(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_set_bool(NULL, "a", false, NULL, NULL));
+
+    const uint8_t expected[] = {
+        0xF4, /* false */
+    };
+    assert_value_sent("a", expected, sizeof(expected));
+}
+
+void test_set_float(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_set_float(NULL, "a", 1.5f, NULL, NULL));
+
+    const uint8_t expected[] = {
+        0xFA, 0x3F, 0xC0, 0x00, 0x00, /* primitive(1.5) */
+    };
+    assert_value_sent("a", expected, sizeof(expected));
+}
+
+void test_set_string(void)
+{
+    /* Not NUL-terminated, and with characters that JSON would need escaped */
+    const char str[] = {'"', 'h', 'i', '\\', 'x'};
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_set_string(NULL, "s", str, 4, NULL, NULL));
+
+    const uint8_t expected[] = {
+        0x64,                /* text(4) */
+        '"', 'h', 'i', '\\', /* "\"hi\\" */
+    };
+    assert_value_sent("s", expected, sizeof(expected));
+}
+
+void test_set_string_long(void)
+{
+    char str[24];
+
+    memset(str, 'x', sizeof(str));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_lightdb_set_string(NULL, "s", str, sizeof(str), NULL, NULL));
+
+    TEST_ASSERT_EQUAL(2 + sizeof(str), last_coap_payload_size);
+    TEST_ASSERT_EQUAL_HEX8(0x78, last_coap_payload[0]); /* text(24) */
+    TEST_ASSERT_EQUAL_HEX8(24, last_coap_payload[1]);
+    TEST_ASSERT_EACH_EQUAL_CHAR('x', &last_coap_payload[2], sizeof(str));
+}
+
+void test_batch_commit(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_add_int(batch, "a/b", 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_add_bool(batch, "x/y", true));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_add_string(batch, "a/c", "hi", 2));
+
+    enum golioth_status ret = golioth_lightdb_batch_commit(batch, test_set_cb, (void *) 1);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL_PTR(test_set_cb, golioth_coap_client_set_fake.arg7_val);
+    TEST_ASSERT_EQUAL_PTR((void *) 1, golioth_coap_client_set_fake.arg8_val);
+
+    const uint8_t expected[] = {
+        0xBF,           /* map(*) */
+        0x61, 'a',      /* "a" */
+        0xBF,           /* map(*) */
+        0x61, 'b',      /* "b" */
+        0x01,           /* unsigned(1) */
+        0x61, 'c',      /* "c" */
+        0x62, 'h', 'i', /* "hi" */
+        0xFF,           /* primitive(*) */
+        0x61, 'x',      /* "x" */
+        0xBF,           /* map(*) */
+        0x61, 'y',      /* "y" */
+        0xF5,           /* true */
+        0xFF,           /* primitive(*) */
+        0xFF,           /* primitive(*) */
+    };
+    assert_batch_sent("", expected, sizeof(expected));
+}
+
+void test_batch_commit_parent_path(void)
+{
+    golioth_lightdb_batch_add_int(batch, "sensor/t/b", 2);
+    golioth_lightdb_batch_add_int(batch, "sensor/t/a", 1);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_commit(batch, NULL, NULL));
+
+    const uint8_t expected[] = {
+        0xBF,      /* map(*) */
+        0x61, 'a', /* "a" */
+        0x01,      /* unsigned(1) */
+        0x61, 'b', /* "b" */
+        0x02,      /* unsigned(2) */
+        0xFF,      /* primitive(*) */
+    };
+    assert_batch_sent("sensor/t", expected, sizeof(expected));
+}
+
+void test_batch_commit_raw(void)
+{
+    const uint8_t cbor[] = {
+        0x82, /* array(2) */
+        0x01, /* unsigned(1) */
+        0x02, /* unsigned(2) */
+    };
+
+    golioth_lightdb_batch_add_raw(batch, "cfg/list", cbor, sizeof(cbor));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_commit(batch, NULL, NULL));
+
+    const uint8_t expected[] = {
+        0xBF,               /* map(*) */
+        0x64,               /* text(4) */
+        'l', 'i', 's', 't', /* "list" */
+        0x82,               /* array(2) */
+        0x01,               /* unsigned(1) */
+        0x02,               /* unsigned(2) */
+        0xFF,               /* primitive(*) */
+    };
+    assert_batch_sent("cfg", expected, sizeof(expected));
+}
+
+void test_batch_overlapping_paths(void)
+{
+    golioth_lightdb_batch_add_int(batch, "a", 1);
+    golioth_lightdb_batch_add_int(batch, "a-b", 2);
+    golioth_lightdb_batch_add_int(batch, "a/b", 3);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+void test_batch_repeated_path(void)
+{
+    golioth_lightdb_batch_add_int(batch, "a", 1);
+    golioth_lightdb_batch_add_int(batch, "a", 2);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+void test_batch_add_failed(void)
+{
+    golioth_lightdb_batch_add_int(batch, "a", 1);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_batch_add_int(batch, "b//c", 2));
+
+    /* The batch is not sent without the failed value */
+    golioth_lightdb_batch_add_int(batch, "c", 3);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+void test_batch_add_null(void)
+{
+    golioth_lightdb_batch_add_int(batch, "a", 1);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL, golioth_lightdb_batch_add_string(batch, "b", NULL, 3));
+
+    golioth_lightdb_batch_add_int(batch, "c", 3);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+void test_batch_full(void)
+{
+    const char *paths[] = {"a", "b", "c", "d", "e"};
+
+    for (size_t i = 0; i < CONFIG_GOLIOTH_LIGHTDB_STATE_BATCH_MAX_ENTRIES; i++)
+    {
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_lightdb_batch_add_int(batch, paths[i], i));
+    }
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, golioth_lightdb_batch_add_int(batch, paths[4], 4));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, golioth_lightdb_batch_commit(batch, NULL, NULL));
+}
+
+void test_batch_too_large(void)
+{
+    golioth_lightdb_batch_add_string(batch, "a", "0123456789", 10);
+    golioth_lightdb_batch_add_string(batch, "b", "0123456789", 10);
+    golioth_lightdb_batch_add_string(batch, "c", "0123456789", 10);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+void test_batch_empty(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE, golioth_lightdb_batch_commit(batch, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+}
+
+#if defined(UNIT_TEST_BENCHMARK)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Reference for the benchmark: the JSON text which the typed setters used to send, including
+ * the temporary buffer of strings. The payload copy done by the request queue is common to
+ * both paths and left out. */
+static size_t format_json(char *buf, size_t size, int type, int32_t i, float f, const char *str)
+{
+    switch (type)
+    {
+        case 0:
+            return snprintf(buf, size, "%" PRId32, i);
+        case 1:
+            return snprintf(buf, size, "%f", (double) f);
+        default:
+        {
+            size_t bufsize = strlen(str) + 3;
+            char *tmp = malloc(bufsize);
+            snprintf(tmp, bufsize, "\"%s\"", str);
+            memcpy(buf, tmp, bufsize - 1);
+            free(tmp);
+            return bufsize - 1;
+        }
+    }
+}
+
+static size_t encode_cbor(uint8_t *buf, int type, int32_t i, float f, const char *str)
+{
+    switch (type)
+    {
+        case 0:
+            return lightdb_encode_int(buf, i);
+        case 1:
+            return lightdb_encode_float(buf, f);
+        default:
+        {
+            size_t len = strlen(str);
+            size_t head_len = lightdb_encode_string_head(buf, len);
+            memcpy(buf + head_len, str, len);
+            return head_len + len;
+        }
+    }
+}
+
+void test_set_encode_benchmark(void)
+{
+    static const char *names[] = {"int", "float", "string"};
+    const char *str = "firmware-1.2.3";
+    const size_t rounds = 200000;
+    char json[64];
+    uint8_t cbor[64];
+
+    for (int type = 0; type < 3; type++)
+    {
+        size_t json_len = 0;
+        size_t cbor_len = 0;
+
+        uint64_t start = now_ns();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            json_len = format_json(json, sizeof(json), type, -(int32_t) r, r * 0.25f, str);
+        }
+        uint64_t json_ns = now_ns() - start;
+
+        start = now_ns();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            cbor_len = encode_cbor(cbor, type, -(int32_t) r, r * 0.25f, str);
+        }
+        uint64_t cbor_ns = now_ns() - start;
+
+        TEST_ASSERT_NOT_EQUAL(0, cbor_len);
+        TEST_ASSERT_LESS_OR_EQUAL(json_len, cbor_len);
+
+        printf("%6s: json %6.1f ns/value %2zu bytes, cbor %6.1f ns/value %2zu bytes\n",
+               names[type],
+               (double) json_ns / rounds,
+               json_len,
+               (double) cbor_ns / rounds,
+               cbor_len);
+    }
+}
+
+#endif  // UNIT_TEST_BENCHMARK
+
+int main(void)
+{
+    UNITY_BEGIN();
+#if defined(UNIT_TEST_BENCHMARK)
+    RUN_TEST(test_set_encode_benchmark);
+#else
+    RUN_TEST(test_set_int);
+    RUN_TEST(test_set_bool);
+    RUN_TEST(test_set_float);
+    RUN_TEST(test_set_string);
+    RUN_TEST(test_set_string_long);
+    RUN_TEST(test_batch_commit);
+    RUN_TEST(test_batch_commit_parent_path);
+    RUN_TEST(test_batch_commit_raw);
+    RUN_TEST(test_batch_overlapping_paths);
+    RUN_TEST(test_batch_repeated_path);
+    RUN_TEST(test_batch_add_failed);
+    RUN_TEST(test_batch_add_null);
+    RUN_TEST(test_batch_full);
+    RUN_TEST(test_batch_too_large);
+    RUN_TEST(test_batch_empty);
+#endif
+    return UNITY_END();
+}
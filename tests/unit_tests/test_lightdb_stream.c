@@ -0,0 +1,317 @@
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LIGHTDB_STATE
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_DEPTH 3
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN 8
+#define CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_STRING_BUF_SIZE 4
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/lightdb_stream.c"
+
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_blockwise_get,
+                struct golioth_client *,
+                const char *,
+                const char *,
+                enum golioth_content_type,
+                uint32_t,
+                golioth_get_block_cb_fn,
+                golioth_end_block_cb_fn,
+                void *);
+FAKE_VOID_FUNC(test_end_cb,
+               struct golioth_client *,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const char *,
+               uint32_t,
+               void *);
+
+struct value
+{
+    char path[CONFIG_GOLIOTH_LIGHTDB_STATE_STREAM_MAX_PATH_LEN + 1];
+    struct golioth_lightdb_stream_value value;
+    uint8_t data[8];
+};
+
+static struct golioth_client *client = (struct golioth_client *) 1;
+static struct value values[16];
+static size_t num_values;
+static size_t abort_at = SIZE_MAX;
+
+static enum golioth_status record_value(const struct golioth_lightdb_stream_value *value,
+                                        void *arg)
+{
+    TEST_ASSERT_EQUAL_PTR((void *) 2, arg);
+    TEST_ASSERT_LESS_THAN(ARRAY_SIZE(values), num_values);
+
+    if (num_values == abort_at)
+    {
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    struct value *v = &values[num_values++];
+
+    strcpy(v->path, value->path);
+    v->value = *value;
+    if (value->type == GOLIOTH_LIGHTDB_STREAM_TYPE_STRING)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(sizeof(v->data), value->str.len);
+        memcpy(v->data, value->str.data, value->str.len);
+    }
+
+    return GOLIOTH_OK;
+}
+
+/* Deliver payload in blocks of block_size bytes, like the blockwise download does */
+static enum golioth_status stream_blocks(const uint8_t *payload, size_t size, size_t block_size)
+{
+    num_values = 0;
+    RESET_FAKE(golioth_blockwise_get);
+    RESET_FAKE(test_end_cb);
+
+    enum golioth_status status =
+        golioth_lightdb_stream_get(client, "cfg", record_value, test_end_cb, (void *) 2);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, status);
+
+    golioth_get_block_cb_fn block_cb = golioth_blockwise_get_fake.arg5_val;
+    golioth_end_block_cb_fn end_cb = golioth_blockwise_get_fake.arg6_val;
+    void *arg = golioth_blockwise_get_fake.arg7_val;
+    uint32_t block_idx = 0;
+
+    for (size_t offset = 0; offset < size && status == GOLIOTH_OK; offset += block_size)
+    {
+        size_t len = min(block_size, size - offset);
+
+        status = block_cb(client,
+                          "cfg",
+                          block_idx,
+                          &payload[offset],
+                          len,
+                          offset + len == size,
+                          block_size,
+                          arg);
+        if (status == GOLIOTH_OK && offset + len < size)
+        {
+            block_idx++;
+        }
+    }
+
+    end_cb(client, status, NULL, "cfg", block_idx, arg);
+
+    TEST_ASSERT_EQUAL(1, test_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(status, test_end_cb_fake.arg1_val);
+    TEST_ASSERT_EQUAL_PTR((void *) 2, test_end_cb_fake.arg5_val);
+
+    return status;
+}
+
+static void assert_int(size_t i, const char *path, int64_t expected)
+{
+    TEST_ASSERT_LESS_THAN(num_values, i);
+    TEST_ASSERT_EQUAL_STRING(path, values[i].path);
+    TEST_ASSERT_EQUAL(GOLIOTH_LIGHTDB_STREAM_TYPE_INT, values[i].value.type);
+    TEST_ASSERT_EQUAL_INT64(expected, values[i].value.i);
+}
+
+static void assert_string(size_t i,
+                          const char *path,
+                          const char *expected,
+                          size_t offset,
+                          size_t total_len)
+{
+    TEST_ASSERT_LESS_THAN(num_values, i);
+    TEST_ASSERT_EQUAL_STRING(path, values[i].path);
+    TEST_ASSERT_EQUAL(GOLIOTH_LIGHTDB_STREAM_TYPE_STRING, values[i].value.type);
+    TEST_ASSERT_EQUAL(strlen(expected), values[i].value.str.len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, values[i].data, strlen(expected));
+    TEST_ASSERT_EQUAL(offset, values[i].value.str.offset);
+    TEST_ASSERT_EQUAL(total_len, values[i].value.str.total_len);
+}
+
+static const uint8_t doc[] = {
+    0xBF,             /* map(*) */
+    0x61, 'a',        /* "a" */
+    0xA2,             /* map(2) */
+    0x61, 'b',        /* "b" */
+    0x01,             /* unsigned(1) */
+    0x61, 'c',        /* "c" */
+    0x82,             /* array(2) */
+    0x38, 0x63,       /* negative(99) */
+    0xF9, 0x3E, 0x00, /* primitive(1.5) */
+    0x61, 's',        /* "s" */
+    0x63,             /* text(3) */
+    'a', 'b', 'c',    /* "abc" */
+    0x61, 't',        /* "t" */
+    0xF5,             /* true */
+    0xFF,             /* primitive(*) */
+};
+
+static void assert_doc_values(void)
+{
+    TEST_ASSERT_EQUAL(5, num_values);
+    assert_int(0, "a/b", 1);
+    assert_int(1, "a/c/0", -100);
+    TEST_ASSERT_EQUAL_STRING("a/c/1", values[2].path);
+    TEST_ASSERT_EQUAL(GOLIOTH_LIGHTDB_STREAM_TYPE_FLOAT, values[2].value.type);
+    TEST_ASSERT_EQUAL_DOUBLE(1.5, values[2].value.f);
+    assert_string(3, "s", "abc", 0, 3);
+    TEST_ASSERT_EQUAL_STRING("t", values[4].path);
+    TEST_ASSERT_EQUAL(GOLIOTH_LIGHTDB_STREAM_TYPE_BOOL, values[4].value.type);
+    TEST_ASSERT_TRUE(values[4].value.b);
+}
+
+void setUp(void) {}
+
+void tearDown(void)
+{
+    abort_at = SIZE_MAX;
+    RESET_FAKE(golioth_blockwise_get);
+    RESET_FAKE(test_end_cb);
+    FFF_RESET_HISTORY();
+}
+
+void test_stream_get(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, stream_blocks(doc, sizeof(doc), sizeof(doc)));
+
+    TEST_ASSERT_EQUAL_STRING(".d/", golioth_blockwise_get_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("cfg", golioth_blockwise_get_fake.arg2_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, golioth_blockwise_get_fake.arg3_val);
+    TEST_ASSERT_EQUAL(0, golioth_blockwise_get_fake.arg4_val);
+
+    assert_doc_values();
+}
+
+void test_stream_get_split_everywhere(void)
+{
+    /* Data items are split at every possible position across blocks */
+    for (size_t block_size = 1; block_size < sizeof(doc); block_size++)
+    {
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, stream_blocks(doc, sizeof(doc), block_size));
+        assert_doc_values();
+    }
+}
+
+void test_stream_get_long_string(void)
+{
+    const uint8_t long_doc[] = {
+        0xA1,                    /* map(1) */
+        0x61, 's',               /* "s" */
+        0x66,                    /* text(6) */
+        'a', 'b', 'c', 'd', 'e', /* "abcde */
+        'f',                     /* f" */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, stream_blocks(long_doc, sizeof(long_doc), 6));
+
+    /* Longer than STRING_BUF_SIZE, so reported in parts */
+    TEST_ASSERT_EQUAL(2, num_values);
+    assert_string(0, "s", "ab", 0, 6);
+    assert_string(1, "s", "cdef", 2, 6);
+}
+
+void test_stream_get_scalar(void)
+{
+    const uint8_t scalar[] = {
+        0x19, 0x01, 0x00, /* unsigned(256) */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, stream_blocks(scalar, sizeof(scalar), 2));
+
+    TEST_ASSERT_EQUAL(1, num_values);
+    assert_int(0, "", 256);
+}
+
+void test_stream_get_empty_containers(void)
+{
+    const uint8_t empty[] = {
+        0x9F,                         /* array(*) */
+        0xA0,                         /* map(0) */
+        0x80,                         /* array(0) */
+        0xC1,                         /* tag(1) */
+        0x1A, 0x00, 0x01, 0x00, 0x00, /* unsigned(65536) */
+        0xFF,                         /* primitive(*) */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, stream_blocks(empty, sizeof(empty), 3));
+
+    TEST_ASSERT_EQUAL(1, num_values);
+    assert_int(0, "2", 65536);
+}
+
+void test_stream_get_truncated(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, stream_blocks(doc, sizeof(doc) - 1, 8));
+
+    /* Values before the end are reported */
+    TEST_ASSERT_EQUAL(5, num_values);
+}
+
+void test_stream_get_trailing_data(void)
+{
+    const uint8_t trailing[] = {
+        0x01, /* unsigned(1) */
+        0x02, /* unsigned(2) */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, stream_blocks(trailing, sizeof(trailing), 1));
+    TEST_ASSERT_EQUAL(1, num_values);
+}
+
+void test_stream_get_too_deep(void)
+{
+    const uint8_t deep[] = {
+        0x81, /* array(1) */
+        0x81, /* array(1) */
+        0x81, /* array(1) */
+        0x81, /* array(1) */
+        0x01, /* unsigned(1) */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, stream_blocks(deep, sizeof(deep), sizeof(deep)));
+    TEST_ASSERT_EQUAL(0, num_values);
+}
+
+void test_stream_get_path_too_long(void)
+{
+    const uint8_t long_key[] = {
+        0xA1,                                   /* map(1) */
+        0x69,                                   /* text(9) */
+        'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', /* "abcdefgh */
+        'i',                                    /* i" */
+        0x01,                                   /* unsigned(1) */
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC,
+                      stream_blocks(long_key, sizeof(long_key), sizeof(long_key)));
+    TEST_ASSERT_EQUAL(0, num_values);
+}
+
+void test_stream_get_aborted(void)
+{
+    abort_at = 1;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_FAIL, stream_blocks(doc, sizeof(doc), 4));
+    TEST_ASSERT_EQUAL(1, num_values);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_get);
+    RUN_TEST(test_stream_get_split_everywhere);
+    RUN_TEST(test_stream_get_long_string);
+    RUN_TEST(test_stream_get_scalar);
+    RUN_TEST(test_stream_get_empty_containers);
+    RUN_TEST(test_stream_get_truncated);
+    RUN_TEST(test_stream_get_trailing_data);
+    RUN_TEST(test_stream_get_too_deep);
+    RUN_TEST(test_stream_get_path_too_long);
+    RUN_TEST(test_stream_get_aborted);
+    return UNITY_END();
+}
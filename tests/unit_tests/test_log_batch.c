@@ -0,0 +1,262 @@
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LOG_BATCH
+#define CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE 64
+#define CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS 1000
+#define CONFIG_GOLIOTH_LOG_BATCH_FLUSH_LEVEL 1
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/log.c"
+
+FAKE_VALUE_FUNC(uint64_t, golioth_sys_now_ms);
+FAKE_VOID_FUNC(test_set_cb,
+               struct golioth_client *,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const char *,
+               void *);
+
+static struct golioth_client *client = (struct golioth_client *) 1;
+static uint8_t sent[CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE + LOG_BATCH_HEAD_MAX];
+static size_t sent_size;
+
+static golioth_sys_timer_t golioth_sys_timer_create_custom_fake(
+    const struct golioth_timer_config *config)
+{
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_LOG_BATCH_MAX_AGE_MS, config->expiration_ms);
+
+    return (golioth_sys_timer_t) 1;
+}
+
+enum golioth_status golioth_coap_client_set_with_header_custom_fake(
+    struct golioth_client *client,
+    const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+    const char *path_prefix,
+    const char *path,
+    enum golioth_content_type content_type,
+    const uint8_t *header,
+    size_t header_size,
+    const uint8_t *payload,
+    size_t payload_size,
+    golioth_set_cb_fn callback,
+    void *callback_arg,
+    int32_t timeout_s)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_CONTENT_TYPE_CBOR, content_type);
+    TEST_ASSERT_NULL(callback);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(sent), header_size + payload_size);
+
+    /* Records are only added while the batch is not being sent */
+    TEST_ASSERT_TRUE(batch.sending);
+
+    memcpy(sent, header, header_size);
+    memcpy(&sent[header_size], payload, payload_size);
+    sent_size = header_size + payload_size;
+
+    return GOLIOTH_OK;
+}
+
+/* Encode records like they are expected in a batch */
+static size_t encode_records(uint8_t *buf,
+                             size_t buf_size,
+                             enum golioth_log_level level,
+                             const char *const *msgs,
+                             size_t num_msgs)
+{
+    ZCBOR_STATE_E(zse, 1, buf, buf_size, 1);
+
+    for (size_t i = 0; i < num_msgs; i++)
+    {
+        TEST_ASSERT_TRUE(log_encode_record(zse, level, "t", msgs[i]));
+    }
+
+    return zse->payload - buf;
+}
+
+static void assert_batch_sent(uint8_t head, const char *const *msgs, size_t num_msgs)
+{
+    uint8_t expected[sizeof(sent)];
+
+    expected[0] = head;
+    size_t size = 1 + encode_records(&expected[1], sizeof(expected) - 1, 2, msgs, num_msgs);
+
+    TEST_ASSERT_EQUAL(size, sent_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, sent, size);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    golioth_sys_timer_create_fake.custom_fake = golioth_sys_timer_create_custom_fake;
+    golioth_coap_client_set_with_header_fake.custom_fake =
+        golioth_coap_client_set_with_header_custom_fake;
+    golioth_log_batch_init();
+}
+
+void tearDown(void)
+{
+    batch.len = 0;
+    batch.num_records = 0;
+    memset(&batch.stats, 0, sizeof(batch.stats));
+    sent_size = 0;
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(golioth_coap_client_set_with_header);
+    RESET_FAKE(golioth_sys_now_ms);
+    RESET_FAKE(test_set_cb);
+    FFF_RESET_HISTORY();
+}
+
+void test_batch_records(void)
+{
+    const char *msgs[] = {"a", "b"};
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_log_info(client, "t", "a", NULL, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_log_info(client, "t", "b", NULL, NULL));
+
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_sys_timer_start_fake.call_count);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_log_flush(client));
+
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_coap_client_set_with_header_fake.arg0_val);
+    TEST_ASSERT_EQUAL_STRING(GOLIOTH_LOG_PATH, golioth_coap_client_set_with_header_fake.arg3_val);
+    assert_batch_sent(0x82, msgs, 2);
+
+    /* Nothing left to send */
+    golioth_log_flush(client);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+}
+
+void test_batch_flush_level(void)
+{
+    golioth_log_warn(client, "t", "a", NULL, NULL);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_with_header_fake.call_count);
+
+    /* Errors are sent right away, with what is batched */
+    golioth_log_error(client, "t", "b", NULL, NULL);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL(0x82, sent[0]);
+}
+
+void test_batch_flush_size(void)
+{
+    const char *msgs[] = {"a", "b"};
+    const char *last[] = {"c"};
+
+    /* Each record takes 27 bytes, so only two fit */
+    golioth_log_info(client, "t", "a", NULL, NULL);
+    golioth_log_info(client, "t", "b", NULL, NULL);
+    golioth_log_info(client, "t", "c", NULL, NULL);
+
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    assert_batch_sent(0x82, msgs, 2);
+
+    golioth_log_flush(client);
+    assert_batch_sent(0x81, last, 1);
+}
+
+void test_batch_flush_age(void)
+{
+    golioth_sys_now_ms_fake.return_val = 100;
+    golioth_log_info(client, "t", "a", NULL, NULL);
+
+    /* Timer fires early: wait for another period */
+    golioth_sys_now_ms_fake.return_val = 1000;
+    on_log_batch_timer(batch.timer, NULL);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL(2, golioth_sys_timer_start_fake.call_count);
+
+    golioth_sys_now_ms_fake.return_val = 1100;
+    on_log_batch_timer(batch.timer, NULL);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+
+    /* Age is also checked when adding records */
+    golioth_log_info(client, "t", "b", NULL, NULL);
+    golioth_sys_now_ms_fake.return_val = 2100;
+    golioth_log_info(client, "t", "c", NULL, NULL);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL(0x82, sent[0]);
+}
+
+void test_batch_too_large(void)
+{
+    char msg[CONFIG_GOLIOTH_LOG_BATCH_BUFFER_SIZE + 1];
+
+    memset(msg, 'x', sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+
+    golioth_log_info(client, "t", "a", NULL, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_log_info(client, "t", msg, NULL, NULL));
+
+    /* Sent on its own, after the batch */
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, batch.num_records);
+}
+
+void test_batch_callback(void)
+{
+    golioth_log_info(client, "t", "a", NULL, NULL);
+    golioth_log_info(client, "t", "b", test_set_cb, NULL);
+
+    /* Records with a callback are not batched */
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(test_set_cb, golioth_coap_client_set_fake.arg7_val);
+    TEST_ASSERT_EQUAL(1, batch.num_records);
+}
+
+void test_batch_other_client(void)
+{
+    struct golioth_client *other = (struct golioth_client *) 2;
+
+    golioth_log_info(client, "t", "a", NULL, NULL);
+    golioth_log_info(other, "t", "b", NULL, NULL);
+
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_coap_client_set_with_header_fake.arg0_val);
+
+    /* Only the batch of the given client is flushed */
+    golioth_log_flush(client);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_with_header_fake.call_count);
+    golioth_log_flush(other);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_with_header_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(other, golioth_coap_client_set_with_header_fake.arg0_val);
+}
+
+void test_batch_stats(void)
+{
+    struct golioth_log_batch_stats stats;
+
+    golioth_log_info(client, "t", "a", NULL, NULL);
+    golioth_log_flush(client);
+    golioth_log_info(client, "t", "b", NULL, NULL);
+    golioth_log_info(client, "t", "c", NULL, NULL);
+    golioth_log_flush(client);
+
+    golioth_log_batch_get_stats(&stats);
+
+    TEST_ASSERT_EQUAL(3, stats.records);
+    TEST_ASSERT_EQUAL(2, stats.requests);
+    /* One request saved, minus the array heads */
+    TEST_ASSERT_EQUAL(LOG_REQUEST_OVERHEAD - 1, stats.bytes_saved);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_records);
+    RUN_TEST(test_batch_flush_level);
+    RUN_TEST(test_batch_flush_size);
+    RUN_TEST(test_batch_flush_age);
+    RUN_TEST(test_batch_too_large);
+    RUN_TEST(test_batch_callback);
+    RUN_TEST(test_batch_other_client);
+    RUN_TEST(test_batch_stats);
+    return UNITY_END();
+}
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LOG_DEFERRED
+#define CONFIG_GOLIOTH_LOG_DEFERRED_PRODUCERS 2
+#define CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE 4
+#define CONFIG_GOLIOTH_LOG_DEFERRED_ARGS_SIZE 48
+#define CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN 64
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/log_deferred.c"
+
+FAKE_VALUE_FUNC(golioth_sys_sem_t, golioth_sys_sem_create, uint32_t, uint32_t);
+FAKE_VALUE_FUNC(bool, golioth_sys_sem_take, golioth_sys_sem_t, int32_t);
+FAKE_VALUE_FUNC(bool, golioth_sys_sem_give, golioth_sys_sem_t);
+FAKE_VOID_FUNC(golioth_sys_sem_destroy, golioth_sys_sem_t);
+FAKE_VALUE_FUNC(golioth_sys_thread_t,
+                golioth_sys_thread_create,
+                const struct golioth_thread_config *);
+FAKE_VALUE_FUNC(golioth_sys_thread_id_t, golioth_sys_thread_id);
+FAKE_VOID_FUNC(golioth_debug_log_to_cloud,
+               struct golioth_client *,
+               enum golioth_debug_log_level,
+               const char *,
+               const char *);
+
+#define THREAD_A ((golioth_sys_thread_id_t) 0xA)
+#define THREAD_B ((golioth_sys_thread_id_t) 0xB)
+#define THREAD_C ((golioth_sys_thread_id_t) 0xC)
+
+static struct golioth_client *client = (struct golioth_client *) 1;
+static char sent_msgs[8][CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN];
+static size_t num_sent;
+
+static void golioth_debug_log_to_cloud_custom_fake(struct golioth_client *client,
+                                                   enum golioth_debug_log_level level,
+                                                   const char *tag,
+                                                   const char *msg)
+{
+    TEST_ASSERT_LESS_THAN(ARRAY_SIZE(sent_msgs), num_sent);
+    TEST_ASSERT_LESS_THAN(sizeof(sent_msgs[0]), strlen(msg));
+
+    strcpy(sent_msgs[num_sent++], msg);
+}
+
+static bool put_from(golioth_sys_thread_id_t thread,
+                     uint64_t tstamp_ms,
+                     const char *format,
+                     va_list args)
+{
+    golioth_sys_thread_id_fake.return_val = thread;
+
+    return golioth_log_deferred_put(client,
+                                    tstamp_ms,
+                                    GOLIOTH_DEBUG_LOG_LEVEL_WARN,
+                                    "tag",
+                                    format,
+                                    args);
+}
+
+static bool put(golioth_sys_thread_id_t thread, uint64_t tstamp_ms, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    bool deferred = put_from(thread, tstamp_ms, format, args);
+    va_end(args);
+
+    return deferred;
+}
+
+/* Defer a message, send it like the log thread does, and compare it to the same message
+ * formatted right away */
+static void assert_deferred(const char *format, ...)
+{
+    char expected[CONFIG_GOLIOTH_LOG_DEFERRED_MSG_MAX_LEN];
+    va_list args;
+
+    va_start(args, format);
+    TEST_ASSERT_TRUE(put_from(THREAD_A, 1000, format, args));
+    va_end(args);
+
+    va_start(args, format);
+    vsnprintf(expected, sizeof(expected), format, args);
+    va_end(args);
+
+    num_sent = 0;
+    log_deferred_drain();
+
+    TEST_ASSERT_EQUAL(1, num_sent);
+    TEST_ASSERT_EQUAL_STRING(expected, sent_msgs[0]);
+}
+
+static void assert_not_deferred(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    TEST_ASSERT_FALSE(put_from(THREAD_A, 1000, format, args));
+    va_end(args);
+
+    TEST_ASSERT_EQUAL(0, golioth_sys_sem_give_fake.call_count);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    golioth_sys_sem_create_fake.return_val = (golioth_sys_sem_t) 1;
+    golioth_sys_thread_create_fake.return_val = (golioth_sys_thread_t) 1;
+    golioth_debug_log_to_cloud_fake.custom_fake = golioth_debug_log_to_cloud_custom_fake;
+    golioth_log_deferred_init();
+}
+
+void tearDown(void)
+{
+    log_deferred_drain();
+    for (size_t i = 0; i < ARRAY_SIZE(log_producers); i++)
+    {
+        log_producers[i].thread = NULL;
+        log_producers[i].dropped_client = NULL;
+        log_producers[i].dropped = 0;
+        log_producers[i].reported = 0;
+    }
+    log_thread_id = NULL;
+    num_sent = 0;
+    RESET_FAKE(golioth_sys_sem_create);
+    RESET_FAKE(golioth_sys_sem_take);
+    RESET_FAKE(golioth_sys_sem_give);
+    RESET_FAKE(golioth_sys_sem_destroy);
+    RESET_FAKE(golioth_sys_thread_create);
+    RESET_FAKE(golioth_sys_thread_id);
+    RESET_FAKE(golioth_debug_log_to_cloud);
+    FFF_RESET_HISTORY();
+}
+
+void test_deferred_record(void)
+{
+    TEST_ASSERT_TRUE(put(THREAD_A, 1000, "value %d", 42));
+
+    /* Only the raw arguments are captured, until the log thread is woken up */
+    TEST_ASSERT_EQUAL(1, golioth_sys_sem_give_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_debug_log_to_cloud_fake.call_count);
+
+    log_deferred_drain();
+
+    TEST_ASSERT_EQUAL(1, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_debug_log_to_cloud_fake.arg0_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_DEBUG_LOG_LEVEL_WARN, golioth_debug_log_to_cloud_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("tag", golioth_debug_log_to_cloud_fake.arg2_val);
+    TEST_ASSERT_EQUAL_STRING("value 42", sent_msgs[0]);
+}
+
+void test_deferred_not_started(void)
+{
+    log_thread = NULL;
+
+    assert_not_deferred("value %d", 42);
+
+    golioth_log_deferred_init();
+}
+
+void test_deferred_integers(void)
+{
+    assert_deferred("%d %i %u %x %X %o %c %%", -5, 7, 3u, 255, 255, 8, 'z');
+    assert_deferred("%hhd %hd %ld %lld", (signed char) -1, (short) -2, -3L, -4LL);
+    assert_deferred("%zu %jd %td", (size_t) 5, (intmax_t) 6, (ptrdiff_t) 7);
+    assert_deferred("%08" PRIx32 " %" PRIu64, (uint32_t) 0xbeef, (uint64_t) 123456789012ULL);
+}
+
+void test_deferred_floats(void)
+{
+    assert_deferred("%5.2f|%-8e|%g|%Lf", 3.14159, 2.5, 0.0001, (long double) 1.5);
+}
+
+void test_deferred_strings(void)
+{
+    char str[] = "copied";
+
+    assert_deferred("%s and %s", "one", (char *) NULL);
+
+    /* Strings are copied, as they may not outlive the call */
+    put(THREAD_A, 1000, "%s", str);
+    strcpy(str, "change");
+    num_sent = 0;
+    log_deferred_drain();
+    TEST_ASSERT_EQUAL_STRING("copied", sent_msgs[0]);
+}
+
+void test_deferred_star(void)
+{
+    assert_deferred("%*d|%-*.*s|", 6, 42, 8, 3, "abcdef");
+}
+
+void test_deferred_precision(void)
+{
+    /* Not terminated, the precision bounds the copy */
+    char buf[4] = {'a', 'b', 'c', 'd'};
+
+    assert_deferred("%.*s|%.2s|%.*s", (int) sizeof(buf), buf, buf, -1, "all");
+    TEST_ASSERT_EQUAL_STRING("abcd|ab|all", sent_msgs[0]);
+
+    /* Only the bytes within the precision are copied, so this fits in the arguments */
+    assert_deferred("%.3s", "a string longer than the 48 bytes of arguments of a record");
+}
+
+void test_deferred_pointer(void)
+{
+    assert_deferred("%p", (void *) 0x1234);
+}
+
+void test_deferred_truncated(void)
+{
+    /* Longer than the maximum message length */
+    assert_deferred("prefix that takes space %s %s %d",
+                    "aaaaaaaaaaaaaaaaaaaa",
+                    "bbbbbbbbbbbbbbbbbbbb",
+                    123456789);
+    assert_deferred("literal xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx %d", 1);
+}
+
+void test_deferred_unsupported(void)
+{
+    int n;
+
+    assert_not_deferred("%n", &n);
+    assert_not_deferred("%ls", L"wide");
+    assert_not_deferred("%-+#0123456789012345d", 1);
+}
+
+void test_deferred_args_too_large(void)
+{
+    assert_not_deferred("%s", "a string longer than the 48 bytes of arguments of a record");
+    assert_not_deferred("%f %f %f %f %f %f %f", 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0);
+}
+
+void test_deferred_merged_by_timestamp(void)
+{
+    put(THREAD_A, 100, "a%d", 1);
+    put(THREAD_A, 300, "a%d", 2);
+    put(THREAD_B, 200, "b%d", 1);
+    put(THREAD_B, 400, "b%d", 2);
+
+    /* Each thread stages its records in its own ring */
+    TEST_ASSERT_EQUAL_PTR(THREAD_A, log_producers[0].thread);
+    TEST_ASSERT_EQUAL_PTR(THREAD_B, log_producers[1].thread);
+    TEST_ASSERT_EQUAL(2, ringbuf_size(&log_producers[0].records));
+    TEST_ASSERT_EQUAL(2, ringbuf_size(&log_producers[1].records));
+
+    log_deferred_drain();
+
+    TEST_ASSERT_EQUAL(4, num_sent);
+    TEST_ASSERT_EQUAL_STRING("a1", sent_msgs[0]);
+    TEST_ASSERT_EQUAL_STRING("b1", sent_msgs[1]);
+    TEST_ASSERT_EQUAL_STRING("a2", sent_msgs[2]);
+    TEST_ASSERT_EQUAL_STRING("b2", sent_msgs[3]);
+}
+
+void test_deferred_dropped(void)
+{
+    for (int i = 0; i < CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE + 2; i++)
+    {
+        TEST_ASSERT_TRUE(put(THREAD_A, 100 + i, "a%d", i));
+    }
+    put(THREAD_B, 1000, "b");
+
+    /* Only the producer with a full ring drops records, and the log thread is woken up anyway */
+    TEST_ASSERT_EQUAL(2, log_producers[0].dropped);
+    TEST_ASSERT_EQUAL(0, log_producers[1].dropped);
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE + 3,
+                      golioth_sys_sem_give_fake.call_count);
+
+    log_deferred_drain();
+
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE + 2, num_sent);
+    TEST_ASSERT_EQUAL_STRING("a0", sent_msgs[0]);
+    TEST_ASSERT_EQUAL_STRING("2 log messages dropped", sent_msgs[1]);
+    TEST_ASSERT_EQUAL_STRING("b", sent_msgs[CONFIG_GOLIOTH_LOG_DEFERRED_QUEUE_SIZE + 1]);
+
+    /* Reported once */
+    num_sent = 0;
+    put(THREAD_A, 2000, "a");
+    log_deferred_drain();
+    TEST_ASSERT_EQUAL(1, num_sent);
+}
+
+void test_deferred_dropped_after_last_record(void)
+{
+    put(THREAD_A, 100, "a");
+    log_deferred_drain();
+
+    /* Dropped after the log thread took the last record of the ring */
+    log_producers[0].dropped_client = client;
+    log_producers[0].dropped++;
+
+    /* Reported without waiting for the thread to log again */
+    num_sent = 0;
+    log_deferred_drain();
+    TEST_ASSERT_EQUAL(1, num_sent);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_debug_log_to_cloud_fake.arg0_val);
+    TEST_ASSERT_EQUAL_STRING("1 log messages dropped", sent_msgs[0]);
+}
+
+void test_deferred_no_producer(void)
+{
+    put(THREAD_A, 100, "a");
+    put(THREAD_B, 100, "b");
+
+    /* All rings are claimed by other threads */
+    TEST_ASSERT_FALSE(put(THREAD_C, 100, "c"));
+}
+
+void test_deferred_reclaimed(void)
+{
+    put(THREAD_A, 100, "a");
+    put(THREAD_B, 100, "b");
+    log_deferred_drain();
+
+    /* All rings are claimed, but empty */
+    num_sent = 0;
+    TEST_ASSERT_TRUE(put(THREAD_C, 200, "c"));
+    TEST_ASSERT_EQUAL_PTR(THREAD_C, log_producers[0].thread);
+
+    /* The thread that lost its ring reclaims the other empty one */
+    TEST_ASSERT_TRUE(put(THREAD_A, 300, "a"));
+    TEST_ASSERT_EQUAL_PTR(THREAD_A, log_producers[1].thread);
+
+    /* Rings with records are not reclaimed */
+    TEST_ASSERT_FALSE(put(THREAD_B, 400, "b"));
+
+    log_deferred_drain();
+    TEST_ASSERT_EQUAL(2, num_sent);
+    TEST_ASSERT_EQUAL_STRING("c", sent_msgs[0]);
+    TEST_ASSERT_EQUAL_STRING("a", sent_msgs[1]);
+}
+
+void test_deferred_reclaim_busy(void)
+{
+    put(THREAD_A, 100, "a");
+    put(THREAD_B, 100, "b");
+    log_deferred_drain();
+
+    /* The owner of the first ring is putting a record */
+    log_producers[0].busy = true;
+    TEST_ASSERT_FALSE(put(THREAD_C, 200, "c"));
+    TEST_ASSERT_EQUAL_PTR(THREAD_A, log_producers[0].thread);
+    log_producers[0].busy = false;
+}
+
+void test_deferred_thread_create_failed(void)
+{
+    log_thread = NULL;
+    golioth_sys_thread_create_fake.return_val = NULL;
+
+    golioth_log_deferred_init();
+
+    /* Formatted right away instead */
+    assert_not_deferred("value %d", 42);
+    TEST_ASSERT_EQUAL(1, golioth_sys_sem_destroy_fake.call_count);
+    TEST_ASSERT_EQUAL(golioth_sys_mutex_create_fake.call_count,
+                      golioth_sys_mutex_destroy_fake.call_count);
+
+    /* Started by the next client */
+    golioth_sys_thread_create_fake.return_val = (golioth_sys_thread_t) 1;
+    golioth_log_deferred_init();
+    TEST_ASSERT_TRUE(put(THREAD_A, 100, "a"));
+}
+
+void test_deferred_log_thread(void)
+{
+    log_thread_id = THREAD_C;
+
+    /* Logged while sending a message: dropped, without claiming a ring */
+    TEST_ASSERT_TRUE(put(THREAD_C, 100, "c"));
+    TEST_ASSERT_NULL(log_producers[0].thread);
+
+    log_deferred_drain();
+    TEST_ASSERT_EQUAL(0, num_sent);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_deferred_record);
+    RUN_TEST(test_deferred_not_started);
+    RUN_TEST(test_deferred_integers);
+    RUN_TEST(test_deferred_floats);
+    RUN_TEST(test_deferred_strings);
+    RUN_TEST(test_deferred_star);
+    RUN_TEST(test_deferred_precision);
+    RUN_TEST(test_deferred_pointer);
+    RUN_TEST(test_deferred_truncated);
+    RUN_TEST(test_deferred_unsupported);
+    RUN_TEST(test_deferred_args_too_large);
+    RUN_TEST(test_deferred_merged_by_timestamp);
+    RUN_TEST(test_deferred_dropped);
+    RUN_TEST(test_deferred_dropped_after_last_record);
+    RUN_TEST(test_deferred_no_producer);
+    RUN_TEST(test_deferred_reclaimed);
+    RUN_TEST(test_deferred_reclaim_busy);
+    RUN_TEST(test_deferred_thread_create_failed);
+    RUN_TEST(test_deferred_log_thread);
+    return UNITY_END();
+}
@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_LOG_GOVERNOR
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_ENTRIES 2
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_DEDUP_INTERVAL_MS 100
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_RATE 2
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_BURST 3
+#define CONFIG_GOLIOTH_LOG_GOVERNOR_SUMMARY_INTERVAL_MS 10000
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/log_governor.c"
+
+FAKE_VOID_FUNC(golioth_debug_log_to_cloud,
+               struct golioth_client *,
+               enum golioth_debug_log_level,
+               const char *,
+               const char *);
+
+static struct golioth_client *client = (struct golioth_client *) 1;
+static const char *tag = "tag";
+static const char *format_a = "a %d";
+static const char *format_b = "b %d";
+static const char *format_c = "c %d";
+static char sent_msg[LOG_SUMMARY_MAX_LEN];
+
+static void golioth_debug_log_to_cloud_custom_fake(struct golioth_client *client,
+                                                   enum golioth_debug_log_level level,
+                                                   const char *tag,
+                                                   const char *msg)
+{
+    strcpy(sent_msg, msg);
+}
+
+static bool allow(uint64_t tstamp_ms, enum golioth_debug_log_level level, const char *format)
+{
+    return golioth_log_governor_allow(client, tstamp_ms, level, tag, format);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    golioth_debug_log_to_cloud_fake.custom_fake = golioth_debug_log_to_cloud_custom_fake;
+    golioth_log_governor_init();
+}
+
+void tearDown(void)
+{
+    memset(log_entries, 0, sizeof(log_entries));
+    memset(log_buckets, 0, sizeof(log_buckets));
+    log_summary_pending = false;
+    log_evicted.client = NULL;
+    log_evicted.suppressed = 0;
+    sent_msg[0] = '\0';
+    RESET_FAKE(golioth_debug_log_to_cloud);
+    FFF_RESET_HISTORY();
+}
+
+void test_governor_repeated(void)
+{
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+    TEST_ASSERT_FALSE(allow(1050, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+
+    /* Other messages are not affected */
+    TEST_ASSERT_TRUE(allow(1050, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_b));
+
+    /* Counted from the last message that was sent */
+    TEST_ASSERT_TRUE(allow(1100, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+    TEST_ASSERT_EQUAL(1, log_entries[0].suppressed);
+}
+
+void test_governor_rate(void)
+{
+    /* Burst of 3 messages, then 2 per second */
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_a));
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_b));
+    TEST_ASSERT_TRUE(allow(1100, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_a));
+    TEST_ASSERT_FALSE(allow(1200, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_b));
+    TEST_ASSERT_FALSE(allow(1400, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_b));
+    TEST_ASSERT_TRUE(allow(1600, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_b));
+
+    /* Each level has its own budget */
+    TEST_ASSERT_TRUE(allow(1600, GOLIOTH_DEBUG_LOG_LEVEL_INFO, format_a));
+}
+
+void test_governor_summary(void)
+{
+    allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(1010, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(1020, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    TEST_ASSERT_EQUAL(0, golioth_debug_log_to_cloud_fake.call_count);
+
+    /* The timer is started once, by the first suppressed message */
+    TEST_ASSERT_EQUAL(1, golioth_sys_timer_start_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(log_summary_timer, golioth_sys_timer_start_fake.arg0_val);
+
+    /* Sent when it expires, even if nothing else is logged */
+    on_log_summary_timer(log_summary_timer, NULL);
+
+    TEST_ASSERT_EQUAL(1, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_debug_log_to_cloud_fake.arg0_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_DEBUG_LOG_LEVEL_ERROR, golioth_debug_log_to_cloud_fake.arg1_val);
+    TEST_ASSERT_EQUAL_PTR(tag, golioth_debug_log_to_cloud_fake.arg2_val);
+    TEST_ASSERT_EQUAL_STRING("2 similar messages suppressed: a %d", sent_msg);
+
+    /* Only once */
+    on_log_summary_timer(log_summary_timer, NULL);
+    TEST_ASSERT_EQUAL(1, golioth_debug_log_to_cloud_fake.call_count);
+
+    /* Started again by the next suppressed message */
+    allow(21000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(21010, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    TEST_ASSERT_EQUAL(2, golioth_sys_timer_start_fake.call_count);
+}
+
+void test_governor_summary_locked(void)
+{
+    allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(1010, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+
+    /* A message is being governed, so the timer checks again later */
+    golioth_sys_mutex_lock_fake.return_val = false;
+    on_log_summary_timer(log_summary_timer, NULL);
+    golioth_sys_mutex_lock_fake.return_val = true;
+
+    TEST_ASSERT_EQUAL(0, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL(2, golioth_sys_timer_start_fake.call_count);
+
+    on_log_summary_timer(log_summary_timer, NULL);
+    TEST_ASSERT_EQUAL(1, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("1 similar messages suppressed: a %d", sent_msg);
+}
+
+void test_governor_evicted(void)
+{
+    allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(1010, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a);
+    allow(1020, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_b);
+    allow(1025, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_b);
+
+    /* Replaces the least recently logged message, which is only counted */
+    TEST_ASSERT_TRUE(allow(1030, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_c));
+    TEST_ASSERT_EQUAL(0, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(format_c, log_entries[0].format);
+    TEST_ASSERT_EQUAL_PTR(format_b, log_entries[1].format);
+
+    /* Replaces the other message, at a level with tokens left */
+    TEST_ASSERT_TRUE(allow(1040, GOLIOTH_DEBUG_LOG_LEVEL_WARN, format_a));
+    TEST_ASSERT_EQUAL(0, golioth_debug_log_to_cloud_fake.call_count);
+
+    /* Evicted messages are reported together, with the summaries */
+    on_log_summary_timer(log_summary_timer, NULL);
+
+    TEST_ASSERT_EQUAL(1, golioth_debug_log_to_cloud_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(client, golioth_debug_log_to_cloud_fake.arg0_val);
+    TEST_ASSERT_EQUAL(GOLIOTH_DEBUG_LOG_LEVEL_WARN, golioth_debug_log_to_cloud_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("golioth_log", golioth_debug_log_to_cloud_fake.arg2_val);
+    TEST_ASSERT_EQUAL_STRING("2 other messages suppressed", sent_msg);
+}
+
+void test_governor_no_timer(void)
+{
+    log_governor_mutex = NULL;
+    golioth_sys_timer_create_fake.return_val = NULL;
+    golioth_log_governor_init();
+
+    /* Not governed, as summaries could not be sent */
+    TEST_ASSERT_EQUAL(1, golioth_sys_mutex_destroy_fake.call_count);
+    TEST_ASSERT_NULL(log_governor_mutex);
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+
+    golioth_sys_timer_create_fake.return_val = (golioth_sys_timer_t) 1;
+    golioth_log_governor_init();
+}
+
+void test_governor_not_initialized(void)
+{
+    log_governor_mutex = NULL;
+
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+    TEST_ASSERT_TRUE(allow(1000, GOLIOTH_DEBUG_LOG_LEVEL_ERROR, format_a));
+
+    golioth_log_governor_init();
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_governor_repeated);
+    RUN_TEST(test_governor_rate);
+    RUN_TEST(test_governor_summary);
+    RUN_TEST(test_governor_summary_locked);
+    RUN_TEST(test_governor_evicted);
+    RUN_TEST(test_governor_no_timer);
+    RUN_TEST(test_governor_not_initialized);
+    return UNITY_END();
+}
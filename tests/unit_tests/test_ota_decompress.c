@@ -0,0 +1,525 @@
+#include <unity.h>
+#include <fff.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/evp.h>
+
+#define CONFIG_GOLIOTH_OTA
+#define CONFIG_GOLIOTH_OTA_HEATSHRINK_WINDOW_SZ2 10
+#define CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS 2
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/ota_decompress.c"
+
+DEFINE_FFF_GLOBALS;
+
+golioth_sys_sha256_t golioth_sys_sha256_create(void)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+
+    return ctx;
+}
+
+void golioth_sys_sha256_destroy(golioth_sys_sha256_t sha_ctx)
+{
+    EVP_MD_CTX_free(sha_ctx);
+}
+
+enum golioth_status golioth_sys_sha256_update(golioth_sys_sha256_t sha_ctx,
+                                              const uint8_t *input,
+                                              size_t len)
+{
+    EVP_DigestUpdate(sha_ctx, input, len);
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_sys_sha256_finish(golioth_sys_sha256_t sha_ctx, uint8_t *output)
+{
+    EVP_DigestFinal_ex(sha_ctx, output, NULL);
+    return GOLIOTH_OK;
+}
+
+#define WINDOW_SZ2 10
+#define LOOKAHEAD_SZ2 4
+#define MAX_IMAGE_SIZE (1024 * 1024)
+
+static uint8_t image[MAX_IMAGE_SIZE];
+static size_t image_len;
+static uint8_t compressed[GOLIOTH_OTA_DECOMPRESS_HEADER_LEN + MAX_IMAGE_SIZE * 9 / 8 + 16];
+static size_t compressed_len;
+static uint8_t out[MAX_IMAGE_SIZE];
+static size_t out_len;
+static uint32_t next_block_idx;
+static int last_blocks;
+static uint32_t fail_block_idx;
+static struct golioth_ota_component component;
+static struct ota_decompress_stage *stage;
+
+/*
+ * Minimal heatshrink encoder: greedy, with a single candidate match per position.
+ * Compresses less than the heatshrink tool, but produces the same format.
+ */
+struct bit_writer
+{
+    uint8_t *buf;
+    size_t len;
+    uint8_t bits;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t value, uint8_t count)
+{
+    while (count--)
+    {
+        if (0 == w->bits)
+        {
+            w->buf[w->len++] = 0;
+            w->bits = 8;
+        }
+        w->bits--;
+        if (value & (1U << count))
+        {
+            w->buf[w->len - 1] |= (1U << w->bits);
+        }
+    }
+}
+
+static size_t heatshrink_encode(const uint8_t *in, size_t len, uint8_t window_sz2, uint8_t *buf)
+{
+    static int32_t last_pos[1 << 16];
+    const size_t window = 1 << window_sz2;
+    const size_t lookahead = 1 << LOOKAHEAD_SZ2;
+    struct bit_writer w = {.buf = buf};
+
+    memset(last_pos, 0xFF, sizeof(last_pos));
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t match_len = 0;
+        size_t dist = 0;
+
+        if (pos + 3 <= len)
+        {
+            uint16_t hash = (uint16_t) ((in[pos] << 8) ^ (in[pos + 1] << 4) ^ in[pos + 2]);
+            int32_t cand = last_pos[hash];
+            last_pos[hash] = (int32_t) pos;
+
+            if (cand >= 0 && pos - cand <= window)
+            {
+                while (match_len < lookahead && pos + match_len < len
+                       && in[cand + match_len] == in[pos + match_len])
+                {
+                    match_len++;
+                }
+                dist = pos - cand;
+            }
+        }
+
+        if (match_len * 9 > (size_t) (1 + window_sz2 + LOOKAHEAD_SZ2))
+        {
+            put_bits(&w, 0, 1);
+            put_bits(&w, dist - 1, window_sz2);
+            put_bits(&w, match_len - 1, LOOKAHEAD_SZ2);
+            pos += match_len;
+        }
+        else
+        {
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[pos], 8);
+            pos++;
+        }
+    }
+
+    return w.len;
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        buf[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+/* The stage copies the hash of the component when created, so create it for the new component */
+static void set_component_hash(void)
+{
+    EVP_Digest(compressed, compressed_len, component.hash, NULL, EVP_sha256(), NULL);
+
+    ota_decompress_stage_destroy(stage);
+    stage = ota_decompress_stage_create(&component);
+}
+
+static void make_compressed(uint8_t algorithm, uint8_t window_sz2, uint32_t declared_size)
+{
+    memcpy(compressed, GOLIOTH_OTA_DECOMPRESS_MAGIC, 4);
+    compressed[4] = algorithm;
+    compressed[5] = window_sz2;
+    compressed[6] = LOOKAHEAD_SZ2;
+    compressed[7] = 0;
+    put_le32(&compressed[8], declared_size);
+    memset(&compressed[12], 0xAB, GOLIOTH_OTA_COMPONENT_BIN_HASH_LEN);
+
+    compressed_len = GOLIOTH_OTA_DECOMPRESS_HEADER_LEN
+        + heatshrink_encode(image,
+                            image_len,
+                            window_sz2,
+                            &compressed[GOLIOTH_OTA_DECOMPRESS_HEADER_LEN]);
+
+    set_component_hash();
+}
+
+/* Looks like code: a small set of recurring words, with some random operands */
+static void make_image(size_t len)
+{
+    static const uint32_t words[] = {0x4770B510, 0xF7FFBD10, 0x68204604, 0x2000E7FE};
+    uint32_t rnd = 12345;
+
+    for (size_t i = 0; i < len; i += 4)
+    {
+        rnd = rnd * 1103515245 + 12345;
+        uint32_t word = (rnd >> 28) ? words[(rnd >> 16) % 4] : rnd;
+        memcpy(&image[i], &word, (len - i < 4) ? len - i : 4);
+    }
+
+    image_len = len;
+}
+
+static enum golioth_status block_cb(const struct golioth_ota_component *c,
+                                    uint32_t block_idx,
+                                    const uint8_t *block_buffer,
+                                    size_t block_buffer_len,
+                                    bool is_last,
+                                    size_t negotiated_block_size,
+                                    void *arg)
+{
+    /* Blocks are passed on in order, and passed again after a failed block */
+    TEST_ASSERT_LESS_OR_EQUAL(next_block_idx, block_idx);
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_BLOCKWISE_DOWNLOAD_MAX_BLOCK_SIZE, negotiated_block_size);
+    TEST_ASSERT_TRUE(is_last || block_buffer_len == negotiated_block_size);
+    TEST_ASSERT_TRUE(c->decompressed);
+
+    if (block_idx == fail_block_idx)
+    {
+        fail_block_idx = UINT32_MAX;
+        return GOLIOTH_ERR_IO;
+    }
+
+    memcpy(&out[block_idx * negotiated_block_size], block_buffer, block_buffer_len);
+    out_len = block_idx * negotiated_block_size + block_buffer_len;
+    next_block_idx = block_idx + 1;
+    last_blocks += is_last;
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status write_in_blocks(size_t start, size_t end, size_t block_size)
+{
+    for (size_t offset = start; offset < end; offset += block_size)
+    {
+        size_t n = (end - offset < block_size) ? end - offset : block_size;
+        bool is_last = (offset + n == compressed_len);
+
+        enum golioth_status status = ota_decompress_stage_write(stage,
+                                                                offset,
+                                                                &compressed[offset],
+                                                                n,
+                                                                is_last,
+                                                                block_cb,
+                                                                NULL);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    memset(&component, 0, sizeof(component));
+    strcpy(component.uri, "/.u/c/main@1.2.3");
+
+    out_len = 0;
+    next_block_idx = 0;
+    last_blocks = 0;
+    fail_block_idx = UINT32_MAX;
+
+    ota_decompress_init();
+    make_image(5000);
+}
+
+void tearDown(void)
+{
+    struct ota_decompress_stage *saved;
+
+    ota_decompress_stage_destroy(stage);
+    stage = NULL;
+    golioth_ota_register_decompressor(NULL);
+
+    /* Restoring at block 0 drops the saved stages */
+    while (_num_saved_stages > 0)
+    {
+        ota_decompress_stage_restore(&_saved_stages[0]->component, 0, &saved);
+    }
+}
+
+void test_is_compressed(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+
+    TEST_ASSERT_TRUE(ota_decompress_is_compressed(compressed, compressed_len));
+    TEST_ASSERT_FALSE(ota_decompress_is_compressed(image, image_len));
+}
+
+void test_decompress_in_blocks(void)
+{
+    const size_t block_sizes[] = {16, 64, 1024};
+
+    for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++)
+    {
+        if (i > 0)
+        {
+            tearDown();
+            setUp();
+        }
+
+        make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+        TEST_ASSERT_LESS_THAN(image_len, compressed_len);
+
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, compressed_len, block_sizes[i]));
+        TEST_ASSERT_EQUAL(1, last_blocks);
+        TEST_ASSERT_EQUAL(image_len, out_len);
+        TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+    }
+}
+
+void test_component_describes_image(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, compressed_len, 64));
+
+    const struct golioth_ota_component *c = ota_decompress_stage_component(stage);
+    TEST_ASSERT_EQUAL(image_len, c->size);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0xAB, c->hash, sizeof(c->hash));
+    TEST_ASSERT_EQUAL_STRING(component.uri, c->uri);
+    TEST_ASSERT_TRUE(c->decompressed);
+}
+
+void test_hash_mismatch(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+    /* Corrupted on the way, still decompresses to an image of the declared size */
+    compressed[12] ^= 0x01;
+
+    /* The last block is only passed on once the compressed component is verified */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_FAIL, write_in_blocks(0, compressed_len, 64));
+    TEST_ASSERT_EQUAL(0, last_blocks);
+}
+
+void test_smaller_window(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2 - 2, image_len);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, compressed_len, 64));
+    TEST_ASSERT_EQUAL(image_len, out_len);
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+}
+
+void test_window_too_large(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2 + 1, image_len);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NOT_IMPLEMENTED, write_in_blocks(0, compressed_len, 64));
+}
+
+void test_unknown_algorithm(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_ZLIB, WINDOW_SZ2, image_len);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NOT_IMPLEMENTED, write_in_blocks(0, compressed_len, 64));
+}
+
+void test_truncated(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len + 1);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, write_in_blocks(0, compressed_len, 64));
+    TEST_ASSERT_EQUAL(0, last_blocks);
+}
+
+void test_longer_than_declared(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len - 1);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, write_in_blocks(0, compressed_len, 64));
+}
+
+void test_resume(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, 256, 64));
+
+    struct ota_decompress_stage *saved = stage;
+    ota_decompress_stage_save(stage);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ota_decompress_stage_restore(&component, 4, &stage));
+    TEST_ASSERT_EQUAL_PTR(saved, stage);
+
+    /* Resuming must continue exactly where the stage stopped */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE, write_in_blocks(320, compressed_len, 64));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(256, compressed_len, 64));
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+}
+
+void test_resume_parallel(void)
+{
+    struct golioth_ota_component other = component;
+    strcpy(other.uri, "/.u/c/modem@2.0.0");
+
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, 256, 64));
+
+    struct ota_decompress_stage *saved = stage;
+    struct ota_decompress_stage *other_saved = ota_decompress_stage_create(&other);
+
+    /* Each component keeps its own stage */
+    ota_decompress_stage_save(stage);
+    ota_decompress_stage_save(other_saved);
+    stage = NULL;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ota_decompress_stage_restore(&other, 4, &stage));
+    TEST_ASSERT_EQUAL_PTR(other_saved, stage);
+    ota_decompress_stage_destroy(stage);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ota_decompress_stage_restore(&component, 4, &stage));
+    TEST_ASSERT_EQUAL_PTR(saved, stage);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(256, compressed_len, 64));
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+}
+
+void test_resume_changed_component(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, 256, 64));
+
+    ota_decompress_stage_save(stage);
+    stage = NULL;
+
+    /* Compressed data must not be passed on as the image */
+    component.hash[0] ^= 0x01;
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE,
+                      ota_decompress_stage_restore(&component, 4, &stage));
+    TEST_ASSERT_NULL(stage);
+    TEST_ASSERT_EQUAL(0, _num_saved_stages);
+}
+
+void test_failed_block_is_rolled_back(void)
+{
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+
+    /* Fails after earlier blocks of the same input block were passed on */
+    fail_block_idx = 2;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_IO, write_in_blocks(0, compressed_len, 1024));
+    TEST_ASSERT_EQUAL(2, next_block_idx);
+
+    /* The failed input block is downloaded again */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(stage->in_offset, compressed_len, 1024));
+    TEST_ASSERT_EQUAL(1, last_blocks);
+    TEST_ASSERT_EQUAL(image_len, out_len);
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+}
+
+static enum golioth_status copy_init(void *state, const uint8_t params[2])
+{
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status copy_process(void *state,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        golioth_ota_decompress_output_cb output,
+                                        void *output_arg)
+{
+    return output(data, len, output_arg);
+}
+
+void test_custom_decompressor(void)
+{
+    static const struct golioth_ota_decompressor copy = {
+        .algorithm = GOLIOTH_OTA_COMPRESSION_ZLIB,
+        .state_size = 1,
+        .init = copy_init,
+        .process = copy_process,
+    };
+
+    make_compressed(GOLIOTH_OTA_COMPRESSION_ZLIB, 0, image_len);
+    memcpy(&compressed[GOLIOTH_OTA_DECOMPRESS_HEADER_LEN], image, image_len);
+    compressed_len = GOLIOTH_OTA_DECOMPRESS_HEADER_LEN + image_len;
+    set_component_hash();
+
+    golioth_ota_register_decompressor(&copy);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, compressed_len, 1024));
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+}
+
+#if defined(UNIT_TEST_BENCHMARK)
+
+void test_benchmark(void)
+{
+    struct timespec start, end;
+
+    make_image(MAX_IMAGE_SIZE);
+    make_compressed(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, WINDOW_SZ2, image_len);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, write_in_blocks(0, compressed_len, 1024));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    TEST_ASSERT_EQUAL_MEMORY(image, out, image_len);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("heatshrink -w %d -l %d: %zu -> %zu bytes (%.1f%%), %.1f MB/s, RAM %zu bytes\n",
+           WINDOW_SZ2,
+           LOOKAHEAD_SZ2,
+           compressed_len,
+           image_len,
+           100.0 * compressed_len / image_len,
+           image_len / seconds / 1e6,
+           sizeof(struct ota_decompress_stage) + golioth_ota_decompressor_heatshrink.state_size);
+}
+
+#endif  // UNIT_TEST_BENCHMARK
+
+int main(void)
+{
+    UNITY_BEGIN();
+#if defined(UNIT_TEST_BENCHMARK)
+    RUN_TEST(test_benchmark);
+#else
+    RUN_TEST(test_is_compressed);
+    RUN_TEST(test_decompress_in_blocks);
+    RUN_TEST(test_component_describes_image);
+    RUN_TEST(test_smaller_window);
+    RUN_TEST(test_window_too_large);
+    RUN_TEST(test_unknown_algorithm);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_longer_than_declared);
+    RUN_TEST(test_hash_mismatch);
+    RUN_TEST(test_resume);
+    RUN_TEST(test_resume_parallel);
+    RUN_TEST(test_resume_changed_component);
+    RUN_TEST(test_failed_block_is_rolled_back);
+    RUN_TEST(test_custom_decompressor);
+#endif
+    return UNITY_END();
+}
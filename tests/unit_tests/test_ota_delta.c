@@ -0,0 +1,231 @@
+#include <unity.h>
+#include <fff.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/ota_delta.c"
+
+DEFINE_FFF_GLOBALS;
+
+golioth_sys_sha256_t golioth_sys_sha256_create(void)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+
+    return ctx;
+}
+
+void golioth_sys_sha256_destroy(golioth_sys_sha256_t sha_ctx)
+{
+    EVP_MD_CTX_free(sha_ctx);
+}
+
+enum golioth_status golioth_sys_sha256_update(golioth_sys_sha256_t sha_ctx,
+                                              const uint8_t *input,
+                                              size_t len)
+{
+    EVP_DigestUpdate(sha_ctx, input, len);
+    return GOLIOTH_OK;
+}
+
+enum golioth_status golioth_sys_sha256_finish(golioth_sys_sha256_t sha_ctx, uint8_t *output)
+{
+    EVP_DigestFinal_ex(sha_ctx, output, NULL);
+    return GOLIOTH_OK;
+}
+
+#define MAX_IMAGE_SIZE (64 * 1024)
+
+static uint8_t src[MAX_IMAGE_SIZE];
+static size_t src_len;
+static uint8_t tgt[MAX_IMAGE_SIZE];
+static size_t tgt_len;
+static uint8_t out[MAX_IMAGE_SIZE];
+static size_t out_written;
+static uint8_t patch[2 * MAX_IMAGE_SIZE];
+static size_t patch_len;
+static struct golioth_ota_delta delta;
+
+static size_t read_file(const char *path, uint8_t *buf, size_t size)
+{
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+
+    size_t len = fread(buf, 1, size, f);
+    TEST_ASSERT_TRUE(feof(f));
+    fclose(f);
+
+    return len;
+}
+
+static void load_patch(const char *path)
+{
+    patch_len = read_file(path, patch, sizeof(patch));
+}
+
+static enum golioth_status read_src(size_t offset, uint8_t *buf, size_t len, void *arg)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(src_len, offset + len);
+    memcpy(buf, &src[offset], len);
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status write_out(size_t offset,
+                                     const uint8_t *buf,
+                                     size_t len,
+                                     size_t target_size,
+                                     void *arg)
+{
+    TEST_ASSERT_EQUAL(out_written, offset);
+    TEST_ASSERT_EQUAL(tgt_len, target_size);
+    TEST_ASSERT_LESS_OR_EQUAL(tgt_len, offset + len);
+    memcpy(&out[offset], buf, len);
+    out_written += len;
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status apply_in_chunks(size_t len, size_t chunk_size)
+{
+    for (size_t offset = 0; offset < len; offset += chunk_size)
+    {
+        size_t n = (len - offset < chunk_size) ? len - offset : chunk_size;
+
+        enum golioth_status status = golioth_ota_delta_apply(&delta, &patch[offset], n);
+        if (GOLIOTH_OK != status)
+        {
+            return status;
+        }
+    }
+
+    return GOLIOTH_OK;
+}
+
+static void reset_delta(void)
+{
+    golioth_ota_delta_abort(&delta);
+
+    memset(out, 0, sizeof(out));
+    out_written = 0;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_ota_delta_init(&delta, read_src, write_out, NULL));
+}
+
+static void check_apply_in_chunks(const char *path)
+{
+    const size_t chunk_sizes[] = {1, 5, 12, 64, 1024, sizeof(patch)};
+
+    load_patch(path);
+
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        reset_delta();
+
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, apply_in_chunks(patch_len, chunk_sizes[i]));
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_ota_delta_finish(&delta));
+        TEST_ASSERT_EQUAL(tgt_len, out_written);
+        TEST_ASSERT_EQUAL_MEMORY(tgt, out, tgt_len);
+    }
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    src_len = read_file(DELTA_SOURCE_PATH, src, sizeof(src));
+    tgt_len = read_file(DELTA_TARGET_PATH, tgt, sizeof(tgt));
+    load_patch(DELTA_PATCH_PATH);
+
+    reset_delta();
+}
+
+void tearDown(void)
+{
+    golioth_ota_delta_abort(&delta);
+}
+
+void test_is_patch(void)
+{
+    TEST_ASSERT_TRUE(golioth_ota_delta_is_patch(patch, patch_len));
+    TEST_ASSERT_FALSE(golioth_ota_delta_is_patch(src, src_len));
+    TEST_ASSERT_FALSE(golioth_ota_delta_is_patch(patch, 3));
+}
+
+void test_apply_compressed(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OTA_COMPRESSION_HEATSHRINK, patch[4]);
+    TEST_ASSERT_LESS_THAN(tgt_len / 2, patch_len);
+
+    check_apply_in_chunks(DELTA_PATCH_PATH);
+}
+
+void test_apply_uncompressed(void)
+{
+    load_patch(DELTA_PATCH_UNCOMPRESSED_PATH);
+    TEST_ASSERT_EQUAL(0, patch[4]);
+
+    check_apply_in_chunks(DELTA_PATCH_UNCOMPRESSED_PATH);
+}
+
+void test_hash_mismatch(void)
+{
+    patch[12] ^= 0xFF;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, apply_in_chunks(patch_len, 64));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_FAIL, golioth_ota_delta_finish(&delta));
+}
+
+void test_truncated_patch(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, apply_in_chunks(patch_len - 16, 64));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NO_MORE_DATA, golioth_ota_delta_finish(&delta));
+}
+
+void test_invalid_magic(void)
+{
+    patch[0] = 'X';
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, apply_in_chunks(patch_len, 64));
+}
+
+void test_unknown_compression(void)
+{
+    patch[4] = 0x7F;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NOT_IMPLEMENTED, apply_in_chunks(patch_len, 64));
+}
+
+void test_record_exceeds_target(void)
+{
+    load_patch(DELTA_PATCH_UNCOMPRESSED_PATH);
+
+    /* diff_len of the first record */
+    patch[GOLIOTH_OTA_DELTA_HEADER_LEN + 3] = 0x01;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, apply_in_chunks(patch_len, 64));
+}
+
+void test_trailing_data(void)
+{
+    load_patch(DELTA_PATCH_UNCOMPRESSED_PATH);
+    patch[patch_len++] = 0;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, apply_in_chunks(patch_len, patch_len));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_is_patch);
+    RUN_TEST(test_apply_compressed);
+    RUN_TEST(test_apply_uncompressed);
+    RUN_TEST(test_hash_mismatch);
+    RUN_TEST(test_truncated_patch);
+    RUN_TEST(test_invalid_magic);
+    RUN_TEST(test_unknown_compression);
+    RUN_TEST(test_record_exceeds_target);
+    RUN_TEST(test_trailing_data);
+    return UNITY_END();
+}
@@ -0,0 +1,300 @@
+#include <unity.h>
+#include <fff.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CONFIG_GOLIOTH_OTA
+#define CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS 4
+#define CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS 2
+
+#include "fakes/golioth_sys_fake.h"
+#include "../../src/ota_scheduler.c"
+
+DEFINE_FFF_GLOBALS;
+
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_ota_download_component,
+                struct golioth_client *,
+                const struct golioth_ota_component *,
+                uint32_t,
+                ota_component_block_write_cb,
+                ota_component_download_end_cb,
+                void *);
+FAKE_VALUE_FUNC(enum golioth_status,
+                job_block_cb,
+                const struct golioth_ota_component *,
+                uint32_t,
+                const uint8_t *,
+                size_t,
+                bool,
+                size_t,
+                void *);
+FAKE_VOID_FUNC(job_end_cb,
+               enum golioth_status,
+               const struct golioth_coap_rsp_code *,
+               const struct golioth_ota_component *,
+               uint32_t,
+               void *);
+FAKE_VOID_FUNC(progress_cb, const struct golioth_ota_component *, size_t, void *);
+FAKE_VOID_FUNC(all_end_cb, size_t, void *);
+
+/* Downloads started through golioth_ota_download_component() */
+struct started_download
+{
+    const struct golioth_ota_component *component;
+    uint32_t block_idx;
+    ota_component_block_write_cb block_cb;
+    ota_component_download_end_cb end_cb;
+    void *arg;
+};
+
+static struct started_download started[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+static size_t num_started;
+static enum golioth_status start_status[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+static size_t num_start_calls;
+
+static struct golioth_client *client = (struct golioth_client *) 1;
+static struct golioth_ota_component components[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+static struct golioth_ota_download_job jobs[CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS];
+
+/* Mutexes created and not destroyed yet */
+static int num_mutexes(void)
+{
+    return golioth_sys_mutex_create_fake.call_count - golioth_sys_mutex_destroy_fake.call_count;
+}
+
+static enum golioth_status download_component_custom_fake(
+    struct golioth_client *c,
+    const struct golioth_ota_component *component,
+    uint32_t block_idx,
+    ota_component_block_write_cb block_cb,
+    ota_component_download_end_cb end_cb,
+    void *arg)
+{
+    enum golioth_status status = start_status[num_start_calls++];
+    if (GOLIOTH_OK == status)
+    {
+        started[num_started++] = (struct started_download){
+            .component = component,
+            .block_idx = block_idx,
+            .block_cb = block_cb,
+            .end_cb = end_cb,
+            .arg = arg,
+        };
+    }
+
+    return status;
+}
+
+static void end_download(size_t i, enum golioth_status status)
+{
+    started[i].end_cb(status, NULL, started[i].component, 7, started[i].arg);
+}
+
+static enum golioth_status start(size_t num_jobs, size_t max_in_flight)
+{
+    return golioth_ota_download_components(client,
+                                           jobs,
+                                           num_jobs,
+                                           max_in_flight,
+                                           progress_cb,
+                                           all_end_cb,
+                                           NULL);
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    RESET_FAKE(golioth_ota_download_component);
+    RESET_FAKE(job_block_cb);
+    RESET_FAKE(job_end_cb);
+    RESET_FAKE(progress_cb);
+    RESET_FAKE(all_end_cb);
+
+    golioth_ota_download_component_fake.custom_fake = download_component_custom_fake;
+
+    memset(started, 0, sizeof(started));
+    memset(start_status, 0, sizeof(start_status));
+    num_started = 0;
+    num_start_calls = 0;
+
+    for (size_t i = 0; i < CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS; i++)
+    {
+        snprintf(components[i].package, sizeof(components[i].package), "pkg%zu", i);
+        jobs[i] = (struct golioth_ota_download_job){
+            .component = &components[i],
+            .block_idx = 0,
+            .block_cb = job_block_cb,
+            .end_cb = job_end_cb,
+            .arg = &components[i],
+        };
+    }
+}
+
+void tearDown(void) {}
+
+void test_invalid_args(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_ota_download_components(NULL, jobs, 1, 0, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_ota_download_components(client, NULL, 1, 0, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT, start(0, 0));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      start(CONFIG_GOLIOTH_OTA_MAX_NUM_COMPONENTS + 1, 0));
+
+    jobs[1].end_cb = NULL;
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL, start(2, 0));
+
+    TEST_ASSERT_EQUAL(0, golioth_ota_download_component_fake.call_count);
+    TEST_ASSERT_EQUAL(0, num_mutexes());
+}
+
+void test_in_flight_limit(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(4, 2));
+    TEST_ASSERT_EQUAL(2, num_started);
+    TEST_ASSERT_EQUAL_PTR(&components[0], started[0].component);
+    TEST_ASSERT_EQUAL_PTR(&components[1], started[1].component);
+
+    /* A component completing frees a slot for the next one */
+    end_download(1, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(3, num_started);
+    TEST_ASSERT_EQUAL_PTR(&components[2], started[2].component);
+    TEST_ASSERT_EQUAL(1, job_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(&components[1], job_end_cb_fake.arg4_val);
+
+    end_download(0, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(4, num_started);
+
+    end_download(2, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(0, all_end_cb_fake.call_count);
+
+    end_download(3, GOLIOTH_OK);
+    TEST_ASSERT_EQUAL(4, job_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(0, all_end_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(0, num_mutexes());
+}
+
+void test_default_in_flight_limit(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(3, 0));
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_OTA_MAX_PARALLEL_DOWNLOADS, num_started);
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        end_download(i, GOLIOTH_OK);
+    }
+
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.call_count);
+}
+
+void test_resume_block_idx(void)
+{
+    jobs[0].block_idx = 12;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(1, 0));
+    TEST_ASSERT_EQUAL(12, started[0].block_idx);
+
+    end_download(0, GOLIOTH_OK);
+}
+
+void test_progress(void)
+{
+    uint8_t block[100] = {};
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(1, 0));
+
+    job_block_cb_fake.return_val = GOLIOTH_OK;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      started[0].block_cb(&components[0],
+                                          1,
+                                          block,
+                                          sizeof(block),
+                                          false,
+                                          1024,
+                                          started[0].arg));
+    TEST_ASSERT_EQUAL(1, job_block_cb_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(&components[0], job_block_cb_fake.arg6_val);
+    TEST_ASSERT_EQUAL(1, progress_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1024 + sizeof(block), progress_cb_fake.arg1_val);
+    TEST_ASSERT_EQUAL_PTR(&components[0], progress_cb_fake.arg2_val);
+
+    /* No progress for blocks the application failed to write */
+    job_block_cb_fake.return_val = GOLIOTH_ERR_FAIL;
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_FAIL,
+                      started[0].block_cb(&components[0],
+                                          2,
+                                          block,
+                                          sizeof(block),
+                                          false,
+                                          1024,
+                                          started[0].arg));
+    TEST_ASSERT_EQUAL(1, progress_cb_fake.call_count);
+
+    end_download(0, GOLIOTH_ERR_FAIL);
+}
+
+void test_failed_component(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(3, 2));
+
+    end_download(0, GOLIOTH_ERR_TIMEOUT);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_TIMEOUT, job_end_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(7, job_end_cb_fake.arg3_val);
+    TEST_ASSERT_EQUAL(3, num_started);
+
+    end_download(1, GOLIOTH_OK);
+    end_download(2, GOLIOTH_OK);
+
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.arg0_val);
+}
+
+void test_start_failure(void)
+{
+    start_status[0] = GOLIOTH_ERR_QUEUE_FULL;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(3, 2));
+
+    /* The failed component ended right away, and the next ones were started instead */
+    TEST_ASSERT_EQUAL(1, job_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_QUEUE_FULL, job_end_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(2, num_started);
+    TEST_ASSERT_EQUAL_PTR(&components[1], started[0].component);
+    TEST_ASSERT_EQUAL_PTR(&components[2], started[1].component);
+
+    end_download(0, GOLIOTH_OK);
+    end_download(1, GOLIOTH_OK);
+
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.arg0_val);
+}
+
+void test_all_fail_to_start(void)
+{
+    start_status[0] = GOLIOTH_ERR_QUEUE_FULL;
+    start_status[1] = GOLIOTH_ERR_QUEUE_FULL;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, start(2, 1));
+
+    TEST_ASSERT_EQUAL(2, job_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, all_end_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(2, all_end_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(0, num_mutexes());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_invalid_args);
+    RUN_TEST(test_in_flight_limit);
+    RUN_TEST(test_default_in_flight_limit);
+    RUN_TEST(test_resume_block_idx);
+    RUN_TEST(test_progress);
+    RUN_TEST(test_failed_component);
+    RUN_TEST(test_start_failure);
+    RUN_TEST(test_all_fail_to_start);
+    return UNITY_END();
+}
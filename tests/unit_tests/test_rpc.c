@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <time.h>
 #include <unity.h>
 #include <fff.h>
 
@@ -11,12 +12,10 @@ static const char *last_err_msg = NULL;
 static const char *last_wrn_msg = NULL;
 
 #define CONFIG_GOLIOTH_RPC
-#define CONFIG_GOLIOTH_DEBUG_LOG
-#define GLTH_LOGX(...)
-#define GLTH_LOG_BUFFER_HEXDUMP(...)
 #define GLTH_LOGE(TAG, msg, ...) last_err_msg = msg;
 #define GLTH_LOGW(TAG, msg, ...) last_wrn_msg = msg;
 
+#include "fakes/golioth_sys_fake.h"
 #include "fakes/coap_client_fake.h"
 #include "../../src/rpc.c"
 
@@ -25,11 +24,136 @@ FAKE_VALUE_FUNC(enum golioth_rpc_status,
                 zcbor_state_t *,
                 zcbor_state_t *,
                 void *);
+FAKE_VALUE_FUNC(size_t, golioth_client_get_upload_block_size, struct golioth_client *);
+FAKE_VALUE_FUNC(enum golioth_status,
+                golioth_blockwise_post,
+                struct golioth_client *,
+                const char *,
+                const char *,
+                enum golioth_content_type,
+                read_block_cb,
+                golioth_set_cb_fn,
+                void *);
+FAKE_VOID_FUNC(test_rpc_deferred_fn,
+               struct golioth_rpc_call *,
+               zcbor_state_t *,
+               zcbor_state_t *,
+               void *);
 
 struct golioth_rpc grpc;
+struct golioth_rpc_slot slots[CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS];
 uint8_t last_coap_payload[256];
 size_t last_coap_payload_size;
 
+/* Calls handed to the worker threads, and to the deferred method */
+struct golioth_rpc_call *queued_calls[CONFIG_GOLIOTH_RPC_QUEUE_DEPTH];
+size_t num_queued;
+struct golioth_rpc_call *running_calls[CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS + 1];
+size_t num_running;
+bool mbox_create_fails;
+
+golioth_mbox_t golioth_mbox_create(size_t num_items, size_t item_size)
+{
+    return mbox_create_fails ? NULL : (golioth_mbox_t) 1;
+}
+
+bool golioth_mbox_try_send(golioth_mbox_t mbox, const void *item)
+{
+    if (num_queued == ARRAY_SIZE(queued_calls))
+    {
+        return false;
+    }
+
+    memcpy(&queued_calls[num_queued++], item, sizeof(queued_calls[0]));
+    return true;
+}
+
+bool golioth_mbox_recv(golioth_mbox_t mbox, void *item, int32_t timeout_ms)
+{
+    return false;
+}
+
+void golioth_mbox_destroy(golioth_mbox_t mbox) {}
+
+golioth_sys_sem_t golioth_sys_sem_create(uint32_t sem_max_count, uint32_t sem_initial_count)
+{
+    return (golioth_sys_sem_t) 1;
+}
+
+bool golioth_sys_sem_take(golioth_sys_sem_t sem, int32_t ms_to_wait)
+{
+    return true;
+}
+
+bool golioth_sys_sem_give(golioth_sys_sem_t sem)
+{
+    return true;
+}
+
+void golioth_sys_sem_destroy(golioth_sys_sem_t sem) {}
+
+golioth_sys_thread_t golioth_sys_thread_create(const struct golioth_thread_config *config)
+{
+    return (golioth_sys_thread_t) 1;
+}
+
+void golioth_sys_thread_destroy(golioth_sys_thread_t thread) {}
+
+void golioth_sys_msleep(uint32_t ms) {}
+
+/* Read a blockwise response in blocks of the current upload block size */
+static enum golioth_status golioth_blockwise_post_custom_fake(
+    struct golioth_client *client,
+    const char *path_prefix,
+    const char *path,
+    enum golioth_content_type content_type,
+    read_block_cb read_cb,
+    golioth_set_cb_fn set_cb,
+    void *callback_arg)
+{
+    bool is_last = false;
+
+    last_coap_payload_size = 0;
+
+    for (uint32_t block_idx = 0; !is_last; block_idx++)
+    {
+        size_t block_size = golioth_client_get_upload_block_size_fake.return_val;
+
+        enum golioth_status status = read_cb(block_idx,
+                                             &last_coap_payload[last_coap_payload_size],
+                                             &block_size,
+                                             &is_last,
+                                             callback_arg);
+        if (status != GOLIOTH_OK)
+        {
+            return status;
+        }
+        last_coap_payload_size += block_size;
+    }
+
+    return GOLIOTH_OK;
+}
+
+/* Run the oldest queued call, as a worker thread would */
+static void run_queued_call(void)
+{
+    TEST_ASSERT_GREATER_THAN(0, num_queued);
+
+    struct golioth_rpc_call *call = queued_calls[0];
+    num_queued--;
+    memmove(&queued_calls[0], &queued_calls[1], num_queued * sizeof(queued_calls[0]));
+
+    rpc_call_run(call);
+}
+
+static void store_deferred_call(struct golioth_rpc_call *call,
+                                zcbor_state_t *request_params_array,
+                                zcbor_state_t *response_detail_map,
+                                void *callback_arg)
+{
+    running_calls[num_running++] = call;
+}
+
 enum golioth_status golioth_coap_client_set_custom_fake(struct golioth_client *client,
                                                         const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
                                                         const char *path_prefix,
@@ -49,18 +173,31 @@ enum golioth_status golioth_coap_client_set_custom_fake(struct golioth_client *c
 
 void setUp(void)
 {
+    golioth_sys_fake_reset();
     memset(&grpc, 0, sizeof(grpc));
+    memset(slots, 0, sizeof(slots));
+    grpc.rpcs = slots;
+    grpc.max_rpcs = CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS;
     golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    golioth_blockwise_post_fake.custom_fake = golioth_blockwise_post_custom_fake;
+    golioth_client_get_upload_block_size_fake.return_val = 1024;
 }
 void tearDown(void)
 {
+    rpc_release(&grpc);
     last_err_msg = NULL;
     last_wrn_msg = NULL;
     last_coap_payload_size = 0;
     RESET_FAKE(golioth_coap_client_observe);
     RESET_FAKE(golioth_coap_client_set);
     RESET_FAKE(test_rpc_method_fn);
+    RESET_FAKE(test_rpc_deferred_fn);
+    RESET_FAKE(golioth_client_get_upload_block_size);
+    RESET_FAKE(golioth_blockwise_post);
     FFF_RESET_HISTORY();
+    num_queued = 0;
+    num_running = 0;
+    mbox_create_fails = false;
 }
 
 void test_rpc_register(void)
@@ -308,6 +445,65 @@ void test_rpc_call_one(void)
     TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
 }
 
+void test_rpc_register_table(void)
+{
+    static const struct golioth_rpc_method table[] = {
+        GOLIOTH_RPC_METHOD("other", test_rpc_method_fn, NULL),
+        GOLIOTH_RPC_METHOD("test", test_rpc_method_fn, (void *) table),
+    };
+
+    enum golioth_status ret = golioth_rpc_register_table(&grpc, table, ARRAY_SIZE(table));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(2, grpc.num_rpcs);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_observe_fake.call_count);
+
+    /* The table is referenced, not copied */
+    TEST_ASSERT_EQUAL_PTR(&table[1], grpc.rpcs[1].method);
+
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x80,                               /* array(0) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR(table, test_rpc_method_fn_fake.arg2_val);
+}
+
+void test_rpc_register_table_too_many(void)
+{
+    static const struct golioth_rpc_method table[] = {
+        GOLIOTH_RPC_METHOD("a", test_rpc_method_fn, NULL),
+        GOLIOTH_RPC_METHOD("b", test_rpc_method_fn, NULL),
+    };
+
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS - 1; i++)
+    {
+        enum golioth_status ret = golioth_rpc_register(&grpc, "", NULL, NULL);
+        TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    }
+
+    /* None of the table is registered when it doesn't fit */
+    enum golioth_status ret = golioth_rpc_register_table(&grpc, table, ARRAY_SIZE(table));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC, ret);
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_RPC_MAX_NUM_METHODS - 1, grpc.num_rpcs);
+}
+
 enum golioth_rpc_status rpc_method_fake(zcbor_state_t *request_params_array,
                                         zcbor_state_t *response_detail_map,
                                         void *callback_arg)
@@ -421,6 +617,402 @@ void test_rpc_call_one_with_params(void)
     TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
 }
 
+/* Response to call id "123" by rpc_method_fake() */
+static const uint8_t return_val_response[] = {
+    0xBF,                                                       /* map(*) */
+    0x62,                                                       /* text(2) */
+    0x69, 0x64,                                                 /* "id" */
+    0x63,                                                       /* text(3) */
+    0x31, 0x32, 0x33,                                           /* "123" */
+    0x66,                                                       /* text(6) */
+    0x64, 0x65, 0x74, 0x61, 0x69, 0x6C,                         /* "detail" */
+    0xBF,                                                       /* map(*) */
+    0x6A,                                                       /* text(10) */
+    0x72, 0x65, 0x74, 0x75, 0x72, 0x6E, 0x5F, 0x76, 0x61, 0x6C, /* "return_val" */
+    0x63,                                                       /* text(3) */
+    0x66, 0x6F, 0x6F,                                           /* "foo" */
+    0xFF,                                                       /* primitive(*) */
+    0x6A,                                                       /* text(10) */
+    0x73, 0x74, 0x61, 0x74, 0x75, 0x73, 0x43, 0x6F, 0x64, 0x65, /* "statusCode" */
+    0x00,                                                       /* unsigned(0) */
+    0xFF,                                                       /* primitive(*) */
+};
+
+static void rpc_deferred_fake(struct golioth_rpc_call *call,
+                              zcbor_state_t *request_params_array,
+                              zcbor_state_t *response_detail_map,
+                              void *callback_arg)
+{
+    rpc_method_fake(request_params_array, response_detail_map, callback_arg);
+    store_deferred_call(call, request_params_array, response_detail_map, callback_arg);
+}
+
+void test_rpc_call_deferred(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = rpc_deferred_fake;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, (void *) true);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x82,                               /* array(2) */
+        0x61,                               /* text(1) */
+        0x61,                               /* "a" */
+        0x18, 0xF8,                         /* unsigned(248) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+
+    /* The method runs on a worker, and responds once completed */
+    TEST_ASSERT_EQUAL(0, test_rpc_deferred_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(1, num_queued);
+
+    run_queued_call();
+    TEST_ASSERT_EQUAL(1, test_rpc_deferred_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    ret = golioth_rpc_call_complete(running_calls[0], GOLIOTH_RPC_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+
+    TEST_ASSERT_EQUAL(sizeof(return_val_response), last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(return_val_response, last_coap_payload, last_coap_payload_size);
+}
+
+static void call_test_method(void)
+{
+    enum golioth_status status = GOLIOTH_OK;
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 0,
+    };
+    const uint8_t payload[] = {
+        0xA3,                               /* map(3) */
+        0x66,                               /* text(6) */
+        0x6D, 0x65, 0x74, 0x68, 0x6F, 0x64, /* "method" */
+        0x64,                               /* text(4) */
+        0x74, 0x65, 0x73, 0x74,             /* "test" */
+        0x62,                               /* text(2) */
+        0x69, 0x64,                         /* "id" */
+        0x63,                               /* text(3) */
+        0x31, 0x32, 0x33,                   /* "123" */
+        0x66,                               /* text(6) */
+        0x70, 0x61, 0x72, 0x61, 0x6D, 0x73, /* "params" */
+        0x80,                               /* array(0) */
+    };
+    on_rpc(NULL, status, &coap_rsp_code, NULL, payload, sizeof(payload), &grpc);
+}
+
+static void assert_resource_exhausted(void)
+{
+    const uint8_t expected_status[] = {
+        0x6A,                                                       /* text(10) */
+        0x73, 0x74, 0x61, 0x74, 0x75, 0x73, 0x43, 0x6F, 0x64, 0x65, /* "statusCode" */
+        0x08,                                                       /* unsigned(8) */
+    };
+
+    TEST_ASSERT_NOT_NULL(memmem(last_coap_payload,
+                                last_coap_payload_size,
+                                expected_status,
+                                sizeof(expected_status)));
+}
+
+void test_rpc_call_deferred_limits(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = store_deferred_call;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    /* Calls beyond the queue depth are rejected right away */
+    for (int i = 0; i < CONFIG_GOLIOTH_RPC_QUEUE_DEPTH; i++)
+    {
+        call_test_method();
+    }
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    call_test_method();
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    assert_resource_exhausted();
+
+    /* Calls beyond the concurrency limit are rejected, even with room in the queue */
+    while (num_queued > 0)
+    {
+        run_queued_call();
+    }
+    for (int i = CONFIG_GOLIOTH_RPC_QUEUE_DEPTH; i < CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS; i++)
+    {
+        call_test_method();
+        run_queued_call();
+    }
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS, grpc.num_calls);
+
+    call_test_method();
+    TEST_ASSERT_EQUAL(0, num_queued);
+    TEST_ASSERT_EQUAL(2, golioth_coap_client_set_fake.call_count);
+    assert_resource_exhausted();
+
+    /* Completing a call makes room for the next one */
+    ret = golioth_rpc_call_complete(running_calls[0], GOLIOTH_RPC_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    call_test_method();
+    TEST_ASSERT_EQUAL(1, num_queued);
+    run_queued_call();
+
+    for (size_t i = 1; i < num_running; i++)
+    {
+        golioth_rpc_call_complete(running_calls[i], GOLIOTH_RPC_OK);
+    }
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+}
+
+void test_rpc_deferred_queue_alloc_failed(void)
+{
+    mbox_create_fails = true;
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC,
+                      golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL));
+    TEST_ASSERT_NULL(grpc.calls_mutex);
+    TEST_ASSERT_NULL(grpc.workers_stopped);
+    TEST_ASSERT_EQUAL(0, grpc.num_workers);
+    TEST_ASSERT_EQUAL(0, grpc.num_rpcs);
+
+    /* Retried by the next registration */
+    mbox_create_fails = false;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL));
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_RPC_NUM_WORKERS, grpc.num_workers);
+}
+
+void test_rpc_deinit_with_pending_calls(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = store_deferred_call;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL));
+
+    call_test_method();
+    run_queued_call();
+    TEST_ASSERT_EQUAL(1, num_running);
+
+    /* The handle stays valid for the call in progress */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE, golioth_rpc_deinit(&grpc));
+    TEST_ASSERT_FALSE(grpc.stopping);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_cancel_observations_by_prefix_fake.call_count);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_rpc_call_complete(running_calls[0], GOLIOTH_RPC_OK));
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+}
+
+void test_rpc_call_response_larger_than_block(void)
+{
+    test_rpc_method_fn_fake.custom_fake = rpc_method_fake;
+    enum golioth_status ret = golioth_rpc_register(&grpc, "test", test_rpc_method_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    /* Without worker threads, responses of regular methods are sent with a single request */
+    golioth_client_get_upload_block_size_fake.return_val = 16;
+    call_test_method();
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_blockwise_post_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_GREATER_THAN(16, last_coap_payload_size);
+    TEST_ASSERT_NOT_NULL(memmem(last_coap_payload, last_coap_payload_size, "foo", 3));
+}
+
+void test_rpc_call_response_larger_than_block_workers(void)
+{
+    test_rpc_method_fn_fake.custom_fake = rpc_method_fake;
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_rpc_register(&grpc, "test", test_rpc_method_fn, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_rpc_register_deferred(&grpc, "other", test_rpc_deferred_fn, NULL));
+
+    /* Handed to a worker thread, which sends it blockwise */
+    golioth_client_get_upload_block_size_fake.return_val = 16;
+    call_test_method();
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(1, grpc.num_calls);
+
+    run_queued_call();
+
+    TEST_ASSERT_EQUAL(0, test_rpc_deferred_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_blockwise_post_fake.call_count);
+    TEST_ASSERT_GREATER_THAN(16, last_coap_payload_size);
+    TEST_ASSERT_NOT_NULL(memmem(last_coap_payload, last_coap_payload_size, "foo", 3));
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+
+    /* Sent with a single request when too many calls are in progress */
+    grpc.num_calls = CONFIG_GOLIOTH_RPC_MAX_CONCURRENT_CALLS;
+    call_test_method();
+    grpc.num_calls = 0;
+
+    TEST_ASSERT_EQUAL(0, num_queued);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+}
+
+static enum golioth_rpc_status rpc_method_too_large_fake(zcbor_state_t *request_params_array,
+                                                         zcbor_state_t *response_detail_map,
+                                                         void *callback_arg)
+{
+    static const uint8_t dump[CONFIG_GOLIOTH_RPC_MAX_RESPONSE_LEN];
+    struct zcbor_string value = {
+        .value = dump,
+        .len = sizeof(dump),
+    };
+
+    zcbor_tstr_put_lit(response_detail_map, "dump");
+    zcbor_bstr_encode(response_detail_map, &value);
+
+    return GOLIOTH_RPC_OK;
+}
+
+void test_rpc_call_response_too_large(void)
+{
+    test_rpc_method_fn_fake.custom_fake = rpc_method_too_large_fake;
+    enum golioth_status ret = golioth_rpc_register(&grpc, "test", test_rpc_method_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    call_test_method();
+
+    TEST_ASSERT_EQUAL(1, test_rpc_method_fn_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+    assert_resource_exhausted();
+}
+
+void test_rpc_call_deferred_blockwise(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = rpc_deferred_fake;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    golioth_client_get_upload_block_size_fake.return_val = 32;
+    call_test_method();
+    run_queued_call();
+
+    ret = golioth_rpc_call_complete(running_calls[0], GOLIOTH_RPC_OK);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_blockwise_post_fake.call_count);
+
+    TEST_ASSERT_EQUAL(sizeof(return_val_response), last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(return_val_response, last_coap_payload, last_coap_payload_size);
+}
+
+/* Streams one "value" entry per chunk, up to num_chunks */
+struct stream_detail
+{
+    size_t num_chunks;
+    size_t num_written;
+    size_t fail_at;
+};
+
+static enum golioth_status write_stream_detail(zcbor_state_t *response_detail_map,
+                                               bool *is_last,
+                                               void *arg)
+{
+    struct stream_detail *detail = arg;
+
+    if (detail->num_written == detail->fail_at)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    bool ok = zcbor_tstr_put_lit(response_detail_map, "value")
+        && zcbor_uint32_put(response_detail_map, detail->num_written);
+    TEST_ASSERT_TRUE(ok);
+
+    detail->num_written++;
+    *is_last = (detail->num_written == detail->num_chunks);
+
+    return GOLIOTH_OK;
+}
+
+void test_rpc_call_deferred_streamed(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = rpc_deferred_fake;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    golioth_client_get_upload_block_size_fake.return_val = 32;
+    call_test_method();
+    run_queued_call();
+
+    struct stream_detail detail = {
+        .num_chunks = 10,
+        .fail_at = SIZE_MAX,
+    };
+    ret = golioth_rpc_call_complete_streamed(running_calls[0],
+                                             GOLIOTH_RPC_OK,
+                                             write_stream_detail,
+                                             &detail);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+    TEST_ASSERT_EQUAL(10, detail.num_written);
+    TEST_ASSERT_EQUAL(1, golioth_blockwise_post_fake.call_count);
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+
+    /* Detail from the deferred callback, the streamed entries, then the status */
+    const size_t status_len = 14;
+    const size_t detail_len = sizeof(return_val_response) - status_len;
+    uint8_t expected[sizeof(last_coap_payload)];
+    size_t expected_len = detail_len;
+
+    memcpy(expected, return_val_response, detail_len);
+    for (uint8_t i = 0; i < detail.num_chunks; i++)
+    {
+        const uint8_t entry[] = {0x65, 'v', 'a', 'l', 'u', 'e', i};
+        memcpy(&expected[expected_len], entry, sizeof(entry));
+        expected_len += sizeof(entry);
+    }
+    memcpy(&expected[expected_len], &return_val_response[detail_len], status_len);
+    expected_len += status_len;
+
+    TEST_ASSERT_EQUAL(expected_len, last_coap_payload_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, last_coap_payload, last_coap_payload_size);
+}
+
+void test_rpc_call_deferred_streamed_abort(void)
+{
+    test_rpc_deferred_fn_fake.custom_fake = store_deferred_call;
+    enum golioth_status ret =
+        golioth_rpc_register_deferred(&grpc, "test", test_rpc_deferred_fn, NULL);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, ret);
+
+    golioth_client_get_upload_block_size_fake.return_val = 32;
+    call_test_method();
+    run_queued_call();
+
+    struct stream_detail detail = {
+        .num_chunks = 10,
+        .fail_at = 6,
+    };
+    ret = golioth_rpc_call_complete_streamed(running_calls[0],
+                                             GOLIOTH_RPC_OK,
+                                             write_stream_detail,
+                                             &detail);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_IO, ret);
+    TEST_ASSERT_EQUAL(6, detail.num_written);
+    TEST_ASSERT_EQUAL(0, grpc.num_calls);
+}
+
 void test_rpc_call_same_multiple(void)
 {
     enum golioth_status ret = golioth_rpc_register(&grpc, "test", test_rpc_method_fn, NULL);
@@ -510,9 +1102,99 @@ void test_rpc_register_many_call_all(void)
     }
 }
 
+#if defined(UNIT_TEST_BENCHMARK)
+
+#define BENCHMARK_MAX_METHODS 256
+
+/* Reference for the benchmark: the linear scan which the hash index replaced */
+static const struct golioth_rpc_method *find_method_linear(struct golioth_rpc *grpc,
+                                                           const char *method,
+                                                           size_t method_len)
+{
+    for (size_t i = 0; i < grpc->num_rpcs; i++)
+    {
+        const struct golioth_rpc_method *rpc = grpc->rpcs[i].method;
+        if (strlen(rpc->method) == method_len && strncmp(rpc->method, method, method_len) == 0)
+        {
+            return rpc;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void benchmark_dispatch(size_t num_methods)
+{
+    static struct golioth_rpc_slot bench_slots[BENCHMARK_MAX_METHODS];
+    static char names[BENCHMARK_MAX_METHODS][24];
+    const size_t rounds = 200000 / num_methods + 1;
+    size_t found = 0;
+
+    rpc_release(&grpc);
+    memset(&grpc, 0, sizeof(grpc));
+    memset(bench_slots, 0, sizeof(bench_slots));
+    grpc.rpcs = bench_slots;
+    grpc.max_rpcs = BENCHMARK_MAX_METHODS;
+
+    for (size_t i = 0; i < num_methods; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "diagnostics_%zu", i);
+        TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                          golioth_rpc_register(&grpc, names[i], test_rpc_method_fn, NULL));
+    }
+
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < num_methods; i++)
+        {
+            found += (NULL != find_method_linear(&grpc, names[i], strlen(names[i])));
+        }
+    }
+    uint64_t linear_ns = now_ns() - start;
+
+    start = now_ns();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < num_methods; i++)
+        {
+            found += (NULL != find_registered_method(&grpc, names[i], strlen(names[i])));
+        }
+    }
+    uint64_t hashed_ns = now_ns() - start;
+
+    TEST_ASSERT_EQUAL(2 * rounds * num_methods, found);
+
+    printf("%3zu methods: linear %7.1f ns/call, hashed %5.1f ns/call\n",
+           num_methods,
+           (double) linear_ns / (rounds * num_methods),
+           (double) hashed_ns / (rounds * num_methods));
+}
+
+void test_rpc_dispatch_benchmark(void)
+{
+    benchmark_dispatch(8);
+    benchmark_dispatch(64);
+    benchmark_dispatch(256);
+}
+
+#endif  // UNIT_TEST_BENCHMARK
+
 int main(void)
 {
     UNITY_BEGIN();
+#if defined(UNIT_TEST_BENCHMARK)
+    RUN_TEST(test_rpc_dispatch_benchmark);
+#else
     RUN_TEST(test_rpc_register);
     RUN_TEST(test_rpc_register_multi);
     RUN_TEST(test_rpc_register_too_many);
@@ -525,8 +1207,21 @@ int main(void)
     RUN_TEST(test_rpc_call_not_registered);
     RUN_TEST(test_rpc_call_one);
     RUN_TEST(test_rpc_call_with_return);
+    RUN_TEST(test_rpc_register_table);
+    RUN_TEST(test_rpc_register_table_too_many);
     RUN_TEST(test_rpc_call_one_with_params);
+    RUN_TEST(test_rpc_call_deferred);
+    RUN_TEST(test_rpc_call_deferred_limits);
+    RUN_TEST(test_rpc_deferred_queue_alloc_failed);
+    RUN_TEST(test_rpc_deinit_with_pending_calls);
+    RUN_TEST(test_rpc_call_response_larger_than_block);
+    RUN_TEST(test_rpc_call_response_larger_than_block_workers);
+    RUN_TEST(test_rpc_call_response_too_large);
+    RUN_TEST(test_rpc_call_deferred_blockwise);
+    RUN_TEST(test_rpc_call_deferred_streamed);
+    RUN_TEST(test_rpc_call_deferred_streamed_abort);
     RUN_TEST(test_rpc_call_same_multiple);
     RUN_TEST(test_rpc_register_many_call_all);
+#endif
     return UNITY_END();
 }
@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <time.h>
+#include <unity.h>
+#include <fff.h>
+
+
+DEFINE_FFF_GLOBALS;
+
+#define CONFIG_GOLIOTH_SETTINGS
+#define CONFIG_GOLIOTH_MAX_NUM_SETTINGS 1024
+
+#include "fakes/golioth_sys_fake.h"
+#include "fakes/coap_client_fake.h"
+#include "../../src/settings.c"
+
+FAKE_VALUE_FUNC(enum golioth_settings_status, test_int_cb, int32_t, void *);
+FAKE_VALUE_FUNC(enum golioth_settings_status, test_bool_cb, bool, void *);
+FAKE_VALUE_FUNC(enum golioth_settings_status, test_string_cb, const char *, size_t, void *);
+FAKE_VOID_FUNC(test_batch_cb, const char *const *, size_t, void *);
+FAKE_VALUE_FUNC(enum golioth_status, test_storage_save, const void *, size_t, void *);
+FAKE_VALUE_FUNC(enum golioth_status, test_storage_load, void *, size_t *, void *);
+
+static struct golioth_settings gsettings;
+static struct golioth_settings_slot slots[CONFIG_GOLIOTH_MAX_NUM_SETTINGS];
+static uint8_t last_coap_payload[CONFIG_GOLIOTH_SETTINGS_MAX_RESPONSE_LEN];
+static size_t last_coap_payload_size;
+
+static char names[CONFIG_GOLIOTH_MAX_NUM_SETTINGS][16];
+
+static const char *batch_keys[8];
+
+static int64_t push_version;
+static uint8_t stored[CONFIG_GOLIOTH_SETTINGS_CACHE_MAX_LEN];
+static size_t stored_len;
+
+static const struct golioth_settings_storage storage = {
+    .save = test_storage_save,
+    .load = test_storage_load,
+};
+
+enum golioth_status golioth_coap_client_set_custom_fake(struct golioth_client *client,
+                                                        const uint8_t token[GOLIOTH_COAP_TOKEN_LEN],
+                                                        const char *path_prefix,
+                                                        const char *path,
+                                                        uint32_t content_type,
+                                                        const uint8_t *payload,
+                                                        size_t payload_size,
+                                                        golioth_set_cb_fn callback,
+                                                        void *callback_arg,
+                                                        int32_t timeout_s)
+{
+    memcpy(last_coap_payload, payload, payload_size);
+    last_coap_payload_size = payload_size;
+
+    return GOLIOTH_OK;
+}
+
+/* Settings document with one int value per key, or the key position without values */
+static size_t encode_settings(uint8_t *buf,
+                              size_t buf_size,
+                              const char **keys,
+                              const int32_t *values,
+                              size_t num_keys)
+{
+    ZCBOR_STATE_E(zse, 2, buf, buf_size, 1);
+
+    TEST_ASSERT_TRUE(zcbor_map_start_encode(zse, 2));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_lit(zse, "version"));
+    TEST_ASSERT_TRUE(zcbor_int64_put(zse, push_version));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_lit(zse, "settings"));
+    TEST_ASSERT_TRUE(zcbor_map_start_encode(zse, num_keys));
+
+    for (size_t i = 0; i < num_keys; i++)
+    {
+        TEST_ASSERT_TRUE(zcbor_tstr_put_term(zse, keys[i], SIZE_MAX));
+        TEST_ASSERT_TRUE(zcbor_int32_put(zse, values ? values[i] : (int32_t) i));
+    }
+
+    TEST_ASSERT_TRUE(zcbor_map_end_encode(zse, num_keys));
+    TEST_ASSERT_TRUE(zcbor_map_end_encode(zse, 2));
+
+    return zse->payload - buf;
+}
+
+static void push_values(const char **keys, const int32_t *values, size_t num_keys)
+{
+    static uint8_t buf[32 * CONFIG_GOLIOTH_MAX_NUM_SETTINGS];
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 5,
+    };
+
+    size_t len = encode_settings(buf, sizeof(buf), keys, values, num_keys);
+
+    on_settings(NULL, GOLIOTH_OK, &coap_rsp_code, NULL, buf, len, &gsettings);
+}
+
+static void push_string(const char *key, const char *str)
+{
+    uint8_t buf[128];
+    struct golioth_coap_rsp_code coap_rsp_code = {
+        .code_class = 2,
+        .code_detail = 5,
+    };
+    ZCBOR_STATE_E(zse, 2, buf, sizeof(buf), 1);
+
+    TEST_ASSERT_TRUE(zcbor_map_start_encode(zse, 2));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_lit(zse, "version"));
+    TEST_ASSERT_TRUE(zcbor_int64_put(zse, push_version));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_lit(zse, "settings"));
+    TEST_ASSERT_TRUE(zcbor_map_start_encode(zse, 1));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_term(zse, key, SIZE_MAX));
+    TEST_ASSERT_TRUE(zcbor_tstr_put_term(zse, str, SIZE_MAX));
+    TEST_ASSERT_TRUE(zcbor_map_end_encode(zse, 1));
+    TEST_ASSERT_TRUE(zcbor_map_end_encode(zse, 2));
+
+    on_settings(NULL, GOLIOTH_OK, &coap_rsp_code, NULL, buf, zse->payload - buf, &gsettings);
+}
+
+static void push_settings(const char **keys, size_t num_keys)
+{
+    push_values(keys, NULL, num_keys);
+}
+
+static enum golioth_status storage_save_custom_fake(const void *data, size_t len, void *arg)
+{
+    memcpy(stored, data, len);
+    stored_len = len;
+
+    return GOLIOTH_OK;
+}
+
+static enum golioth_status storage_load_custom_fake(void *data, size_t *len, void *arg)
+{
+    if (stored_len == 0 || stored_len > *len)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    memcpy(data, stored, stored_len);
+    *len = stored_len;
+
+    return GOLIOTH_OK;
+}
+
+static void batch_cb_custom_fake(const char *const *changed_keys, size_t num_changed, void *arg)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(ARRAY_SIZE(batch_keys), num_changed);
+    memcpy(batch_keys, changed_keys, num_changed * sizeof(*changed_keys));
+}
+
+static void reset_settings(void)
+{
+    memset(&gsettings, 0, sizeof(gsettings));
+    memset(slots, 0, sizeof(slots));
+    gsettings.settings = slots;
+    gsettings.max_settings = CONFIG_GOLIOTH_MAX_NUM_SETTINGS;
+}
+
+void setUp(void)
+{
+    golioth_sys_fake_reset();
+    reset_settings();
+    memset(batch_keys, 0, sizeof(batch_keys));
+    golioth_coap_client_set_fake.custom_fake = golioth_coap_client_set_custom_fake;
+    test_batch_cb_fake.custom_fake = batch_cb_custom_fake;
+    test_storage_save_fake.custom_fake = storage_save_custom_fake;
+    test_storage_load_fake.custom_fake = storage_load_custom_fake;
+    push_version = 1652109801583;
+    stored_len = 0;
+    test_int_cb_fake.return_val = GOLIOTH_SETTINGS_SUCCESS;
+    test_bool_cb_fake.return_val = GOLIOTH_SETTINGS_SUCCESS;
+    test_string_cb_fake.return_val = GOLIOTH_SETTINGS_SUCCESS;
+
+    for (size_t i = 0; i < CONFIG_GOLIOTH_MAX_NUM_SETTINGS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "SETTING_%zu", i);
+    }
+}
+
+void tearDown(void)
+{
+    settings_release(&gsettings);
+    last_coap_payload_size = 0;
+    RESET_FAKE(golioth_coap_client_get);
+    RESET_FAKE(golioth_coap_client_set);
+    RESET_FAKE(test_int_cb);
+    RESET_FAKE(test_bool_cb);
+    RESET_FAKE(test_string_cb);
+    RESET_FAKE(test_batch_cb);
+    RESET_FAKE(test_storage_save);
+    RESET_FAKE(test_storage_load);
+    FFF_RESET_HISTORY();
+}
+
+void test_settings_dispatch(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings,
+                                                    "SPEED_MAX",
+                                                    test_int_cb,
+                                                    (void *) 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_bool(&gsettings, "SPEE", test_bool_cb, NULL));
+
+    /* Registered entries are kept in their slot */
+    TEST_ASSERT_EQUAL_PTR(&gsettings.settings[0].registered_entry, gsettings.settings[0].entry);
+
+    const char *keys[] = {"SPEED_MAX", "SPEED"};
+    push_settings(keys, 2);
+
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(0, test_int_cb_fake.arg0_history[0]);
+    TEST_ASSERT_EQUAL_PTR((void *) 1, test_int_cb_fake.arg1_history[0]);
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.arg0_history[1]);
+    TEST_ASSERT_EQUAL_PTR(NULL, test_int_cb_fake.arg1_history[1]);
+    TEST_ASSERT_EQUAL(0, test_bool_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+}
+
+void test_settings_not_recognized(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+
+    const char *keys[] = {"SPEED_", "SPEED"};
+    push_settings(keys, 2);
+
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.arg0_val);
+
+    const uint8_t expected_error[] = {
+        0x6B,                                                             /* text(11) */
+        0x73, 0x65, 0x74, 0x74, 0x69, 0x6E, 0x67, 0x5F, 0x6B, 0x65, 0x79, /* "setting_key" */
+        0x66,                                                             /* text(6) */
+        0x53, 0x50, 0x45, 0x45, 0x44, 0x5F,                               /* "SPEED_" */
+    };
+
+    TEST_ASSERT_NOT_NULL(memmem(last_coap_payload,
+                                last_coap_payload_size,
+                                expected_error,
+                                sizeof(expected_error)));
+}
+
+void test_settings_long_key(void)
+{
+    /* Longer than the 63 characters which used to be copied out of the payload */
+    static const char long_key[] =
+        "A_VERY_LONG_SETTING_NAME_THAT_DOES_NOT_FIT_INTO_SIXTY_FOUR_BYTES_0";
+    static const char long_key_1[] =
+        "A_VERY_LONG_SETTING_NAME_THAT_DOES_NOT_FIT_INTO_SIXTY_FOUR_BYTES_1";
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, long_key_1, test_int_cb, NULL));
+
+    const char *keys[] = {long_key, long_key_1};
+    push_settings(keys, 2);
+
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.arg0_val);
+}
+
+void test_settings_duplicate_key(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_bool(&gsettings, "SPEED", test_bool_cb, NULL));
+
+    /* The first registration wins, as with the linear search */
+    const char *keys[] = {"SPEED"};
+    push_settings(keys, 1);
+
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(0, test_bool_cb_fake.call_count);
+}
+
+void test_settings_register_too_many(void)
+{
+    for (size_t i = 0; i < CONFIG_GOLIOTH_MAX_NUM_SETTINGS; i++)
+    {
+        TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                          golioth_settings_register_int(&gsettings, names[i], test_int_cb, NULL));
+    }
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_MEM_ALLOC,
+                      golioth_settings_register_int(&gsettings, "ONE_MORE", test_int_cb, NULL));
+
+    /* All registered settings are still found with a full index */
+    const char *keys[CONFIG_GOLIOTH_MAX_NUM_SETTINGS];
+    for (size_t i = 0; i < CONFIG_GOLIOTH_MAX_NUM_SETTINGS; i++)
+    {
+        keys[i] = names[CONFIG_GOLIOTH_MAX_NUM_SETTINGS - 1 - i];
+    }
+    push_settings(keys, CONFIG_GOLIOTH_MAX_NUM_SETTINGS);
+
+    TEST_ASSERT_EQUAL(CONFIG_GOLIOTH_MAX_NUM_SETTINGS, test_int_cb_fake.call_count);
+}
+
+void test_settings_table(void)
+{
+    static const struct golioth_settings_entry table[] = {
+        GOLIOTH_SETTINGS_INT("SPEED", test_int_cb, (void *) 2),
+        GOLIOTH_SETTINGS_BOOL("LED", test_bool_cb, NULL),
+    };
+    static const struct golioth_settings_entry no_cb[] = {
+        GOLIOTH_SETTINGS_INT("SPEED", NULL, NULL),
+    };
+    static const struct golioth_settings_entry no_type[] = {
+        {.name = "SPEED", .int_cb = test_int_cb},
+    };
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_NULL,
+                      golioth_settings_register_table(&gsettings, no_cb, ARRAY_SIZE(no_cb)));
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_settings_register_table(&gsettings, no_type, ARRAY_SIZE(no_type)));
+    TEST_ASSERT_EQUAL(0, gsettings.num_settings);
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_table(&gsettings, table, ARRAY_SIZE(table)));
+    TEST_ASSERT_EQUAL(2, gsettings.num_settings);
+
+    /* The table is referenced, not copied */
+    TEST_ASSERT_EQUAL_PTR(&table[0], gsettings.settings[0].entry);
+
+    const char *keys[] = {"SPEED"};
+    push_settings(keys, 1);
+
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL_PTR((void *) 2, test_int_cb_fake.arg1_val);
+}
+
+void test_settings_unchanged_skipped(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+
+    const char *keys[] = {"SPEED"};
+    int32_t values[] = {5};
+
+    push_values(keys, values, 1);
+    push_values(keys, values, 1);
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+
+    values[0] = 6;
+    push_values(keys, values, 1);
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(6, test_int_cb_fake.arg0_val);
+
+    /* Unchanged settings are still reported as applied */
+    TEST_ASSERT_EQUAL(3, golioth_coap_client_set_fake.call_count);
+}
+
+void test_settings_string_unchanged_skipped(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_string(&gsettings, "NAME", test_string_cb, NULL));
+
+    push_string("NAME", "abc");
+    push_string("NAME", "abc");
+    TEST_ASSERT_EQUAL(1, test_string_cb_fake.call_count);
+
+    /* A prefix of the last value is a change, as is any other string */
+    push_string("NAME", "ab");
+    TEST_ASSERT_EQUAL(2, test_string_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(2, test_string_cb_fake.arg1_val);
+
+    push_string("NAME", "abd");
+    TEST_ASSERT_EQUAL(3, test_string_cb_fake.call_count);
+    push_string("NAME", "");
+    TEST_ASSERT_EQUAL(4, test_string_cb_fake.call_count);
+    push_string("NAME", "");
+    TEST_ASSERT_EQUAL(4, test_string_cb_fake.call_count);
+}
+
+void test_settings_failed_retried(void)
+{
+    enum golioth_settings_status statuses[] = {
+        GOLIOTH_SETTINGS_GENERAL_ERROR,
+        GOLIOTH_SETTINGS_SUCCESS,
+    };
+    SET_RETURN_SEQ(test_int_cb, statuses, ARRAY_SIZE(statuses));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+
+    const char *keys[] = {"SPEED"};
+    int32_t values[] = {5};
+
+    push_values(keys, values, 1);
+    push_values(keys, values, 1);
+    push_values(keys, values, 1);
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.call_count);
+}
+
+void test_settings_batch(void)
+{
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "A", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "B", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "C", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_batch_cb(&gsettings, test_batch_cb, (void *) 1));
+
+    const char *keys[] = {"A", "B", "C"};
+    int32_t values[] = {1, 2, 3};
+
+    push_values(keys, values, 3);
+    TEST_ASSERT_EQUAL(1, test_batch_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(3, test_batch_cb_fake.arg1_val);
+    TEST_ASSERT_EQUAL_PTR((void *) 1, test_batch_cb_fake.arg2_val);
+
+    values[1] = 7;
+    push_values(keys, values, 3);
+    TEST_ASSERT_EQUAL(2, test_batch_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(1, test_batch_cb_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("B", batch_keys[0]);
+
+    /* Nothing changed */
+    push_values(keys, values, 3);
+    TEST_ASSERT_EQUAL(2, test_batch_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(4, test_int_cb_fake.call_count);
+}
+
+void test_settings_storage_empty(void)
+{
+    /* Nothing stored yet */
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_IO, golioth_settings_register_storage(&gsettings, &storage));
+    TEST_ASSERT_EQUAL(1, test_storage_load_fake.call_count);
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_STATE,
+                      golioth_settings_register_storage(&gsettings, &storage));
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(0, test_int_cb_fake.call_count);
+
+    const char *keys[] = {"SPEED"};
+    int32_t values[] = {5};
+
+    /* Saved once per version */
+    push_values(keys, values, 1);
+    push_values(keys, values, 1);
+    TEST_ASSERT_EQUAL(1, test_storage_save_fake.call_count);
+
+    push_version++;
+    values[0] = 6;
+    push_values(keys, values, 1);
+    TEST_ASSERT_EQUAL(2, test_storage_save_fake.call_count);
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.call_count);
+}
+
+void test_settings_storage_replay(void)
+{
+    const char *keys[] = {"SPEED", "MODE"};
+    int32_t values[] = {5, 2};
+
+    /* Settings saved before the reboot */
+    stored_len = encode_settings(stored, sizeof(stored), keys, values, 2);
+
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "MODE", test_int_cb, (void *) 1));
+    TEST_ASSERT_EQUAL(GOLIOTH_OK, golioth_settings_register_storage(&gsettings, &storage));
+
+    /* Settings registered before the storage get the saved values right away */
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(0, golioth_coap_client_set_fake.call_count);
+
+    /* Settings registered afterwards wait for the cloud, the cache is not replayed again */
+    TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                      golioth_settings_register_int(&gsettings, "SPEED", test_int_cb, NULL));
+    TEST_ASSERT_EQUAL(1, test_int_cb_fake.call_count);
+
+    /* The same version from the cloud is only reported, and applied to the new setting */
+    push_values(keys, values, 2);
+    TEST_ASSERT_EQUAL(2, test_int_cb_fake.call_count);
+    TEST_ASSERT_EQUAL(5, test_int_cb_fake.arg0_val);
+    TEST_ASSERT_EQUAL(0, test_storage_save_fake.call_count);
+    TEST_ASSERT_EQUAL(1, golioth_coap_client_set_fake.call_count);
+}
+
+void test_settings_storage_invalid(void)
+{
+    memset(stored, 0xFF, 16);
+    stored_len = 16;
+
+    TEST_ASSERT_EQUAL(GOLIOTH_ERR_INVALID_FORMAT,
+                      golioth_settings_register_storage(&gsettings, &storage));
+    TEST_ASSERT_EQUAL(0, gsettings.cache_len);
+}
+
+#if defined(UNIT_TEST_BENCHMARK)
+
+/* Reference for the benchmark: the linear scan which the hash index replaced */
+static struct golioth_settings_slot *find_setting_linear(struct golioth_settings *settings,
+                                                        const char *key,
+                                                        size_t key_len)
+{
+    char name[64] = {};
+
+    memcpy(name, key, (key_len < sizeof(name)) ? key_len : sizeof(name) - 1);
+
+    for (size_t i = 0; i < settings->num_settings; i++)
+    {
+        struct golioth_settings_slot *s = &settings->settings[i];
+        if (strcmp(s->entry->name, name) == 0)
+        {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void benchmark_lookup(size_t num_settings)
+{
+    const size_t rounds = 200000 / num_settings + 1;
+    size_t found = 0;
+
+    settings_release(&gsettings);
+    reset_settings();
+
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        TEST_ASSERT_EQUAL(GOLIOTH_OK,
+                          golioth_settings_register_int(&gsettings, names[i], test_int_cb, NULL));
+    }
+
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < num_settings; i++)
+        {
+            found += (NULL != find_setting_linear(&gsettings, names[i], strlen(names[i])));
+        }
+    }
+    uint64_t linear_ns = now_ns() - start;
+
+    start = now_ns();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < num_settings; i++)
+        {
+            found += (NULL != find_registered_setting(&gsettings, names[i], strlen(names[i])));
+        }
+    }
+    uint64_t hashed_ns = now_ns() - start;
+
+    TEST_ASSERT_EQUAL(2 * rounds * num_settings, found);
+
+    printf("%4zu settings: linear %8.1f ns/key, hashed %6.1f ns/key\n",
+           num_settings,
+           (double) linear_ns / (rounds * num_settings),
+           (double) hashed_ns / (rounds * num_settings));
+}
+
+void test_settings_lookup_benchmark(void)
+{
+    benchmark_lookup(16);
+    benchmark_lookup(128);
+    benchmark_lookup(1024);
+}
+
+#endif  // UNIT_TEST_BENCHMARK
+
+int main(void)
+{
+    UNITY_BEGIN();
+#if defined(UNIT_TEST_BENCHMARK)
+    RUN_TEST(test_settings_lookup_benchmark);
+#else
+    RUN_TEST(test_settings_dispatch);
+    RUN_TEST(test_settings_not_recognized);
+    RUN_TEST(test_settings_long_key);
+    RUN_TEST(test_settings_duplicate_key);
+    RUN_TEST(test_settings_register_too_many);
+    RUN_TEST(test_settings_table);
+    RUN_TEST(test_settings_unchanged_skipped);
+    RUN_TEST(test_settings_string_unchanged_skipped);
+    RUN_TEST(test_settings_failed_retried);
+    RUN_TEST(test_settings_batch);
+    RUN_TEST(test_settings_storage_empty);
+    RUN_TEST(test_settings_storage_replay);
+    RUN_TEST(test_settings_storage_invalid);
+#endif
+    return UNITY_END();
+}